@@ -0,0 +1,224 @@
+﻿#include "AssetIOSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#include <assimp/DefaultIOSystem.h>
+#include <assimp/IOStream.hpp>
+
+namespace
+{
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Reads a file that's already in memory, either in an archive or mapped. Keeps a mapped file alive while it's open.
+    class AssetIOStream : public Assimp::IOStream
+    {
+    public:
+        AssetIOStream(const unsigned char* data, size_t size, std::shared_ptr<const MappedFile> mapping, ImportIOStats* stats, size_t statsIndex)
+            : data(data), size(size), mapping(std::move(mapping)), stats(stats), statsIndex(statsIndex)
+        {
+        }
+
+        size_t Read(void* buffer, size_t elementSize, size_t count) override
+        {
+            if (elementSize == 0 || position >= size) return 0;
+
+            auto start = std::chrono::steady_clock::now();
+            count = std::min(count, (size - position) / elementSize);
+            std::memcpy(buffer, data + position, count * elementSize);
+            position += count * elementSize;
+            if (stats)
+            {
+                stats->files[statsIndex].bytes += count * elementSize;
+                stats->files[statsIndex].seconds += secondsSince(start);
+            }
+            return count;
+        }
+
+        size_t Write(const void*, size_t, size_t) override
+        {
+            return 0;
+        }
+
+        aiReturn Seek(size_t offset, aiOrigin origin) override
+        {
+            size_t target;
+            if (origin == aiOrigin_SET) target = offset;
+            else if (origin == aiOrigin_CUR) target = position + offset;
+            else target = size - offset;
+            if (target > size) return aiReturn_FAILURE;
+            position = target;
+            return aiReturn_SUCCESS;
+        }
+
+        size_t Tell() const override
+        {
+            return position;
+        }
+
+        size_t FileSize() const override
+        {
+            return size;
+        }
+
+        void Flush() override
+        {
+        }
+
+    private:
+        const unsigned char* data;
+        size_t size;
+        size_t position = 0;
+        std::shared_ptr<const MappedFile> mapping;
+        ImportIOStats* stats;
+        size_t statsIndex;
+    };
+}
+
+const char* GetFileSourceName(FileSource source)
+{
+    switch (source)
+    {
+    case FileSource::Archive: return "archive";
+    case FileSource::Mapped: return "mapped";
+    case FileSource::Cached: return "cached";
+    default: return "stdio";
+    }
+}
+
+size_t ImportIOStats::GetTotalBytes() const
+{
+    size_t bytes = 0;
+    for (const FileReadStats& file : files) bytes += file.bytes;
+    return bytes;
+}
+
+double ImportIOStats::GetTotalSeconds() const
+{
+    double seconds = 0.0;
+    for (const FileReadStats& file : files) seconds += file.seconds;
+    return seconds;
+}
+
+std::shared_ptr<const MappedFile> FileCache::Get(const std::string& path, bool& cached)
+{
+    const std::string key = AssetPack::NormalizePath(path);
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = files.find(key);
+    cached = it != files.end();
+    if (cached) return it->second;
+
+    auto mapping = std::make_shared<MappedFile>();
+    if (!mapping->Open(path)) return nullptr;
+    files[key] = mapping;
+    return mapping;
+}
+
+void FileCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    files.clear();
+}
+
+size_t FileCache::GetFileCount() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return files.size();
+}
+
+size_t FileCache::GetMappedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t bytes = 0;
+    for (const auto& file : files) bytes += file.second->GetSize();
+    return bytes;
+}
+
+FileCache& GetFileCache()
+{
+    static FileCache cache;
+    return cache;
+}
+
+AssetIOSystem::AssetIOSystem(ImportIOStats* stats, FileCache& cache)
+    : stats(stats), cache(cache), fallback(new Assimp::DefaultIOSystem())
+{
+}
+
+AssetIOSystem::~AssetIOSystem()
+{
+    delete fallback;
+}
+
+void AssetIOSystem::AddArchive(const AssetPack& archive)
+{
+    archives.push_back(&archive);
+}
+
+bool AssetIOSystem::Exists(const char* file) const
+{
+    AssetView view;
+    return findInArchives(file, view) || fallback->Exists(file);
+}
+
+Assimp::IOStream* AssetIOSystem::Open(const char* file, const char* mode)
+{
+    // Archives and mappings are read-only.
+    if (std::strchr(mode, 'w') || std::strchr(mode, 'a') || std::strchr(mode, '+')) return fallback->Open(file, mode);
+
+    auto start = std::chrono::steady_clock::now();
+    AssetView view;
+    if (findInArchives(file, view))
+    {
+        size_t index = recordOpen(file, FileSource::Archive, secondsSince(start));
+        return new AssetIOStream(view.data, view.size, nullptr, stats, index);
+    }
+
+    bool cached = false;
+    if (std::shared_ptr<const MappedFile> mapping = cache.Get(file, cached))
+    {
+        size_t index = recordOpen(file, cached ? FileSource::Cached : FileSource::Mapped, secondsSince(start));
+        return new AssetIOStream(mapping->GetData(), mapping->GetSize(), mapping, stats, index);
+    }
+
+    // Reads through stdio aren't broken down, only the time to open the file counts.
+    Assimp::IOStream* stream = fallback->Open(file, mode);
+    if (stream) recordOpen(file, FileSource::Default, secondsSince(start));
+    return stream;
+}
+
+void AssetIOSystem::Close(Assimp::IOStream* stream)
+{
+    delete stream;
+}
+
+bool AssetIOSystem::findInArchives(const std::string& path, AssetView& view) const
+{
+    for (const AssetPack* archive : archives)
+    {
+        if (archive->Find(path, view)) return true;
+    }
+    return FindMountedAsset(path, view);
+}
+
+size_t AssetIOSystem::recordOpen(const std::string& path, FileSource source, double seconds)
+{
+    if (!stats) return 0;
+
+    const std::string key = AssetPack::NormalizePath(path);
+    auto it = std::find_if(stats->files.begin(), stats->files.end(), [&](const FileReadStats& file) { return file.path == key; });
+    if (it == stats->files.end())
+    {
+        FileReadStats file;
+        file.path = key;
+        it = stats->files.insert(stats->files.end(), file);
+    }
+    it->source = source;
+    it->opens++;
+    it->seconds += seconds;
+    return (size_t)(it - stats->files.begin());
+}
@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <assimp/IOSystem.hpp>
+
+#include "AssetPack.h"
+#include "MappedFile.h"
+
+// Where a file opened through the AssetIOSystem came from.
+enum class FileSource
+{
+    Archive,
+    Mapped,
+    Cached,
+    Default
+};
+
+const char* GetFileSourceName(FileSource source);
+
+// What one import read from a file, and how long opening and reading it took.
+struct FileReadStats
+{
+    std::string path;
+    FileSource source = FileSource::Default;
+    int opens = 0;
+    size_t bytes = 0;
+    double seconds = 0.0;
+};
+
+// Every file one import read, so its I/O time can be told apart from parsing.
+struct ImportIOStats
+{
+    std::vector<FileReadStats> files;
+
+    size_t GetTotalBytes() const;
+    double GetTotalSeconds() const;
+};
+
+// Loose files mapped by earlier opens, shared by everything that reads through an AssetIOSystem. Files stay mapped
+// until Clear(), streams that still read from one keep it mapped after that.
+class FileCache
+{
+public:
+    // The mapping of a file, mapped now if it wasn't yet (cached tells which). Null if the file can't be mapped.
+    std::shared_ptr<const MappedFile> Get(const std::string& path, bool& cached);
+    void Clear();
+
+    size_t GetFileCount() const;
+    size_t GetMappedBytes() const;
+
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::shared_ptr<const MappedFile>> files;
+};
+
+// The cache all imports share.
+FileCache& GetFileCache();
+
+// Assimp file system that reads without going through stdio: archives (asset packs) first, including the mounted one,
+// then loose files memory-mapped through a FileCache. Writes, and files that can't be mapped, are left to Assimp's
+// default file system. Every file opened for reading is recorded in stats, if given.
+class AssetIOSystem : public Assimp::IOSystem
+{
+public:
+    explicit AssetIOSystem(ImportIOStats* stats = nullptr, FileCache& cache = GetFileCache());
+    ~AssetIOSystem() override;
+
+    // Look in another archive before the mounted pack. The archive has to outlive the file system.
+    void AddArchive(const AssetPack& archive);
+
+    bool Exists(const char* file) const override;
+    char getOsSeparator() const override { return '/'; }
+    Assimp::IOStream* Open(const char* file, const char* mode = "rb") override;
+    void Close(Assimp::IOStream* stream) override;
+
+private:
+    ImportIOStats* stats;
+    FileCache& cache;
+    std::vector<const AssetPack*> archives;
+    Assimp::IOSystem* fallback;
+
+    bool findInArchives(const std::string& path, AssetView& view) const;
+    // Index of the stats entry for a file, added on its first open.
+    size_t recordOpen(const std::string& path, FileSource source, double seconds);
+};
@@ -0,0 +1,460 @@
+﻿#include "AssetPack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+
+#include <assimp/Importer.hpp>
+#include <assimp/postprocess.h>
+#include <assimp/scene.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "AssetIOSystem.h"
+#include "Util.h"
+
+// One file in the table of contents. Offsets are from the start of the pack.
+struct AssetPack::Entry
+{
+    uint64_t hash;
+    uint64_t offset;
+    uint64_t size;
+    uint32_t nameOffset;
+    uint32_t nameLength;
+};
+
+namespace
+{
+    const char packMagic[8] = { 'L', 'O', 'G', 'L', 'P', 'A', 'C', 'K' };
+    constexpr uint32_t packVersion = 1;
+
+    struct PackHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t fileCount;
+        uint64_t tableOffset;
+        uint64_t namesOffset;
+        uint64_t namesSize;
+    };
+
+    const AssetPack* mountedPack = nullptr;
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+
+    char toLower(char c)
+    {
+        return c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+
+    // FNV-1a of the lowercase path, so lookups ignore case.
+    uint64_t hashPath(const std::string& path)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : path)
+        {
+            hash ^= (unsigned char)toLower(c);
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    bool equalIgnoringCase(const char* a, size_t aLength, const std::string& b)
+    {
+        if (aLength != b.size()) return false;
+        for (size_t i = 0; i < aLength; i++)
+        {
+            if (toLower(a[i]) != toLower(b[i])) return false;
+        }
+        return true;
+    }
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Ask the OS to forget its cached pages of a file, so the next read comes from the disk. Best effort: opening a file
+    // unbuffered on Windows purges its cache if nobody else has it open.
+    void dropFromCache(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+        int file = open(path.c_str(), O_RDONLY);
+        if (file < 0) return;
+        posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+        close(file);
+#endif
+    }
+
+    // Touch one byte per page, so mapped data is actually read.
+    unsigned int touchPages(const unsigned char* data, size_t size)
+    {
+        unsigned int sum = 0;
+        for (size_t i = 0; i < size; i += 4096) sum += data[i];
+        return sum;
+    }
+
+    // Import a model and decode all of its material textures, from the mounted pack if there is one.
+    bool loadModelAssets(const std::string& modelPath)
+    {
+        Assimp::Importer importer;
+        importer.SetIOHandler(new AssetIOSystem());
+        const aiScene* scene = importer.ReadFile(modelPath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
+        if (!scene) return false;
+
+        std::string directory = modelPath.substr(0, modelPath.find_last_of("\\/"));
+        std::vector<std::string> paths;
+        for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+        {
+            for (int type = aiTextureType_DIFFUSE; type <= aiTextureType_UNKNOWN; type++)
+            {
+                for (unsigned int i = 0; i < scene->mMaterials[m]->GetTextureCount((aiTextureType)type); i++)
+                {
+                    aiString texturePath;
+                    scene->mMaterials[m]->GetTexture((aiTextureType)type, i, &texturePath);
+                    std::string path = directory + '/' + texturePath.C_Str();
+                    if (std::find(paths.begin(), paths.end(), path) == paths.end()) paths.push_back(path);
+                }
+            }
+        }
+
+        std::vector<ImageData> images;
+        std::vector<char> succeeded;
+        readImagesParallel(paths, images, succeeded);
+        return std::all_of(succeeded.begin(), succeeded.end(), [](char s) { return s != 0; });
+    }
+}
+
+AssetPack::~AssetPack()
+{
+    Close();
+}
+
+bool AssetPack::Build(const std::vector<std::string>& directories, const std::string& packPath)
+{
+    namespace fs = std::filesystem;
+
+    struct SourceFile
+    {
+        std::string path;
+        Entry entry;
+    };
+    std::vector<SourceFile> files;
+    std::string names;
+    std::error_code error;
+    for (const std::string& directory : directories)
+    {
+        for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+        {
+            if (!it->is_regular_file()) continue;
+            SourceFile file;
+            file.path = NormalizePath(it->path().generic_string());
+            if (file.path == NormalizePath(packPath)) continue;
+            file.entry.hash = hashPath(file.path);
+            file.entry.size = (uint64_t)it->file_size();
+            file.entry.nameOffset = (uint32_t)names.size();
+            file.entry.nameLength = (uint32_t)file.path.size();
+            names += file.path;
+            files.push_back(file);
+        }
+        if (error)
+        {
+            std::cout << "Failed to list " << directory << ": " << error.message() << "\n";
+            return false;
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const SourceFile& a, const SourceFile& b) { return a.entry.hash < b.entry.hash; });
+
+    // Header, table of contents and names come first, then every file's data aligned on its own.
+    PackHeader header = {};
+    std::memcpy(header.magic, packMagic, sizeof(packMagic));
+    header.version = packVersion;
+    header.fileCount = (uint32_t)files.size();
+    header.tableOffset = alignUp(sizeof(PackHeader), packAlignment);
+    header.namesOffset = header.tableOffset + files.size() * sizeof(Entry);
+    header.namesSize = names.size();
+    size_t offset = alignUp((size_t)(header.namesOffset + header.namesSize), packAlignment);
+    for (SourceFile& file : files)
+    {
+        file.entry.offset = offset;
+        offset = alignUp(offset + (size_t)file.entry.size, packAlignment);
+    }
+
+    std::vector<unsigned char> table((size_t)header.namesOffset + names.size(), 0);
+    std::memcpy(table.data(), &header, sizeof(header));
+    for (size_t i = 0; i < files.size(); i++)
+    {
+        std::memcpy(table.data() + header.tableOffset + i * sizeof(Entry), &files[i].entry, sizeof(Entry));
+    }
+    std::memcpy(table.data() + header.namesOffset, names.data(), names.size());
+
+    std::ofstream pack(packPath, std::ios::binary);
+    if (!pack)
+    {
+        std::cout << "Failed to create " << packPath << "\n";
+        return false;
+    }
+    pack.write((const char*)table.data(), table.size());
+
+    std::vector<char> data;
+    const char padding[packAlignment] = {};
+    size_t written = table.size();
+    for (const SourceFile& file : files)
+    {
+        pack.write(padding, file.entry.offset - written);
+        std::ifstream source(file.path, std::ios::binary);
+        data.resize((size_t)file.entry.size);
+        if (!source.read(data.data(), data.size()))
+        {
+            std::cout << "Failed to read " << file.path << "\n";
+            return false;
+        }
+        pack.write(data.data(), data.size());
+        written = (size_t)(file.entry.offset + file.entry.size);
+    }
+    pack.write(padding, offset - written);
+    if (!pack)
+    {
+        std::cout << "Failed to write " << packPath << "\n";
+        return false;
+    }
+
+    std::cout << "Packed " << files.size() << " files (" << offset / 1048576.0 << " MB) into " << packPath << "\n";
+    return true;
+}
+
+std::string AssetPack::NormalizePath(const std::string& path)
+{
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= path.size())
+    {
+        size_t end = path.find_first_of("\\/", start);
+        if (end == std::string::npos) end = path.size();
+        std::string part = path.substr(start, end - start);
+        if (part == "..")
+        {
+            if (!parts.empty() && parts.back() != "..") parts.pop_back();
+            else parts.push_back(part);
+        }
+        else if (!part.empty() && part != ".") parts.push_back(part);
+        start = end + 1;
+    }
+
+    std::string normalized;
+    for (const std::string& part : parts)
+    {
+        if (!normalized.empty()) normalized += '/';
+        normalized += part;
+    }
+    return normalized;
+}
+
+bool AssetPack::Open(const std::string& packPath)
+{
+    Close();
+
+    if (!mapping.Open(packPath)) return false;
+    const unsigned char* base = mapping.GetData();
+    const size_t mappedSize = mapping.GetSize();
+
+    PackHeader header;
+    bool valid = mappedSize >= sizeof(header);
+    if (valid)
+    {
+        std::memcpy(&header, base, sizeof(header));
+        valid = std::memcmp(header.magic, packMagic, sizeof(packMagic)) == 0 && header.version == packVersion &&
+            header.tableOffset % alignof(Entry) == 0 &&
+            header.tableOffset + (uint64_t)header.fileCount * sizeof(Entry) <= header.namesOffset &&
+            header.namesOffset + header.namesSize <= mappedSize;
+    }
+    if (!valid)
+    {
+        std::cout << "Not a valid asset pack: " << packPath << "\n";
+        Close();
+        return false;
+    }
+
+    // Names are checked once here, so lookups can trust them.
+    entries = (const Entry*)(base + header.tableOffset);
+    fileCount = header.fileCount;
+    names = (const char*)base + header.namesOffset;
+    for (size_t i = 0; i < fileCount && valid; i++)
+    {
+        valid = (uint64_t)entries[i].nameOffset + entries[i].nameLength <= header.namesSize;
+    }
+    if (!valid)
+    {
+        std::cout << "Asset pack has a broken table of contents: " << packPath << "\n";
+        Close();
+        return false;
+    }
+    return true;
+}
+
+void AssetPack::Close()
+{
+    mapping.Close();
+    entries = nullptr;
+    names = nullptr;
+    fileCount = 0;
+}
+
+bool AssetPack::Find(const std::string& path, AssetView& view) const
+{
+    if (!entries) return false;
+
+    const unsigned char* base = mapping.GetData();
+    const std::string key = NormalizePath(path);
+    const uint64_t hash = hashPath(key);
+    const Entry* end = entries + fileCount;
+    for (const Entry* entry = std::lower_bound(entries, end, hash, [](const Entry& e, uint64_t h) { return e.hash < h; });
+        entry != end && entry->hash == hash; entry++)
+    {
+        if (!equalIgnoringCase(names + entry->nameOffset, entry->nameLength, key)) continue;
+        if (entry->offset + entry->size > mapping.GetSize()) return false;
+
+        view.data = base + entry->offset;
+        view.size = (size_t)entry->size;
+        return true;
+    }
+    return false;
+}
+
+std::string AssetPack::GetPath(size_t index) const
+{
+    if (index >= fileCount) return std::string();
+    return std::string(names + entries[index].nameOffset, entries[index].nameLength);
+}
+
+void MountAssetPack(const AssetPack* pack)
+{
+    mountedPack = pack;
+}
+
+const AssetPack* GetMountedAssetPack()
+{
+    return mountedPack;
+}
+
+bool FindMountedAsset(const std::string& path, AssetView& view)
+{
+    return mountedPack && mountedPack->Find(path, view);
+}
+
+int runAssetPackBenchmark(const char* packPath, const char* modelPath)
+{
+    AssetPack pack;
+    if (!pack.Open(packPath))
+    {
+        std::cout << "Failed to open " << packPath << ", build it with --build-pack first.\n";
+        return 1;
+    }
+    std::vector<std::string> paths;
+    for (size_t i = 0; i < pack.GetFileCount(); i++) paths.push_back(pack.GetPath(i));
+    pack.Close();
+
+    // Read every file in full: loose files through a stream each, the pack through its one mapping.
+    auto readLoose = [&]()
+    {
+        unsigned int sum = 0;
+        std::vector<unsigned char> data;
+        for (const std::string& path : paths)
+        {
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            data.resize((size_t)file.tellg());
+            file.seekg(0);
+            file.read((char*)data.data(), data.size());
+            sum += touchPages(data.data(), data.size());
+        }
+        return sum;
+    };
+    auto readPack = [&]()
+    {
+        unsigned int sum = 0;
+        AssetView view;
+        for (const std::string& path : paths)
+        {
+            if (pack.Find(path, view)) sum += touchPages(view.data, view.size);
+        }
+        return sum;
+    };
+    auto loadModel = [&]()
+    {
+        return loadModelAssets(modelPath) ? 1u : 0u;
+    };
+
+    // The cold run starts with nothing cached and the pack freshly mapped, warm runs take the best of a few.
+    const int warmIterations = 5;
+    auto measure = [&](bool usePack, auto&& work, double& coldTime, double& warmTime)
+    {
+        if (usePack) dropFromCache(packPath);
+        else for (const std::string& path : paths) dropFromCache(path);
+        GetFileCache().Clear();
+
+        auto start = std::chrono::steady_clock::now();
+        if (usePack)
+        {
+            pack.Open(packPath);
+            MountAssetPack(&pack);
+        }
+        unsigned int result = work();
+        coldTime = secondsSince(start);
+
+        warmTime = 1e30;
+        for (int i = 0; i < warmIterations; i++)
+        {
+            start = std::chrono::steady_clock::now();
+            result += work();
+            warmTime = std::min(warmTime, secondsSince(start));
+        }
+        if (usePack)
+        {
+            MountAssetPack(nullptr);
+            pack.Close();
+        }
+        return result;
+    };
+
+    struct Case
+    {
+        const char* name;
+        bool usePack;
+        std::function<unsigned int()> work;
+    };
+    const Case cases[] = {
+        { "Read all, loose", false, readLoose },
+        { "Read all, pack", true, readPack },
+        { "Load model, loose", false, loadModel },
+        { "Load model, pack", true, loadModel },
+    };
+
+    std::cout << "Asset pack benchmark: " << paths.size() << " files, model " << modelPath << "\n";
+    for (const Case& c : cases)
+    {
+        double coldTime, warmTime;
+        measure(c.usePack, c.work, coldTime, warmTime);
+        char line[256];
+        snprintf(line, sizeof(line), "%-20s cold %8.2f ms  warm %8.2f ms", c.name, coldTime * 1e3, warmTime * 1e3);
+        std::cout << line << "\n";
+    }
+    return 0;
+}
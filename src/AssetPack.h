@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "MappedFile.h"
+
+// The bytes of one file, valid for as long as whatever holds them (e.g. a mapped asset pack) is open.
+struct AssetView
+{
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+};
+
+// A single read-only file holding many assets, memory-mapped once and read in place. The file starts with a header and
+// a table of contents sorted by path hash, followed by the path strings and then every file's data, each aligned to
+// packAlignment bytes so loaders can read from it directly.
+class AssetPack
+{
+public:
+    static constexpr size_t packAlignment = 64;
+
+    AssetPack() = default;
+    ~AssetPack();
+    AssetPack(const AssetPack&) = delete;
+    AssetPack& operator=(const AssetPack&) = delete;
+
+    // Write every file under the given directories into a new pack at packPath. Files are stored under the relative path
+    // they were found at, e.g. "resources/backpack.obj" for the directory "resources".
+    static bool Build(const std::vector<std::string>& directories, const std::string& packPath);
+    // The form paths are stored in: forward slashes and no "." or "dir/.." parts. Lookups also ignore case, like Windows.
+    static std::string NormalizePath(const std::string& path);
+
+    // Map a pack built by Build(). Closes the one open before, if any.
+    bool Open(const std::string& packPath);
+    void Close();
+    bool IsOpen() const { return entries != nullptr; }
+
+    // Look up a file. The view points into the mapping, nothing is copied.
+    bool Find(const std::string& path, AssetView& view) const;
+    size_t GetFileCount() const { return fileCount; }
+    // Path of the index-th file, in table of contents order.
+    std::string GetPath(size_t index) const;
+
+private:
+    struct Entry;
+
+    MappedFile mapping;
+    const Entry* entries = nullptr;
+    const char* names = nullptr;
+    size_t fileCount = 0;
+};
+
+// The pack the loaders (images, shader sources, models) look in before falling back to loose files. None by default.
+void MountAssetPack(const AssetPack* pack);
+const AssetPack* GetMountedAssetPack();
+// Look a file up in the mounted pack.
+bool FindMountedAsset(const std::string& path, AssetView& view);
+
+// Compare loading every file of a pack, and the model's assets, from the pack against loose files. Cold runs drop
+// the files from the OS cache first, where the OS lets us.
+int runAssetPackBenchmark(const char* packPath, const char* modelPath);
@@ -96,6 +96,14 @@ public:
             Position -= WorldUp * velocity;
     }
 
+    // sets the Euler angles directly, e.g. when replaying a recorded camera path
+    void SetOrientation(float yaw, float pitch)
+    {
+        Yaw = yaw;
+        Pitch = pitch;
+        updateCameraVectors();
+    }
+
     void SetControlMode(bool controlled)
     {
         Controlled = controlled;
@@ -0,0 +1,68 @@
+﻿#include "CameraPath.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+#include "Camera.h"
+
+namespace
+{
+    const char pathMagic[4] = { 'C', 'A', 'M', 'P' };
+    constexpr uint32_t pathVersion = 1;
+
+    struct PathHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint32_t frameCount;
+        float frameDelta;
+    };
+
+    static_assert(sizeof(CameraPath::Frame) == 24, "Frames are written as they are in memory");
+}
+
+void CameraPath::Apply(const Frame& frame, Camera& camera)
+{
+    camera.Position = frame.position;
+    camera.Zoom = frame.zoom;
+    camera.SetOrientation(frame.yaw, frame.pitch);
+}
+
+bool CameraPath::Save(const std::string& path) const
+{
+    PathHeader header = {};
+    std::memcpy(header.magic, pathMagic, sizeof(pathMagic));
+    header.version = pathVersion;
+    header.frameCount = (uint32_t)frames.size();
+    header.frameDelta = frameDelta;
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    file.write((const char*)&header, sizeof(header));
+    file.write((const char*)frames.data(), frames.size() * sizeof(Frame));
+    return (bool)file;
+}
+
+bool CameraPath::Load(const std::string& path)
+{
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+    if (!file) return false;
+    const std::streamoff fileSize = file.tellg();
+    file.seekg(0);
+
+    PathHeader header;
+    if (!file.read((char*)&header, sizeof(header))) return false;
+    if (std::memcmp(header.magic, pathMagic, sizeof(pathMagic)) != 0 || header.version != pathVersion) return false;
+    // A truncated or corrupt file mustn't make us allocate whatever its frame count claims, or replay with a delta
+    // that stops time or runs it backwards.
+    if ((uint64_t)header.frameCount * sizeof(Frame) > (uint64_t)(fileSize - (std::streamoff)sizeof(header))) return false;
+    if (!std::isfinite(header.frameDelta) || header.frameDelta <= 0.0f) return false;
+
+    std::vector<Frame> loaded(header.frameCount);
+    if (!file.read((char*)loaded.data(), loaded.size() * sizeof(Frame))) return false;
+    frames = std::move(loaded);
+    frameDelta = header.frameDelta;
+    return true;
+}
@@ -0,0 +1,42 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+class Camera;
+
+// Where the camera was on every frame of a run, for replaying the same view sequence in later runs. Frames hold the
+// camera itself rather than the input that moved it, so a replay doesn't depend on frame or simulation timing and
+// looks the same in every build.
+//
+// The file is a small header followed by one packed frame after another, 24 bytes each.
+class CameraPath
+{
+public:
+    struct Frame
+    {
+        glm::vec3 position;
+        float yaw;
+        float pitch;
+        float zoom;
+    };
+
+    void Add(const Frame& frame) { frames.push_back(frame); }
+    // Move camera to where it was on a recorded frame.
+    static void Apply(const Frame& frame, Camera& camera);
+
+    bool Save(const std::string& path) const;
+    bool Load(const std::string& path);
+
+    size_t GetFrameCount() const { return frames.size(); }
+    const Frame& GetFrame(size_t index) const { return frames[index]; }
+    // Seconds each replayed frame advances time by: the average frame time while recording.
+    float GetFrameDelta() const { return frameDelta; }
+    void SetFrameDelta(float delta) { frameDelta = delta; }
+
+private:
+    std::vector<Frame> frames;
+    float frameDelta = 1.0f / 60.0f;
+};
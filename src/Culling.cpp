@@ -0,0 +1,69 @@
+﻿#include "Culling.h"
+
+#include <cmath>
+
+Bounds Bounds::Transform(const glm::mat4& matrix) const
+{
+    // Transform the center and extents instead of all eight corners.
+    glm::vec3 center = glm::vec3(matrix * glm::vec4((min + max) * 0.5f, 1.0f));
+    glm::vec3 extents = (max - min) * 0.5f;
+    glm::mat3 absolute = glm::mat3(matrix);
+    for (int i = 0; i < 3; i++)
+    {
+        absolute[i] = glm::abs(absolute[i]);
+    }
+    glm::vec3 newExtents = absolute * extents;
+
+    Bounds result;
+    result.min = center - newExtents;
+    result.max = center + newExtents;
+    return result;
+}
+
+Frustum::Frustum(const glm::mat4& viewProjection)
+{
+    // Gribb/Hartmann plane extraction: each plane is the fourth row plus or minus one of the other rows.
+    glm::mat4 m = glm::transpose(viewProjection);
+    planes[0] = m[3] + m[0]; // Left
+    planes[1] = m[3] - m[0]; // Right
+    planes[2] = m[3] + m[1]; // Bottom
+    planes[3] = m[3] - m[1]; // Top
+    planes[4] = m[3] + m[2]; // Near
+    planes[5] = m[3] - m[2]; // Far
+
+    for (glm::vec4& plane : planes)
+    {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+bool Frustum::IntersectsSphere(const glm::vec3& center, float radius) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        if (glm::dot(glm::vec3(plane), center) + plane.w < -radius) return false;
+    }
+    return true;
+}
+
+bool Frustum::IntersectsBox(const Bounds& bounds) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        // Test the corner that lies furthest along the plane normal.
+        glm::vec3 corner = glm::vec3(plane.x >= 0.0f ? bounds.max.x : bounds.min.x,
+                                     plane.y >= 0.0f ? bounds.max.y : bounds.min.y,
+                                     plane.z >= 0.0f ? bounds.max.z : bounds.min.z);
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) return false;
+    }
+    return true;
+}
+
+bool SphereIntersectsBox(const glm::vec3& center, float radius, const Bounds& bounds)
+{
+    if (std::isinf(radius)) return true;
+
+    glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+    glm::vec3 offset = center - closest;
+    return glm::dot(offset, offset) <= radius * radius;
+}
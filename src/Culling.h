@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <glm/glm.hpp>
+
+// Axis-aligned bounding box.
+struct Bounds
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    // Bounds of this box after transforming it by the given matrix.
+    Bounds Transform(const glm::mat4& matrix) const;
+};
+
+// View frustum as six planes, pointing inwards.
+class Frustum
+{
+public:
+    // Extract the planes from a combined projection * view (* model) matrix.
+    explicit Frustum(const glm::mat4& viewProjection);
+
+    bool IntersectsSphere(const glm::vec3& center, float radius) const;
+    bool IntersectsBox(const Bounds& bounds) const;
+
+private:
+    glm::vec4 planes[6];
+};
+
+bool SphereIntersectsBox(const glm::vec3& center, float radius, const Bounds& bounds);
@@ -0,0 +1,161 @@
+﻿#include "FrameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // Constant initialized, so it already works for allocations made during static initialization.
+    std::atomic<long long> heapAllocations(0);
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) & ~(alignment - 1);
+    }
+}
+
+// Replace the global allocation functions, only to count calls. The nothrow versions call these, the aligned ones
+// aren't counted.
+void* operator new(std::size_t size)
+{
+    heapAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* pointer = std::malloc(size ? size : 1)) return pointer;
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete(void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void* pointer, std::size_t) noexcept
+{
+    std::free(pointer);
+}
+
+long long GetHeapAllocationCount()
+{
+    return heapAllocations.load(std::memory_order_relaxed);
+}
+
+FrameArena::FrameArena(size_t capacity) : capacity(capacity)
+{
+    block = (unsigned char*)std::malloc(capacity);
+    heapAllocationsAtReset = GetHeapAllocationCount();
+}
+
+FrameArena::~FrameArena()
+{
+    for (void* extra : overflow) std::free(extra);
+    std::free(block);
+}
+
+FrameArena& FrameArena::Get()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
+
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+    frame.allocations++;
+    frame.bytes += size;
+
+    size_t offset = alignUp((size_t)(uintptr_t)(block + used), alignment) - (size_t)(uintptr_t)block;
+    if (offset + size <= capacity)
+    {
+        used = offset + size;
+        return block + offset;
+    }
+
+    // Doesn't fit, carry on in an extra block until the next reset makes the main one big enough.
+    if (!overflow.empty())
+    {
+        unsigned char* extra = (unsigned char*)overflow.back();
+        offset = alignUp((size_t)(uintptr_t)(extra + overflowUsed), alignment) - (size_t)(uintptr_t)extra;
+        if (offset + size <= overflowCapacity)
+        {
+            overflowUsed = offset + size;
+            return extra + offset;
+        }
+    }
+    overflowCapacity = std::max(capacity, size + alignment);
+    unsigned char* extra = (unsigned char*)std::malloc(overflowCapacity);
+    if (!extra) throw std::bad_alloc();
+    overflow.push_back(extra);
+    frame.overflowBlocks++;
+    offset = alignUp((size_t)(uintptr_t)extra, alignment) - (size_t)(uintptr_t)extra;
+    overflowUsed = offset + size;
+    return extra + offset;
+}
+
+const char* FrameArena::Format(const char* format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    va_list retry;
+    va_copy(retry, args);
+
+    // Try the space that's left first, most strings fit and only need formatting once.
+    char* text = (char*)(block + used);
+    int length = used < capacity ? vsnprintf(text, capacity - used, format, args) : vsnprintf(nullptr, 0, format, args);
+    va_end(args);
+    if (length < 0)
+    {
+        va_end(retry);
+        return "";
+    }
+    if ((size_t)length < capacity - std::min(used, capacity))
+    {
+        va_end(retry);
+        return (const char*)Allocate(length + 1, 1);
+    }
+
+    text = (char*)Allocate(length + 1, 1);
+    vsnprintf(text, length + 1, format, retry);
+    va_end(retry);
+    return text;
+}
+
+void FrameArena::Reset()
+{
+    const long long heapCount = GetHeapAllocationCount();
+    frame.heapAllocations = heapCount - heapAllocationsAtReset;
+    heapAllocationsAtReset = heapCount;
+    lastFrame = frame;
+    frame = FrameStats();
+
+    // Grow so a frame like this one fits in the main block next time.
+    if (!overflow.empty())
+    {
+        for (void* extra : overflow) std::free(extra);
+        overflow.clear();
+        overflowUsed = 0;
+        overflowCapacity = 0;
+        std::free(block);
+        capacity = std::max(capacity * 2, alignUp(lastFrame.bytes * 2, 4096));
+        block = (unsigned char*)std::malloc(capacity);
+        if (!block) throw std::bad_alloc();
+    }
+    used = 0;
+}
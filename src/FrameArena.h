@@ -0,0 +1,85 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Linear allocator for data that only lives for one frame. Allocations are bumped out of one block, and all of them are
+// freed at once by Reset() at the start of the next frame. When a frame needs more than the block holds, extra blocks
+// are allocated and the block grows to fit on the next Reset(), so a steady frame doesn't touch the heap at all. An
+// arena is only used by the thread it belongs to.
+class FrameArena
+{
+public:
+    struct FrameStats
+    {
+        int allocations = 0;
+        size_t bytes = 0;
+        // Blocks that had to be added because the frame didn't fit.
+        int overflowBlocks = 0;
+        // Everything the process allocated with new during the frame, arena or not.
+        long long heapAllocations = 0;
+    };
+
+    explicit FrameArena(size_t capacity = 64 * 1024);
+    ~FrameArena();
+    FrameArena(const FrameArena&) = delete;
+    FrameArena& operator=(const FrameArena&) = delete;
+
+    // The calling thread's arena. Threads that run a frame loop reset theirs once per frame, others shouldn't use it.
+    static FrameArena& Get();
+
+    void* Allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+    // printf into the arena. The string is valid until the next Reset().
+    const char* Format(const char* format, ...);
+    // Free everything allocated since the last reset, and keep the stats of the frame that ends.
+    void Reset();
+
+    const FrameStats& GetLastFrameStats() const { return lastFrame; }
+    size_t GetCapacity() const { return capacity; }
+
+private:
+    unsigned char* block = nullptr;
+    size_t capacity = 0;
+    size_t used = 0;
+    std::vector<void*> overflow;
+    size_t overflowUsed = 0;
+    size_t overflowCapacity = 0;
+    FrameStats frame;
+    FrameStats lastFrame;
+    long long heapAllocationsAtReset = 0;
+};
+
+// Standard library allocator on top of a FrameArena. Freeing is a no-op, containers using it must not outlive the frame.
+template <typename T>
+class FrameAllocator
+{
+public:
+    using value_type = T;
+
+    FrameAllocator() : arena(&FrameArena::Get()) {}
+    explicit FrameAllocator(FrameArena& arena) : arena(&arena) {}
+    template <typename U>
+    FrameAllocator(const FrameAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return (T*)arena->Allocate(count * sizeof(T), alignof(T)); }
+    void deallocate(T*, size_t) {}
+
+    template <typename U>
+    bool operator==(const FrameAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U>
+    bool operator!=(const FrameAllocator<U>& other) const { return arena != other.arena; }
+
+private:
+    template <typename U>
+    friend class FrameAllocator;
+
+    FrameArena* arena;
+};
+
+template <typename T>
+using FrameVector = std::vector<T, FrameAllocator<T>>;
+using FrameString = std::basic_string<char, std::char_traits<char>, FrameAllocator<char>>;
+
+// Heap allocations made through operator new since the program started, on any thread.
+long long GetHeapAllocationCount();
@@ -0,0 +1,174 @@
+﻿#include "FramePacer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <timeapi.h>
+#else
+#include <time.h>
+#endif
+
+FrameLimiter::FrameLimiter()
+{
+#ifdef _WIN32
+    // Sleeps are rounded up to the timer resolution, 15.6 ms by default.
+    timeBeginPeriod(1);
+#endif
+}
+
+FrameLimiter::~FrameLimiter()
+{
+#ifdef _WIN32
+    timeEndPeriod(1);
+#endif
+}
+
+void FrameLimiter::Wait(double framesPerSecond)
+{
+    const double period = 1.0 / framesPerSecond;
+    double now = GetPreciseTime();
+    if (nextDeadline == 0.0 || now - nextDeadline > period) nextDeadline = now;
+    nextDeadline += period;
+
+    lastSleep = 0.0;
+    lastSpin = 0.0;
+    const double sleepUntil = nextDeadline - spinThreshold;
+    if (now < sleepUntil)
+    {
+        std::this_thread::sleep_for(std::chrono::duration<double>(sleepUntil - now));
+        const double woke = GetPreciseTime();
+        lastSleep = woke - now;
+        // Spin longer after an overshoot, and shrink back slowly once sleeps are on time again.
+        const double overshoot = woke - sleepUntil;
+        spinThreshold = std::clamp(std::max(spinThreshold * 0.99, overshoot + minSpin), minSpin, maxSpin);
+        now = woke;
+    }
+
+    const double spinStart = now;
+    while (now < nextDeadline)
+    {
+        std::this_thread::yield();
+        now = GetPreciseTime();
+    }
+    lastSpin = now - spinStart;
+}
+
+double GetPreciseTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double GetProcessCpuTime()
+{
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0.0;
+    auto seconds = [](const FILETIME& time)
+    {
+        return (((unsigned long long)time.dwHighDateTime << 32) | time.dwLowDateTime) * 1e-7;
+    };
+    return seconds(kernel) + seconds(user);
+#else
+    timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) return 0.0;
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+void FrameTimer::Tick()
+{
+    const double now = GetPreciseTime();
+    const double frameTime = (now - lastTick) * 1e3;
+    lastTick = now;
+    frames++;
+    sum += frameTime;
+    sumOfSquares += frameTime * frameTime;
+    maxFrameTime = std::max(maxFrameTime, frameTime);
+}
+
+FrameTimingSummary FrameTimer::Take()
+{
+    const double now = GetPreciseTime();
+    const double cpuTime = GetProcessCpuTime();
+
+    FrameTimingSummary summary;
+    summary.frames = frames;
+    if (frames > 0)
+    {
+        summary.averageFrameTime = sum / frames;
+        summary.maxFrameTime = maxFrameTime;
+        summary.jitter = std::sqrt(std::max(sumOfSquares / frames - summary.averageFrameTime * summary.averageFrameTime, 0.0));
+    }
+    if (now > startTime) summary.cpuUsage = (cpuTime - startCpuTime) / (now - startTime);
+
+    // Frame intervals carry on from one summary to the next, the frame in progress counts for the new one.
+    startTime = now;
+    startCpuTime = cpuTime;
+    if (lastTick == 0.0) lastTick = now;
+    frames = 0;
+    sum = 0.0;
+    sumOfSquares = 0.0;
+    maxFrameTime = 0.0;
+    return summary;
+}
+
+FrameTimeStats ComputeFrameTimeStats(const std::vector<float>& frameTimes)
+{
+    FrameTimeStats stats;
+    if (frameTimes.empty()) return stats;
+
+    std::vector<float> sorted = frameTimes;
+    std::sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (float time : sorted) sum += time;
+    auto percentile = [&](int percent) { return sorted[(sorted.size() - 1) * percent / 100]; };
+
+    stats.frames = (int)sorted.size();
+    stats.mean = sum / sorted.size();
+    stats.p50 = percentile(50);
+    stats.p95 = percentile(95);
+    stats.p99 = percentile(99);
+    stats.worst = sorted.back();
+    return stats;
+}
+
+bool WriteFrameTimeStats(const char* path, const FrameTimeStats& stats, const std::vector<float>& frameTimes)
+{
+    char line[256];
+    const size_t length = std::strlen(path);
+    if (length >= 4 && std::strcmp(path + length - 4, ".csv") == 0)
+    {
+        // Every run adds a row. Only a new file gets the header.
+        std::ofstream file(path, std::ios::app | std::ios::ate);
+        if (!file) return false;
+        if (file.tellp() == 0) file << "frames,mean_ms,p50_ms,p95_ms,p99_ms,worst_ms\n";
+        snprintf(line, sizeof(line), "%d,%.4f,%.4f,%.4f,%.4f,%.4f\n", stats.frames, stats.mean, stats.p50, stats.p95, stats.p99,
+            stats.worst);
+        file << line;
+        return (bool)file;
+    }
+
+    std::ofstream file(path);
+    if (!file) return false;
+
+    snprintf(line, sizeof(line), "{\n  \"frames\": %d,\n  \"mean_ms\": %.4f,\n  \"p50_ms\": %.4f,\n  \"p95_ms\": %.4f,\n"
+        "  \"p99_ms\": %.4f,\n  \"worst_ms\": %.4f,\n  \"frame_times_ms\": [", stats.frames, stats.mean, stats.p50, stats.p95,
+        stats.p99, stats.worst);
+    file << line;
+    for (size_t i = 0; i < frameTimes.size(); i++)
+    {
+        snprintf(line, sizeof(line), "%s%.4f", i == 0 ? "" : ", ", frameTimes[i]);
+        file << line;
+    }
+    file << "]\n}\n";
+    return (bool)file;
+}
@@ -0,0 +1,92 @@
+﻿#pragma once
+
+#include <vector>
+
+// Holds the frame loop to a target rate. Sleeping alone overshoots by up to a scheduler tick, so it sleeps until shortly
+// before the deadline and spins for the rest. The spin covers the worst overshoot seen recently, so it stays a few
+// hundred microseconds on a quiet system and grows when sleeps get less precise. Deadlines advance by whole periods,
+// which keeps the average rate exact even though single frames end a little early or late.
+class FrameLimiter
+{
+public:
+    // Shortest and longest time spent spinning, in seconds.
+    static constexpr double minSpin = 0.0002;
+    static constexpr double maxSpin = 0.002;
+
+    FrameLimiter();
+    ~FrameLimiter();
+    FrameLimiter(const FrameLimiter&) = delete;
+    FrameLimiter& operator=(const FrameLimiter&) = delete;
+
+    // Wait until the next frame is due at framesPerSecond. Frames that ran late move the schedule instead of being
+    // made up for by rushing the ones after them.
+    void Wait(double framesPerSecond);
+    // Forget the schedule, when the limiter wasn't used for a while.
+    void Reset() { nextDeadline = 0.0; }
+
+    // Seconds spent sleeping and spinning during the last Wait().
+    double GetLastSleep() const { return lastSleep; }
+    double GetLastSpin() const { return lastSpin; }
+    double GetSpinThreshold() const { return spinThreshold; }
+
+private:
+    double nextDeadline = 0.0;
+    double spinThreshold = minSpin;
+    double lastSleep = 0.0;
+    double lastSpin = 0.0;
+};
+
+// Seconds on a monotonic clock.
+double GetPreciseTime();
+// Seconds of CPU time the process used so far, over all of its threads.
+double GetProcessCpuTime();
+
+struct FrameTimingSummary
+{
+    int frames = 0;
+    // Milliseconds.
+    double averageFrameTime = 0.0;
+    double maxFrameTime = 0.0;
+    // Standard deviation of the frame times, in milliseconds.
+    double jitter = 0.0;
+    // CPU time over wall time, 1 is one core kept busy.
+    double cpuUsage = 0.0;
+};
+
+// Frame intervals and CPU use of the process, measured from one Take() to the next.
+class FrameTimer
+{
+public:
+    FrameTimer() { Take(); }
+
+    // Call once per frame.
+    void Tick();
+    // The frames since the last call, and start measuring again.
+    FrameTimingSummary Take();
+    double GetElapsed() const { return GetPreciseTime() - startTime; }
+
+private:
+    double startTime = 0.0;
+    double startCpuTime = 0.0;
+    double lastTick = 0.0;
+    int frames = 0;
+    double sum = 0.0;
+    double sumOfSquares = 0.0;
+    double maxFrameTime = 0.0;
+};
+
+// How frame times of a run are spread, in milliseconds. Percentiles are the nearest frame at or below the rank.
+struct FrameTimeStats
+{
+    int frames = 0;
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double worst = 0.0;
+};
+
+FrameTimeStats ComputeFrameTimeStats(const std::vector<float>& frameTimes);
+// Write the stats as JSON with every frame time included, or append them as a CSV row, depending on whether path ends
+// in .csv. A new CSV file starts with a header, so it collects one row per run.
+bool WriteFrameTimeStats(const char* path, const FrameTimeStats& stats, const std::vector<float>& frameTimes);
@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// Hands frames from the thread that builds them to the thread that renders them, through two packets. One is filled in
+// while the other is drawn, so building can run one frame ahead of rendering and never more. Packets are reused, so
+// whatever they hold keeps its memory from frame to frame. Both ends may also be the same thread, which renders every
+// packet right after building it.
+template <typename Packet>
+class FramePipeline
+{
+public:
+    // The packet to fill in next, once the renderer is done with it.
+    Packet& BeginWrite()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return !full[writeIndex]; });
+        return packets[writeIndex];
+    }
+
+    void EndWrite()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            full[writeIndex] = true;
+            writeIndex ^= 1;
+        }
+        condition.notify_all();
+    }
+
+    // The oldest packet not rendered yet, or null once the pipeline is closed and nothing is left.
+    Packet* BeginRead()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        condition.wait(lock, [this]() { return full[readIndex] || closed; });
+        return full[readIndex] ? &packets[readIndex] : nullptr;
+    }
+
+    void EndRead()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            full[readIndex] = false;
+            readIndex ^= 1;
+        }
+        condition.notify_all();
+    }
+
+    // Let the reader run out of packets, or start over once it has.
+    void Close()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            closed = true;
+        }
+        condition.notify_all();
+    }
+
+    void Reopen()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        closed = false;
+    }
+
+private:
+    Packet packets[2];
+    bool full[2] = { false, false };
+    int writeIndex = 0;
+    int readIndex = 0;
+    bool closed = false;
+    std::mutex mutex;
+    std::condition_variable condition;
+};
@@ -0,0 +1,248 @@
+﻿#include "GpuResources.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+#include "imgui.h"
+
+namespace
+{
+    uint64_t resourceKey(GpuResourceType type, unsigned int id)
+    {
+        return ((uint64_t)type << 32) | id;
+    }
+
+    // __FILE__ may be a full path, only the file name is worth showing.
+    const char* fileName(const char* path)
+    {
+        const char* name = path;
+        for (const char* c = path; *c; c++)
+        {
+            if (*c == '/' || *c == '\\') name = c + 1;
+        }
+        return name;
+    }
+
+    std::string formatBytes(size_t bytes)
+    {
+        char text[32];
+        if (bytes >= 1024 * 1024) snprintf(text, sizeof(text), "%.2f MB", bytes / 1048576.0);
+        else if (bytes >= 1024) snprintf(text, sizeof(text), "%.1f KB", bytes / 1024.0);
+        else snprintf(text, sizeof(text), "%zu B", bytes);
+        return text;
+    }
+}
+
+GpuResourceTracker& GpuResourceTracker::Get()
+{
+    static GpuResourceTracker tracker;
+    return tracker;
+}
+
+void GpuResourceTracker::Track(GpuResourceType type, unsigned int id, size_t bytes, const std::string& owner, const char* file, int line)
+{
+    if (id == 0) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    resources[resourceKey(type, id)] = { type, id, bytes, owner, file, line };
+}
+
+void GpuResourceTracker::SetSize(GpuResourceType type, unsigned int id, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = resources.find(resourceKey(type, id));
+    if (found != resources.end()) found->second.bytes = bytes;
+}
+
+void GpuResourceTracker::SetOwner(GpuResourceType type, unsigned int id, const std::string& owner)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto found = resources.find(resourceKey(type, id));
+    if (found != resources.end()) found->second.owner = owner;
+}
+
+void GpuResourceTracker::Untrack(GpuResourceType type, unsigned int id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    resources.erase(resourceKey(type, id));
+}
+
+std::vector<GpuResourceTracker::Resource> GpuResourceTracker::GetResources() const
+{
+    std::vector<Resource> list;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        list.reserve(resources.size());
+        for (const auto& entry : resources) list.push_back(entry.second);
+    }
+    std::sort(list.begin(), list.end(), [](const Resource& a, const Resource& b)
+    {
+        if (a.bytes != b.bytes) return a.bytes > b.bytes;
+        if (a.type != b.type) return a.type < b.type;
+        return a.id < b.id;
+    });
+    return list;
+}
+
+size_t GpuResourceTracker::GetTotalBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    size_t total = 0;
+    for (const auto& entry : resources) total += entry.second.bytes;
+    return total;
+}
+
+void GpuResourceTracker::DrawWindow()
+{
+    const std::vector<Resource> list = GetResources();
+
+    ImGui::Begin("GPU Resources");
+    size_t typeBytes[4] = {};
+    int typeCounts[4] = {};
+    size_t totalBytes = 0;
+    for (const Resource& resource : list)
+    {
+        typeBytes[(int)resource.type] += resource.bytes;
+        typeCounts[(int)resource.type]++;
+        totalBytes += resource.bytes;
+    }
+    ImGui::Text("%zu objects, %s", list.size(), formatBytes(totalBytes).c_str());
+    for (int type = 0; type < 4; type++)
+    {
+        ImGui::BulletText("%s: %d, %s", GetTypeName((GpuResourceType)type), typeCounts[type], formatBytes(typeBytes[type]).c_str());
+    }
+
+    if (ImGui::CollapsingHeader("By owner", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        // Owners largest first.
+        std::map<std::string, std::pair<int, size_t>> owners;
+        for (const Resource& resource : list)
+        {
+            std::pair<int, size_t>& owner = owners[resource.owner];
+            owner.first++;
+            owner.second += resource.bytes;
+        }
+        std::vector<std::pair<std::string, std::pair<int, size_t>>> sorted(owners.begin(), owners.end());
+        std::sort(sorted.begin(), sorted.end(), [](const std::pair<std::string, std::pair<int, size_t>>& a,
+            const std::pair<std::string, std::pair<int, size_t>>& b) { return a.second.second > b.second.second; });
+
+        if (ImGui::BeginTable("Owners", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+            ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 10.0f)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Owner");
+            ImGui::TableSetupColumn("Objects");
+            ImGui::TableSetupColumn("Size");
+            ImGui::TableHeadersRow();
+            for (const auto& owner : sorted)
+            {
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(owner.first.c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%d", owner.second.first);
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(formatBytes(owner.second.second).c_str());
+            }
+            ImGui::EndTable();
+        }
+    }
+
+    if (ImGui::CollapsingHeader("Objects", ImGuiTreeNodeFlags_DefaultOpen))
+    {
+        const char* filters[] = { "All", "Buffers", "Textures", "Renderbuffers", "Programs" };
+        int filter = typeFilter + 1;
+        if (ImGui::Combo("Type", &filter, filters, IM_ARRAYSIZE(filters))) typeFilter = filter - 1;
+
+        if (ImGui::BeginTable("Objects", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_ScrollY,
+            ImVec2(0.0f, ImGui::GetTextLineHeightWithSpacing() * 16.0f)))
+        {
+            ImGui::TableSetupScrollFreeze(0, 1);
+            ImGui::TableSetupColumn("Type");
+            ImGui::TableSetupColumn("Name");
+            ImGui::TableSetupColumn("Size");
+            ImGui::TableSetupColumn("Owner");
+            ImGui::TableSetupColumn("Created at");
+            ImGui::TableHeadersRow();
+            for (const Resource& resource : list)
+            {
+                if (typeFilter >= 0 && (int)resource.type != typeFilter) continue;
+                ImGui::TableNextRow();
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(GetTypeName(resource.type));
+                ImGui::TableNextColumn(); ImGui::Text("%u", resource.id);
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(formatBytes(resource.bytes).c_str());
+                ImGui::TableNextColumn(); ImGui::TextUnformatted(resource.owner.c_str());
+                ImGui::TableNextColumn(); ImGui::Text("%s:%d", fileName(resource.file), resource.line);
+            }
+            ImGui::EndTable();
+        }
+    }
+    ImGui::End();
+}
+
+void GpuResourceTracker::ReportLeaks() const
+{
+    const std::vector<Resource> list = GetResources();
+    if (list.empty()) return;
+
+    // One line per owner and creation site, a mesh's buffers would otherwise fill pages.
+    struct Group
+    {
+        GpuResourceType type;
+        std::string owner;
+        const char* file;
+        int line;
+        int count;
+        size_t bytes;
+    };
+    std::vector<Group> groups;
+    size_t totalBytes = 0;
+    for (const Resource& resource : list)
+    {
+        totalBytes += resource.bytes;
+        auto group = std::find_if(groups.begin(), groups.end(), [&](const Group& g)
+        {
+            return g.type == resource.type && g.line == resource.line && std::strcmp(g.file, resource.file) == 0 && g.owner == resource.owner;
+        });
+        if (group == groups.end()) groups.push_back({ resource.type, resource.owner, resource.file, resource.line, 1, resource.bytes });
+        else
+        {
+            group->count++;
+            group->bytes += resource.bytes;
+        }
+    }
+    std::sort(groups.begin(), groups.end(), [](const Group& a, const Group& b) { return a.bytes > b.bytes; });
+
+    std::cout << "GPU resource leaks: " << list.size() << " objects were never deleted, " << formatBytes(totalBytes) << "\n";
+    for (const Group& group : groups)
+    {
+        char line[512];
+        snprintf(line, sizeof(line), "  %4d %-12s %10s  %s (%s:%d)", group.count, GetTypeName(group.type), formatBytes(group.bytes).c_str(),
+            group.owner.c_str(), fileName(group.file), group.line);
+        std::cout << line << "\n";
+    }
+}
+
+size_t GpuResourceTracker::GetMipChainBytes(int width, int height, int bytesPerTexel, int levels)
+{
+    size_t bytes = 0;
+    for (int level = 0; level < levels; level++)
+    {
+        bytes += (size_t)width * height * bytesPerTexel;
+        if (width == 1 && height == 1) break;
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+    }
+    return bytes;
+}
+
+const char* GpuResourceTracker::GetTypeName(GpuResourceType type)
+{
+    switch (type)
+    {
+    case GpuResourceType::Buffer: return "Buffer";
+    case GpuResourceType::Texture: return "Texture";
+    case GpuResourceType::Renderbuffer: return "Renderbuffer";
+    case GpuResourceType::Program: return "Program";
+    }
+    return "";
+}
@@ -0,0 +1,70 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+enum class GpuResourceType
+{
+    Buffer,
+    Texture,
+    Renderbuffer,
+    Program
+};
+
+// Bookkeeping for the GL objects that take up video memory: buffers, textures, renderbuffers and shader programs. Each
+// is recorded with its size, an owner tag and the line that created it, so the window can show what the memory goes to.
+// main() calls ReportLeaks() once everything that owns GL objects is gone but the context still exists, so whatever is
+// still recorded by then was never deleted. Sizes are what the uploaded data takes, except that RGB texels count as four
+// bytes like drivers store them. TextureManager replaces the sizes of its textures with what the driver reports.
+// Programs count their binary.
+class GpuResourceTracker
+{
+public:
+    struct Resource
+    {
+        GpuResourceType type;
+        unsigned int id;
+        size_t bytes;
+        std::string owner;
+        // __FILE__ and __LINE__ of the call that created it.
+        const char* file;
+        int line;
+    };
+
+    static GpuResourceTracker& Get();
+    GpuResourceTracker(const GpuResourceTracker&) = delete;
+    GpuResourceTracker& operator=(const GpuResourceTracker&) = delete;
+
+    // Any thread. Tracking a name again replaces its record, like a texture reloaded into the same name. Use
+    // TRACK_GPU_RESOURCE() to fill in the creation site.
+    void Track(GpuResourceType type, unsigned int id, size_t bytes, const std::string& owner, const char* file, int line);
+    void SetSize(GpuResourceType type, unsigned int id, size_t bytes);
+    void SetOwner(GpuResourceType type, unsigned int id, const std::string& owner);
+    void Untrack(GpuResourceType type, unsigned int id);
+
+    std::vector<Resource> GetResources() const;
+    size_t GetTotalBytes() const;
+
+    // Totals per type and owner, and every resource, largest first.
+    void DrawWindow();
+    // Prints what is still tracked, grouped by owner and creation site.
+    void ReportLeaks() const;
+
+    // Bytes of a mip chain of uncompressed texels, down to 1x1 or levels deep.
+    static size_t GetMipChainBytes(int width, int height, int bytesPerTexel, int levels = 32);
+    static const char* GetTypeName(GpuResourceType type);
+
+private:
+    GpuResourceTracker() = default;
+
+    mutable std::mutex mutex;
+    // By type in the high bits and name in the low ones, GL names are only unique per type.
+    std::unordered_map<uint64_t, Resource> resources;
+    int typeFilter = -1;
+};
+
+#define TRACK_GPU_RESOURCE(type, id, bytes, owner) GpuResourceTracker::Get().Track(type, id, bytes, owner, __FILE__, __LINE__)
@@ -0,0 +1,372 @@
+﻿#include "JobSystem.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+struct JobSystem::Job
+{
+    std::function<void()> task;
+    Affinity affinity = Affinity::Worker;
+    // The job itself counts as one until Schedule() has registered it with all its dependencies.
+    std::atomic<int> unfinishedDependencies{ 1 };
+    // Guards continuations, and finished against jobs registering themselves as it finishes.
+    std::mutex mutex;
+    std::atomic<bool> finished{ false };
+    std::vector<JobHandle> continuations;
+};
+
+namespace
+{
+    // Lets enqueue() find the calling worker's own deque.
+    thread_local const JobSystem* currentSystem = nullptr;
+    thread_local int currentWorker = -1;
+
+    // Idle workers check this often for new jobs before they go to sleep.
+    constexpr int spinsBeforeSleep = 64;
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
+
+JobSystem::JobSystem(int workerCount) : mainThread(std::this_thread::get_id()), queuedJobs(0), sleepingWorkers(0), stopping(false)
+{
+    if (workerCount < 0) workerCount = (int)std::max(1u, std::thread::hardware_concurrency()) - 1;
+
+    for (int i = 0; i <= workerCount; i++) queues.push_back(std::make_unique<Queue>());
+    for (int i = 0; i < workerCount; i++) workers.emplace_back(&JobSystem::workerThread, this, i);
+}
+
+JobSystem::~JobSystem()
+{
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) worker.join();
+}
+
+JobSystem& JobSystem::Get()
+{
+    static JobSystem system;
+    return system;
+}
+
+JobSystem::JobHandle JobSystem::Schedule(std::function<void()> task, std::initializer_list<JobHandle> dependencies, Affinity affinity)
+{
+    return schedule(std::move(task), dependencies.begin(), dependencies.size(), affinity);
+}
+
+JobSystem::JobHandle JobSystem::Schedule(std::function<void()> task, const std::vector<JobHandle>& dependencies, Affinity affinity)
+{
+    return schedule(std::move(task), dependencies.data(), dependencies.size(), affinity);
+}
+
+JobSystem::JobHandle JobSystem::Then(const JobHandle& job, std::function<void()> task, Affinity affinity)
+{
+    return schedule(std::move(task), &job, 1, affinity);
+}
+
+JobSystem::JobHandle JobSystem::schedule(std::function<void()> task, const JobHandle* dependencies, size_t dependencyCount, Affinity affinity)
+{
+    JobHandle job = std::make_shared<Job>();
+    job->task = std::move(task);
+    job->affinity = affinity;
+
+    for (size_t i = 0; i < dependencyCount; i++)
+    {
+        Job* dependency = dependencies[i].get();
+        if (!dependency) continue;
+
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->finished) continue;
+        dependency->continuations.push_back(job);
+        job->unfinishedDependencies++;
+    }
+
+    // The last dependency to finish queues it, which may be this.
+    if (--job->unfinishedDependencies == 0) enqueue(job);
+    return job;
+}
+
+int JobSystem::GetCurrentWorker()
+{
+    return currentSystem ? currentWorker : -1;
+}
+
+bool JobSystem::IsFinished(const JobHandle& job)
+{
+    return !job || job->finished.load(std::memory_order_acquire);
+}
+
+void JobSystem::Wait(const JobHandle& job)
+{
+    while (!IsFinished(job))
+    {
+        if (runOneJob()) continue;
+        if (IsMainThread() && RunMainThreadJobs() > 0) continue;
+        std::this_thread::yield();
+    }
+}
+
+void JobSystem::Wait(const std::vector<JobHandle>& jobs)
+{
+    for (const JobHandle& job : jobs) Wait(job);
+}
+
+void JobSystem::ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grain)
+{
+    if (count == 0) return;
+    if (grain == 0) grain = std::max<size_t>(1, count / ((workers.size() + 1) * 4));
+    if (workers.empty() || count <= grain)
+    {
+        function(0, count);
+        return;
+    }
+
+    // The caller takes the first chunk, and then whatever nobody has stolen yet.
+    std::vector<JobHandle> chunks;
+    chunks.reserve((count - 1) / grain);
+    for (size_t begin = grain; begin < count; begin += grain)
+    {
+        const size_t end = std::min(count, begin + grain);
+        chunks.push_back(Schedule([&function, begin, end]() { function(begin, end); }));
+    }
+    function(0, grain);
+    Wait(chunks);
+}
+
+int JobSystem::RunMainThreadJobs()
+{
+    // Jobs that queue more main thread jobs don't keep this going, those run next frame.
+    std::deque<JobHandle> jobs;
+    {
+        std::lock_guard<std::mutex> lock(mainQueue.mutex);
+        jobs.swap(mainQueue.jobs);
+    }
+    for (JobHandle& job : jobs)
+    {
+        job->task();
+        finish(*job);
+    }
+    return (int)jobs.size();
+}
+
+void JobSystem::workerThread(int index)
+{
+    currentSystem = this;
+    currentWorker = index;
+
+    while (true)
+    {
+        if (runOneJob()) continue;
+
+        // New work tends to come in bursts, check a few times before paying for a sleep and a wake up.
+        bool pending = false;
+        for (int spin = 0; spin < spinsBeforeSleep && !pending; spin++)
+        {
+            std::this_thread::yield();
+            pending = queuedJobs.load() > 0 || stopping.load();
+        }
+
+        if (!pending)
+        {
+            // Counting ourselves as sleeping before checking for jobs means enqueue() sees us if we miss its job.
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepingWorkers++;
+            wake.wait(lock, [this]() { return queuedJobs.load() > 0 || stopping.load(); });
+            sleepingWorkers--;
+        }
+        if (stopping && queuedJobs.load() == 0) return;
+    }
+}
+
+void JobSystem::enqueue(JobHandle job)
+{
+    if (job->affinity == Affinity::MainThread)
+    {
+        std::lock_guard<std::mutex> lock(mainQueue.mutex);
+        mainQueue.jobs.push_back(std::move(job));
+        return;
+    }
+
+    Queue& queue = currentSystem == this ? *queues[currentWorker] : *queues.back();
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(std::move(job));
+    }
+    queuedJobs++;
+    if (sleepingWorkers.load() > 0)
+    {
+        // A worker between checking for jobs and waiting holds the mutex, so it can't miss the notification.
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        wake.notify_one();
+    }
+}
+
+JobSystem::JobHandle JobSystem::findJob()
+{
+    const int queueCount = (int)queues.size();
+    const int own = currentSystem == this ? currentWorker : queueCount - 1;
+
+    // Newest first from our own deque.
+    {
+        Queue& queue = *queues[own];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.back());
+            queue.jobs.pop_back();
+            queuedJobs--;
+            return job;
+        }
+    }
+
+    // Oldest first from everyone else's, they are likely the biggest pieces of work left.
+    for (int i = 1; i < queueCount; i++)
+    {
+        Queue& queue = *queues[(own + i) % queueCount];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.jobs.empty())
+        {
+            JobHandle job = std::move(queue.jobs.front());
+            queue.jobs.pop_front();
+            queuedJobs--;
+            return job;
+        }
+    }
+    return nullptr;
+}
+
+bool JobSystem::runOneJob()
+{
+    JobHandle job = findJob();
+    if (!job) return false;
+
+    job->task();
+    finish(*job);
+    return true;
+}
+
+void JobSystem::finish(Job& job)
+{
+    // Release what the task captured before anyone waiting on it carries on.
+    job.task = nullptr;
+
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job.mutex);
+        job.finished.store(true, std::memory_order_release);
+        continuations.swap(job.continuations);
+    }
+    for (JobHandle& continuation : continuations)
+    {
+        if (--continuation->unfinishedDependencies == 0) enqueue(std::move(continuation));
+    }
+}
+
+int runJobSystemBenchmark()
+{
+    const int hardwareThreads = (int)std::max(1u, std::thread::hardware_concurrency());
+    const int iterations = 5;
+    bool correct = true;
+    char line[256];
+
+    // Scheduling overhead: jobs that do nothing, queued from outside the pool, and spawned by a worker into its own
+    // deque for the others to steal.
+    {
+        JobSystem jobs;
+        const int jobCount = 100000;
+        std::atomic<int> ran(0);
+        double externalTime = 1e30, spawnedTime = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            ran = 0;
+            auto start = std::chrono::steady_clock::now();
+            std::vector<JobSystem::JobHandle> handles;
+            handles.reserve(jobCount);
+            for (int j = 0; j < jobCount; j++) handles.push_back(jobs.Schedule([&ran]() { ran++; }));
+            jobs.Wait(handles);
+            externalTime = std::min(externalTime, secondsSince(start));
+            correct = correct && ran == jobCount;
+
+            ran = 0;
+            start = std::chrono::steady_clock::now();
+            jobs.Wait(jobs.Schedule([&]()
+            {
+                std::vector<JobSystem::JobHandle> children;
+                children.reserve(jobCount);
+                for (int j = 0; j < jobCount; j++) children.push_back(jobs.Schedule([&ran]() { ran++; }));
+                jobs.Wait(children);
+            }));
+            spawnedTime = std::min(spawnedTime, secondsSince(start));
+            correct = correct && ran == jobCount;
+        }
+        snprintf(line, sizeof(line), "Empty jobs on %d workers: %d from outside %.2f ms (%.2f M jobs/s), spawned by a worker %.2f ms (%.2f M jobs/s)",
+            jobs.GetWorkerCount(), jobCount, externalTime * 1e3, jobCount / externalTime / 1e6, spawnedTime * 1e3, jobCount / spawnedTime / 1e6);
+        std::cout << line << "\n";
+
+        // A chain where every job depends on the one before must run strictly in order, and a continuation on the main
+        // thread only once the chain is done.
+        const int chainLength = 1000;
+        int next = 0;
+        bool ordered = true;
+        std::vector<JobSystem::JobHandle> chain;
+        for (int j = 0; j < chainLength; j++)
+        {
+            chain.push_back(jobs.Schedule([&next, &ordered, j]() { ordered = ordered && next++ == j; }, { chain.empty() ? nullptr : chain.back() }));
+        }
+        bool onMainThread = false;
+        jobs.Wait(jobs.Then(chain.back(), [&]() { onMainThread = jobs.IsMainThread() && next == chainLength; }, JobSystem::Affinity::MainThread));
+        correct = correct && ordered && onMainThread;
+    }
+
+    // Parallel for scaling, on a loop that is heavy enough per item to be worth splitting. Every item writes its own
+    // result, so any thread count must give exactly the serial output.
+    const size_t itemCount = 1 << 22;
+    auto work = [](size_t i)
+    {
+        float x = (float)i * 0.001f;
+        return std::sqrt(x) * std::sin(x) + std::cos(x * 0.5f);
+    };
+    std::vector<float> expected(itemCount), results(itemCount);
+
+    double serialTime = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t j = 0; j < itemCount; j++) expected[j] = work(j);
+        serialTime = std::min(serialTime, secondsSince(start));
+    }
+    snprintf(line, sizeof(line), "Parallel for over %zu items: plain loop %.2f ms", itemCount, serialTime * 1e3);
+    std::cout << line << "\n";
+
+    for (int threads = 1; ; threads = std::min(threads * 2, hardwareThreads))
+    {
+        JobSystem jobs(threads - 1);
+        double time = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            std::fill(results.begin(), results.end(), 0.0f);
+            auto start = std::chrono::steady_clock::now();
+            jobs.ParallelFor(itemCount, [&](size_t begin, size_t end)
+            {
+                for (size_t j = begin; j < end; j++) results[j] = work(j);
+            });
+            time = std::min(time, secondsSince(start));
+        }
+        bool identical = results == expected;
+        correct = correct && identical;
+        snprintf(line, sizeof(line), "%2d threads %7.2f ms (%.2fx)%s", threads, time * 1e3, serialTime / time, identical ? "" : "  MISMATCH");
+        std::cout << line << "\n";
+        if (threads == hardwareThreads) break;
+    }
+
+    if (!correct) std::cout << "Job system results don't match the expected ones\n";
+    return correct ? 0 : 1;
+}
@@ -0,0 +1,95 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Runs tasks on a pool of worker threads. Every worker has its own deque: it pushes and pops the work it spawns at the
+// back, so nested work stays hot in its cache, and idle workers steal from the front of the others'. A job can depend
+// on other jobs and only starts once they have all finished, which is also how continuations are expressed. Jobs that
+// need the GL context go to a main thread queue instead, run by RunMainThreadJobs() once per frame.
+//
+// Waiting never blocks a thread that could be working: Wait() and ParallelFor() run other jobs until theirs are done,
+// so jobs can wait on jobs they spawned. Tasks must not throw.
+class JobSystem
+{
+public:
+    struct Job;
+    using JobHandle = std::shared_ptr<Job>;
+
+    enum class Affinity
+    {
+        Worker,
+        MainThread
+    };
+
+    // A negative count uses one less than the hardware threads, the thread that waits is the last one. With no workers
+    // at all, jobs run when they are waited on.
+    explicit JobSystem(int workerCount = -1);
+    ~JobSystem();
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    // Shared by the whole engine, created on first use. The thread that creates it counts as the main thread.
+    static JobSystem& Get();
+
+    // Run task once all dependencies have finished. Finished or null dependencies are ignored.
+    JobHandle Schedule(std::function<void()> task, std::initializer_list<JobHandle> dependencies = {}, Affinity affinity = Affinity::Worker);
+    JobHandle Schedule(std::function<void()> task, const std::vector<JobHandle>& dependencies, Affinity affinity = Affinity::Worker);
+    // Run task after job, on the main thread if asked.
+    JobHandle Then(const JobHandle& job, std::function<void()> task, Affinity affinity = Affinity::Worker);
+
+    static bool IsFinished(const JobHandle& job);
+    // Help out with other jobs until job has finished.
+    void Wait(const JobHandle& job);
+    void Wait(const std::vector<JobHandle>& jobs);
+
+    // Call function(begin, end) over [0, count) in chunks of up to grain items, and return once all are done. The
+    // calling thread takes part. 0 picks a grain that gives every thread a few chunks to balance uneven items.
+    void ParallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t grain = 0);
+
+    // Run the main thread jobs that are ready. Returns how many ran.
+    int RunMainThreadJobs();
+    bool IsMainThread() const { return std::this_thread::get_id() == mainThread.load(); }
+    // Make the calling thread the one that runs main thread jobs, for when the GL context moves to another thread.
+    void SetMainThread() { mainThread = std::this_thread::get_id(); }
+    int GetWorkerCount() const { return (int)workers.size(); }
+    // Index of the calling thread in whichever pool it works for, -1 outside of any pool.
+    static int GetCurrentWorker();
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<JobHandle> jobs;
+    };
+
+    std::atomic<std::thread::id> mainThread;
+    std::vector<std::thread> workers;
+    // One per worker, and a last one that every thread outside the pool pushes to.
+    std::vector<std::unique_ptr<Queue>> queues;
+    Queue mainQueue;
+    // Jobs in queues, so sleeping workers know there's something to steal.
+    std::atomic<int> queuedJobs;
+    std::atomic<int> sleepingWorkers;
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::atomic<bool> stopping;
+
+    JobHandle schedule(std::function<void()> task, const JobHandle* dependencies, size_t dependencyCount, Affinity affinity);
+    void workerThread(int index);
+    void enqueue(JobHandle job);
+    JobHandle findJob();
+    bool runOneJob();
+    void finish(Job& job);
+};
+
+// Compare scheduling empty jobs, and how parallel for scales with the number of workers, against plain loops. The
+// results are checked, so it also catches a scheduler that lost or reordered work.
+int runJobSystemBenchmark();
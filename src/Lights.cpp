@@ -0,0 +1,23 @@
+﻿#include "Lights.h"
+
+#include <cmath>
+#include <limits>
+
+float ComputeLightRadius(float constant, float linear, float quadratic, float intensity, float threshold)
+{
+    // Solve intensity / (constant + linear * d + quadratic * d^2) = threshold for d.
+    float c = constant - intensity / threshold;
+    if (c >= 0.0f) return 0.0f; // Never bright enough to matter.
+
+    if (quadratic > 0.0f)
+    {
+        return (-linear + std::sqrt(linear * linear - 4.0f * quadratic * c)) / (2.0f * quadratic);
+    }
+    if (linear > 0.0f)
+    {
+        return -c / linear;
+    }
+
+    // Without any falloff the light reaches everywhere.
+    return std::numeric_limits<float>::infinity();
+}
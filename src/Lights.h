@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <glm/glm.hpp>
+
+// Has to match the light array size in the lighting shaders.
+#define NR_POINT_LIGHTS 4
+
+struct Light
+{
+    glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
+    bool castShadows = true;
+};
+
+struct DirectionalLight : Light
+{
+    glm::vec3 direction;
+};
+
+struct PointLight : Light
+{
+    glm::vec3 position;
+    float constant = 1.0f;
+    float linear;
+    float quadratic;
+    // Distance at which the light's contribution drops below the cutoff threshold, see ComputeLightRadius().
+    float radius = 0.0f;
+};
+
+struct SpotLight : Light
+{
+    glm::vec3 position;
+    glm::vec3 direction;
+    float constant = 1.0f;
+    float linear;
+    float quadratic;
+    float cutOff;
+    float outerCutOff;
+    float radius = 0.0f;
+};
+
+// Distance at which a light with the given attenuation and peak intensity falls below threshold.
+// E.g. a threshold of 1/256 is one 8-bit step, so anything beyond the radius can't change the final color.
+float ComputeLightRadius(float constant, float linear, float quadratic, float intensity, float threshold);
@@ -1,6 +1,16 @@
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iostream>
-#include <sstream>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "imgui.h"
 #include "imgui_impl_glfw.h"
@@ -18,9 +28,28 @@
 
 #include "Main.h"
 
+#include "AssetPack.h"
+#include "CameraPath.h"
+#include "FrameArena.h"
+#include "FramePacer.h"
+#include "GpuResources.h"
+#include "FramePipeline.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "Regression.h"
+#include "RenderTarget.h"
 #include "Shader.h"
+#include "ShaderCompiler.h"
+#include "ShadowCascades.h"
+#include "TextureManager.h"
+#include "TextureStreamer.h"
+#include "TextureTool.h"
+#include "Util.h"
+#include "ShadowAtlas.h"
 #include "Camera.h"
 #include "Model.h"
+#include "Lights.h"
+#include "Culling.h"
 
 glm::vec3 pointLightPositions[] = {
 	glm::vec3( 0.7f,  0.2f,  2.0f),
@@ -36,39 +65,9 @@ struct Material
 	float emissiveStrength = 0.0f;
 };
 
-struct Light
-{
-	glm::vec3 color = glm::vec3(1.0f, 1.0f, 1.0f);
-};
-
-struct DirectionalLight : Light
-{
-	glm::vec3 direction;
-};
-
-struct PointLight : Light
-{
-	glm::vec3 position;
-	float constant = 1.0f;
-	float linear;
-	float quadratic;
-};
-
-struct SpotLight : Light
-{
-	glm::vec3 position;
-	glm::vec3 direction;
-	float constant = 1.0f;
-	float linear;
-	float quadratic;
-	float cutOff;
-	float outerCutOff;
-};
-
 struct Material material;
 
 struct DirectionalLight directionalLight;
-#define NR_POINT_LIGHTS 4
 struct PointLight pointLights[NR_POINT_LIGHTS];
 struct SpotLight spotLight;
 
@@ -76,6 +75,45 @@ float ambientMultiplier = 0.1f;
 float diffuseMultiplier = 0.5f;
 float specularMultiplier = 1.0f;
 
+// Results of the last lighting kernel benchmark, in GPU milliseconds per draw.
+struct LightingBenchmark
+{
+	int draws = 0;
+	double referenceTime = 0.0;
+	double optimizedTime = 0.0;
+};
+
+// Static per-fragment costs of both kernels: each light evaluation in the reference kernel samples the diffuse map twice
+// and the specular map once, and transforms its position and/or direction into view space. The benchmark turns the
+// optimized kernel's shadow lookups off, the reference kernel has none.
+const int referenceTextureFetches = 3 * (NR_POINT_LIGHTS + 2);
+const int optimizedTextureFetches = 2;
+const int referenceFragmentTransforms = NR_POINT_LIGHTS + 3;
+
+// Lights are culled once their contribution drops below this, by default one 8-bit color step.
+float lightCutoff = 1.0f / 256.0f;
+bool lightCulling = true;
+
+// What survived culling during the last frame.
+struct LightCullingStats
+{
+	int meshesDrawn = 0;
+	int meshesCulled = 0;
+	int pointLightsUploaded = 0;
+	int visiblePointLights = 0;
+};
+
+// Lights that reach one mesh, worked out on the job system before any of the draws.
+struct MeshLights
+{
+	bool visible = false;
+	bool spotLightReaches = false;
+	int count = 0;
+	int indices[NR_POINT_LIGHTS];
+};
+// Meshes culled per job. Each one is only a few box tests, so a job needs several to be worth scheduling.
+const size_t meshCullingBatch = 16;
+
 glm::vec4 clearColor = glm::vec4(0.1f, 0.1f, 0.1f, 1.0f);
 bool wireframe = false;
 
@@ -88,22 +126,406 @@ Camera camera = Camera(glm::vec3(0.0f, 0.0f, 3.0f));
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// Camera movement is simulated in fixed steps of 1 / simulationRate seconds, independent of the frame rate, and frames
+// are rendered between the last two steps. Mouse look is applied as events arrive, it isn't integrated over time.
+bool fixedTimestep = true;
+int simulationRate = 120;
+// Simulation time a single frame can add. After a long stall the simulation falls behind instead of running a burst
+// of steps that would stall the next frame too.
+const double maxSimulationLag = 0.25;
+
+// Set while a recorded camera path is replayed, which real input mustn't disturb.
+bool ignoreInput = false;
+
 // Mouse movement variables
 bool firstMouseInput = true; // To prevent a jarring "jump" when the player first moves the mouse.
 float lastX = windowWidth / 2.0, lastY = windowHeight / 2.0;
 
-int main()
+// Everything about the scene the renderer reads, copied into every frame packet, so the UI can edit the globals above
+// while the render thread is still drawing an older copy.
+struct SceneState
+{
+	Material material;
+	DirectionalLight directionalLight;
+	PointLight pointLights[NR_POINT_LIGHTS];
+	SpotLight spotLight;
+	float ambientMultiplier = 0.0f;
+	float diffuseMultiplier = 0.0f;
+	float specularMultiplier = 0.0f;
+	bool lightCulling = true;
+	glm::vec4 clearColor = glm::vec4(0.0f);
+	bool wireframe = false;
+};
+
+enum class VsyncMode
+{
+	Off,
+	On,
+	// Waits for vertical blank unless the frame missed it, in which case it's presented right away and tears, instead
+	// of waiting for the next one. Needs EXT_swap_control_tear, falls back to On without it.
+	Adaptive
+};
+
+// Settings of the renderer's objects that the UI edits, and one-off requests. The renderer applies them before it
+// draws the frame that carries them.
+struct RendererSettings
+{
+	bool shadowsEnabled = true;
+	int cascadeCount = 0;
+	int shadowResolution = 0;
+	float shadowDistance = 0.0f;
+	float splitLambda = 0.0f;
+	int firstCachedCascade = 0;
+	int cachedUpdateInterval = 0;
+	float cacheMargin = 0.0f;
+	bool atlasEnabled = true;
+	float shadowRange = 0.0f;
+	float depthBias = 0.0f;
+	bool streamingEnabled = true;
+	int streamingBudgetMegabytes = 0;
+	float mipBias = 0.0f;
+	int maxUploadsPerFrame = 0;
+	bool evictionEnabled = true;
+	int textureBudgetMegabytes = 0;
+	int evictAfterFrames = 0;
+	// Texture tables are only gathered while the UI shows them.
+	bool wantStreamedTextures = false;
+	bool wantTextures = false;
+	// Keep the present timings of every frame, see Renderer.
+	bool recordTimings = false;
+	VsyncMode vsync = VsyncMode::On;
+
+	bool invalidateCachedCascades = false;
+	bool invalidateCasters = false;
+	bool reloadAllTextures = false;
+	std::vector<unsigned int> reloadTextures;
+	bool runLightingBenchmark = false;
+};
+
+// What the renderer reports back to the UI, from the last frame it drew.
+struct RendererStats
+{
+	bool shadersReady = false;
+	bool shadersBatched = false;
+	bool parallelShaderCompile = false;
+	float shaderCompileTime = 0.0f;
+	LightCullingStats lightCulling;
+	struct Cascade
+	{
+		float split = 0.0f;
+		float renderTime = 0.0f;
+		int updates = 0;
+		bool updated = false;
+	};
+	Cascade cascades[CascadedShadowMap::maxCascades];
+	double atlasUsage = 0.0;
+	int renderedTiles = 0;
+	int atlasEvictions = 0;
+	int tileSizes[NR_POINT_LIGHTS + 1] = {};
+	size_t streamedBytes = 0;
+	size_t streamingBudgetBytes = 1;
+	int pendingLoads = 0;
+	int uploads = 0;
+	int streamingEvictions = 0;
+	std::vector<TextureStreamer::TextureInfo> streamedTextures;
+	TextureManager::FrameStats textureStats;
+	std::vector<TextureManager::TextureInfo> textures;
+	LightingBenchmark lightingBenchmark;
+	// Milliseconds, averaged over the last presentHistory frames.
+	float frameTime = 0.0f;
+	float latency = 0.0f;
+	float maxLatency = 0.0f;
+	// Milliseconds the last frame took to build on the CPU, up to presenting it, and to execute on the GPU. The GPU time
+	// is from a few frames ago, unless frames are finished.
+	float cpuTime = 0.0f;
+	float gpuTime = 0.0f;
+};
+
+// A copy of ImGui's draw data. The render thread draws it while the main thread already builds the next UI, which
+// reuses ImGui's own draw lists. The copies keep their buffers, so this doesn't allocate once the UI settles.
+struct UIDrawData
+{
+	ImDrawData drawData;
+	std::vector<std::unique_ptr<ImDrawList>> lists;
+
+	void CopyFrom(const ImDrawData& source);
+};
+
+// One frame, as the main thread hands it to the renderer.
+struct FramePacket
+{
+	long long frame = 0;
+	// glfwGetTime() when the input this frame reacts to was polled.
+	double inputTime = 0.0;
+	int width = 0;
+	int height = 0;
+	glm::mat4 view = glm::mat4(1.0f);
+	glm::mat4 projection = glm::mat4(1.0f);
+	glm::mat4 model = glm::mat4(1.0f);
+	glm::vec3 cameraPosition = glm::vec3(0.0f);
+	float fieldOfView = 0.0f;
+	float aspect = 1.0f;
+	SceneState scene;
+	RendererSettings settings;
+	UIDrawData ui;
+};
+
+// Present timings the renderer keeps for the UI.
+const int presentHistory = 120;
+
+// Milliseconds between presents, and from polling input to presenting, one entry per frame.
+struct PresentTimings
+{
+	std::vector<float> frameTimes;
+	std::vector<float> latencies;
+};
+
+// The frame pacing modes --bench-pacing compares.
+struct PacingMode
+{
+	const char* name;
+	int frameLimit;
+	VsyncMode vsync;
+};
+const PacingMode pacingModes[] = {
+	{ "Uncapped", 0, VsyncMode::Off },
+	{ "Limited to 60", 60, VsyncMode::Off },
+	{ "Vsync", 0, VsyncMode::On },
+	{ "Adaptive vsync", 0, VsyncMode::Adaptive },
+};
+const int pacingModeCount = sizeof(pacingModes) / sizeof(pacingModes[0]);
+
+// The GL objects the frame loop draws with, owned by whichever thread renders.
+struct Renderer
+{
+	GLFWwindow* window;
+	ShaderCompiler& shaderCompiler;
+	unsigned int modelShaderHandle;
+	unsigned int modelPackedShaderHandle;
+	unsigned int referenceShaderHandle;
+	unsigned int shadowShaderHandle;
+	TextureStreamer& textureStreamer;
+	TextureManager& textureManager;
+	Model& model;
+	CascadedShadowMap& shadowMap;
+	ShadowAtlas& shadowAtlas;
+	// Where frames are drawn, 0 for the window.
+	unsigned int framebuffer = 0;
+	bool adaptiveVsyncSupported = false;
+	// Set by the first frame, GLFW doesn't say what the driver starts with.
+	int swapInterval = -2;
+
+	RendererStats stats{};
+	// The render thread publishes its stats here after every frame, for the UI to pick up.
+	std::mutex statsMutex{};
+	RendererStats publishedStats{};
+
+	// The last presentHistory frames, and every frame while the settings ask to record them.
+	double lastPresent = 0.0;
+	float frameTimes[presentHistory] = {};
+	float latencies[presentHistory] = {};
+	int presentCount = 0;
+	PresentTimings recordedTimings{};
+	// Kept until the shaders it times are ready.
+	bool lightingBenchmarkRequested = false;
+
+	// Timestamps around the GPU work of recent frames, read once they are available so the CPU doesn't wait for them.
+	// The shadow passes time themselves with GL_TIME_ELAPSED, which can't nest.
+	static constexpr int gpuTimerFrames = 4;
+	unsigned int gpuTimerQueries[gpuTimerFrames][2] = {};
+	bool gpuTimerPending[gpuTimerFrames] = {};
+	int gpuTimerFrame = 0;
+};
+
+// Frame pacing of the main loop: the simulation time not yet stepped through, the camera position before the last step,
+// and an optional frame limit. 0 leaves the frame rate up to vsync. Frame times and CPU use are summed up for the UI
+// twice a second.
+struct FramePacing
+{
+	double simulationTime = 0.0;
+	glm::vec3 previousCameraPosition = glm::vec3(0.0f);
+	int simulationSteps = 0;
+	// Where the frame is between the last two steps.
+	float interpolation = 1.0f;
+	int frameLimit = 0;
+	FrameLimiter limiter;
+	FrameTimer timer;
+	FrameTimingSummary summary;
+};
+
+// --bench-pipeline: compares both frame loop modes over a fixed number of frames each, then quits.
+struct PipelineBenchmark
 {
-	// GLFW and GLAD init.
-	glfwInit();
+	static constexpr int warmupFrames = 60, measuredFrames = 300;
+	int frame = 0;
+	PresentTimings results[2];
+};
+
+// --bench-pacing: runs every pacing mode for a fixed number of frames, then quits.
+struct PacingBenchmark
+{
+	static constexpr int warmupFrames = 60, measuredFrames = 300;
+	int frame = 0;
+	FrameTimer timer;
+	FrameTimingSummary results[pacingModeCount];
+};
+
+// --headless: counts frames from when the shaders are in, so the fallback program isn't measured, and records a fixed
+// number of them after a warmup that lets texture streaming settle.
+struct HeadlessRun
+{
+	static constexpr int warmupFrames = 30;
+	int frames = 0;
+	int frame = 0;
+};
+
+// --replay-camera: the path frame replayed this frame. It starts once the shaders are in, so the fallback program isn't
+// measured.
+struct Replay
+{
+	size_t frame = 0;
+	bool started = false;
+};
+
+int main(int argc, char** argv)
+{
+	// Command line options.
+	bool serialShaderCompile = false;
+	bool runBenchmark = false;
+	bool compressTextures = false;
+	bool benchmarkMips = false;
+	bool benchmarkPNG = false;
+	bool benchmarkJPEG = false;
+	bool buildPack = false;
+	bool benchmarkPack = false;
+	bool benchmarkJobs = false;
+	// Render on a thread of its own from the start, or compare both ways of running the frame loop.
+	bool startRenderThread = false;
+	bool benchmarkPipeline = false;
+	bool benchmarkPacing = false;
+	// Render a fixed number of frames offscreen without a display, then report timings and optionally save the last one.
+	bool headless = false;
+	int headlessFrames = 300;
+	const char* screenshotPath = nullptr;
+	// Record the camera on every frame, or replay a recording with fixed frame deltas and report how long frames took.
+	const char* recordPath = nullptr;
+	const char* replayPath = nullptr;
+	const char* replayStatsPath = nullptr;
+	// Render the scenes of a regression script headless and check them against golden images and timing baselines, or
+	// make the current results the new references.
+	const char* regressionScript = nullptr;
+	// Write a trace of the first frames.
+	const char* tracePath = nullptr;
+	int traceFrames = 120;
+	bool updateGolden = false;
+	bool updateBaselines = false;
+	// Asset pack to read resources and shaders from instead of loose files, see AssetPack.
+	const char* packPath = nullptr;
+	MipFilter mipFilter = MipFilter::Kaiser;
+	AtlasSettings atlasSettings;
+	// Model or directory the offline tools work on, each has its own default.
+	const char* toolPath = nullptr;
+	for (int i = 1; i < argc; i++)
+	{
+		if (std::strcmp(argv[i], "--serial-shaders") == 0) serialShaderCompile = true;
+		else if (std::strcmp(argv[i], "--bench-lighting") == 0) runBenchmark = true;
+		else if (std::strcmp(argv[i], "--compress-textures") == 0) compressTextures = true;
+		else if (std::strcmp(argv[i], "--bench-mips") == 0) benchmarkMips = true;
+		else if (std::strcmp(argv[i], "--bench-png") == 0) benchmarkPNG = true;
+		else if (std::strcmp(argv[i], "--bench-jpeg") == 0) benchmarkJPEG = true;
+		else if (std::strcmp(argv[i], "--no-atlas") == 0) atlasSettings.enabled = false;
+		else if (std::strcmp(argv[i], "--build-pack") == 0) buildPack = true;
+		else if (std::strcmp(argv[i], "--bench-pack") == 0) benchmarkPack = true;
+		else if (std::strcmp(argv[i], "--bench-jobs") == 0) benchmarkJobs = true;
+		else if (std::strcmp(argv[i], "--render-thread") == 0) startRenderThread = true;
+		else if (std::strcmp(argv[i], "--bench-pipeline") == 0) benchmarkPipeline = true;
+		else if (std::strcmp(argv[i], "--bench-pacing") == 0) benchmarkPacing = true;
+		else if (std::strcmp(argv[i], "--headless") == 0) headless = true;
+		else if (std::strcmp(argv[i], "--frames") == 0 && i + 1 < argc) headlessFrames = std::max(std::atoi(argv[++i]), 1);
+		else if (std::strcmp(argv[i], "--screenshot") == 0 && i + 1 < argc) screenshotPath = argv[++i];
+		else if (std::strcmp(argv[i], "--record-camera") == 0 && i + 1 < argc) recordPath = argv[++i];
+		else if (std::strcmp(argv[i], "--replay-camera") == 0 && i + 1 < argc) replayPath = argv[++i];
+		else if (std::strcmp(argv[i], "--replay-stats") == 0 && i + 1 < argc) replayStatsPath = argv[++i];
+		else if (std::strcmp(argv[i], "--regression") == 0 && i + 1 < argc) regressionScript = argv[++i];
+		else if (std::strcmp(argv[i], "--update-golden") == 0) updateGolden = true;
+		else if (std::strcmp(argv[i], "--update-baselines") == 0) updateBaselines = true;
+		else if (std::strcmp(argv[i], "--trace") == 0 && i + 1 < argc) tracePath = argv[++i];
+		else if (std::strcmp(argv[i], "--trace-frames") == 0 && i + 1 < argc) traceFrames = std::max(std::atoi(argv[++i]), 1);
+		else if (std::strcmp(argv[i], "--pack") == 0 && i + 1 < argc) packPath = argv[++i];
+		else if (std::strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc)
+		{
+			mipFilter = std::strcmp(argv[++i], "box") == 0 ? MipFilter::Box : MipFilter::Kaiser;
+		}
+		else if (argv[i][0] != '-') toolPath = argv[i];
+	}
+
+	// Offline tools, these run without opening a window.
+	const char* defaultModelPath = "resources/backpack.obj";
+	if (compressTextures) return runTextureCompression(toolPath ? toolPath : defaultModelPath, mipFilter);
+	if (benchmarkMips) return runMipBenchmark(toolPath ? toolPath : defaultModelPath);
+	if (benchmarkPNG) return runImageDecodeBenchmark(toolPath ? toolPath : "resources", ".png");
+	if (benchmarkJPEG) return runJpegDecodeBenchmark(toolPath ? toolPath : "resources");
+	const char* defaultPackPath = "assets.pack";
+	if (buildPack) return AssetPack::Build({ "resources", "shaders" }, toolPath ? toolPath : defaultPackPath) ? 0 : 1;
+	if (benchmarkPack) return runAssetPackBenchmark(toolPath ? toolPath : defaultPackPath, defaultModelPath);
+	if (benchmarkJobs) return runJobSystemBenchmark();
+
+	// Start the workers from here, so this is the thread that runs main thread jobs.
+	JobSystem& jobSystem = JobSystem::Get();
+
+	if (regressionScript) headless = true;
+
+	CameraPath cameraPath;
+	if (replayPath)
+	{
+		if (!cameraPath.Load(replayPath) || cameraPath.GetFrameCount() == 0)
+		{
+			std::cout << "Failed to load camera path " << replayPath << "\n";
+			return 1;
+		}
+		ignoreInput = true;
+	}
+
+	// Map the asset pack once, everything below reads from it.
+	AssetPack assetPack;
+	if (packPath)
+	{
+		if (!assetPack.Open(packPath))
+		{
+			std::cout << "Failed to open asset pack " << packPath << "\n";
+			return 1;
+		}
+		MountAssetPack(&assetPack);
+	}
+
+	// GLFW and GLAD init. Headless runs use GLFW's null platform, which needs no display, with a surfaceless EGL context or
+	// OSMesa. Both work with Mesa's llvmpipe on machines without a GPU.
+	if (headless) glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	if (!glfwInit())
+	{
+		std::cout << "Failed to initialize GLFW\n";
+		return 1;
+	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 6);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	if (headless)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+	}
 
 	GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, "LearnOpenGL", NULL, NULL);
+	if (!window && headless)
+	{
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+		window = glfwCreateWindow(windowWidth, windowHeight, "LearnOpenGL", NULL, NULL);
+	}
 	if (!window)
 	{
 		std::cout << "Failed to create GLFW window\n";
+		// llvmpipe may report an older version than it can run the shaders with.
+		if (headless) std::cout << "Headless rendering needs EGL or OSMesa with OpenGL 4.6, try MESA_GL_VERSION_OVERRIDE=4.6\n";
 		glfwTerminate();
 		return 1;
 	}
@@ -116,6 +538,19 @@ int main()
 	}
 
 	glViewport(0, 0, windowWidth, windowHeight);
+
+	// Without a window there's no default framebuffer to draw into, so frames go to one of our own.
+	std::unique_ptr<RenderTarget> headlessTarget;
+	if (headless)
+	{
+		headlessTarget = std::make_unique<RenderTarget>(windowWidth, windowHeight);
+		if (!headlessTarget->IsComplete())
+		{
+			std::cout << "Failed to create the offscreen framebuffer\n";
+			return 1;
+		}
+		std::cout << "Rendering headless on " << glGetString(GL_RENDERER) << " (" << glGetString(GL_VERSION) << ")\n";
+	}
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 
 	// Set up callbacks to handle mouse movement and scrolling.
@@ -139,199 +574,1477 @@ int main()
 	// Set up renderer/platform backends.
 	ImGui_ImplGlfw_InitForOpenGL(window, true);
 	ImGui_ImplOpenGL3_Init();
+	// Creates the font texture now, while this thread has the context. The OpenGL backend needs nothing else per frame.
+	ImGui_ImplOpenGL3_NewFrame();
+
 
 
+	// Everything that owns GL objects lives in this scope, so it's all deleted while the context still exists.
+	int exitCode = 0;
+	{
+		// Load and create textures
+		// OpenGL's y coordinates increase upwards, whereas a picture's y coordinates increase downwards.
+		stbi_set_flip_vertically_on_load(true);
 
-	// Load and create textures
-	// OpenGL's y coordinates increase upwards, whereas a picture's y coordinates increase downwards.
-	stbi_set_flip_vertically_on_load(true);
+		// Submit all shader programs at once so the driver can compile them while the model loads.
+		ShaderCompiler shaderCompiler = ShaderCompiler(!serialShaderCompile);
+		unsigned int modelShaderHandle = shaderCompiler.Add("shaders/model.vsh", "shaders/model.fsh");
+		// Meshes whose material has its scalar maps packed into one texture use this permutation.
+		unsigned int modelPackedShaderHandle = shaderCompiler.Add("shaders/model.vsh", "shaders/model.fsh", "#define PACKED_MATERIAL\n");
+		unsigned int referenceShaderHandle = shaderCompiler.Add("shaders/model_reference.vsh", "shaders/model_reference.fsh");
+		unsigned int shadowShaderHandle = shaderCompiler.Add("shaders/shadow_depth.vsh", "shaders/shadow_depth.fsh");
+		shaderCompiler.Submit();
 
-	// Add model shaders and model itself.
-	Shader modelShader = Shader("shaders\\model.vsh", "shaders\\model.fsh");
-	Model backpack = Model("resources\\backpack.obj");
+		// Add the model itself. Its compressed textures stream in as they are needed.
+		TextureStreamer textureStreamer;
+		TextureManager textureManager = TextureManager(&textureStreamer);
+		Model backpack = Model("resources/backpack.obj", textureManager, atlasSettings);
 
 
 	
-	// Light initialization.
-	directionalLight.direction = glm::vec3(1.0f, -1.0f, 1.0f);
+		// Shadows of the directional light, and of all point and spot lights.
+		CascadedShadowMap shadowMap;
+		ShadowAtlas shadowAtlas;
+
+		// Light initialization.
+		directionalLight.direction = glm::vec3(1.0f, -1.0f, 1.0f);
+
+		for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+		{
+			pointLights[i].position = pointLightPositions[i];
+			pointLights[i].linear = 0.09f;
+			pointLights[i].quadratic = 0.032f;
+		}
+
+		spotLight.linear = 0.09f;
+		spotLight.quadratic = 0.032f;
+		spotLight.cutOff = 12.5f;
+		spotLight.outerCutOff = 17.5f;
+
+		// Main loop
+		Profiler& profiler = Profiler::Get();
+		profiler.SetThreadName("Main");
+		if (tracePath) profiler.StartCapture(tracePath, traceFrames);
+		FrameArena& frameArena = FrameArena::Get();
+		Renderer renderer{ window, shaderCompiler, modelShaderHandle, modelPackedShaderHandle, referenceShaderHandle, shadowShaderHandle,
+			textureStreamer, textureManager, backpack, shadowMap, shadowAtlas };
+		if (headlessTarget) renderer.framebuffer = headlessTarget->GetFramebuffer();
+		renderer.adaptiveVsyncSupported = glfwExtensionSupported("WGL_EXT_swap_control_tear") || glfwExtensionSupported("GLX_EXT_swap_control_tear");
+		RendererSettings settings = getRendererSettings(renderer);
+		settings.runLightingBenchmark = runBenchmark;
+		// Vsync would hide the difference between the frame loop modes, and there's no display to sync to without a window.
+		if (benchmarkPipeline || headless || replayPath) settings.vsync = VsyncMode::Off;
+		RendererStats stats;
+
+		// Frames are built here and drawn either right away, or by a render thread that owns the GL context while this
+		// thread builds the next frame.
+		FramePipeline<FramePacket> pipeline;
+		std::thread renderThread;
+		bool useRenderThread = startRenderThread && !benchmarkPipeline;
+		FramePacing pacing;
+		pacing.previousCameraPosition = camera.Position;
+		// Runs that end by themselves, each only advanced when the command line asked for it.
+		PipelineBenchmark pipelineBenchmark;
+		PacingBenchmark pacingBenchmark;
+		HeadlessRun headlessRun;
+		headlessRun.frames = headlessFrames;
+		Replay replay;
+		double recordedTime = 0.0;
+		// Let the render thread draw what it has left, and take the GL context back.
+		auto stopRenderThread = [&]()
+		{
+			pipeline.Close();
+			renderThread.join();
+			glfwMakeContextCurrent(window);
+			jobSystem.SetMainThread();
+		};
+
+		// The regression harness drives the renderer itself, instead of the frame loop.
+		if (regressionScript)
+		{
+			exitCode = runRegressionTests(renderer, settings, regressionScript, updateGolden, updateBaselines);
+			glfwSetWindowShouldClose(window, true);
+		}
+
+		long long frameCount = 0;
+		double inputTime = glfwGetTime();
+		while (!glfwWindowShouldClose(window))
+		{
+			// Hand the GL context over when the mode changed.
+			if (useRenderThread && !renderThread.joinable())
+			{
+				pipeline.Reopen();
+				glfwMakeContextCurrent(nullptr);
+				renderThread = std::thread(runRenderThread, std::ref(renderer), std::ref(pipeline));
+			}
+			else if (!useRenderThread && renderThread.joinable())
+			{
+				stopRenderThread();
+			}
 
-	for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+			// Everything transient from the last frame goes at once. The render thread starts its own frames.
+			frameArena.Reset();
+			if (!renderThread.joinable()) profiler.BeginFrame();
+
+			// Delta time calculation
+			float currentFrame = glfwGetTime();
+			deltaTime = currentFrame - lastFrame;
+			lastFrame = currentFrame;
+			pacing.timer.Tick();
+			pacingBenchmark.timer.Tick();
+			if (pacing.timer.GetElapsed() >= 0.5) pacing.summary = pacing.timer.Take();
+
+			// Input, and the simulation steps that are due by now. A replay moves the camera itself, by whole frames.
+			profiler.BeginCpuScope("Input");
+			processInput(window);
+			if (replayPath)
+			{
+				deltaTime = cameraPath.GetFrameDelta();
+				CameraPath::Apply(cameraPath.GetFrame(replay.frame), camera);
+				pacing.previousCameraPosition = camera.Position;
+				pacing.simulationSteps = 0;
+				pacing.interpolation = 1.0f;
+			}
+			else
+			{
+				stepSimulation(window, pacing);
+			}
+			// Between the last two steps, so motion stays smooth when frames and steps don't line up.
+			const glm::vec3 cameraPosition = glm::mix(pacing.previousCameraPosition, camera.Position, pacing.interpolation);
+			if (recordPath)
+			{
+				cameraPath.Add({ cameraPosition, camera.Yaw, camera.Pitch, camera.Zoom });
+				recordedTime += deltaTime;
+			}
+			profiler.EndCpuScope();
+
+			// The last frame the renderer finished.
+			{
+				std::lock_guard<std::mutex> lock(renderer.statsMutex);
+				stats = renderer.publishedStats;
+			}
+
+			// Start Dear ImGui frame. The OpenGL backend created its font texture at startup, and doesn't need more setup.
+			profiler.BeginCpuScope("UI build");
+			ImGui_ImplGlfw_NewFrame();
+			ImGui::NewFrame();
+
+			buildSettingsWindow(settings, stats, renderer.adaptiveVsyncSupported, useRenderThread, pacing);
+			profiler.DrawWindow();
+			GpuResourceTracker::Get().DrawWindow();
+			ImGui::Render();
+			profiler.EndCpuScope();
+
+			// Spotlight is attached to the camera.
+			spotLight.position = cameraPosition;
+			spotLight.direction = camera.Front;
+			updateLightRadii();
+
+			// Fill in the next packet. With a render thread, this waits until it's done with the frame before last.
+			profiler.BeginCpuScope("Wait for renderer");
+			FramePacket& packet = pipeline.BeginWrite();
+			profiler.EndCpuScope();
+
+			profiler.BeginCpuScope("Frame packet");
+			packet.frame = frameCount++;
+			packet.inputTime = inputTime;
+			packet.width = windowWidth;
+			packet.height = windowHeight;
+			// Defining view matrices (model, view, projection) to transform vertices to NDC.
+			packet.aspect = (float)windowWidth / (float)windowHeight;
+			packet.fieldOfView = glm::radians(camera.Zoom);
+			packet.view = glm::lookAt(cameraPosition, cameraPosition + camera.Front, camera.Up);
+			packet.projection = glm::perspective(packet.fieldOfView, packet.aspect, 0.1f, 100.0f);
+			packet.model = glm::mat4(1.0f);
+			packet.cameraPosition = cameraPosition;
+			packet.scene = captureScene();
+			packet.settings = settings;
+			// Headless frames leave the UI out, so screenshots only show the scene.
+			if (headless) packet.ui.drawData.Clear();
+			else packet.ui.CopyFrom(*ImGui::GetDrawData());
+			profiler.EndCpuScope();
+			pipeline.EndWrite();
+
+			// Requests go out with one packet only.
+			settings.invalidateCachedCascades = false;
+			settings.invalidateCasters = false;
+			settings.reloadAllTextures = false;
+			settings.reloadTextures.clear();
+			settings.runLightingBenchmark = false;
+
+			// Without a render thread, draw the packet right away.
+			if (!renderThread.joinable())
+			{
+				renderFrame(renderer, *pipeline.BeginRead());
+				pipeline.EndRead();
+			}
+
+			// Hold the loop to the frame limit before polling, so the next frame reacts to the newest input.
+			if (pacing.frameLimit > 0)
+			{
+				profiler.BeginCpuScope("Frame limiter");
+				pacing.limiter.Wait(pacing.frameLimit);
+				profiler.EndCpuScope();
+			}
+			else
+			{
+				pacing.limiter.Reset();
+			}
+
+			// Poll input events for the next frame.
+			profiler.BeginCpuScope("Input");
+			glfwPollEvents();
+			inputTime = glfwGetTime();
+			profiler.EndCpuScope();
+
+			// Runs that end by themselves close the window once they are done.
+			if (headless && !replayPath && advanceHeadlessRun(headlessRun, stats, settings)) glfwSetWindowShouldClose(window, true);
+			if (replayPath && advanceReplay(replay, cameraPath.GetFrameCount(), stats, settings)) glfwSetWindowShouldClose(window, true);
+			if (benchmarkPacing && advancePacingBenchmark(pacingBenchmark, pacing, settings, renderer.adaptiveVsyncSupported))
+			{
+				glfwSetWindowShouldClose(window, true);
+			}
+			if (benchmarkPipeline && advancePipelineBenchmark(pipelineBenchmark, renderer, settings, useRenderThread, [&]()
+				{
+					if (renderThread.joinable()) stopRenderThread();
+				}))
+			{
+				glfwSetWindowShouldClose(window, true);
+			}
+		}
+
+		// Take the GL context back to shut down.
+		if (renderThread.joinable()) stopRenderThread();
+		if (profiler.IsCapturing()) std::cout << "Closed before the trace capture finished, nothing was written\n";
+
+		if (recordPath && !saveCameraRecording(cameraPath, recordedTime, recordPath)) exitCode = 1;
+		if (replayPath)
+		{
+			if (!reportReplay(renderer.recordedTimings, replayStatsPath)) exitCode = 1;
+		}
+		else if (headless)
+		{
+			reportFrameTimes("Headless", renderer.recordedTimings);
+		}
+		if (headless && !regressionScript && screenshotPath && !saveScreenshot(*headlessTarget, screenshotPath)) exitCode = 1;
+		headlessTarget.reset();
+		glDeleteQueries(Renderer::gpuTimerFrames * 2, &renderer.gpuTimerQueries[0][0]);
+	}
+	Profiler::Get().ReleaseGpuResources();
+	// Whatever is still tracked now was never deleted.
+	GpuResourceTracker::Get().ReportLeaks();
+
+	// Shut down Dear ImGui.
+	ImGui_ImplOpenGL3_Shutdown();
+	ImGui_ImplGlfw_Shutdown();
+	ImGui::DestroyContext();
+
+	glfwTerminate();
+	return exitCode;
+}
+
+void setTransformUniforms(const Shader& shader, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection)
+{
+	shader.setMat4("model", model);
+	shader.setMat4("view", view);
+	shader.setMat4("projection", projection);
+
+	// Model matrix specifically for normal vectors. Inverting it once per draw is a lot cheaper than once per vertex.
+	shader.setMat3("normalMatrix", glm::mat3(glm::transpose(glm::inverse(view * model))));
+}
+
+void setLightUniforms(const Shader& shader, const SceneState& scene, const glm::mat4& view)
+{
+	// Lights are sent in view space, so the fragment shader doesn't have to transform them for every fragment.
+	// The reference shader still expects world space and does this itself.
+	const glm::mat3 viewRotation = glm::mat3(view);
+
+	// Send material and lighting information to shader.
+	shader.setFloat("material.shininess", scene.material.shininess);
+
+	// Directional Light attributes.
+	shader.setVec3("directionalLight.direction", viewRotation * scene.directionalLight.direction);
+	shader.setVec3("directionalLight.ambient", scene.directionalLight.color * scene.ambientMultiplier);
+	shader.setVec3("directionalLight.diffuse", scene.directionalLight.color * scene.diffuseMultiplier);
+	shader.setVec3("directionalLight.specular", scene.directionalLight.color * scene.specularMultiplier);
+
+	// Point Light attributes.
+	FrameArena& arena = FrameArena::Get();
+	for (int i = 0; i < NR_POINT_LIGHTS; i++)
+	{
+		shader.setVec3(arena.Format("pointLights[%d].position", i), glm::vec3(view * glm::vec4(scene.pointLights[i].position, 1.0f)));
+		shader.setVec3(arena.Format("pointLights[%d].ambient", i), scene.pointLights[i].color * scene.ambientMultiplier);
+		shader.setVec3(arena.Format("pointLights[%d].diffuse", i), scene.pointLights[i].color * scene.diffuseMultiplier);
+		shader.setVec3(arena.Format("pointLights[%d].specular", i), scene.pointLights[i].color * scene.specularMultiplier);
+		shader.setFloat(arena.Format("pointLights[%d].constant", i), scene.pointLights[i].constant);
+		shader.setFloat(arena.Format("pointLights[%d].linear", i), scene.pointLights[i].linear);
+		shader.setFloat(arena.Format("pointLights[%d].quadratic", i), scene.pointLights[i].quadratic);
+		shader.setFloat(arena.Format("pointLights[%d].radius", i), scene.pointLights[i].radius);
+	}
+
+	// Spotlight attributes.
+	shader.setVec3("spotLight.position", glm::vec3(view * glm::vec4(scene.spotLight.position, 1.0f)));
+	shader.setVec3("spotLight.direction", glm::normalize(viewRotation * scene.spotLight.direction));
+	shader.setVec3("spotLight.ambient", scene.spotLight.color * scene.ambientMultiplier);
+	shader.setVec3("spotLight.diffuse", scene.spotLight.color * scene.diffuseMultiplier);
+	shader.setVec3("spotLight.specular", scene.spotLight.color * scene.specularMultiplier);
+	shader.setFloat("spotLight.constant", scene.spotLight.constant);
+	shader.setFloat("spotLight.linear", scene.spotLight.linear);
+	shader.setFloat("spotLight.quadratic", scene.spotLight.quadratic);
+	shader.setFloat("spotLight.cutOff", glm::cos(glm::radians(scene.spotLight.cutOff)));
+	shader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(scene.spotLight.outerCutOff)));
+	shader.setFloat("spotLight.radius", scene.spotLight.radius);
+}
+
+void updateLightRadii()
+{
+	// The brightest a light can get is all three components at full strength.
+	const float multipliers = ambientMultiplier + diffuseMultiplier + specularMultiplier;
+
+	for (int i = 0; i < NR_POINT_LIGHTS; i++)
+	{
+		PointLight& light = pointLights[i];
+		float intensity = glm::max(light.color.r, glm::max(light.color.g, light.color.b)) * multipliers;
+		light.radius = ComputeLightRadius(light.constant, light.linear, light.quadratic, intensity, lightCutoff);
+	}
+
+	float intensity = glm::max(spotLight.color.r, glm::max(spotLight.color.g, spotLight.color.b)) * multipliers;
+	spotLight.radius = ComputeLightRadius(spotLight.constant, spotLight.linear, spotLight.quadratic, intensity, lightCutoff);
+}
+
+void requestTextureMips(TextureStreamer& streamer, Model& model, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection,
+	int viewportHeight)
+{
+	// projection[1][1] is 1 / tan(fovY / 2), so this is the height in pixels of one unit at a distance of one unit.
+	const float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+	const glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+
+	// Meshes outside the view don't need any detail.
+	const Frustum frustum = Frustum(projection * view);
+	for (Mesh& mesh : model.GetMeshes())
+	{
+		if (!frustum.IntersectsBox(mesh.bounds.Transform(modelMatrix))) continue;
+		streamer.RequestMeshTextures(mesh, modelMatrix, cameraPosition, pixelsPerUnit);
+	}
+}
+
+void drawWithLightCulling(Model& model, const Shader& shader, const Shader& packedShader, const SceneState& scene, const glm::mat4& modelMatrix,
+	const glm::mat4& view, const glm::mat4& projection, LightCullingStats& stats)
+{
+	stats = LightCullingStats();
+
+	// Cull lights against the view frustum once, then each mesh only tests the lights that are left.
+	const Frustum frustum = Frustum(projection * view);
+	int visibleLights[NR_POINT_LIGHTS];
+	int visibleCount = 0;
+	for (int i = 0; i < NR_POINT_LIGHTS; i++)
 	{
-		pointLights[i].position = pointLightPositions[i];
-		pointLights[i].linear = 0.09f;
-		pointLights[i].quadratic = 0.032f;
+		if (scene.pointLights[i].radius <= 0.0f) continue;
+		if (scene.lightCulling && !frustum.IntersectsSphere(scene.pointLights[i].position, scene.pointLights[i].radius)) continue;
+		visibleLights[visibleCount++] = i;
 	}
+	stats.visiblePointLights = visibleCount;
+
+	// Meshes are culled independently, so that runs on the job system. Only the draws need the GL context.
+	std::vector<Mesh>& meshes = model.GetMeshes();
+	FrameVector<MeshLights> meshLights(meshes.size());
+	JobSystem::Get().ParallelFor(meshes.size(), [&](size_t begin, size_t end)
+	{
+		for (size_t m = begin; m < end; m++)
+		{
+			MeshLights& lights = meshLights[m];
+			const Bounds bounds = meshes[m].bounds.Transform(modelMatrix);
+			lights.visible = !scene.lightCulling || frustum.IntersectsBox(bounds);
+			if (!lights.visible) continue;
+
+			for (int i = 0; i < visibleCount; i++)
+			{
+				const PointLight& light = scene.pointLights[visibleLights[i]];
+				if (scene.lightCulling && !SphereIntersectsBox(light.position, light.radius, bounds)) continue;
+				lights.indices[lights.count++] = visibleLights[i];
+			}
+			lights.spotLightReaches = scene.spotLight.radius > 0.0f && (!scene.lightCulling || SphereIntersectsBox(scene.spotLight.position, scene.spotLight.radius, bounds));
+		}
+	}, meshCullingBatch);
 
-	spotLight.linear = 0.09f;
-	spotLight.quadratic = 0.032f;
-	spotLight.cutOff = 12.5f;
-	spotLight.outerCutOff = 17.5f;
+	Mesh::ResetTextureBindings();
+	// The last program used is the base one. Only switch when a mesh needs the other permutation.
+	unsigned int activeProgram = shader.ID;
+	for (size_t m = 0; m < meshes.size(); m++)
+	{
+		const MeshLights& lights = meshLights[m];
+		if (!lights.visible)
+		{
+			stats.meshesCulled++;
+			continue;
+		}
+
+		Mesh& mesh = meshes[m];
+		const Shader& meshShader = mesh.packedMaterial ? packedShader : shader;
+		if (meshShader.ID != activeProgram)
+		{
+			meshShader.use();
+			activeProgram = meshShader.ID;
+		}
+		meshShader.setIntArray("pointLightIndices", lights.indices, lights.count);
+		meshShader.setInt("pointLightCount", lights.count);
+		meshShader.setBool("spotLightEnabled", lights.spotLightReaches);
+		mesh.Draw(meshShader);
+
+		stats.meshesDrawn++;
+		stats.pointLightsUploaded += lights.count;
+	}
+}
+
+void setReferenceLightUniforms(const Shader& shader, const SceneState& scene)
+{
+	// The reference kernel transforms lights itself, so it gets the same values in world space.
+	setLightUniforms(shader, scene, glm::mat4(1.0f));
+}
+
+LightingBenchmark runLightingBenchmark(Model& model, const Shader& referenceShader, const Shader& optimizedShader,
+	const SceneState& scene, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection)
+{
+	const int draws = 64;
+	LightingBenchmark result;
 
-	// Main loop
-	while (!glfwWindowShouldClose(window))
+	// Meshes with packed materials need the PACKED_MATERIAL permutation, which the reference kernel has no version of.
+	// Both kernels leave them out, so they shade the same meshes from the right textures.
+	const std::vector<Mesh>& meshes = model.GetMeshes();
+	if (std::all_of(meshes.begin(), meshes.end(), [](const Mesh& mesh) { return mesh.packedMaterial; }))
 	{
-		// Delta time calculation
-		float currentFrame = glfwGetTime();
-		deltaTime = currentFrame - lastFrame;
-		lastFrame = currentFrame;
+		std::cout << "Lighting benchmark: every mesh has a packed material, which the reference kernel can't draw\n";
+		return result;
+	}
+	result.draws = draws;
 
-		// Input
-		processInput(window);
+	// Without depth testing, every draw shades every covered fragment again, so the timing is dominated by the fragment shader.
+	glDisable(GL_DEPTH_TEST);
 
-		// Start Dear ImGui frame.
-		ImGui_ImplOpenGL3_NewFrame();
-		ImGui_ImplGlfw_NewFrame();
-		ImGui::NewFrame();
+	unsigned int query;
+	glGenQueries(1, &query);
 
-		// Construct my own very awesome debug window.
-		ImGui::Begin("Scene Settings");
-		if (ImGui::Button("Toggle Wireframe"))
+	auto drawUnpacked = [&](const Shader& shader)
+	{
+		Mesh::ResetTextureBindings();
+		for (Mesh& mesh : model.GetMeshes())
 		{
-			wireframe = !wireframe;
-			if (wireframe) glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-			else glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+			if (!mesh.packedMaterial) mesh.Draw(shader);
 		}
+	};
 
-		if (ImGui::CollapsingHeader("Scene Colors"))
+	for (int kernel = 0; kernel < 2; kernel++)
+	{
+		const Shader& shader = kernel == 0 ? referenceShader : optimizedShader;
+		shader.use();
+		setTransformUniforms(shader, modelMatrix, view, projection);
+		if (kernel == 0) setReferenceLightUniforms(shader, scene);
+		else setLightUniforms(shader, scene, view);
+
+		// Evaluate every light in both kernels, so culling doesn't skew the comparison.
+		int allLights[NR_POINT_LIGHTS];
+		for (int i = 0; i < NR_POINT_LIGHTS; i++) allLights[i] = i;
+		shader.setIntArray("pointLightIndices", allLights, NR_POINT_LIGHTS);
+		shader.setInt("pointLightCount", NR_POINT_LIGHTS);
+		shader.setBool("spotLightEnabled", true);
+		// The reference kernel has no shadows. Turn them off in the optimized one as well, renderFrame() has just bound
+		// the cascades and the atlas for it and binds them again next frame.
+		if (kernel == 1)
 		{
-			ImGui::ColorEdit4("Background Color", (float*)&clearColor);
+			shader.setInt("cascadeCount", 0);
+			FrameArena& arena = FrameArena::Get();
+			for (int i = 0; i < NR_POINT_LIGHTS; i++) shader.setInt(arena.Format("pointLights[%d].shadowTile", i), -1);
+			shader.setInt("spotLight.shadowTile", -1);
+		}
 
-			ImGui::SliderFloat("Ambient Multiplier", &ambientMultiplier, 0.0f, 1.0f);
-			ImGui::SliderFloat("Diffuse Multiplier", &diffuseMultiplier, 0.0f, 1.0f);
-			ImGui::SliderFloat("Specular Multiplier", &specularMultiplier, 0.0f, 1.0f);
-			
-			if (ImGui::TreeNode("Material"))
+		// Warm up once, so state changes and lazy driver work aren't measured.
+		drawUnpacked(shader);
+		glFinish();
+
+		glBeginQuery(GL_TIME_ELAPSED, query);
+		for (int i = 0; i < draws; i++)
+		{
+			drawUnpacked(shader);
+		}
+		glEndQuery(GL_TIME_ELAPSED);
+
+		// Waiting for the result stalls, but that's fine for a one-off benchmark.
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+		double time = elapsed / 1000000.0 / draws;
+		if (kernel == 0) result.referenceTime = time;
+		else result.optimizedTime = time;
+	}
+
+	glDeleteQueries(1, &query);
+	glEnable(GL_DEPTH_TEST);
+
+	std::cout << "Lighting benchmark (" << draws << " draws): reference " << result.referenceTime << " ms, optimized "
+		<< result.optimizedTime << " ms per draw\n";
+
+	return result;
+}
+
+SceneState captureScene()
+{
+	SceneState scene;
+	scene.material = material;
+	scene.directionalLight = directionalLight;
+	std::copy(std::begin(pointLights), std::end(pointLights), scene.pointLights);
+	scene.spotLight = spotLight;
+	scene.ambientMultiplier = ambientMultiplier;
+	scene.diffuseMultiplier = diffuseMultiplier;
+	scene.specularMultiplier = specularMultiplier;
+	scene.lightCulling = lightCulling;
+	scene.clearColor = clearColor;
+	scene.wireframe = wireframe;
+	return scene;
+}
+
+RendererSettings getRendererSettings(const Renderer& renderer)
+{
+	RendererSettings settings;
+	settings.shadowsEnabled = renderer.shadowMap.enabled;
+	settings.cascadeCount = renderer.shadowMap.cascadeCount;
+	settings.shadowResolution = renderer.shadowMap.resolution;
+	settings.shadowDistance = renderer.shadowMap.shadowDistance;
+	settings.splitLambda = renderer.shadowMap.splitLambda;
+	settings.firstCachedCascade = renderer.shadowMap.firstCachedCascade;
+	settings.cachedUpdateInterval = renderer.shadowMap.cachedUpdateInterval;
+	settings.cacheMargin = renderer.shadowMap.cacheMargin;
+	settings.atlasEnabled = renderer.shadowAtlas.enabled;
+	settings.shadowRange = renderer.shadowAtlas.shadowRange;
+	settings.depthBias = renderer.shadowAtlas.depthBias;
+	settings.streamingEnabled = renderer.textureStreamer.enabled;
+	settings.streamingBudgetMegabytes = renderer.textureStreamer.budgetMegabytes;
+	settings.mipBias = renderer.textureStreamer.mipBias;
+	settings.maxUploadsPerFrame = renderer.textureStreamer.maxUploadsPerFrame;
+	settings.evictionEnabled = renderer.textureManager.evictionEnabled;
+	settings.textureBudgetMegabytes = renderer.textureManager.budgetMegabytes;
+	settings.evictAfterFrames = renderer.textureManager.evictAfterFrames;
+	return settings;
+}
+
+void applyRendererSettings(Renderer& renderer, const RendererSettings& settings)
+{
+	renderer.shadowMap.enabled = settings.shadowsEnabled;
+	renderer.shadowMap.cascadeCount = settings.cascadeCount;
+	renderer.shadowMap.resolution = settings.shadowResolution;
+	renderer.shadowMap.shadowDistance = settings.shadowDistance;
+	renderer.shadowMap.splitLambda = settings.splitLambda;
+	renderer.shadowMap.firstCachedCascade = settings.firstCachedCascade;
+	renderer.shadowMap.cachedUpdateInterval = settings.cachedUpdateInterval;
+	renderer.shadowMap.cacheMargin = settings.cacheMargin;
+	renderer.shadowAtlas.enabled = settings.atlasEnabled;
+	renderer.shadowAtlas.shadowRange = settings.shadowRange;
+	renderer.shadowAtlas.depthBias = settings.depthBias;
+	renderer.textureStreamer.enabled = settings.streamingEnabled;
+	renderer.textureStreamer.budgetMegabytes = settings.streamingBudgetMegabytes;
+	renderer.textureStreamer.mipBias = settings.mipBias;
+	renderer.textureStreamer.maxUploadsPerFrame = settings.maxUploadsPerFrame;
+	renderer.textureManager.evictionEnabled = settings.evictionEnabled;
+	renderer.textureManager.budgetMegabytes = settings.textureBudgetMegabytes;
+	renderer.textureManager.evictAfterFrames = settings.evictAfterFrames;
+
+	// Needs the context, so it's set here rather than by the UI.
+	int swapInterval = settings.vsync == VsyncMode::Off ? 0 : 1;
+	if (settings.vsync == VsyncMode::Adaptive && renderer.adaptiveVsyncSupported) swapInterval = -1;
+	if (swapInterval != renderer.swapInterval)
+	{
+		glfwSwapInterval(swapInterval);
+		renderer.swapInterval = swapInterval;
+	}
+
+	if (settings.invalidateCachedCascades) renderer.shadowMap.InvalidateStatic();
+	if (settings.invalidateCasters) renderer.shadowAtlas.InvalidateCasters();
+	if (settings.reloadAllTextures) renderer.textureManager.ReloadAll();
+	for (unsigned int id : settings.reloadTextures) renderer.textureManager.Reload(id);
+	// Waits for the shaders, so it's kept until then.
+	if (settings.runLightingBenchmark) renderer.lightingBenchmarkRequested = true;
+}
+
+void renderFrame(Renderer& renderer, FramePacket& packet)
+{
+	Profiler& profiler = Profiler::Get();
+	const SceneState& scene = packet.scene;
+	RendererStats& stats = renderer.stats;
+	const double cpuStart = GetPreciseTime();
+	Mesh::ResetDrawStats();
+	applyRendererSettings(renderer, packet.settings);
+
+	// Skip timing the frame when the queries from gpuTimerFrames frames ago still aren't in.
+	if (renderer.gpuTimerQueries[0][0] == 0) glGenQueries(Renderer::gpuTimerFrames * 2, &renderer.gpuTimerQueries[0][0]);
+	const int gpuTimer = renderer.gpuTimerFrame;
+	const bool gpuTimed = !renderer.gpuTimerPending[gpuTimer];
+	if (gpuTimed) glQueryCounter(renderer.gpuTimerQueries[gpuTimer][0], GL_TIMESTAMP);
+
+	// Finish the GL side of work that jobs handed back, like uploads after a decode.
+	JobSystem::Get().RunMainThreadJobs();
+
+	// Pick up any shader programs that finished compiling. Until then, the fallback program is used.
+	renderer.shaderCompiler.Poll();
+	Shader modelShader = renderer.shaderCompiler.Get(renderer.modelShaderHandle);
+	Shader modelPackedShader = renderer.shaderCompiler.Get(renderer.modelPackedShaderHandle);
+
+	glViewport(0, 0, packet.width, packet.height);
+	glPolygonMode(GL_FRONT_AND_BACK, scene.wireframe ? GL_LINE : GL_FILL);
+
+	// Stream in the texture detail visible meshes need this frame.
+	profiler.BeginCpuScope("Texture streaming");
+	renderer.textureStreamer.BeginFrame();
+	requestTextureMips(renderer.textureStreamer, renderer.model, packet.model, packet.view, packet.projection, packet.height);
+	renderer.textureStreamer.Update();
+	profiler.EndCpuScope();
+
+	// Render the shadow maps that need it before drawing the scene.
+	if (renderer.shaderCompiler.IsReady(renderer.shadowShaderHandle))
+	{
+		Shader depthShader = renderer.shaderCompiler.Get(renderer.shadowShaderHandle);
+		auto drawCasters = [&](const Shader& shader)
+		{
+			shader.setMat4("model", packet.model);
+			renderer.model.Draw(shader);
+		};
+
+		ProfileScope shadowScope("Shadow maps", true);
+		{
+			ProfileScope scope("Shadow cascades", true);
+			renderer.shadowMap.Update(packet.view, packet.fieldOfView, packet.aspect, 0.1f, scene.directionalLight.direction, depthShader, drawCasters);
+		}
+		{
+			ProfileScope scope("Shadow atlas", true);
+			renderer.shadowAtlas.Update(scene.pointLights, scene.spotLight, packet.cameraPosition, packet.fieldOfView, depthShader, drawCasters);
+		}
+	}
+
+	// The shadow passes leave the default framebuffer bound.
+	glBindFramebuffer(GL_FRAMEBUFFER, renderer.framebuffer);
+
+	// Clear the color and depth buffers from the previous frame.
+	glClearColor(scene.clearColor.x, scene.clearColor.y, scene.clearColor.z, scene.clearColor.w);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+	// Send transformation matrices and lights to shader. Send them every frame since they tend to change often.
+	profiler.BeginCpuScope("Uniform upload");
+	for (const Shader* shader : { &modelPackedShader, &modelShader })
+	{
+		shader->use();
+		setTransformUniforms(*shader, packet.model, packet.view, packet.projection);
+		setLightUniforms(*shader, scene, packet.view);
+		renderer.shadowMap.Bind(*shader, packet.view);
+		renderer.shadowAtlas.Bind(*shader, packet.view);
+	}
+	profiler.EndCpuScope();
+
+	// Draw our 3D model, with only the lights that can actually reach each mesh.
+	profiler.BeginCpuScope("Scene");
+	profiler.BeginGpuScope("Scene");
+	drawWithLightCulling(renderer.model, modelShader, modelPackedShader, scene, packet.model, packet.view, packet.projection, stats.lightCulling);
+	profiler.EndGpuScope();
+	profiler.EndCpuScope();
+
+	// Time both lighting kernels once they are available, if requested.
+	if (renderer.lightingBenchmarkRequested && renderer.shaderCompiler.AllReady())
+	{
+		Shader referenceShader = renderer.shaderCompiler.Get(renderer.referenceShaderHandle);
+		stats.lightingBenchmark = runLightingBenchmark(renderer.model, referenceShader, modelShader, scene, packet.model, packet.view, packet.projection);
+		renderer.lightingBenchmarkRequested = false;
+	}
+
+	renderer.textureManager.EndFrame();
+
+	// ImGui: Render
+	profiler.BeginCpuScope("UI render");
+	profiler.BeginGpuScope("UI render");
+	ImGui_ImplOpenGL3_RenderDrawData(&packet.ui.drawData);
+	profiler.EndGpuScope();
+	profiler.EndCpuScope();
+
+	if (gpuTimed)
+	{
+		glQueryCounter(renderer.gpuTimerQueries[gpuTimer][1], GL_TIMESTAMP);
+		renderer.gpuTimerPending[gpuTimer] = true;
+	}
+	stats.cpuTime = (float)((GetPreciseTime() - cpuStart) * 1e3);
+
+	// GLFW: swap buffers. Offscreen frames aren't presented, they are finished instead, so the timings cover the GPU
+	// work rather than how fast the driver queues it up.
+	profiler.BeginCpuScope("Swap");
+	if (renderer.framebuffer == 0) glfwSwapBuffers(renderer.window);
+	else glFinish();
+	profiler.EndCpuScope();
+
+	// Oldest first, so the newest available frame is the one reported.
+	for (int i = 1; i <= Renderer::gpuTimerFrames; i++)
+	{
+		const int timer = (gpuTimer + i) % Renderer::gpuTimerFrames;
+		if (!renderer.gpuTimerPending[timer]) continue;
+		GLint available = 0;
+		glGetQueryObjectiv(renderer.gpuTimerQueries[timer][1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(renderer.gpuTimerQueries[timer][0], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(renderer.gpuTimerQueries[timer][1], GL_QUERY_RESULT, &end);
+		stats.gpuTime = (float)((end - start) / 1e6);
+		renderer.gpuTimerPending[timer] = false;
+	}
+	renderer.gpuTimerFrame = (gpuTimer + 1) % Renderer::gpuTimerFrames;
+
+	// Latency ends when the frame is handed to the display, the compositor and the display itself add a constant.
+	const double presentTime = glfwGetTime();
+	const float frameTime = renderer.lastPresent > 0.0 ? (float)((presentTime - renderer.lastPresent) * 1e3) : 0.0f;
+	const float latency = (float)((presentTime - packet.inputTime) * 1e3);
+	renderer.lastPresent = presentTime;
+	renderer.frameTimes[renderer.presentCount % presentHistory] = frameTime;
+	renderer.latencies[renderer.presentCount % presentHistory] = latency;
+	renderer.presentCount++;
+	if (packet.settings.recordTimings)
+	{
+		renderer.recordedTimings.frameTimes.push_back(frameTime);
+		renderer.recordedTimings.latencies.push_back(latency);
+	}
+
+	// Everything the UI shows about the renderer.
+	const int presentCount = std::min(renderer.presentCount, presentHistory);
+	stats.frameTime = stats.latency = stats.maxLatency = 0.0f;
+	for (int i = 0; i < presentCount; i++)
+	{
+		stats.frameTime += renderer.frameTimes[i] / presentCount;
+		stats.latency += renderer.latencies[i] / presentCount;
+		stats.maxLatency = std::max(stats.maxLatency, renderer.latencies[i]);
+	}
+	stats.shadersReady = renderer.shaderCompiler.AllReady();
+	stats.shadersBatched = renderer.shaderCompiler.IsBatched();
+	stats.parallelShaderCompile = renderer.shaderCompiler.HasParallelCompile();
+	stats.shaderCompileTime = renderer.shaderCompiler.GetCompileTime();
+	for (int i = 0; i < CascadedShadowMap::maxCascades; i++)
+	{
+		RendererStats::Cascade& cascade = stats.cascades[i];
+		cascade.split = renderer.shadowMap.GetSplitDistance(i);
+		cascade.renderTime = renderer.shadowMap.GetRenderTime(i);
+		cascade.updates = renderer.shadowMap.GetUpdateCount(i);
+		cascade.updated = renderer.shadowMap.WasUpdated(i);
+	}
+	const ShadowAtlasAllocator& allocator = renderer.shadowAtlas.GetScheduler().GetAllocator();
+	stats.atlasUsage = (double)allocator.GetUsedArea() / ((long long)allocator.GetAtlasSize() * allocator.GetAtlasSize());
+	stats.renderedTiles = renderer.shadowAtlas.GetRenderedTileCount();
+	stats.atlasEvictions = renderer.shadowAtlas.GetScheduler().GetEvictionCount();
+	for (int i = 0; i <= NR_POINT_LIGHTS; i++) stats.tileSizes[i] = renderer.shadowAtlas.GetTileSize(i);
+	stats.streamedBytes = renderer.textureStreamer.GetResidentBytes();
+	stats.streamingBudgetBytes = renderer.textureStreamer.GetBudgetBytes();
+	stats.pendingLoads = renderer.textureStreamer.GetPendingLoadCount();
+	stats.uploads = renderer.textureStreamer.GetUploadCount();
+	stats.streamingEvictions = renderer.textureStreamer.GetEvictionCount();
+	stats.textureStats = renderer.textureManager.GetFrameStats();
+	if (packet.settings.wantStreamedTextures) stats.streamedTextures = renderer.textureStreamer.GetTextureInfo();
+	else stats.streamedTextures.clear();
+	if (packet.settings.wantTextures) stats.textures = renderer.textureManager.GetTextureInfo();
+	else stats.textures.clear();
+
+	profiler.RecordCounter("Draw calls", Mesh::GetDrawCalls());
+	profiler.RecordCounter("Triangles", (double)Mesh::GetTriangles());
+	profiler.RecordCounter("Texture bytes", (double)stats.textureStats.residentBytes);
+	profiler.RecordCounter("Streamed texture bytes", (double)stats.streamedBytes);
+	profiler.RecordCounter("Render CPU ms", stats.cpuTime);
+	profiler.RecordCounter("Render GPU ms", stats.gpuTime);
+
+	std::lock_guard<std::mutex> lock(renderer.statsMutex);
+	renderer.publishedStats = stats;
+}
+
+void runRenderThread(Renderer& renderer, FramePipeline<FramePacket>& pipeline)
+{
+	glfwMakeContextCurrent(renderer.window);
+	JobSystem::Get().SetMainThread();
+
+	// Frames start when their packet arrives, the profiler's frame is the one being rendered.
+	Profiler& profiler = Profiler::Get();
+	profiler.SetThreadName("Render");
+	while (FramePacket* packet = pipeline.BeginRead())
+	{
+		FrameArena::Get().Reset();
+		profiler.BeginFrame();
+		renderFrame(renderer, *packet);
+		pipeline.EndRead();
+	}
+
+	// Leave the context for the main thread to take back.
+	glfwMakeContextCurrent(nullptr);
+}
+
+void reportPipelineBenchmark(const PresentTimings& singleThreaded, const PresentTimings& renderThread)
+{
+	auto average = [](const std::vector<float>& values)
+	{
+		double sum = 0.0;
+		for (float value : values) sum += value;
+		return values.empty() ? 0.0 : sum / values.size();
+	};
+	auto percentile99 = [](std::vector<float> values)
+	{
+		if (values.empty()) return 0.0f;
+		std::sort(values.begin(), values.end());
+		return values[(values.size() - 1) * 99 / 100];
+	};
+
+	std::cout << "Frame pipeline, " << singleThreaded.frameTimes.size() << " frames per mode, vsync off\n";
+	const char* names[] = { "Single-threaded", "Render thread" };
+	const PresentTimings* timings[] = { &singleThreaded, &renderThread };
+	for (int mode = 0; mode < 2; mode++)
+	{
+		char line[256];
+		snprintf(line, sizeof(line), "%-16s frame %6.2f ms avg, %6.2f ms p99   input to present %6.2f ms avg, %6.2f ms p99",
+			names[mode], average(timings[mode]->frameTimes), percentile99(timings[mode]->frameTimes),
+			average(timings[mode]->latencies), percentile99(timings[mode]->latencies));
+		std::cout << line << "\n";
+	}
+}
+
+void reportFrameTimes(const char* run, const PresentTimings& timings)
+{
+	if (timings.frameTimes.empty())
+	{
+		std::cout << run << " ended before any frame was measured\n";
+		return;
+	}
+
+	const FrameTimeStats stats = ComputeFrameTimeStats(timings.frameTimes);
+	char line[256];
+	snprintf(line, sizeof(line), "%s, %d frames at %dx%d: %.2f ms mean (%.1f FPS), p50 %.2f, p95 %.2f, p99 %.2f, worst %.2f ms",
+		run, stats.frames, windowWidth, windowHeight, stats.mean, 1000.0 / stats.mean, stats.p50, stats.p95, stats.p99, stats.worst);
+	std::cout << line << "\n";
+}
+
+void reportPacingBenchmark(const FrameTimingSummary results[], bool adaptiveVsyncSupported)
+{
+	std::cout << "Frame pacing, " << results[0].frames << " frames per mode\n";
+	for (int mode = 0; mode < pacingModeCount; mode++)
+	{
+		const FrameTimingSummary& result = results[mode];
+		char line[256];
+		snprintf(line, sizeof(line), "%-16s frame %6.2f ms avg, %6.2f ms max, jitter %6.3f ms   CPU %5.1f%% of a core",
+			pacingModes[mode].name, result.averageFrameTime, result.maxFrameTime, result.jitter, 100.0 * result.cpuUsage);
+		std::cout << line << "\n";
+	}
+	if (!adaptiveVsyncSupported) std::cout << "Adaptive vsync isn't supported here, it ran as regular vsync\n";
+}
+
+int runRegressionTests(Renderer& renderer, const RendererSettings& settings, const char* scriptPath, bool updateGolden, bool updateBaselines)
+{
+	namespace fs = std::filesystem;
+
+	RegressionScript script;
+	std::string error;
+	if (!script.Load(scriptPath, error))
+	{
+		std::cout << "Regression script " << error << "\n";
+		return 1;
+	}
+
+	// Golden images and baselines live next to the script. What failing scenes rendered goes to output/ there.
+	const fs::path directory = fs::path(scriptPath).parent_path();
+	const fs::path goldenDirectory = directory / "golden";
+	const fs::path outputDirectory = directory / "output";
+	const fs::path baselinesPath = directory / "baselines.csv";
+	std::error_code ignored;
+	fs::create_directories(goldenDirectory, ignored);
+	fs::create_directories(outputDirectory, ignored);
+	std::map<std::string, TimingBaseline> baselines;
+	LoadTimingBaselines(baselinesPath.string(), baselines);
+	bool baselinesChanged = false;
+
+	RenderTarget target(script.width, script.height);
+	if (!target.IsComplete())
+	{
+		std::cout << "Failed to create the " << script.width << "x" << script.height << " framebuffer\n";
+		return 1;
+	}
+	const unsigned int windowFramebuffer = renderer.framebuffer;
+	renderer.framebuffer = target.GetFramebuffer();
+
+	FramePacket packet;
+	packet.width = script.width;
+	packet.height = script.height;
+	packet.aspect = (float)script.width / (float)script.height;
+	auto render = [&]()
+	{
+		FrameArena::Get().Reset();
+		Profiler::Get().BeginFrame();
+		packet.inputTime = glfwGetTime();
+		renderFrame(renderer, packet);
+		packet.frame++;
+		packet.settings.invalidateCachedCascades = false;
+		packet.settings.invalidateCasters = false;
+	};
+
+	std::ofstream report((outputDirectory / "report.csv").string());
+	report << "scene,different_pixels,max_delta_e,cpu_ms,cpu_baseline_ms,gpu_ms,gpu_baseline_ms,result\n";
+	std::cout << "Regression run of " << script.scenes.size() << " scenes at " << script.width << "x" << script.height << "\n";
+	int failures = 0;
+	for (const RegressionScene& regressionScene : script.scenes)
+	{
+		// Set up the view like the frame loop does, with the spot light on the camera.
+		Camera view = Camera(regressionScene.position);
+		view.SetOrientation(regressionScene.yaw, regressionScene.pitch);
+		spotLight.position = view.Position;
+		spotLight.direction = view.Front;
+		updateLightRadii();
+
+		packet.fieldOfView = glm::radians(regressionScene.zoom);
+		packet.view = view.GetViewMatrix();
+		packet.projection = glm::perspective(packet.fieldOfView, packet.aspect, 0.1f, 100.0f);
+		packet.model = glm::mat4(1.0f);
+		packet.cameraPosition = view.Position;
+		packet.scene = captureScene();
+		packet.scene.lightCulling = regressionScene.lightCulling;
+		packet.scene.wireframe = regressionScene.wireframe;
+		packet.settings = settings;
+		packet.settings.shadowsEnabled = regressionScene.shadows;
+		packet.settings.atlasEnabled = regressionScene.atlas;
+		packet.settings.vsync = VsyncMode::Off;
+		// The camera jumped, so nothing cached for the last scene's view carries over. One-shot requests stay out.
+		packet.settings.invalidateCachedCascades = true;
+		packet.settings.invalidateCasters = true;
+		packet.settings.reloadAllTextures = false;
+		packet.settings.reloadTextures.clear();
+		packet.settings.runLightingBenchmark = false;
+
+		// Warm up until the real shaders are in and the textures this view needs have streamed in.
+		const int maxWarmupFrames = 1000;
+		for (int frame = 0; frame < maxWarmupFrames; frame++)
+		{
+			render();
+			const RendererStats& stats = renderer.stats;
+			if (frame >= script.warmupFrames && stats.shadersReady && stats.pendingLoads == 0 && stats.uploads == 0) break;
+		}
+
+		std::vector<float> cpuTimes, gpuTimes;
+		for (int frame = 0; frame < script.measuredFrames; frame++)
+		{
+			render();
+			cpuTimes.push_back(renderer.stats.cpuTime);
+			gpuTimes.push_back(renderer.stats.gpuTime);
+		}
+		const double cpuTime = ComputeFrameTimeStats(cpuTimes).p50;
+		const double gpuTime = ComputeFrameTimeStats(gpuTimes).p50;
+
+		// Compare the last frame with the golden image, or make it the golden image.
+		bool passed = true;
+		std::string imageResult;
+		ImageComparison comparison;
+		const std::vector<unsigned char> pixels = target.ReadPixels();
+		const std::string goldenPath = (goldenDirectory / (regressionScene.name + ".png")).string();
+		std::vector<unsigned char> golden;
+		int goldenWidth = 0, goldenHeight = 0;
+		if (updateGolden || !ReadGoldenImage(goldenPath, golden, goldenWidth, goldenHeight))
+		{
+			imageResult = writePNG(goldenPath.c_str(), pixels.data(), script.width, script.height, 3) ? "new golden image" : "failed to write golden image";
+		}
+		else if (goldenWidth != script.width || goldenHeight != script.height)
+		{
+			imageResult = "golden image is " + std::to_string(goldenWidth) + "x" + std::to_string(goldenHeight);
+			passed = false;
+		}
+		else
+		{
+			comparison = CompareImages(pixels.data(), golden.data(), script.width, script.height, script.colorTolerance);
+			char text[128];
+			snprintf(text, sizeof(text), "%.3f%% of pixels differ, max dE %.1f", 100.0f * comparison.differentFraction, comparison.maxDifference);
+			imageResult = text;
+			if (comparison.differentFraction > script.maxDifferentPixels)
 			{
-				ImGui::SliderFloat("Shininess", &material.shininess, 0.1, 64.0);
-				ImGui::SliderFloat("Emissive Strength", &material.emissiveStrength, 0.0, 1.0);
-				
-				ImGui::TreePop();
+				passed = false;
+				const fs::path actualPath = outputDirectory / (regressionScene.name + ".png");
+				const fs::path diffPath = outputDirectory / (regressionScene.name + ".diff.png");
+				writePNG(actualPath.string().c_str(), pixels.data(), script.width, script.height, 3);
+				writePNG(diffPath.string().c_str(), comparison.diffImage.data(), script.width, script.height, 3);
+				imageResult += ", see " + diffPath.string();
 			}
+		}
 
-			if (ImGui::TreeNode("Directional Light"))
-			{
-				ImGui::SliderFloat3("Direction", (float*)&directionalLight.direction, -1.0f, 1.0f);
-				ImGui::ColorEdit3("Color", (float*)&directionalLight.color);
+		// Compare the median frame costs with the baseline, with a relative threshold and an absolute slack.
+		auto baseline = baselines.find(regressionScene.name);
+		const bool hasBaseline = baseline != baselines.end() && !updateBaselines;
+		const TimingBaseline reference = hasBaseline ? baseline->second : TimingBaseline{ cpuTime, gpuTime };
+		auto withinBudget = [&](double time, double baselineTime, float threshold)
+		{
+			return time <= std::max(baselineTime * (1.0 + threshold), baselineTime + script.minSlack);
+		};
+		const bool cpuPassed = !hasBaseline || withinBudget(cpuTime, reference.cpuTime, script.cpuThreshold);
+		const bool gpuPassed = !hasBaseline || withinBudget(gpuTime, reference.gpuTime, script.gpuThreshold);
+		passed = passed && cpuPassed && gpuPassed;
+		if (!hasBaseline)
+		{
+			baselines[regressionScene.name] = reference;
+			baselinesChanged = true;
+		}
 
-				ImGui::TreePop();
-			}
+		if (!passed) failures++;
+		char line[512];
+		snprintf(line, sizeof(line), "%-4s %-20s image: %s\n     cpu %.3f ms (baseline %.3f)%s, gpu %.3f ms (baseline %.3f)%s%s",
+			passed ? "ok" : "FAIL", regressionScene.name.c_str(), imageResult.c_str(), cpuTime, reference.cpuTime, cpuPassed ? "" : " OVER BUDGET",
+			gpuTime, reference.gpuTime, gpuPassed ? "" : " OVER BUDGET", hasBaseline ? "" : ", new baseline");
+		std::cout << line << "\n";
+		snprintf(line, sizeof(line), "%s,%d,%.2f,%.4f,%.4f,%.4f,%.4f,%s\n", regressionScene.name.c_str(), comparison.differentPixels,
+			comparison.maxDifference, cpuTime, reference.cpuTime, gpuTime, reference.gpuTime, passed ? "pass" : "fail");
+		report << line;
+	}
 
-			if (ImGui::TreeNode("Point Lights"))
+	renderer.framebuffer = windowFramebuffer;
+	if (baselinesChanged && !SaveTimingBaselines(baselinesPath.string(), baselines))
+	{
+		std::cout << "Failed to write " << baselinesPath.string() << "\n";
+		failures++;
+	}
+	std::cout << failures << " of " << script.scenes.size() << " scenes failed, report in " << (outputDirectory / "report.csv").string() << "\n";
+	return failures > 0 ? 1 : 0;
+}
+
+void stepSimulation(GLFWwindow* window, FramePacing& pacing)
+{
+	if (fixedTimestep)
+	{
+		const double step = 1.0 / simulationRate;
+		pacing.simulationTime += std::min((double)deltaTime, maxSimulationLag);
+		pacing.simulationSteps = 0;
+		while (pacing.simulationTime >= step)
+		{
+			pacing.previousCameraPosition = camera.Position;
+			moveCamera(window, (float)step);
+			pacing.simulationTime -= step;
+			pacing.simulationSteps++;
+		}
+		pacing.interpolation = (float)(pacing.simulationTime / step);
+	}
+	else
+	{
+		moveCamera(window, deltaTime);
+		pacing.previousCameraPosition = camera.Position;
+		pacing.simulationSteps = 1;
+		pacing.interpolation = 1.0f;
+	}
+}
+
+void buildSettingsWindow(RendererSettings& settings, const RendererStats& stats, bool adaptiveVsyncSupported, bool& useRenderThread,
+	FramePacing& pacing)
+{
+	// Construct my own very awesome debug window.
+	ImGui::Begin("Scene Settings");
+	if (ImGui::Button("Toggle Wireframe"))
+	{
+		wireframe = !wireframe;
+	}
+
+	if (ImGui::CollapsingHeader("Scene Colors"))
+	{
+		ImGui::ColorEdit4("Background Color", (float*)&clearColor);
+
+		ImGui::SliderFloat("Ambient Multiplier", &ambientMultiplier, 0.0f, 1.0f);
+		ImGui::SliderFloat("Diffuse Multiplier", &diffuseMultiplier, 0.0f, 1.0f);
+		ImGui::SliderFloat("Specular Multiplier", &specularMultiplier, 0.0f, 1.0f);
+	
+		if (ImGui::TreeNode("Material"))
+		{
+			ImGui::SliderFloat("Shininess", &material.shininess, 0.1, 64.0);
+			ImGui::SliderFloat("Emissive Strength", &material.emissiveStrength, 0.0, 1.0);
+		
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Directional Light"))
+		{
+			// Cached shadow cascades notice direction changes by themselves.
+			ImGui::SliderFloat3("Direction", (float*)&directionalLight.direction, -1.0f, 1.0f);
+			ImGui::ColorEdit3("Color", (float*)&directionalLight.color);
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Point Lights"))
+		{
+			for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
 			{
-				for (unsigned int i = 0; i < NR_POINT_LIGHTS; i++)
+				if (ImGui::TreeNode(FrameArena::Get().Format("Point Light #%u", i + 1)))
 				{
-					std::ostringstream ss;
-					ss << "Point Light #" << i + 1;
-
-					if (ImGui::TreeNode(ss.str().c_str()))
-					{
-						ImGui::SliderFloat3("Position", (float*)&pointLights[i].position, -20.0f, 20.0f);
-						ImGui::ColorEdit3("Color", (float*)&pointLights[i].color);
-						ImGui::SliderFloat("Linear Falloff", &pointLights[i].linear, 0.0f, 0.5f);
-						ImGui::SliderFloat("Quadratic Falloff", &pointLights[i].quadratic, 0.0f, 0.5f);
-
-						ImGui::TreePop();
-					}
+					ImGui::SliderFloat3("Position", (float*)&pointLights[i].position, -20.0f, 20.0f);
+					ImGui::ColorEdit3("Color", (float*)&pointLights[i].color);
+					ImGui::SliderFloat("Linear Falloff", &pointLights[i].linear, 0.0f, 0.5f);
+					ImGui::SliderFloat("Quadratic Falloff", &pointLights[i].quadratic, 0.0f, 0.5f);
+					ImGui::Checkbox("Cast Shadows", &pointLights[i].castShadows);
+
+					ImGui::TreePop();
 				}
+			}
+
+			ImGui::TreePop();
+		}
+
+		if (ImGui::TreeNode("Spot Light"))
+		{
+			ImGui::ColorEdit3("Color", (float*)&spotLight.color);
+			ImGui::SliderFloat("Inner Cone Angle", &spotLight.cutOff, 1.0f, 89.0f);
+			ImGui::SliderFloat("Outer Cone Angle", &spotLight.outerCutOff, 1.0f, 89.0f);
+			ImGui::SliderFloat("Linear Falloff", &spotLight.linear, 0.0f, 1.0f);
+			ImGui::SliderFloat("Quadratic Falloff", &spotLight.quadratic, 0.0f, 1.0f);
+			ImGui::Checkbox("Cast Shadows", &spotLight.castShadows);
+
+			ImGui::TreePop();
+		}
+	}
+	ImGui::Text("%.2f FPS / %.2f ms", 1.0f / deltaTime, deltaTime * 1000.0f);
+	const FrameArena::FrameStats& arenaStats = FrameArena::Get().GetLastFrameStats();
+	ImGui::Text("Heap allocations: %lld / frame, arena: %d (%zu bytes)", arenaStats.heapAllocations, arenaStats.allocations, arenaStats.bytes);
+	if (stats.shadersReady)
+	{
+		ImGui::Text("Shader compile (%s%s): %.2f ms", stats.shadersBatched ? "batched" : "serial",
+			stats.parallelShaderCompile ? ", parallel" : "", stats.shaderCompileTime);
+	}
+	else
+	{
+		ImGui::Text("Compiling shaders...");
+	}
+
+	if (ImGui::CollapsingHeader("Frame Pipeline"))
+	{
+		ImGui::Checkbox("Render Thread", &useRenderThread);
+		ImGui::Text("Frame time: %.2f ms", stats.frameTime);
+		ImGui::Text("Render CPU: %.2f ms, GPU: %.2f ms", stats.cpuTime, stats.gpuTime);
+		ImGui::Text("Input to present: %.2f ms (max %.2f ms)", stats.latency, stats.maxLatency);
+	}
+
+	if (ImGui::CollapsingHeader("Frame Pacing"))
+	{
+		ImGui::Checkbox("Fixed Timestep", &fixedTimestep);
+		ImGui::SliderInt("Simulation Rate (Hz)", &simulationRate, 10, 240);
+		ImGui::SliderInt("Frame Limit (FPS)", &pacing.frameLimit, 0, 360, pacing.frameLimit > 0 ? "%d" : "Off");
+		const char* vsyncModes[] = { "Off", "On", "Adaptive" };
+		int vsync = (int)settings.vsync;
+		if (ImGui::Combo("Vsync", &vsync, vsyncModes, 3)) settings.vsync = (VsyncMode)vsync;
+		if (settings.vsync == VsyncMode::Adaptive && !adaptiveVsyncSupported)
+		{
+			ImGui::Text("Adaptive vsync isn't supported, using regular vsync");
+		}
+
+		ImGui::Text("Simulation steps this frame: %d, interpolation %.2f", pacing.simulationSteps, pacing.interpolation);
+		ImGui::Text("Frame time: %.2f ms avg, %.2f ms max", pacing.summary.averageFrameTime, pacing.summary.maxFrameTime);
+		ImGui::Text("Jitter: %.3f ms", pacing.summary.jitter);
+		ImGui::Text("CPU usage: %.0f%% of a core", 100.0 * pacing.summary.cpuUsage);
+		if (pacing.frameLimit > 0)
+		{
+			ImGui::Text("Limiter: slept %.2f ms, spun %.3f ms (threshold %.3f ms)", pacing.limiter.GetLastSleep() * 1e3,
+				pacing.limiter.GetLastSpin() * 1e3, pacing.limiter.GetSpinThreshold() * 1e3);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Light Culling"))
+	{
+		ImGui::Checkbox("Enabled", &lightCulling);
+		ImGui::SliderFloat("Cutoff Threshold", &lightCutoff, 0.5f / 256.0f, 16.0f / 256.0f, "%.4f");
+		for (int i = 0; i < NR_POINT_LIGHTS; i++)
+		{
+			ImGui::Text("Point Light #%d radius: %.2f", i + 1, pointLights[i].radius);
+		}
+		ImGui::Text("Spot Light radius: %.2f", spotLight.radius);
+		ImGui::Text("Visible point lights: %d / %d", stats.lightCulling.visiblePointLights, NR_POINT_LIGHTS);
+		ImGui::Text("Meshes drawn: %d, culled: %d", stats.lightCulling.meshesDrawn, stats.lightCulling.meshesCulled);
+		if (stats.lightCulling.meshesDrawn > 0)
+		{
+			ImGui::Text("Point lights per draw: %.2f", (float)stats.lightCulling.pointLightsUploaded / stats.lightCulling.meshesDrawn);
+		}
+	}
+
+	if (ImGui::CollapsingHeader("Shadows"))
+	{
+		ImGui::Checkbox("Enabled", &settings.shadowsEnabled);
+		ImGui::SliderInt("Cascades", &settings.cascadeCount, 1, CascadedShadowMap::maxCascades);
+
+		const int resolutions[] = { 512, 1024, 2048, 4096 };
+		const char* resolutionNames[] = { "512", "1024", "2048", "4096" };
+		int resolutionIndex = 0;
+		while (resolutionIndex < 3 && resolutions[resolutionIndex] < settings.shadowResolution) resolutionIndex++;
+		if (ImGui::Combo("Resolution", &resolutionIndex, resolutionNames, 4))
+		{
+			settings.shadowResolution = resolutions[resolutionIndex];
+		}
+
+		ImGui::SliderFloat("Shadow Distance", &settings.shadowDistance, 5.0f, 100.0f);
+		ImGui::SliderFloat("Split Lambda", &settings.splitLambda, 0.0f, 1.0f);
+		ImGui::SliderInt("First Cached Cascade", &settings.firstCachedCascade, 0, CascadedShadowMap::maxCascades);
+		ImGui::SliderInt("Cached Update Interval", &settings.cachedUpdateInterval, 0, 120);
+		ImGui::SliderFloat("Cache Margin", &settings.cacheMargin, 1.0f, 2.0f);
+		if (ImGui::Button("Invalidate Cached Cascades")) settings.invalidateCachedCascades = true;
 
-				ImGui::TreePop();
+		if (ImGui::BeginTable("Cascades", 5))
+		{
+			ImGui::TableSetupColumn("#");
+			ImGui::TableSetupColumn("Split");
+			ImGui::TableSetupColumn("GPU ms");
+			ImGui::TableSetupColumn("Updates");
+			ImGui::TableSetupColumn("This Frame");
+			ImGui::TableHeadersRow();
+			for (int i = 0; i < settings.cascadeCount; i++)
+			{
+				const RendererStats::Cascade& cascade = stats.cascades[i];
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::Text("%d%s", i, i >= settings.firstCachedCascade ? " (cached)" : "");
+				ImGui::TableNextColumn(); ImGui::Text("%.1f", cascade.split);
+				ImGui::TableNextColumn(); ImGui::Text("%.3f", cascade.renderTime);
+				ImGui::TableNextColumn(); ImGui::Text("%d", cascade.updates);
+				ImGui::TableNextColumn(); ImGui::Text(cascade.updated ? "rendered" : "-");
 			}
+			ImGui::EndTable();
+		}
 
-			if (ImGui::TreeNode("Spot Light"))
+		if (ImGui::TreeNode("Shadow Atlas"))
+		{
+			ImGui::Checkbox("Enabled", &settings.atlasEnabled);
+			ImGui::SliderFloat("Shadow Range", &settings.shadowRange, 1.0f, 50.0f);
+			ImGui::SliderFloat("Depth Bias", &settings.depthBias, 0.0f, 0.01f, "%.5f");
+			if (ImGui::Button("Invalidate Casters")) settings.invalidateCasters = true;
+			ImGui::Text("Atlas usage: %.1f%%", 100.0 * stats.atlasUsage);
+			ImGui::Text("Tiles rendered this frame: %d", stats.renderedTiles);
+			ImGui::Text("Evictions: %d", stats.atlasEvictions);
+			for (int i = 0; i < NR_POINT_LIGHTS; i++)
 			{
-				ImGui::ColorEdit3("Color", (float*)&spotLight.color);
-				ImGui::SliderFloat("Inner Cone Angle", &spotLight.cutOff, 1.0f, 89.0f);
-				ImGui::SliderFloat("Outer Cone Angle", &spotLight.outerCutOff, 1.0f, 89.0f);
-				ImGui::SliderFloat("Linear Falloff", &spotLight.linear, 0.0f, 1.0f);
-				ImGui::SliderFloat("Quadratic Falloff", &spotLight.quadratic, 0.0f, 1.0f);
+				ImGui::Text("Point Light #%d: %d px", i + 1, stats.tileSizes[i]);
+			}
+			ImGui::Text("Spot Light: %d px", stats.tileSizes[NR_POINT_LIGHTS]);
 
-				ImGui::TreePop();
+			ImGui::TreePop();
+		}
+	}
+
+	settings.wantStreamedTextures = ImGui::CollapsingHeader("Texture Streaming");
+	if (settings.wantStreamedTextures)
+	{
+		ImGui::Checkbox("Enabled", &settings.streamingEnabled);
+		ImGui::SliderInt("Budget (MB)", &settings.streamingBudgetMegabytes, 1, 512);
+		ImGui::SliderFloat("Mip Bias", &settings.mipBias, -2.0f, 4.0f);
+		ImGui::SliderInt("Uploads / Frame", &settings.maxUploadsPerFrame, 1, 16);
+
+		float usage = (float)stats.streamedBytes / stats.streamingBudgetBytes;
+		char overlay[64];
+		snprintf(overlay, sizeof(overlay), "%.1f / %d MB", stats.streamedBytes / 1048576.0, settings.streamingBudgetMegabytes);
+		ImGui::ProgressBar(usage, ImVec2(-1.0f, 0.0f), overlay);
+		ImGui::Text("Pending loads: %d", stats.pendingLoads);
+		ImGui::Text("Uploads this frame: %d", stats.uploads);
+		ImGui::Text("Evictions: %d", stats.streamingEvictions);
+
+		if (ImGui::BeginTable("Residency", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+		{
+			ImGui::TableSetupColumn("Texture");
+			ImGui::TableSetupColumn("Resident");
+			ImGui::TableSetupColumn("Needed");
+			ImGui::TableSetupColumn("MB");
+			ImGui::TableHeadersRow();
+			for (const TextureStreamer::TextureInfo& texture : stats.streamedTextures)
+			{
+				std::string name = texture.path.substr(texture.path.find_last_of("\\/") + 1);
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::Text("%s", name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%dx%d%s", std::max(texture.width >> texture.residentLevel, 1),
+					std::max(texture.height >> texture.residentLevel, 1), texture.loading ? " (loading)" : "");
+				ImGui::TableNextColumn(); ImGui::Text("%dx%d", std::max(texture.width >> texture.neededLevel, 1), std::max(texture.height >> texture.neededLevel, 1));
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", texture.residentBytes / 1048576.0);
 			}
+			ImGui::EndTable();
 		}
-		char* frameTime = new char[32];
-		sprintf_s(frameTime, 32, "%.2f FPS / %.2f ms", 1.0f / deltaTime, deltaTime * 1000.0f);
-		ImGui::Text(frameTime);
-		ImGui::End();
-
-		// Rendering
-		// Clear the color and depth buffers from the previous frame.
-		glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-
-		// Defining view matrices (model, view, projection) to transform vertices to NDC.
-		glm::mat4 view = camera.GetViewMatrix();
-		glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)windowWidth / (float)windowHeight, 0.1f, 100.0f);
-		glm::mat4 model = glm::mat4(1.0f);
-
-		// Send transformation matrices to shader. Send them every frame since they tend to change often.
-		modelShader.use();
-		modelShader.setMat4("model", model);
-		modelShader.setMat4("view", view);
-		modelShader.setMat4("projection", projection);
-
-		// Send material and lighting information to shader.
-		modelShader.setFloat("material.shininess", material.shininess);
-
-		// Directional Light attributes.
-		modelShader.setVec3("directionalLight.direction", directionalLight.direction);
-		modelShader.setVec3("directionalLight.ambient", directionalLight.color * ambientMultiplier);
-		modelShader.setVec3("directionalLight.diffuse", directionalLight.color * diffuseMultiplier);
-		modelShader.setVec3("directionalLight.specular", directionalLight.color * specularMultiplier);
-
-		// Point Light attributes.
-		for (int i = 0; i < NR_POINT_LIGHTS; i++)
+	}
+
+	settings.wantTextures = ImGui::CollapsingHeader("Texture Memory");
+	if (settings.wantTextures)
+	{
+		const TextureManager::FrameStats& textureStats = stats.textureStats;
+		ImGui::Checkbox("Evict Unused Textures", &settings.evictionEnabled);
+		ImGui::SliderInt("Budget (MB)##TextureMemory", &settings.textureBudgetMegabytes, 1, 1024);
+		ImGui::SliderInt("Evict After (frames)", &settings.evictAfterFrames, 1, 600);
+		if (ImGui::Button("Reload All")) settings.reloadAllTextures = true;
+
+		ImGui::Text("Resident: %.2f MB in %d textures", textureStats.residentBytes / 1048576.0, textureStats.residentTextures);
+		ImGui::Text("Evictions: %d, reloads: %d (last frame)", textureStats.evictions, textureStats.reloads);
+
+		if (ImGui::BeginTable("Textures", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
 		{
-			std::string index = std::to_string(i);
-			
-			modelShader.setVec3("pointLights[" + index + "].position", pointLights[i].position);
-			modelShader.setVec3("pointLights[" + index + "].ambient", pointLights[i].color * ambientMultiplier);
-			modelShader.setVec3("pointLights[" + index + "].diffuse", pointLights[i].color * diffuseMultiplier);
-			modelShader.setVec3("pointLights[" + index + "].specular", pointLights[i].color * specularMultiplier);
-			modelShader.setFloat("pointLights[" + index + "].constant", pointLights[i].constant);
-			modelShader.setFloat("pointLights[" + index + "].linear", pointLights[i].linear);
-			modelShader.setFloat("pointLights[" + index + "].quadratic", pointLights[i].quadratic);
-		}
-
-		// Spotlight attributes.
-		spotLight.position = camera.Position;
-		spotLight.direction = camera.Front;
-		modelShader.setVec3("spotLight.position", spotLight.position);
-		modelShader.setVec3("spotLight.direction", spotLight.direction);
-		modelShader.setVec3("spotLight.ambient", spotLight.color * ambientMultiplier);
-		modelShader.setVec3("spotLight.diffuse", spotLight.color * diffuseMultiplier);
-		modelShader.setVec3("spotLight.specular", spotLight.color * specularMultiplier);
-		modelShader.setFloat("spotLight.constant", spotLight.constant);
-		modelShader.setFloat("spotLight.linear", spotLight.linear);
-		modelShader.setFloat("spotLight.quadratic", spotLight.quadratic);
-		modelShader.setFloat("spotLight.cutOff", glm::cos(glm::radians(spotLight.cutOff)));
-		modelShader.setFloat("spotLight.outerCutOff", glm::cos(glm::radians(spotLight.outerCutOff)));
-
-		// Draw our 3D model!
-		backpack.Draw(modelShader);
-
-		// ImGui: Render
-		ImGui::Render();
-		ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
-
-		// GLFW: swap buffers and poll input events.
-		glfwSwapBuffers(window);
-		glfwPollEvents();
+			ImGui::TableSetupColumn("Texture");
+			ImGui::TableSetupColumn("Size");
+			ImGui::TableSetupColumn("MB");
+			ImGui::TableSetupColumn("State");
+			ImGui::TableSetupColumn("");
+			ImGui::TableHeadersRow();
+			for (const TextureManager::TextureInfo& texture : stats.textures)
+			{
+				std::string name = texture.path.substr(texture.path.find_last_of("\\/") + 1);
+				ImGui::TableNextRow();
+				ImGui::TableNextColumn(); ImGui::Text("%s", name.c_str());
+				ImGui::TableNextColumn(); ImGui::Text("%dx%d, %d mips", texture.width, texture.height, texture.levelCount);
+				ImGui::TableNextColumn(); ImGui::Text("%.2f", texture.bytes / 1048576.0);
+				ImGui::TableNextColumn(); ImGui::Text(texture.streamed ? "streamed" : texture.resident ? "resident" : "evicted");
+				ImGui::TableNextColumn();
+				if (!texture.streamed)
+				{
+					ImGui::PushID((int)texture.id);
+					if (ImGui::SmallButton("Reload")) settings.reloadTextures.push_back(texture.id);
+					ImGui::PopID();
+				}
+			}
+			ImGui::EndTable();
+		}
 	}
 
-	// Shut down Dear ImGui.
-	ImGui_ImplOpenGL3_Shutdown();
-	ImGui_ImplGlfw_Shutdown();
-	ImGui::DestroyContext();
+	if (ImGui::CollapsingHeader("Lighting Benchmark"))
+	{
+		if (ImGui::Button("Run Benchmark")) settings.runLightingBenchmark = true;
 
-	glfwTerminate();
-	return 0;
+		const LightingBenchmark& lightingBenchmark = stats.lightingBenchmark;
+		if (lightingBenchmark.draws > 0)
+		{
+			ImGui::Text("%d draws per kernel", lightingBenchmark.draws);
+			ImGui::Text("Reference: %.3f ms / draw", lightingBenchmark.referenceTime);
+			ImGui::Text("Optimized: %.3f ms / draw", lightingBenchmark.optimizedTime);
+			ImGui::Text("Speedup: %.2fx", lightingBenchmark.referenceTime / lightingBenchmark.optimizedTime);
+			ImGui::Text("Texture fetches / fragment: %d -> %d", referenceTextureFetches, optimizedTextureFetches);
+			ImGui::Text("Matrix transforms / fragment: %d -> %d", referenceFragmentTransforms, 0);
+			ImGui::Text("Matrix inversions / vertex: 1 -> 0");
+		}
+	}
+	ImGui::End();
+}
+
+bool advanceHeadlessRun(HeadlessRun& run, const RendererStats& stats, RendererSettings& settings)
+{
+	if (stats.shadersReady) run.frame++;
+	settings.recordTimings = run.frame >= HeadlessRun::warmupFrames;
+	return run.frame >= HeadlessRun::warmupFrames + run.frames;
+}
+
+bool advanceReplay(Replay& replay, size_t pathFrames, const RendererStats& stats, RendererSettings& settings)
+{
+	// Every frame the replay plays is recorded.
+	if (replay.started) replay.frame++;
+	else replay.started = stats.shadersReady;
+	settings.recordTimings = replay.started;
+	return replay.frame >= pathFrames;
+}
+
+bool advancePacingBenchmark(PacingBenchmark& benchmark, FramePacing& pacing, RendererSettings& settings, bool adaptiveVsyncSupported)
+{
+	// Switch pacing modes, and measure each once it has settled.
+	const int phaseFrames = PacingBenchmark::warmupFrames + PacingBenchmark::measuredFrames;
+	const int mode = benchmark.frame / phaseFrames;
+	const int phaseFrame = benchmark.frame++ % phaseFrames;
+	if (phaseFrame == 0)
+	{
+		pacing.frameLimit = pacingModes[mode].frameLimit;
+		settings.vsync = pacingModes[mode].vsync;
+	}
+	if (phaseFrame == PacingBenchmark::warmupFrames) benchmark.timer.Take();
+	if (phaseFrame == phaseFrames - 1)
+	{
+		benchmark.results[mode] = benchmark.timer.Take();
+		if (mode == pacingModeCount - 1)
+		{
+			reportPacingBenchmark(benchmark.results, adaptiveVsyncSupported);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool advancePipelineBenchmark(PipelineBenchmark& benchmark, Renderer& renderer, RendererSettings& settings, bool& useRenderThread,
+	const std::function<void()>& stopRenderThread)
+{
+	// Switch modes and collect the present timings of each once it has run long enough.
+	const int phaseFrames = PipelineBenchmark::warmupFrames + PipelineBenchmark::measuredFrames;
+	const int mode = benchmark.frame / phaseFrames;
+	const int phaseFrame = benchmark.frame++ % phaseFrames;
+	useRenderThread = mode == 1;
+	// The last frame of a phase isn't recorded, it may be the one that waits for the render thread to stop.
+	settings.recordTimings = phaseFrame >= PipelineBenchmark::warmupFrames && phaseFrame < phaseFrames - 1;
+	if (phaseFrame == phaseFrames - 1)
+	{
+		// The timings are the renderer's, stop it before taking them.
+		stopRenderThread();
+		benchmark.results[mode] = std::move(renderer.recordedTimings);
+		renderer.recordedTimings = PresentTimings();
+		if (mode == 1)
+		{
+			reportPipelineBenchmark(benchmark.results[0], benchmark.results[1]);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool saveCameraRecording(CameraPath& path, double recordedTime, const char* outputPath)
+{
+	if (path.GetFrameCount() > 0) path.SetFrameDelta((float)(recordedTime / path.GetFrameCount()));
+	if (!path.Save(outputPath))
+	{
+		std::cout << "Failed to write " << outputPath << "\n";
+		return false;
+	}
+	std::cout << "Recorded " << path.GetFrameCount() << " camera frames to " << outputPath << "\n";
+	return true;
+}
+
+bool reportReplay(const PresentTimings& timings, const char* statsPath)
+{
+	reportFrameTimes("Replay", timings);
+	if (statsPath && !WriteFrameTimeStats(statsPath, ComputeFrameTimeStats(timings.frameTimes), timings.frameTimes))
+	{
+		std::cout << "Failed to write " << statsPath << "\n";
+		return false;
+	}
+	return true;
+}
+
+bool saveScreenshot(const RenderTarget& target, const char* path)
+{
+	std::vector<unsigned char> pixels = target.ReadPixels();
+	if (!writePNG(path, pixels.data(), target.GetWidth(), target.GetHeight(), 3))
+	{
+		std::cout << "Failed to write " << path << "\n";
+		return false;
+	}
+	std::cout << "Saved the last frame to " << path << "\n";
+	return true;
+}
+
+void UIDrawData::CopyFrom(const ImDrawData& source)
+{
+	// Assigning an ImVector frees and reallocates it, resizing keeps its memory.
+	auto copy = [](auto& to, const auto& from)
+	{
+		to.resize(from.Size);
+		if (from.Size > 0) std::memcpy(to.Data, from.Data, from.size_in_bytes());
+	};
+
+	while ((int)lists.size() < source.CmdListsCount) lists.push_back(std::make_unique<ImDrawList>(ImGui::GetDrawListSharedData()));
+	drawData.Clear();
+	for (int i = 0; i < source.CmdListsCount; i++)
+	{
+		const ImDrawList& from = *source.CmdLists[i];
+		ImDrawList& to = *lists[i];
+		copy(to.CmdBuffer, from.CmdBuffer);
+		copy(to.IdxBuffer, from.IdxBuffer);
+		copy(to.VtxBuffer, from.VtxBuffer);
+		to.Flags = from.Flags;
+		drawData.CmdLists.push_back(&to);
+	}
+	drawData.Valid = source.Valid;
+	drawData.CmdListsCount = source.CmdListsCount;
+	drawData.TotalIdxCount = source.TotalIdxCount;
+	drawData.TotalVtxCount = source.TotalVtxCount;
+	drawData.DisplayPos = source.DisplayPos;
+	drawData.DisplaySize = source.DisplaySize;
+	drawData.FramebufferScale = source.FramebufferScale;
+	drawData.OwnerViewport = source.OwnerViewport;
 }
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height)
 {
 	windowWidth = width;
 	windowHeight = height;
-	glViewport(0, 0, windowWidth, windowHeight);
 }
 
 void processInput(GLFWwindow* window)
@@ -340,34 +2053,40 @@ void processInput(GLFWwindow* window)
 	{
 		glfwSetWindowShouldClose(window, true);
 	}
+}
+
+void moveCamera(GLFWwindow* window, float timeStep)
+{
 	if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::FORWARD, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::FORWARD, timeStep);
 	}
 	if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::BACKWARD, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::BACKWARD, timeStep);
 	}
 	if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::LEFT, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::LEFT, timeStep);
 	}
 	if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::RIGHT, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::RIGHT, timeStep);
 	}
 	if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::DOWN, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::DOWN, timeStep);
 	}
 	if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
 	{
-		camera.ProcessKeyboard(Camera_Movement::UP, deltaTime);
+		camera.ProcessKeyboard(Camera_Movement::UP, timeStep);
 	}
 }
 
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 {
+	if (ignoreInput) return;
+
 	// To prevent first-time input "jump".
 	if (firstMouseInput)
 	{
@@ -387,11 +2106,14 @@ void mouse_callback(GLFWwindow* window, double xpos, double ypos)
 
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
+	if (ignoreInput) return;
 	camera.ProcessMouseScroll(yoffset);
 }
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+	if (ignoreInput) return;
+
 	if (key == GLFW_KEY_R && action == GLFW_PRESS)
 	{
 		camera.SetControlMode(!camera.Controlled);
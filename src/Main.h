@@ -1,9 +1,69 @@
 #pragma once
 
+#include <functional>
+
+#include <glm/glm.hpp>
+
 struct GLFWwindow;
+class Shader;
+class Model;
+class TextureStreamer;
+struct LightingBenchmark;
+struct LightCullingStats;
+struct SceneState;
+struct RendererSettings;
+struct FramePacket;
+struct Renderer;
+struct PresentTimings;
+struct FrameTimingSummary;
+struct RendererStats;
+struct FramePacing;
+struct PipelineBenchmark;
+struct PacingBenchmark;
+struct HeadlessRun;
+struct Replay;
+class CameraPath;
+class RenderTarget;
+template <typename Packet> class FramePipeline;
+
+void setTransformUniforms(const Shader& shader, const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection);
+void setLightUniforms(const Shader& shader, const SceneState& scene, const glm::mat4& view);
+void setReferenceLightUniforms(const Shader& shader, const SceneState& scene);
+void updateLightRadii();
+void requestTextureMips(TextureStreamer& streamer, Model& model, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection,
+	int viewportHeight);
+void drawWithLightCulling(Model& model, const Shader& shader, const Shader& packedShader, const SceneState& scene, const glm::mat4& modelMatrix,
+	const glm::mat4& view, const glm::mat4& projection, LightCullingStats& stats);
+LightingBenchmark runLightingBenchmark(Model& model, const Shader& referenceShader, const Shader& optimizedShader,
+	const SceneState& scene, const glm::mat4& modelMatrix, const glm::mat4& view, const glm::mat4& projection);
+
+SceneState captureScene();
+RendererSettings getRendererSettings(const Renderer& renderer);
+void applyRendererSettings(Renderer& renderer, const RendererSettings& settings);
+void renderFrame(Renderer& renderer, FramePacket& packet);
+void runRenderThread(Renderer& renderer, FramePipeline<FramePacket>& pipeline);
+void reportPipelineBenchmark(const PresentTimings& singleThreaded, const PresentTimings& renderThread);
+void reportFrameTimes(const char* run, const PresentTimings& timings);
+int runRegressionTests(Renderer& renderer, const RendererSettings& settings, const char* scriptPath, bool updateGolden, bool updateBaselines);
+void reportPacingBenchmark(const FrameTimingSummary results[], bool adaptiveVsyncSupported);
+
+// The frame loop's pieces. The advance functions are called once per frame and return true once their run is done.
+void stepSimulation(GLFWwindow* window, FramePacing& pacing);
+void buildSettingsWindow(RendererSettings& settings, const RendererStats& stats, bool adaptiveVsyncSupported, bool& useRenderThread,
+	FramePacing& pacing);
+bool advanceHeadlessRun(HeadlessRun& run, const RendererStats& stats, RendererSettings& settings);
+bool advanceReplay(Replay& replay, size_t pathFrames, const RendererStats& stats, RendererSettings& settings);
+bool advancePacingBenchmark(PacingBenchmark& benchmark, FramePacing& pacing, RendererSettings& settings, bool adaptiveVsyncSupported);
+bool advancePipelineBenchmark(PipelineBenchmark& benchmark, Renderer& renderer, RendererSettings& settings, bool& useRenderThread,
+	const std::function<void()>& stopRenderThread);
+bool saveCameraRecording(CameraPath& path, double recordedTime, const char* outputPath);
+bool reportReplay(const PresentTimings& timings, const char* statsPath);
+bool saveScreenshot(const RenderTarget& target, const char* path);
+
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
+void moveCamera(GLFWwindow* window, float timeStep);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods);
\ No newline at end of file
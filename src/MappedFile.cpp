@@ -0,0 +1,87 @@
+﻿#include "MappedFile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::~MappedFile()
+{
+    Close();
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER fileSize;
+    if (!GetFileSizeEx(file, &fileSize))
+    {
+        CloseHandle(file);
+        return false;
+    }
+    // Windows can't map an empty file.
+    if (fileSize.QuadPart > 0)
+    {
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+        if (!view)
+        {
+            if (mapping) CloseHandle(mapping);
+            CloseHandle(file);
+            return false;
+        }
+        mappingHandle = mapping;
+        data = (const unsigned char*)view;
+        size = (size_t)fileSize.QuadPart;
+    }
+    fileHandle = file;
+#else
+    int file = ::open(path.c_str(), O_RDONLY);
+    if (file < 0) return false;
+    struct stat status;
+    bool mapped = fstat(file, &status) == 0;
+    if (mapped && status.st_size > 0)
+    {
+        void* view = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        mapped = view != MAP_FAILED;
+        if (mapped)
+        {
+            data = (const unsigned char*)view;
+            size = (size_t)status.st_size;
+        }
+    }
+    // The mapping keeps the file alive on its own.
+    close(file);
+    if (!mapped) return false;
+#endif
+    open = true;
+    return true;
+}
+
+void MappedFile::Close()
+{
+    if (!open) return;
+
+#ifdef _WIN32
+    if (data) UnmapViewOfFile(data);
+    if (mappingHandle) CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    mappingHandle = nullptr;
+    fileHandle = nullptr;
+#else
+    if (data) munmap((void*)data, size);
+#endif
+    open = false;
+    data = nullptr;
+    size = 0;
+}
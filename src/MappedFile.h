@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+
+// A whole file mapped read-only into memory. Pages are only read from disk when they're first touched.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Map a file, closing the one mapped before, if any. An empty file maps to no data.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const { return open; }
+
+    const unsigned char* GetData() const { return data; }
+    size_t GetSize() const { return size; }
+
+private:
+    bool open = false;
+    const unsigned char* data = nullptr;
+    size_t size = 0;
+#ifdef _WIN32
+    void* fileHandle = nullptr;
+    void* mappingHandle = nullptr;
+#endif
+};
@@ -1,41 +1,150 @@
 ﻿#include "Mesh.h"
+#include "FrameArena.h"
+#include "GpuResources.h"
+#include "TextureManager.h"
 
-Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures)
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+    // Texture each unit had bound by the last mesh draw, 0 if unknown.
+    constexpr unsigned int trackedTextureUnits = 16;
+    unsigned int boundTextures[trackedTextureUnits] = {};
+    int drawCalls = 0;
+    size_t triangles = 0;
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, TextureManager* textureManager)
+    : textureManager(textureManager)
 {
     this->vertices = vertices;
     this->indices = indices;
     this->textures = textures;
+    for (const Texture& texture : textures)
+    {
+        if (texture.type == "texture_packed") packedMaterial = true;
+    }
+
+    if (!vertices.empty())
+    {
+        bounds.min = bounds.max = vertices[0].Position;
+        for (const Vertex& vertex : vertices)
+        {
+            bounds.min = glm::min(bounds.min, vertex.Position);
+            bounds.max = glm::max(bounds.max, vertex.Position);
+        }
+    }
+
+    // Compare the total surface area with the area it covers in texture space.
+    float surfaceArea = 0.0f, uvArea = 0.0f;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        const Vertex& a = vertices[indices[i]];
+        const Vertex& b = vertices[indices[i + 1]];
+        const Vertex& c = vertices[indices[i + 2]];
+        surfaceArea += glm::length(glm::cross(b.Position - a.Position, c.Position - a.Position)) * 0.5f;
+        glm::vec2 uvB = b.TexCoords - a.TexCoords, uvC = c.TexCoords - a.TexCoords;
+        uvArea += std::abs(uvB.x * uvC.y - uvB.y * uvC.x) * 0.5f;
+    }
+    if (surfaceArea > 0.0f) uvDensity = std::sqrt(uvArea / surfaceArea);
     
     setupMesh();
 }
 
-void Mesh::Draw(Shader& shader)
+Mesh::Mesh(Mesh&& other) noexcept
+    : vertices(std::move(other.vertices)), indices(std::move(other.indices)), textures(std::move(other.textures)),
+      bounds(other.bounds), uvDensity(other.uvDensity), packedMaterial(other.packedMaterial),
+      VAO(other.VAO), VBO(other.VBO), EBO(other.EBO), textureManager(other.textureManager)
+{
+    other.VAO = other.VBO = other.EBO = 0;
+}
+
+Mesh& Mesh::operator=(Mesh&& other) noexcept
+{
+    if (this == &other) return *this;
+    release();
+    vertices = std::move(other.vertices);
+    indices = std::move(other.indices);
+    textures = std::move(other.textures);
+    bounds = other.bounds;
+    uvDensity = other.uvDensity;
+    packedMaterial = other.packedMaterial;
+    VAO = other.VAO;
+    VBO = other.VBO;
+    EBO = other.EBO;
+    textureManager = other.textureManager;
+    other.VAO = other.VBO = other.EBO = 0;
+    return *this;
+}
+
+Mesh::~Mesh()
+{
+    release();
+}
+
+void Mesh::Draw(const Shader& shader)
 {
     unsigned int diffuseNr = 1;
     unsigned int specularNr = 1;
+    unsigned int packedNr = 1;
     for (unsigned int i = 0; i < textures.size(); i++)
     {
         glActiveTexture(GL_TEXTURE0 + i);
 
-        std::string number;
-        std::string name = textures[i].type;
+        unsigned int number = 0;
+        const std::string& name = textures[i].type;
         if (name == "texture_diffuse")
         {
-            number = std::to_string(diffuseNr++);
+            number = diffuseNr++;
         }
         else if (name == "texture_specular")
         {
-            number = std::to_string(specularNr++);
+            number = specularNr++;
+        }
+        else if (name == "texture_packed")
+        {
+            number = packedNr++;
         }
 
-        shader.setInt(("material." + name + number).c_str(), i);
-        glBindTexture(GL_TEXTURE_2D, textures[i].id);
+        // Built in the frame arena, this runs for every texture of every mesh each frame.
+        FrameArena& arena = FrameArena::Get();
+        shader.setInt(number ? arena.Format("material.%s%u", name.c_str(), number) : arena.Format("material.%s", name.c_str()), i);
+        if (textureManager) textureManager->Use(textures[i].id);
+        if (i >= trackedTextureUnits || boundTextures[i] != textures[i].id)
+        {
+            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            if (i < trackedTextureUnits) boundTextures[i] = textures[i].id;
+        }
     }
     glActiveTexture(GL_TEXTURE0);
 
     glBindVertexArray(VAO);
     glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
     glBindVertexArray(0);
+    drawCalls++;
+    triangles += indices.size() / 3;
+}
+
+void Mesh::ResetTextureBindings()
+{
+    std::fill(std::begin(boundTextures), std::end(boundTextures), 0u);
+}
+
+int Mesh::GetDrawCalls()
+{
+    return drawCalls;
+}
+
+size_t Mesh::GetTriangles()
+{
+    return triangles;
+}
+
+void Mesh::ResetDrawStats()
+{
+    drawCalls = 0;
+    triangles = 0;
 }
 
 void Mesh::setupMesh()
@@ -52,9 +161,11 @@ void Mesh::setupMesh()
     
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
     glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    TRACK_GPU_RESOURCE(GpuResourceType::Buffer, VBO, vertices.size() * sizeof(Vertex), "Mesh vertices");
     
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    TRACK_GPU_RESOURCE(GpuResourceType::Buffer, EBO, indices.size() * sizeof(unsigned int), "Mesh indices");
 
     // Enable vertex attrib pointers.
     glEnableVertexAttribArray(0);
@@ -66,3 +177,15 @@ void Mesh::setupMesh()
     
     glBindVertexArray(0);
 }
+
+void Mesh::release()
+{
+    if (VAO == 0) return;
+    GpuResourceTracker& tracker = GpuResourceTracker::Get();
+    tracker.Untrack(GpuResourceType::Buffer, VBO);
+    tracker.Untrack(GpuResourceType::Buffer, EBO);
+    glDeleteBuffers(1, &VBO);
+    glDeleteBuffers(1, &EBO);
+    glDeleteVertexArrays(1, &VAO);
+    VAO = VBO = EBO = 0;
+}
@@ -5,6 +5,9 @@
 #include <glm/glm.hpp>
 
 #include "Shader.h"
+#include "Culling.h"
+
+class TextureManager;
 
 struct Vertex
 {
@@ -26,12 +29,34 @@ public:
     std::vector<Vertex> vertices;
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
+    // Object space bounds of all vertices.
+    Bounds bounds;
+    // Texture coordinate units per object space unit, averaged over the surface. Zero without texture coordinates.
+    float uvDensity = 0.0f;
+    // Whether the material's scalar maps are packed into one texture, which needs the PACKED_MATERIAL shader permutation.
+    bool packedMaterial = false;
 
-    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures);
-    void Draw(Shader& shader);
+    // Textures are marked as used through the texture manager on every draw, if one is given.
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, std::vector<Texture> textures, TextureManager* textureManager = nullptr);
+    // A mesh owns its vertex array and buffers, so it can be moved but not copied.
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&& other) noexcept;
+    Mesh& operator=(Mesh&& other) noexcept;
+    ~Mesh();
+    void Draw(const Shader& shader);
+    // Draw() doesn't bind textures that the previous mesh draw left bound, which is what lets meshes sharing an atlas
+    // skip their binds. Call this before a run of mesh draws, anything else may have changed the bindings since.
+    static void ResetTextureBindings();
+    // Draw calls and triangles of all mesh draws since the last reset.
+    static int GetDrawCalls();
+    static size_t GetTriangles();
+    static void ResetDrawStats();
 
 private:
-    unsigned int VAO, VBO, EBO;
+    unsigned int VAO = 0, VBO = 0, EBO = 0;
+    TextureManager* textureManager;
     void setupMesh();
+    void release();
     
 };
\ No newline at end of file
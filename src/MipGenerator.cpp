@@ -0,0 +1,259 @@
+﻿#include "MipGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include <emmintrin.h>
+
+namespace
+{
+    constexpr double pi = 3.14159265358979323846;
+
+    // Kaiser window parameters. The kernel covers 1.5 destination pixels on either side.
+    constexpr float kaiserRadius = 1.5f;
+    constexpr float kaiserAlpha = 4.0f;
+
+    // Linear to sRGB conversion goes through a table indexed by the linear value, fine enough that the darkest
+    // (steepest) part of the curve still hits every output value.
+    constexpr int linearToSrgbTableSize = 16384;
+
+    struct ConversionTables
+    {
+        float srgbToLinear[256];
+        float byteToFloat[256];
+        unsigned char linearToSrgb[linearToSrgbTableSize + 1];
+
+        ConversionTables()
+        {
+            for (int i = 0; i < 256; i++)
+            {
+                float value = i / 255.0f;
+                srgbToLinear[i] = value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+                byteToFloat[i] = value;
+            }
+            for (int i = 0; i <= linearToSrgbTableSize; i++)
+            {
+                float value = (float)i / linearToSrgbTableSize;
+                float srgb = value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+                linearToSrgb[i] = (unsigned char)(srgb * 255.0f + 0.5f);
+            }
+        }
+    };
+
+    const ConversionTables& getConversionTables()
+    {
+        static const ConversionTables tables;
+        return tables;
+    }
+
+    // Zeroth order modified Bessel function of the first kind, for the Kaiser window.
+    double besselI0(double x)
+    {
+        double sum = 1.0, term = 1.0;
+        for (int k = 1; k < 32; k++)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    // Filter weight at a distance measured in destination pixels.
+    double filterWeight(MipFilter filter, double x)
+    {
+        x = std::abs(x);
+        if (filter == MipFilter::Box) return x < 0.5 ? 1.0 : 0.0;
+
+        if (x >= kaiserRadius) return 0.0;
+        double sinc = x < 1e-6 ? 1.0 : std::sin(pi * x) / (pi * x);
+        double t = x / kaiserRadius;
+        return sinc * besselI0(kaiserAlpha * std::sqrt(1.0 - t * t)) / besselI0(kaiserAlpha);
+    }
+
+    // The source pixels (wrapped around the edge) and weights contributing to each destination pixel along one axis.
+    struct FilterTaps
+    {
+        int tapCount = 0;
+        std::vector<int> indices;
+        std::vector<float> weights;
+    };
+
+    FilterTaps buildTaps(MipFilter filter, int sourceSize, int destinationSize)
+    {
+        FilterTaps taps;
+        double scale = (double)sourceSize / destinationSize;
+        double radius = (filter == MipFilter::Box ? 0.5 : kaiserRadius) * scale;
+        taps.tapCount = (int)std::ceil(radius * 2.0) + 1;
+        taps.indices.resize((size_t)destinationSize * taps.tapCount);
+        taps.weights.resize((size_t)destinationSize * taps.tapCount);
+
+        for (int i = 0; i < destinationSize; i++)
+        {
+            double center = (i + 0.5) * scale;
+            int first = (int)std::floor(center - radius);
+            double total = 0.0;
+            for (int t = 0; t < taps.tapCount; t++)
+            {
+                int source = first + t;
+                double weight = filterWeight(filter, (source + 0.5 - center) / scale);
+                taps.indices[(size_t)i * taps.tapCount + t] = ((source % sourceSize) + sourceSize) % sourceSize;
+                taps.weights[(size_t)i * taps.tapCount + t] = (float)weight;
+                total += weight;
+            }
+            for (int t = 0; t < taps.tapCount; t++)
+            {
+                taps.weights[(size_t)i * taps.tapCount + t] = (float)(taps.weights[(size_t)i * taps.tapCount + t] / total);
+            }
+        }
+        return taps;
+    }
+
+    // Downsample a float RGBA image with a separable filter: horizontally into a temporary image first, then
+    // vertically. One pixel is one SSE register.
+    void downsample(const std::vector<float>& source, int sourceWidth, int sourceHeight, std::vector<float>& destination,
+        int destinationWidth, int destinationHeight, MipFilter filter)
+    {
+        FilterTaps horizontal = buildTaps(filter, sourceWidth, destinationWidth);
+        FilterTaps vertical = buildTaps(filter, sourceHeight, destinationHeight);
+
+        std::vector<float> temporary((size_t)destinationWidth * sourceHeight * 4);
+        for (int y = 0; y < sourceHeight; y++)
+        {
+            const float* sourceRow = &source[(size_t)y * sourceWidth * 4];
+            float* temporaryRow = &temporary[(size_t)y * destinationWidth * 4];
+            for (int x = 0; x < destinationWidth; x++)
+            {
+                const int* indices = &horizontal.indices[(size_t)x * horizontal.tapCount];
+                const float* weights = &horizontal.weights[(size_t)x * horizontal.tapCount];
+                __m128 sum = _mm_setzero_ps();
+                for (int t = 0; t < horizontal.tapCount; t++)
+                {
+                    sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(sourceRow + indices[t] * 4), _mm_set1_ps(weights[t])));
+                }
+                _mm_storeu_ps(temporaryRow + x * 4, sum);
+            }
+        }
+
+        destination.assign((size_t)destinationWidth * destinationHeight * 4, 0.0f);
+        for (int y = 0; y < destinationHeight; y++)
+        {
+            const int* indices = &vertical.indices[(size_t)y * vertical.tapCount];
+            const float* weights = &vertical.weights[(size_t)y * vertical.tapCount];
+            float* destinationRow = &destination[(size_t)y * destinationWidth * 4];
+            for (int t = 0; t < vertical.tapCount; t++)
+            {
+                if (weights[t] == 0.0f) continue;
+                const float* temporaryRow = &temporary[(size_t)indices[t] * destinationWidth * 4];
+                __m128 weight = _mm_set1_ps(weights[t]);
+                for (int x = 0; x < destinationWidth * 4; x += 4)
+                {
+                    __m128 sum = _mm_loadu_ps(destinationRow + x);
+                    _mm_storeu_ps(destinationRow + x, _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(temporaryRow + x), weight)));
+                }
+            }
+        }
+    }
+
+    void toFloat(const unsigned char* rgba, size_t pixelCount, const MipSettings& settings, std::vector<float>& image)
+    {
+        const ConversionTables& tables = getConversionTables();
+        const float* colorTable = settings.srgb ? tables.srgbToLinear : tables.byteToFloat;
+
+        image.resize(pixelCount * 4);
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            const unsigned char* pixel = rgba + i * 4;
+            float alpha = tables.byteToFloat[pixel[3]];
+            __m128 color = _mm_setr_ps(colorTable[pixel[0]], colorTable[pixel[1]], colorTable[pixel[2]], alpha);
+            if (settings.premultiplyAlpha) color = _mm_mul_ps(color, _mm_setr_ps(alpha, alpha, alpha, 1.0f));
+            _mm_storeu_ps(&image[i * 4], color);
+        }
+    }
+
+    void toBytes(const std::vector<float>& image, size_t pixelCount, const MipSettings& settings, unsigned char* rgba)
+    {
+        const ConversionTables& tables = getConversionTables();
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 one = _mm_set1_ps(1.0f);
+
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            float pixel[4];
+            __m128 color = _mm_loadu_ps(&image[i * 4]);
+            __m128 alpha = _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3));
+            if (settings.premultiplyAlpha)
+            {
+                // Fully transparent pixels have lost their color, leave them black.
+                __m128 visible = _mm_cmpgt_ps(alpha, _mm_set1_ps(1e-6f));
+                color = _mm_and_ps(_mm_div_ps(color, _mm_max_ps(alpha, _mm_set1_ps(1e-6f))), visible);
+            }
+            _mm_storeu_ps(pixel, _mm_min_ps(_mm_max_ps(color, zero), one));
+            pixel[3] = std::min(std::max(image[i * 4 + 3], 0.0f), 1.0f);
+
+            if (settings.normalMap)
+            {
+                float x = pixel[0] * 2.0f - 1.0f, y = pixel[1] * 2.0f - 1.0f, z = pixel[2] * 2.0f - 1.0f;
+                float length = std::sqrt(x * x + y * y + z * z);
+                if (length > 1e-6f)
+                {
+                    pixel[0] = (x / length) * 0.5f + 0.5f;
+                    pixel[1] = (y / length) * 0.5f + 0.5f;
+                    pixel[2] = (z / length) * 0.5f + 0.5f;
+                }
+            }
+
+            unsigned char* output = rgba + i * 4;
+            for (int c = 0; c < 3; c++)
+            {
+                output[c] = settings.srgb ? tables.linearToSrgb[(int)(pixel[c] * linearToSrgbTableSize + 0.5f)]
+                    : (unsigned char)(pixel[c] * 255.0f + 0.5f);
+            }
+            output[3] = (unsigned char)(pixel[3] * 255.0f + 0.5f);
+        }
+    }
+}
+
+const char* GetMipFilterName(MipFilter filter)
+{
+    return filter == MipFilter::Box ? "box" : "kaiser";
+}
+
+int GetMipLevelCount(int width, int height)
+{
+    int levels = 1;
+    while (width > 1 || height > 1)
+    {
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        levels++;
+    }
+    return levels;
+}
+
+void GenerateMipChain(const unsigned char* rgba, int width, int height, const MipSettings& settings,
+    std::vector<std::vector<unsigned char>>& levels)
+{
+    levels.clear();
+    levels.reserve(GetMipLevelCount(width, height));
+    levels.emplace_back(rgba, rgba + (size_t)width * height * 4);
+
+    // Every level is filtered from the previous one, which is kept in float so errors don't add up across levels.
+    std::vector<float> current, next;
+    toFloat(rgba, (size_t)width * height, settings, current);
+
+    while (width > 1 || height > 1)
+    {
+        int nextWidth = std::max(width / 2, 1);
+        int nextHeight = std::max(height / 2, 1);
+        downsample(current, width, height, next, nextWidth, nextHeight, settings.filter);
+
+        std::vector<unsigned char> level((size_t)nextWidth * nextHeight * 4);
+        toBytes(next, (size_t)nextWidth * nextHeight, settings, level.data());
+        levels.push_back(std::move(level));
+
+        current.swap(next);
+        width = nextWidth;
+        height = nextHeight;
+    }
+}
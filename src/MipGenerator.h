@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <vector>
+
+// Downsampling filter used between mip levels.
+enum class MipFilter
+{
+    Box,   // Averages the source pixels covered by each destination pixel. Cheap, but slightly blurry and aliases.
+    Kaiser // Kaiser windowed sinc over three destination pixels. Sharper mips with less aliasing.
+};
+
+struct MipSettings
+{
+    MipFilter filter = MipFilter::Kaiser;
+    // Color data is stored with the sRGB curve, filter it in linear space so mips don't get darker.
+    bool srgb = true;
+    // Weight color by alpha while filtering so transparent pixels don't bleed their color into the visible ones.
+    bool premultiplyAlpha = true;
+    // Tangent space normals in RGB, renormalized after filtering.
+    bool normalMap = false;
+};
+
+const char* GetMipFilterName(MipFilter filter);
+// Number of levels in a full mip chain down to 1x1, including level 0.
+int GetMipLevelCount(int width, int height);
+
+// Generate the whole mip chain of an RGBA8 image. levels[0] is a copy of the source, every following level is half the
+// size (rounded down, at least 1) of the previous one. Edges wrap around, matching the GL_REPEAT textures are sampled
+// with. Runs on the calling thread; generate separate textures on separate threads to go wide.
+void GenerateMipChain(const unsigned char* rgba, int width, int height, const MipSettings& settings,
+    std::vector<std::vector<unsigned char>>& levels);
@@ -1,17 +1,62 @@
-﻿#include <assimp/Importer.hpp>
+﻿#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+#include <assimp/Importer.hpp>
 #include <assimp/postprocess.h>
 
 #include "Model.h"
-
+#include "AssetIOSystem.h"
+#include "TextureManager.h"
 #include "Util.h"
 
-Model::Model(const char* path)
+namespace
+{
+    // Texture types that get packed into atlases, one atlas slot each.
+    const aiTextureType atlasSlotTypes[] = { aiTextureType_DIFFUSE, aiTextureType_SPECULAR };
+    const char* const atlasSlotNames[] = { "texture_diffuse", "texture_specular" };
+    constexpr int atlasSlotCount = 2;
+
+    // Scalar maps that get packed into the channels of one texture, in channel order. A channel takes the first of its
+    // texture types the material has.
+    const std::vector<aiTextureType> packedChannelTypes[] = {
+        { aiTextureType_SPECULAR },
+        { aiTextureType_AMBIENT_OCCLUSION, aiTextureType_LIGHTMAP },
+        { aiTextureType_SHININESS },
+    };
+    constexpr int packedChannelCount = 3;
+    // Channels a material has no map for: no specular, no occlusion and full gloss.
+    const unsigned char packedChannelFill[4] = { 0, 255, 255, 255 };
+}
+
+Model::Model(const char* path, TextureManager& textureManager, const AtlasSettings& atlasSettings)
+    : textureManager(&textureManager), atlasSettings(atlasSettings)
 {
     loadModel(path);
 }
 
-void Model::Draw(Shader& shader)
+Model::~Model()
+{
+    for (const Texture& texture : textures_loaded)
+    {
+        textureManager->Release(texture.id);
+    }
+    for (const Texture& texture : materialPacked)
+    {
+        if (texture.id != 0) textureManager->Release(texture.id);
+    }
+    for (const std::vector<Texture>& page : atlasTextures)
+    {
+        for (const Texture& texture : page)
+        {
+            if (texture.id != 0) textureManager->Release(texture.id);
+        }
+    }
+}
+
+void Model::Draw(const Shader& shader)
 {
+    Mesh::ResetTextureBindings();
     for (unsigned int i = 0; i < meshes.size(); i++)
     {
         meshes[i].Draw(shader);
@@ -20,8 +65,14 @@ void Model::Draw(Shader& shader)
 
 void Model::loadModel(std::string path)
 {
+    // Read the model and its material files out of the mounted asset pack or memory-mapped loose files, recording how
+    // long reading them takes. The importer owns the file system.
     Assimp::Importer importer;
+    ImportIOStats ioStats;
+    importer.SetIOHandler(new AssetIOSystem(&ioStats));
+    auto importStart = std::chrono::steady_clock::now();
     const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs);
+    double importTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - importStart).count();
 
     // Check for errors during import.
     if (!scene || !scene->mRootNode || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE)
@@ -29,10 +80,264 @@ void Model::loadModel(std::string path)
         std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << "\n";
         return;
     }
+    reportImport(path, ioStats, importTime);
+
+    directory = path.substr(0, path.find_last_of("\\/"));
 
-    directory = path.substr(0, path.find_last_of('\\'));
+    packMaterials(path, scene);
+    buildAtlas(path, scene);
+
+    // Decode all other material textures at once before the meshes ask for them one by one.
+    std::vector<std::string> texturePaths;
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        if (materialAtlas[m].page >= 0) continue;
+        std::vector<std::string> paths = getTexturePaths(scene->mMaterials[m], materialPacked[m].id == 0);
+        texturePaths.insert(texturePaths.end(), paths.begin(), paths.end());
+    }
+    textureManager->Preload(texturePaths);
 
     processNode(scene->mRootNode, scene);
+    if (!atlasTextures.empty()) reportAtlas(scene);
+}
+
+void Model::reportImport(const std::string& path, const ImportIOStats& ioStats, double importTime) const
+{
+    // Whatever the import didn't spend reading files went into parsing and post-processing.
+    const double ioTime = ioStats.GetTotalSeconds();
+    char line[256];
+    snprintf(line, sizeof(line), "Imported %s in %.1f ms: %.1f ms reading %zu files (%.2f MB), %.1f ms parsing",
+        path.c_str(), importTime * 1e3, ioTime * 1e3, ioStats.files.size(), ioStats.GetTotalBytes() / 1048576.0,
+        std::max(importTime - ioTime, 0.0) * 1e3);
+    std::cout << line << "\n";
+    for (const FileReadStats& file : ioStats.files)
+    {
+        snprintf(line, sizeof(line), "  %-40s %-8s %2d opens %8.2f MB %7.2f ms", file.path.c_str(), GetFileSourceName(file.source),
+            file.opens, file.bytes / 1048576.0, file.seconds * 1e3);
+        std::cout << line << "\n";
+    }
+}
+
+void Model::packMaterials(const std::string& path, const aiScene* scene)
+{
+    materialPacked.assign(scene->mNumMaterials, Texture{ 0, "", "" });
+
+    // Materials with at least two scalar maps are worth packing.
+    std::vector<std::vector<std::string>> channelPaths(scene->mNumMaterials, std::vector<std::string>(packedChannelCount));
+    std::vector<std::string> paths;
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        int mapCount = 0;
+        for (int channel = 0; channel < packedChannelCount; channel++)
+        {
+            for (aiTextureType type : packedChannelTypes[channel])
+            {
+                if (scene->mMaterials[m]->GetTextureCount(type) == 0) continue;
+                aiString texturePath;
+                scene->mMaterials[m]->GetTexture(type, 0, &texturePath);
+                channelPaths[m][channel] = directory + '/' + texturePath.C_Str();
+                mapCount++;
+                break;
+            }
+        }
+        if (mapCount < 2)
+        {
+            channelPaths[m].clear();
+            continue;
+        }
+        for (const std::string& channelPath : channelPaths[m])
+        {
+            if (!channelPath.empty() && std::find(paths.begin(), paths.end(), channelPath) == paths.end()) paths.push_back(channelPath);
+        }
+    }
+    if (paths.empty()) return;
+
+    std::vector<ImageData> images;
+    std::vector<char> succeeded;
+    readImagesParallel(paths, images, succeeded);
+
+    // VRAM with a full mip chain, and how many maps a fragment of a packed material fetched before.
+    int packedMaterials = 0, packedMaps = 0, mostMapsPerMaterial = 0;
+    double separateBytes = 0.0, singleChannelBytes = 0.0, packedBytes = 0.0;
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        if (channelPaths[m].empty()) continue;
+
+        // Every map has to be one channel (or gray) and all of them the same size.
+        std::vector<const ImageData*> channels(packedChannelCount, nullptr);
+        const ImageData* first = nullptr;
+        bool packable = true;
+        for (int channel = 0; channel < packedChannelCount && packable; channel++)
+        {
+            if (channelPaths[m][channel].empty()) continue;
+            size_t i = std::find(paths.begin(), paths.end(), channelPaths[m][channel]) - paths.begin();
+            const ImageData& image = images[i];
+            packable = succeeded[i] && !image.compressed && image.components == 1 &&
+                (!first || (image.width == first->width && image.height == first->height));
+            channels[channel] = &image;
+            if (!first) first = &image;
+        }
+        if (!packable) continue;
+
+        ImageData packed = packChannels(channels, packedChannelFill);
+        if (!packed.pixels) continue;
+        Texture& texture = materialPacked[m];
+        texture.type = "texture_packed";
+        texture.path = path + ".packed" + std::to_string(m);
+        texture.id = textureManager->Adopt(texture.path, uploadImage(packed));
+
+        const double mipTexels = (double)packed.width * packed.height * 4.0 / 3.0;
+        int maps = 0;
+        for (const ImageData* channel : channels)
+        {
+            if (!channel) continue;
+            // Gray images used to be uploaded as RGB, which drivers pad to four bytes.
+            separateBytes += mipTexels * (channel->grayscale ? 4 : 1);
+            singleChannelBytes += mipTexels;
+            maps++;
+        }
+        packedBytes += mipTexels * 4;
+        packedMaps += maps;
+        mostMapsPerMaterial = std::max(mostMapsPerMaterial, maps);
+        packedMaterials++;
+    }
+    if (packedMaterials == 0) return;
+
+    char line[256];
+    snprintf(line, sizeof(line), "Packed %d scalar maps of %d materials: up to %d texture fetches per fragment become 1, "
+        "%.1f MB as before, %.1f MB as separate R8, %.1f MB packed",
+        packedMaps, packedMaterials, mostMapsPerMaterial, separateBytes / 1048576.0, singleChannelBytes / 1048576.0,
+        packedBytes / 1048576.0);
+    std::cout << line << "\n";
+}
+
+void Model::buildAtlas(const std::string& path, const aiScene* scene)
+{
+    materialAtlas.assign(scene->mNumMaterials, AtlasPlacement());
+    if (!atlasSettings.enabled) return;
+
+    // Atlas coordinates can't repeat, so materials of meshes whose texture coordinates wrap keep their own textures.
+    const float epsilon = 1e-3f;
+    std::vector<char> wraps(scene->mNumMaterials, 0);
+    for (unsigned int i = 0; i < scene->mNumMeshes; i++)
+    {
+        const aiMesh* mesh = scene->mMeshes[i];
+        if (!mesh->mTextureCoords[0] || wraps[mesh->mMaterialIndex]) continue;
+        for (unsigned int v = 0; v < mesh->mNumVertices; v++)
+        {
+            const aiVector3D& uv = mesh->mTextureCoords[0][v];
+            if (uv.x < -epsilon || uv.x > 1.0f + epsilon || uv.y < -epsilon || uv.y > 1.0f + epsilon)
+            {
+                wraps[mesh->mMaterialIndex] = 1;
+                break;
+            }
+        }
+    }
+
+    // Materials with at most one texture per slot are candidates, the builder decides which are small enough.
+    TextureAtlasBuilder builder = TextureAtlasBuilder(atlasSettings, atlasSlotCount);
+    std::vector<int> builderMaterials(scene->mNumMaterials, -1);
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        if (wraps[m] || materialPacked[m].id != 0) continue;
+
+        aiMaterial* material = scene->mMaterials[m];
+        std::vector<std::string> paths(atlasSlotCount);
+        bool hasTextures = false, singleTextures = true;
+        for (int slot = 0; slot < atlasSlotCount; slot++)
+        {
+            unsigned int count = material->GetTextureCount(atlasSlotTypes[slot]);
+            singleTextures = singleTextures && count <= 1;
+            if (count != 1) continue;
+
+            aiString texturePath;
+            material->GetTexture(atlasSlotTypes[slot], 0, &texturePath);
+            paths[slot] = directory + '/' + texturePath.C_Str();
+            hasTextures = true;
+        }
+        if (hasTextures && singleTextures) builderMaterials[m] = builder.AddMaterial(paths);
+    }
+    builder.Build();
+    if (builder.GetAtlasedMaterialCount() == 0) return;
+
+    const std::vector<AtlasPage>& pages = builder.GetPages();
+    for (size_t page = 0; page < pages.size(); page++)
+    {
+        std::vector<Texture> textures(atlasSlotCount, Texture{ 0, "", "" });
+        for (int slot = 0; slot < atlasSlotCount; slot++)
+        {
+            if (pages[page].slots[slot].empty()) continue;
+            textures[slot].type = atlasSlotNames[slot];
+            textures[slot].path = path + ".atlas" + std::to_string(page) + "." + atlasSlotNames[slot];
+            textures[slot].id = textureManager->Adopt(textures[slot].path, UploadAtlasPage(pages[page], slot, atlasSettings));
+        }
+        atlasTextures.push_back(textures);
+    }
+    for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+    {
+        if (builderMaterials[m] >= 0) materialAtlas[m] = builder.GetPlacement(builderMaterials[m]);
+    }
+
+    long long usedTexels = 0, pageTexels = 0;
+    for (const AtlasPage& page : pages)
+    {
+        usedTexels += page.usedTexels;
+        pageTexels += (long long)page.width * page.height;
+    }
+    char line[256];
+    snprintf(line, sizeof(line), "Texture atlas: %d of %u materials (%d textures) in %zu pages, %.0f%% occupied",
+        builder.GetAtlasedMaterialCount(), scene->mNumMaterials, builder.GetAtlasedTextureCount(), pages.size(),
+        100.0 * usedTexels / std::max(pageTexels, 1ll));
+    std::cout << line << "\n";
+}
+
+void Model::reportAtlas(const aiScene* scene) const
+{
+    // Count the binds one draw of the whole model makes, with and without atlases. Mesh::Draw() skips a bind when the
+    // unit still has the same texture, so only changes between consecutive meshes count.
+    auto countBinds = [](const std::vector<std::vector<std::string>>& drawTextures)
+    {
+        std::vector<std::string> bound;
+        int binds = 0;
+        for (const std::vector<std::string>& textures : drawTextures)
+        {
+            if (bound.size() < textures.size()) bound.resize(textures.size());
+            for (size_t unit = 0; unit < textures.size(); unit++)
+            {
+                if (bound[unit] == textures[unit]) continue;
+                bound[unit] = textures[unit];
+                binds++;
+            }
+        }
+        return binds;
+    };
+
+    std::vector<std::vector<std::string>> withoutAtlas, withAtlas;
+    for (size_t i = 0; i < meshes.size(); i++)
+    {
+        withoutAtlas.push_back(getTexturePaths(scene->mMaterials[meshMaterials[i]]));
+        withAtlas.emplace_back();
+        for (const Texture& texture : meshes[i].textures) withAtlas.back().push_back(texture.path);
+    }
+    std::cout << "Texture binds per model draw: " << countBinds(withoutAtlas) << " without atlases, "
+        << countBinds(withAtlas) << " with them\n";
+}
+
+std::vector<std::string> Model::getTexturePaths(aiMaterial* mat, bool includeSpecular) const
+{
+    // In the order processMesh() gives the mesh its textures.
+    std::vector<std::string> paths;
+    for (aiTextureType type : { aiTextureType_DIFFUSE, aiTextureType_SPECULAR })
+    {
+        if (type == aiTextureType_SPECULAR && !includeSpecular) continue;
+        for (unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString texturePath;
+            mat->GetTexture(type, i, &texturePath);
+            paths.push_back(directory + '/' + texturePath.C_Str());
+        }
+    }
+    return paths;
 }
 
 void Model::processNode(aiNode* node, const aiScene* scene)
@@ -42,6 +347,7 @@ void Model::processNode(aiNode* node, const aiScene* scene)
     {
         aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
         meshes.push_back(processMesh(mesh, scene));
+        meshMaterials.push_back(mesh->mMaterialIndex);
     }
     // Process all child nodes recursively.
     for (unsigned int i = 0; i < node->mNumChildren; i++)
@@ -56,6 +362,9 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     std::vector<unsigned int> indices;
     std::vector<Texture> textures;
 
+    // Meshes with an atlased material sample their part of the atlas page instead.
+    const AtlasPlacement& atlas = materialAtlas[mesh->mMaterialIndex];
+
     // Retrieve all data about the mesh's vertices.
     for (unsigned int i = 0; i < mesh->mNumVertices; i++)
     {
@@ -65,6 +374,7 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
         if (mesh->mTextureCoords[0])
         {
             vertex.TexCoords = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+            if (atlas.page >= 0) vertex.TexCoords = atlas.offset + vertex.TexCoords * atlas.scale;
         }
         else
         {
@@ -87,15 +397,30 @@ Mesh Model::processMesh(aiMesh* mesh, const aiScene* scene)
     if (mesh->mMaterialIndex >= 0)
     {
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];
+        if (atlas.page >= 0)
+        {
+            for (int slot = 0; slot < atlasSlotCount; slot++)
+            {
+                if (material->GetTextureCount(atlasSlotTypes[slot]) > 0) textures.push_back(atlasTextures[atlas.page][slot]);
+            }
+            return Mesh(vertices, indices, textures, textureManager);
+        }
         
         std::vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
         textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
 
-        std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        if (materialPacked[mesh->mMaterialIndex].id != 0)
+        {
+            textures.push_back(materialPacked[mesh->mMaterialIndex]);
+        }
+        else
+        {
+            std::vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
+            textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
+        }
     }
 
-    return Mesh(vertices, indices, textures);
+    return Mesh(vertices, indices, textures, textureManager);
 }
 
 std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName)
@@ -121,7 +446,7 @@ std::vector<Texture> Model::loadMaterialTextures(aiMaterial* mat, aiTextureType
         if (!skip)
         {
             Texture texture;
-            texture.id = loadTexture((directory + '\\' + path.C_Str()).c_str());
+            texture.id = textureManager->Acquire(directory + '/' + path.C_Str());
             texture.type = typeName;
             texture.path = path.C_Str();
 
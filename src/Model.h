@@ -6,19 +6,46 @@
 
 #include "Mesh.h"
 #include "Shader.h"
+#include "TextureAtlas.h"
+
+class TextureManager;
+struct ImportIOStats;
 
 class Model
 {
 public:
-    Model(const char* path);
-    void Draw(Shader& shader);
+    // Textures are loaded through, and owned by, the texture manager. Materials with several scalar maps (specular,
+    // ambient occlusion, gloss) get them packed into one texture, meshes with those need the PACKED_MATERIAL shader
+    // permutation. Materials that only use small textures share atlas pages, see TextureAtlasBuilder.
+    Model(const char* path, TextureManager& textureManager, const AtlasSettings& atlasSettings = AtlasSettings());
+    ~Model();
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+    void Draw(const Shader& shader);
+
+    std::vector<Mesh>& GetMeshes() { return meshes; }
 
 private:
     std::vector<Mesh> meshes;
     std::string directory;
     std::vector<Texture> textures_loaded;
+    TextureManager* textureManager;
+    AtlasSettings atlasSettings;
+    // Where each material's textures are in the atlas pages. Page -1 for materials that use their own textures.
+    std::vector<AtlasPlacement> materialAtlas;
+    // Texture per atlas page and slot, id 0 for slots a page doesn't use.
+    std::vector<std::vector<Texture>> atlasTextures;
+    // Per material, the texture its scalar maps are packed into. Id 0 for materials that use separate textures.
+    std::vector<Texture> materialPacked;
+    // Material of every mesh, in the same order as meshes.
+    std::vector<unsigned int> meshMaterials;
 
     void loadModel(std::string path);
+    void reportImport(const std::string& path, const ImportIOStats& ioStats, double importTime) const;
+    void packMaterials(const std::string& path, const aiScene* scene);
+    void buildAtlas(const std::string& path, const aiScene* scene);
+    void reportAtlas(const aiScene* scene) const;
+    std::vector<std::string> getTexturePaths(aiMaterial* mat, bool includeSpecular = true) const;
     void processNode(aiNode* node, const aiScene* scene);
     Mesh processMesh(aiMesh* mesh, const aiScene* scene);
     std::vector<Texture> loadMaterialTextures(aiMaterial* mat, aiTextureType type, std::string typeName);
@@ -0,0 +1,738 @@
+﻿#include "Profiler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "imgui.h"
+#include "JobSystem.h"
+
+// Finished scopes of one thread. Only the owning thread writes events and only the main thread reads them, so the two
+// indices are all the synchronization needed.
+struct Profiler::ThreadBuffer
+{
+    int index = 0;
+    const char* name = nullptr;
+    std::atomic<bool> owned{ true };
+    std::atomic<uint32_t> written{ 0 };
+    std::atomic<uint32_t> read{ 0 };
+    std::atomic<int> dropped{ 0 };
+    Event events[threadBufferEvents];
+
+    // Scopes the owning thread has open.
+    int depth = 0;
+    const char* openNames[maxScopeDepth];
+    int64_t openStarts[maxScopeDepth];
+};
+
+// Timestamp queries of one frame's GPU scopes. A scope's start and end query are at 2 * index and 2 * index + 1.
+struct Profiler::GpuFrame
+{
+    struct Scope
+    {
+        const char* name;
+        int depth;
+        bool closed;
+    };
+
+    unsigned int queries[maxGpuScopesPerFrame * 2] = {};
+    std::vector<Scope> scopes;
+    // The query issued last. Queries finish in order, so once it's available all of them are.
+    int lastQuery = -1;
+    long long frameIndex = -1;
+    // CPU clock minus GPU clock, in nanoseconds, taken when the frame started.
+    int64_t clockOffset = 0;
+    bool pending = false;
+};
+
+namespace
+{
+    const std::chrono::steady_clock::time_point profilerEpoch = std::chrono::steady_clock::now();
+
+    int64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profilerEpoch).count();
+    }
+
+    // Hands a thread's buffer back to the profiler when the thread exits, so short-lived threads don't pile up buffers.
+    struct ThreadRegistration
+    {
+        void* buffer = nullptr;
+        std::atomic<bool>* owned = nullptr;
+
+        ~ThreadRegistration()
+        {
+            if (owned) owned->store(false, std::memory_order_release);
+        }
+    };
+    thread_local ThreadRegistration threadRegistration;
+
+    ImU32 getScopeColor(const char* name, bool gpu)
+    {
+        unsigned int hash = 2166136261u;
+        for (const char* c = name; *c; c++) hash = (hash ^ (unsigned char)*c) * 16777619u;
+        return ImColor::HSV((hash % 360) / 360.0f, gpu ? 0.45f : 0.6f, gpu ? 0.75f : 0.85f);
+    }
+
+    void writeJsonString(std::ostream& out, const char* text)
+    {
+        out << '"';
+        for (const char* c = text; *c; c++)
+        {
+            if (*c == '"' || *c == '\\') out << '\\' << *c;
+            else if ((unsigned char)*c < 0x20) out << ' ';
+            else out << *c;
+        }
+        out << '"';
+    }
+
+    // Trace timestamps are microseconds.
+    void writeJsonTime(std::ostream& out, const char* key, int64_t nanoseconds)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), ",\"%s\":%.3f", key, nanoseconds / 1e3);
+        out << text;
+    }
+}
+
+float Profiler::ScopeStats::GetMin() const
+{
+    if (count == 0) return 0.0f;
+    return *std::min_element(history.begin(), history.begin() + count);
+}
+
+float Profiler::ScopeStats::GetAverage() const
+{
+    if (count == 0) return 0.0f;
+    double sum = 0.0;
+    for (int i = 0; i < count; i++) sum += history[i];
+    return (float)(sum / count);
+}
+
+float Profiler::ScopeStats::GetPercentile(float percentile) const
+{
+    if (count == 0) return 0.0f;
+    std::vector<float> sorted(history.begin(), history.begin() + count);
+    size_t index = std::min((size_t)(percentile / 100.0f * count), sorted.size() - 1);
+    std::nth_element(sorted.begin(), sorted.begin() + index, sorted.end());
+    return sorted[index];
+}
+
+Profiler& Profiler::Get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+Profiler::Profiler()
+{
+    frames.resize(gpuFramesInFlight + 2);
+    for (FrameRecord& frame : frames)
+    {
+        frame.events.reserve(1024);
+        frame.counters.reserve(captureCountersPerFrame);
+    }
+    gpuScopeStack.reserve(maxScopeDepth);
+}
+
+Profiler::~Profiler()
+{
+}
+
+void Profiler::BeginFrame()
+{
+    std::lock_guard<std::mutex> lock(framesMutex);
+    const int64_t time = now();
+
+    // Close the last frame. Anything recorded before the first frame started is thrown away.
+    if (frameIndex >= 0)
+    {
+        FrameRecord& frame = *findFrame(frameIndex);
+        frame.end = time;
+        collectCpuEvents(frame);
+        addToStats(frame, false);
+
+        if (gpuInitialized)
+        {
+            GpuFrame& gpuFrame = *gpuFrames[frameIndex % gpuFramesInFlight];
+            gpuScopeStack.clear();
+            gpuFrame.pending = gpuFrame.lastQuery >= 0;
+            frame.gpuResolved = !gpuFrame.pending;
+        }
+        else
+        {
+            frame.gpuResolved = true;
+        }
+    }
+    else
+    {
+        FrameRecord discarded;
+        collectCpuEvents(discarded);
+    }
+    resolveGpuFrames(false);
+    if (capturing.load(std::memory_order_relaxed)) captureFrames();
+
+    frameIndex++;
+    FrameRecord& frame = frames[frameIndex % frames.size()];
+    frame.index = frameIndex;
+    frame.start = time;
+    frame.end = time;
+    frame.gpuResolved = false;
+    frame.events.clear();
+    frame.counters.clear();
+
+    if (!gpuInitialized)
+    {
+        for (int i = 0; i < gpuFramesInFlight; i++)
+        {
+            gpuFrames.push_back(std::make_unique<GpuFrame>());
+            gpuFrames.back()->scopes.reserve(maxGpuScopesPerFrame);
+            glGenQueries(maxGpuScopesPerFrame * 2, gpuFrames.back()->queries);
+        }
+        gpuInitialized = true;
+    }
+
+    // A frame whose results still aren't in after all this time is dropped rather than waited for.
+    GpuFrame& gpuFrame = *gpuFrames[frameIndex % gpuFramesInFlight];
+    if (gpuFrame.pending) resolveGpuFrames(true);
+    gpuFrame.scopes.clear();
+    gpuFrame.lastQuery = -1;
+    gpuFrame.frameIndex = frameIndex;
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    gpuFrame.clockOffset = now() - gpuTime;
+}
+
+void Profiler::BeginCpuScope(const char* name)
+{
+    if (!enabled) return;
+
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (buffer.depth < maxScopeDepth)
+    {
+        buffer.openNames[buffer.depth] = name;
+        buffer.openStarts[buffer.depth] = now();
+    }
+    buffer.depth++;
+}
+
+void Profiler::EndCpuScope()
+{
+    // Not checking enabled, so scopes opened before the profiler was turned off still close.
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (buffer.depth == 0) return;
+    buffer.depth--;
+    if (buffer.depth >= maxScopeDepth) return;
+
+    const uint32_t written = buffer.written.load(std::memory_order_relaxed);
+    if (written - buffer.read.load(std::memory_order_acquire) >= (uint32_t)threadBufferEvents)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    Event& event = buffer.events[written % threadBufferEvents];
+    event.name = buffer.openNames[buffer.depth];
+    event.start = buffer.openStarts[buffer.depth];
+    event.end = now();
+    event.depth = buffer.depth;
+    event.thread = buffer.index;
+    buffer.written.store(written + 1, std::memory_order_release);
+}
+
+void Profiler::BeginGpuScope(const char* name)
+{
+    GpuFrame* frame = enabled && gpuInitialized ? gpuFrames[frameIndex % gpuFramesInFlight].get() : nullptr;
+    if (!frame || frame->scopes.size() >= maxGpuScopesPerFrame)
+    {
+        gpuScopeStack.push_back(-1);
+        return;
+    }
+
+    int index = (int)frame->scopes.size();
+    frame->scopes.push_back({ name, (int)gpuScopeStack.size(), false });
+    glQueryCounter(frame->queries[index * 2], GL_TIMESTAMP);
+    frame->lastQuery = index * 2;
+    gpuScopeStack.push_back(index);
+}
+
+void Profiler::EndGpuScope()
+{
+    if (gpuScopeStack.empty()) return;
+    int index = gpuScopeStack.back();
+    gpuScopeStack.pop_back();
+    if (index < 0) return;
+
+    GpuFrame& frame = *gpuFrames[frameIndex % gpuFramesInFlight];
+    glQueryCounter(frame.queries[index * 2 + 1], GL_TIMESTAMP);
+    frame.lastQuery = index * 2 + 1;
+    frame.scopes[index].closed = true;
+}
+
+void Profiler::ReleaseGpuResources()
+{
+    for (const std::unique_ptr<GpuFrame>& frame : gpuFrames)
+    {
+        glDeleteQueries(maxGpuScopesPerFrame * 2, frame->queries);
+    }
+    gpuFrames.clear();
+    gpuScopeStack.clear();
+    gpuInitialized = false;
+}
+
+void Profiler::SetThreadName(const char* name)
+{
+    getThreadBuffer().name = name;
+}
+
+void Profiler::RecordCounter(const char* name, double value)
+{
+    if (frameIndex < 0) return;
+    FrameRecord& frame = *findFrame(frameIndex);
+    if (frame.counters.size() < (size_t)captureCountersPerFrame) frame.counters.push_back({ name, now(), value });
+}
+
+void Profiler::Mark(const char* name, const char* detail)
+{
+    if (!capturing.load(std::memory_order_relaxed)) return;
+
+    CapturedMarker marker;
+    marker.name = name;
+    marker.time = now();
+    marker.thread = getThreadBuffer().index;
+    snprintf(marker.detail, sizeof(marker.detail), "%s", detail ? detail : "");
+    std::lock_guard<std::mutex> lock(markersMutex);
+    if (capturedMarkers.size() < capturedMarkers.capacity()) capturedMarkers.push_back(marker);
+}
+
+bool Profiler::StartCapture(const std::string& path, int frameCount)
+{
+    std::lock_guard<std::mutex> lock(framesMutex);
+    return startCapture(path, frameCount);
+}
+
+bool Profiler::startCapture(const std::string& path, int frameCount)
+{
+    if (capturing.load(std::memory_order_relaxed) || frameCount <= 0) return false;
+
+    // Starts with the next frame, the current one is already under way.
+    frameCount = std::min(frameCount, maxCaptureFrames);
+    capturePath = path;
+    capturedThrough = frameIndex;
+    captureLastFrame = frameIndex + frameCount;
+    droppedCaptureEvents = 0;
+    capturedFrames.clear();
+    capturedFrames.reserve(frameCount);
+    capturedEvents.clear();
+    capturedEvents.reserve((size_t)frameCount * captureEventsPerFrame);
+    capturedCounters.clear();
+    capturedCounters.reserve((size_t)frameCount * captureCountersPerFrame);
+    {
+        std::lock_guard<std::mutex> markersLock(markersMutex);
+        capturedMarkers.clear();
+        capturedMarkers.reserve(maxCaptureMarkers);
+    }
+    lastCaptureMessage = "Capturing " + std::to_string(frameCount) + " frames";
+    capturing.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+const Profiler::FrameRecord* Profiler::GetLatestFrame() const
+{
+    const FrameRecord* latest = nullptr;
+    for (const FrameRecord& frame : frames)
+    {
+        if (frame.index < 0 || frame.index >= frameIndex || !frame.gpuResolved) continue;
+        if (!latest || frame.index > latest->index) latest = &frame;
+    }
+    return latest;
+}
+
+void Profiler::DrawWindow()
+{
+    std::lock_guard<std::mutex> lock(framesMutex);
+
+    // Keep a copy, so pausing holds on to a frame while new ones come in.
+    if (!paused)
+    {
+        if (const FrameRecord* latest = GetLatestFrame())
+        {
+            shownFrame.index = latest->index;
+            shownFrame.start = latest->start;
+            shownFrame.end = latest->end;
+            shownFrame.events.assign(latest->events.begin(), latest->events.end());
+        }
+    }
+
+    ImGui::Begin("Profiler");
+    ImGui::Checkbox("Enabled", &enabled);
+    ImGui::SameLine();
+    ImGui::Checkbox("Pause", &paused);
+    if (ImGui::CollapsingHeader("Capture"))
+    {
+        ImGui::InputText("File", captureFile, sizeof(captureFile));
+        ImGui::SliderInt("Frames", &captureFrameCount, 1, maxCaptureFrames);
+        ImGui::BeginDisabled(capturing.load(std::memory_order_relaxed));
+        if (ImGui::Button("Capture trace")) startCapture(captureFile, captureFrameCount);
+        ImGui::EndDisabled();
+        if (!lastCaptureMessage.empty()) ImGui::TextUnformatted(lastCaptureMessage.c_str());
+    }
+    for (const ScopeStats& stats : scopeStats)
+    {
+        if (std::strcmp(stats.name, "Frame") != 0) continue;
+        ImGui::Text("CPU frame: %.2f ms (min %.2f, avg %.2f, p99 %.2f)", stats.last, stats.GetMin(), stats.GetAverage(), stats.GetPercentile(99.0f));
+    }
+    if (droppedEvents > 0 || droppedGpuFrames > 0)
+    {
+        ImGui::Text("Dropped: %d CPU scopes, %d GPU frames", droppedEvents, droppedGpuFrames);
+    }
+
+    if (ImGui::CollapsingHeader("Timeline", ImGuiTreeNodeFlags_DefaultOpen) && shownFrame.index >= 0)
+    {
+        // One lane per thread that recorded something, in thread order with the GPU last, and a row per nesting level.
+        std::vector<std::pair<int, int>> lanes;
+        int64_t frameEnd = shownFrame.end;
+        for (const Event& event : shownFrame.events)
+        {
+            auto lane = std::find_if(lanes.begin(), lanes.end(), [&](const std::pair<int, int>& l) { return l.first == event.thread; });
+            if (lane == lanes.end()) lane = lanes.insert(lanes.end(), { event.thread, 0 });
+            lane->second = std::max(lane->second, event.depth + 1);
+            frameEnd = std::max(frameEnd, event.end);
+        }
+        std::sort(lanes.begin(), lanes.end(), [](const std::pair<int, int>& a, const std::pair<int, int>& b)
+        {
+            return (unsigned int)a.first < (unsigned int)b.first;
+        });
+
+        const float labelWidth = 80.0f;
+        const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+        const ImVec2 origin = ImGui::GetCursorScreenPos();
+        const float width = std::max(ImGui::GetContentRegionAvail().x - labelWidth, 50.0f);
+        const double frameLength = (double)std::max<int64_t>(frameEnd - shownFrame.start, 1);
+        ImDrawList* drawList = ImGui::GetWindowDrawList();
+
+        ImGui::Text("Frame %lld: %.2f ms", shownFrame.index, frameLength / 1e6);
+        float y = ImGui::GetCursorScreenPos().y;
+        for (const std::pair<int, int>& lane : lanes)
+        {
+            char label[32];
+            if (lane.first < 0) snprintf(label, sizeof(label), "GPU");
+            else snprintf(label, sizeof(label), "Thread %d", lane.first);
+            drawList->AddText(ImVec2(origin.x, y + 2.0f), ImGui::GetColorU32(ImGuiCol_Text), label);
+
+            for (const Event& event : shownFrame.events)
+            {
+                if (event.thread != lane.first) continue;
+                float x0 = origin.x + labelWidth + (float)((event.start - shownFrame.start) / frameLength) * width;
+                float x1 = origin.x + labelWidth + (float)((event.end - shownFrame.start) / frameLength) * width;
+                x1 = std::max(x1, x0 + 1.0f);
+                ImVec2 min(x0, y + event.depth * rowHeight);
+                ImVec2 max(x1, min.y + rowHeight - 1.0f);
+                drawList->AddRectFilled(min, max, getScopeColor(event.name, event.thread < 0));
+                if (x1 - x0 > 20.0f)
+                {
+                    drawList->PushClipRect(min, max, true);
+                    drawList->AddText(ImVec2(x0 + 2.0f, min.y + 2.0f), IM_COL32(0, 0, 0, 255), event.name);
+                    drawList->PopClipRect();
+                }
+                if (ImGui::IsMouseHoveringRect(min, max))
+                {
+                    ImGui::SetTooltip("%s (%s): %.3f ms", event.name, event.thread < 0 ? "GPU" : "CPU", (event.end - event.start) / 1e6);
+                }
+            }
+            y += lane.second * rowHeight + 4.0f;
+        }
+        ImGui::Dummy(ImVec2(labelWidth + width, y - ImGui::GetCursorScreenPos().y));
+    }
+
+    if (ImGui::CollapsingHeader("Scopes", ImGuiTreeNodeFlags_DefaultOpen) &&
+        ImGui::BeginTable("Scopes", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("");
+        ImGui::TableSetupColumn("Last ms");
+        ImGui::TableSetupColumn("Min ms");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("P99 ms");
+        ImGui::TableHeadersRow();
+        for (const ScopeStats& stats : scopeStats)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn(); ImGui::Text("%s", stats.name);
+            ImGui::TableNextColumn(); ImGui::Text(stats.gpu ? "GPU" : "CPU");
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.last);
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.GetMin());
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.GetAverage());
+            ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.GetPercentile(99.0f));
+        }
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
+
+Profiler::ThreadBuffer& Profiler::getThreadBuffer()
+{
+    if (threadRegistration.buffer) return *(ThreadBuffer*)threadRegistration.buffer;
+
+    // First scope on this thread: take over the buffer of a thread that exited, once it has been read, or add one.
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    ThreadBuffer* buffer = nullptr;
+    for (const std::unique_ptr<ThreadBuffer>& candidate : threads)
+    {
+        if (!candidate->owned.load(std::memory_order_acquire) &&
+            candidate->read.load(std::memory_order_relaxed) == candidate->written.load(std::memory_order_relaxed))
+        {
+            buffer = candidate.get();
+            buffer->owned.store(true, std::memory_order_relaxed);
+            buffer->depth = 0;
+            buffer->name = nullptr;
+            break;
+        }
+    }
+    if (!buffer)
+    {
+        threads.push_back(std::make_unique<ThreadBuffer>());
+        buffer = threads.back().get();
+        buffer->index = (int)threads.size() - 1;
+    }
+    // Job workers are named here, so the job system doesn't depend on the profiler.
+    if (JobSystem::GetCurrentWorker() >= 0) buffer->name = "Job worker";
+    threadRegistration.buffer = buffer;
+    threadRegistration.owned = &buffer->owned;
+    return *buffer;
+}
+
+Profiler::FrameRecord* Profiler::findFrame(long long index)
+{
+    FrameRecord& frame = frames[index % frames.size()];
+    return frame.index == index ? &frame : nullptr;
+}
+
+void Profiler::collectCpuEvents(FrameRecord& frame)
+{
+    std::lock_guard<std::mutex> lock(threadsMutex);
+    for (const std::unique_ptr<ThreadBuffer>& buffer : threads)
+    {
+        const uint32_t read = buffer->read.load(std::memory_order_relaxed);
+        const uint32_t written = buffer->written.load(std::memory_order_acquire);
+        for (uint32_t i = read; i != written; i++)
+        {
+            frame.events.push_back(buffer->events[i % threadBufferEvents]);
+        }
+        buffer->read.store(written, std::memory_order_release);
+        droppedEvents += buffer->dropped.exchange(0, std::memory_order_relaxed);
+    }
+}
+
+void Profiler::resolveGpuFrames(bool finalFrame)
+{
+    for (const std::unique_ptr<GpuFrame>& gpuFrame : gpuFrames)
+    {
+        if (!gpuFrame->pending) continue;
+
+        GLuint available = 0;
+        glGetQueryObjectuiv(gpuFrame->queries[gpuFrame->lastQuery], GL_QUERY_RESULT_AVAILABLE, &available);
+        FrameRecord* frame = findFrame(gpuFrame->frameIndex);
+        if (!available)
+        {
+            // Only the frame whose queries are about to be reused has to give up.
+            if (finalFrame && gpuFrame->frameIndex + gpuFramesInFlight <= frameIndex)
+            {
+                gpuFrame->pending = false;
+                droppedGpuFrames++;
+                if (frame) frame->gpuResolved = true;
+            }
+            continue;
+        }
+
+        gpuFrame->pending = false;
+        if (!frame) continue;
+        for (size_t i = 0; i < gpuFrame->scopes.size(); i++)
+        {
+            if (!gpuFrame->scopes[i].closed) continue;
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(gpuFrame->queries[i * 2], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(gpuFrame->queries[i * 2 + 1], GL_QUERY_RESULT, &end);
+            frame->events.push_back({ gpuFrame->scopes[i].name, (int64_t)start + gpuFrame->clockOffset,
+                (int64_t)end + gpuFrame->clockOffset, gpuFrame->scopes[i].depth, -1 });
+        }
+        frame->gpuResolved = true;
+        addToStats(*frame, true);
+    }
+}
+
+void Profiler::addToStats(const FrameRecord& frame, bool gpu)
+{
+    if (!gpu)
+    {
+        ScopeStats& stats = getStats("Frame", false);
+        stats.pending += (frame.end - frame.start) / 1e6;
+        stats.touched = true;
+    }
+    for (const Event& event : frame.events)
+    {
+        if ((event.thread < 0) != gpu) continue;
+        ScopeStats& stats = getStats(event.name, gpu);
+        stats.pending += (event.end - event.start) / 1e6;
+        stats.touched = true;
+    }
+
+    for (ScopeStats& stats : scopeStats)
+    {
+        if (!stats.touched || stats.gpu != gpu) continue;
+        stats.last = (float)stats.pending;
+        stats.history[stats.next] = stats.last;
+        stats.next = (stats.next + 1) % historyFrames;
+        stats.count = std::min(stats.count + 1, historyFrames);
+        stats.pending = 0.0;
+        stats.touched = false;
+    }
+}
+
+Profiler::ScopeStats& Profiler::getStats(const char* name, bool gpu)
+{
+    for (ScopeStats& stats : scopeStats)
+    {
+        if (stats.gpu == gpu && (stats.name == name || std::strcmp(stats.name, name) == 0)) return stats;
+    }
+
+    ScopeStats stats;
+    stats.name = name;
+    stats.gpu = gpu;
+    stats.history.assign(historyFrames, 0.0f);
+    scopeStats.push_back(stats);
+    return scopeStats.back();
+}
+
+void Profiler::captureFrames()
+{
+    // Copy frames in order as their GPU scopes come in. One that already left the ring is skipped.
+    while (capturedThrough < std::min(frameIndex, captureLastFrame))
+    {
+        const FrameRecord* frame = findFrame(capturedThrough + 1);
+        if (frame && !frame->gpuResolved) break;
+        capturedThrough++;
+        if (!frame) continue;
+
+        capturedFrames.push_back({ frame->index, frame->start, frame->end });
+        for (const Event& event : frame->events)
+        {
+            if (capturedEvents.size() < capturedEvents.capacity()) capturedEvents.push_back(event);
+            else droppedCaptureEvents++;
+        }
+        for (const Counter& counter : frame->counters)
+        {
+            if (capturedCounters.size() < capturedCounters.capacity()) capturedCounters.push_back(counter);
+        }
+    }
+    if (capturedThrough < captureLastFrame) return;
+
+    capturing.store(false, std::memory_order_relaxed);
+    if (writeCapture())
+    {
+        lastCaptureMessage = "Wrote " + std::to_string(capturedFrames.size()) + " frames to " + capturePath;
+        if (droppedCaptureEvents > 0) lastCaptureMessage += ", dropped " + std::to_string(droppedCaptureEvents) + " scopes";
+    }
+    else
+    {
+        lastCaptureMessage = "Failed to write " + capturePath;
+    }
+    std::cout << lastCaptureMessage << "\n";
+}
+
+bool Profiler::writeCapture()
+{
+    std::ofstream file(capturePath);
+    if (!file) return false;
+
+    // Frames and the GPU get their own tracks, ahead of the threads. Thread tracks are the profiler's thread indices.
+    const int framesTrack = 0;
+    const int gpuTrack = 1;
+    auto track = [&](int thread) { return thread < 0 ? gpuTrack : thread + 2; };
+    auto beginEvent = [&](const char* name, const char* phase, int tid)
+    {
+        file << ",\n{\"name\":";
+        writeJsonString(file, name);
+        file << ",\"ph\":\"" << phase << "\",\"pid\":1,\"tid\":" << tid;
+    };
+
+    file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    file << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"LearnOpenGL\"}}";
+    auto nameTrack = [&](int tid, const char* name)
+    {
+        beginEvent("thread_name", "M", tid);
+        file << ",\"args\":{\"name\":";
+        writeJsonString(file, name);
+        file << "}}";
+        beginEvent("thread_sort_index", "M", tid);
+        file << ",\"args\":{\"sort_index\":" << tid << "}}";
+    };
+    nameTrack(framesTrack, "Frames");
+    nameTrack(gpuTrack, "GPU");
+    {
+        std::lock_guard<std::mutex> lock(threadsMutex);
+        for (const std::unique_ptr<ThreadBuffer>& buffer : threads)
+        {
+            char name[64];
+            snprintf(name, sizeof(name), "Thread %d", buffer->index);
+            nameTrack(track(buffer->index), buffer->name ? buffer->name : name);
+        }
+    }
+
+    for (const CapturedFrame& frame : capturedFrames)
+    {
+        beginEvent("Frame", "X", framesTrack);
+        writeJsonTime(file, "ts", frame.start);
+        writeJsonTime(file, "dur", frame.end - frame.start);
+        file << ",\"args\":{\"index\":" << frame.index << "}}";
+    }
+    for (const Event& event : capturedEvents)
+    {
+        beginEvent(event.name, "X", track(event.thread));
+        writeJsonTime(file, "ts", event.start);
+        writeJsonTime(file, "dur", event.end - event.start);
+        file << "}";
+    }
+    for (const Counter& counter : capturedCounters)
+    {
+        beginEvent(counter.name, "C", framesTrack);
+        writeJsonTime(file, "ts", counter.time);
+        char value[64];
+        snprintf(value, sizeof(value), "%.17g", counter.value);
+        file << ",\"args\":{\"value\":" << value << "}}";
+    }
+
+    // Only markers inside the captured frames, the first ones may predate the capture.
+    const int64_t captureStart = capturedFrames.empty() ? 0 : capturedFrames.front().start;
+    const int64_t captureEnd = capturedFrames.empty() ? 0 : capturedFrames.back().end;
+    std::lock_guard<std::mutex> lock(markersMutex);
+    for (const CapturedMarker& marker : capturedMarkers)
+    {
+        if (marker.time < captureStart || marker.time > captureEnd) continue;
+        beginEvent(marker.name, "i", track(marker.thread));
+        writeJsonTime(file, "ts", marker.time);
+        file << ",\"s\":\"t\",\"args\":{\"detail\":";
+        writeJsonString(file, marker.detail);
+        file << "}}";
+    }
+    file << "\n]}\n";
+    return (bool)file;
+}
+
+ProfileScope::ProfileScope(const char* name, bool gpu) : gpu(gpu)
+{
+    Profiler& profiler = Profiler::Get();
+    profiler.BeginCpuScope(name);
+    if (gpu) profiler.BeginGpuScope(name);
+}
+
+ProfileScope::~ProfileScope()
+{
+    Profiler& profiler = Profiler::Get();
+    if (gpu) profiler.EndGpuScope();
+    profiler.EndCpuScope();
+}
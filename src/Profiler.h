@@ -0,0 +1,195 @@
+﻿#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// Hierarchical frame profiler. CPU scopes can be opened on any thread: each thread writes finished scopes into its own
+// ring buffer without locking, and the main thread collects them once per frame. GPU scopes are pairs of GL_TIMESTAMP
+// queries (so they nest, and work inside passes that use GL_TIME_ELAPSED themselves), read back a few frames later
+// only once the results are available, so the profiler never stalls the pipeline. GPU times are moved onto the CPU
+// clock, so both show on one timeline. A capture writes a run of frames, with counters and markers, as a trace file.
+class Profiler
+{
+public:
+    // Scope names must outlive the profiler, string literals are expected.
+    struct Event
+    {
+        const char* name;
+        // Nanoseconds since the profiler started, on the CPU clock.
+        int64_t start;
+        int64_t end;
+        int depth;
+        // Index of the thread that recorded it, or -1 for the GPU.
+        int thread;
+    };
+
+    // A value sampled once a frame, like the number of draw calls.
+    struct Counter
+    {
+        const char* name;
+        int64_t time;
+        double value;
+    };
+
+    struct FrameRecord
+    {
+        long long index = -1;
+        int64_t start = 0;
+        int64_t end = 0;
+        bool gpuResolved = false;
+        std::vector<Event> events;
+        std::vector<Counter> counters;
+    };
+
+    struct ScopeStats
+    {
+        const char* name;
+        bool gpu;
+        // Milliseconds per frame, summed over all instances of the scope in a frame, for the last historyFrames frames.
+        std::vector<float> history;
+        int next = 0;
+        int count = 0;
+        float last = 0.0f;
+        // Accumulates the frame being collected.
+        double pending = 0.0;
+        bool touched = false;
+
+        float GetMin() const;
+        float GetAverage() const;
+        float GetPercentile(float percentile) const;
+    };
+
+    static constexpr int historyFrames = 240;
+    // GPU results are read back this many frames after they were issued, at the latest.
+    static constexpr int gpuFramesInFlight = 4;
+    static constexpr int maxGpuScopesPerFrame = 64;
+    // Finished scopes a thread can hold before the main thread collects them. More are dropped.
+    static constexpr int threadBufferEvents = 4096;
+    static constexpr int maxScopeDepth = 32;
+    // Capture buffers are sized for this many frames up front, so capturing doesn't allocate. What doesn't fit is
+    // dropped.
+    static constexpr int maxCaptureFrames = 1000;
+    static constexpr int captureEventsPerFrame = 1024;
+    static constexpr int captureCountersPerFrame = 16;
+    static constexpr int maxCaptureMarkers = 4096;
+
+    bool enabled = true;
+
+    static Profiler& Get();
+    ~Profiler();
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    // Mark the start of a frame on the GL thread. Closes the last frame and collects everything it recorded.
+    void BeginFrame();
+    // Any thread.
+    void BeginCpuScope(const char* name);
+    void EndCpuScope();
+    // The GL thread only, needs a current context.
+    void BeginGpuScope(const char* name);
+    void EndGpuScope();
+    // Free the query objects while the context is still alive.
+    void ReleaseGpuResources();
+    // Any thread. Names the calling thread in captures, the name must outlive the profiler.
+    void SetThreadName(const char* name);
+    // The GL thread only. Samples a counter for the current frame.
+    void RecordCounter(const char* name, double value);
+    // Any thread. An instant in captures, like an asset being loaded. The detail is copied, and cut short if long.
+    void Mark(const char* name, const char* detail = nullptr);
+
+    // Record the next frameCount frames and write them to path as Chrome trace-event JSON, which chrome://tracing and
+    // ui.perfetto.dev open, once their GPU scopes are in. Any thread. Fails if a capture is already running.
+    bool StartCapture(const std::string& path, int frameCount);
+    bool IsCapturing() const { return capturing.load(std::memory_order_relaxed); }
+
+    // The newest frame whose GPU scopes are in (or were dropped).
+    const FrameRecord* GetLatestFrame() const;
+    const std::vector<ScopeStats>& GetScopeStats() const { return scopeStats; }
+    int GetDroppedEvents() const { return droppedEvents; }
+    int GetDroppedGpuFrames() const { return droppedGpuFrames; }
+
+    // Timeline of the latest frame and a table of rolling min/avg/p99 per scope. Can run on another thread than
+    // BeginFrame(), like a main thread building the UI while a render thread draws.
+    void DrawWindow();
+
+private:
+    struct ThreadBuffer;
+    struct GpuFrame;
+
+    struct CapturedFrame
+    {
+        long long index;
+        int64_t start;
+        int64_t end;
+    };
+
+    struct CapturedMarker
+    {
+        const char* name;
+        int64_t time;
+        int thread;
+        char detail[128];
+    };
+
+    Profiler();
+
+    std::mutex threadsMutex;
+    // Held while frames are collected and while the window reads them.
+    std::mutex framesMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    std::vector<std::unique_ptr<GpuFrame>> gpuFrames;
+    bool gpuInitialized = false;
+    std::vector<int> gpuScopeStack;
+
+    std::vector<FrameRecord> frames;
+    long long frameIndex = -1;
+    FrameRecord shownFrame;
+    std::vector<ScopeStats> scopeStats;
+    int droppedEvents = 0;
+    int droppedGpuFrames = 0;
+    bool paused = false;
+
+    std::atomic<bool> capturing{ false };
+    std::string capturePath;
+    long long captureLastFrame = -1;
+    long long capturedThrough = -1;
+    int droppedCaptureEvents = 0;
+    std::vector<CapturedFrame> capturedFrames;
+    std::vector<Event> capturedEvents;
+    std::vector<Counter> capturedCounters;
+    // Markers come from any thread, and rarely, so a lock is fine.
+    std::mutex markersMutex;
+    std::vector<CapturedMarker> capturedMarkers;
+    // The window's capture settings.
+    int captureFrameCount = 120;
+    char captureFile[256] = "trace.json";
+    std::string lastCaptureMessage;
+
+    ThreadBuffer& getThreadBuffer();
+    FrameRecord* findFrame(long long index);
+    void collectCpuEvents(FrameRecord& frame);
+    void resolveGpuFrames(bool finalFrame);
+    void addToStats(const FrameRecord& frame, bool gpu);
+    ScopeStats& getStats(const char* name, bool gpu);
+    // With framesMutex held.
+    bool startCapture(const std::string& path, int frameCount);
+    void captureFrames();
+    bool writeCapture();
+};
+
+// Times the enclosing block on the CPU, and on the GPU too if asked.
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name, bool gpu = false);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool gpu;
+};
@@ -0,0 +1,194 @@
+﻿#include "Regression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+#include "stb_image.h"
+
+namespace
+{
+    bool parseFlag(std::istringstream& line, bool& value)
+    {
+        int flag;
+        if (!(line >> flag)) return false;
+        value = flag != 0;
+        return true;
+    }
+
+    // sRGB to CIE L*a*b* under D65, where a distance of about 2.3 is just noticeable.
+    glm::vec3 toLab(const unsigned char* rgb)
+    {
+        glm::vec3 linear;
+        for (int i = 0; i < 3; i++)
+        {
+            const float c = rgb[i] / 255.0f;
+            linear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+        const glm::vec3 xyz = glm::vec3(
+            (0.4124f * linear.r + 0.3576f * linear.g + 0.1805f * linear.b) / 0.95047f,
+            0.2126f * linear.r + 0.7152f * linear.g + 0.0722f * linear.b,
+            (0.0193f * linear.r + 0.1192f * linear.g + 0.9505f * linear.b) / 1.08883f);
+
+        auto f = [](float t) { return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f; };
+        const glm::vec3 fxyz = glm::vec3(f(xyz.x), f(xyz.y), f(xyz.z));
+        return glm::vec3(116.0f * fxyz.y - 16.0f, 500.0f * (fxyz.x - fxyz.y), 200.0f * (fxyz.y - fxyz.z));
+    }
+}
+
+bool RegressionScript::Load(const std::string& path, std::string& error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = "can't open " + path;
+        return false;
+    }
+
+    scenes.clear();
+    std::string text;
+    int lineNumber = 0;
+    while (std::getline(file, text))
+    {
+        lineNumber++;
+        text = text.substr(0, text.find('#'));
+        std::istringstream line(text);
+        std::string command;
+        if (!(line >> command)) continue;
+
+        RegressionScene* scene = scenes.empty() ? nullptr : &scenes.back();
+        bool valid = true;
+        if (command == "resolution") valid = (bool)(line >> width >> height) && width > 0 && height > 0;
+        else if (command == "warmup") valid = (bool)(line >> warmupFrames);
+        else if (command == "frames") valid = (bool)(line >> measuredFrames) && measuredFrames > 0;
+        else if (command == "image-tolerance") valid = (bool)(line >> colorTolerance >> maxDifferentPixels);
+        else if (command == "cpu-threshold") valid = (bool)(line >> cpuThreshold);
+        else if (command == "gpu-threshold") valid = (bool)(line >> gpuThreshold);
+        else if (command == "min-slack") valid = (bool)(line >> minSlack);
+        else if (command == "scene")
+        {
+            scenes.emplace_back();
+            valid = (bool)(line >> scenes.back().name);
+        }
+        else if (command == "camera" && scene)
+        {
+            valid = (bool)(line >> scene->position.x >> scene->position.y >> scene->position.z >> scene->yaw >> scene->pitch >> scene->zoom);
+        }
+        else if (command == "set" && scene)
+        {
+            std::string setting;
+            line >> setting;
+            if (setting == "shadows") valid = parseFlag(line, scene->shadows);
+            else if (setting == "atlas") valid = parseFlag(line, scene->atlas);
+            else if (setting == "culling") valid = parseFlag(line, scene->lightCulling);
+            else if (setting == "wireframe") valid = parseFlag(line, scene->wireframe);
+            else valid = false;
+        }
+        else valid = false;
+
+        if (!valid)
+        {
+            error = path + ":" + std::to_string(lineNumber) + ": can't make sense of \"" + text + "\"";
+            return false;
+        }
+    }
+
+    if (scenes.empty())
+    {
+        error = path + " has no scenes";
+        return false;
+    }
+    return true;
+}
+
+ImageComparison CompareImages(const unsigned char* actual, const unsigned char* golden, int width, int height, float tolerance)
+{
+    const size_t pixelCount = (size_t)width * height;
+    std::vector<glm::vec3> actualLab(pixelCount), goldenLab(pixelCount);
+    for (size_t i = 0; i < pixelCount; i++)
+    {
+        actualLab[i] = toLab(actual + i * 3);
+        goldenLab[i] = toLab(golden + i * 3);
+    }
+
+    ImageComparison result;
+    result.diffImage.resize(pixelCount * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            const size_t index = (size_t)y * width + x;
+            float difference = glm::length(actualLab[index] - goldenLab[index]);
+            for (int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1) && difference > tolerance; ny++)
+            {
+                for (int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++)
+                {
+                    difference = std::min(difference, glm::length(actualLab[index] - goldenLab[(size_t)ny * width + nx]));
+                }
+            }
+            result.maxDifference = std::max(result.maxDifference, difference);
+
+            unsigned char* out = result.diffImage.data() + index * 3;
+            if (difference > tolerance)
+            {
+                result.differentPixels++;
+                out[0] = (unsigned char)std::min(128.0f + difference * 4.0f, 255.0f);
+                out[1] = 0;
+                out[2] = 0;
+            }
+            else
+            {
+                const unsigned char gray = (unsigned char)(actualLab[index].x * 1.28f);
+                out[0] = out[1] = out[2] = gray;
+            }
+        }
+    }
+    result.differentFraction = pixelCount > 0 ? (float)result.differentPixels / pixelCount : 0.0f;
+    return result;
+}
+
+bool ReadGoldenImage(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height)
+{
+    // Textures are loaded flipped for OpenGL, golden images are compared the way they are stored.
+    stbi_set_flip_vertically_on_load_thread(false);
+    int components;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 3);
+    stbi_set_flip_vertically_on_load_thread(true);
+    if (!data) return false;
+
+    pixels.assign(data, data + (size_t)width * height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+bool LoadTimingBaselines(const std::string& path, std::map<std::string, TimingBaseline>& baselines)
+{
+    std::ifstream file(path);
+    if (!file) return false;
+
+    std::string text;
+    std::getline(file, text);
+    while (std::getline(file, text))
+    {
+        std::replace(text.begin(), text.end(), ',', ' ');
+        std::istringstream line(text);
+        std::string name;
+        TimingBaseline baseline;
+        if (line >> name >> baseline.cpuTime >> baseline.gpuTime) baselines[name] = baseline;
+    }
+    return true;
+}
+
+bool SaveTimingBaselines(const std::string& path, const std::map<std::string, TimingBaseline>& baselines)
+{
+    std::ofstream file(path);
+    if (!file) return false;
+
+    file << "scene,cpu_ms,gpu_ms\n";
+    for (const auto& entry : baselines)
+    {
+        file << entry.first << "," << entry.second.cpuTime << "," << entry.second.gpuTime << "\n";
+    }
+    return (bool)file;
+}
@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// A view the regression harness renders and checks, as scripted in regression/scenes.txt.
+struct RegressionScene
+{
+    std::string name;
+    glm::vec3 position = glm::vec3(0.0f, 0.0f, 3.0f);
+    float yaw = -90.0f;
+    float pitch = 0.0f;
+    float zoom = 45.0f;
+    bool shadows = true;
+    bool atlas = true;
+    bool lightCulling = true;
+    bool wireframe = false;
+};
+
+// The harness settings and the scenes to run. Scripts are plain text, one command per line, with # starting a comment:
+//   resolution <width> <height>     frames are rendered at this size
+//   warmup <frames>                 least frames rendered before measuring, more while textures still stream in
+//   frames <frames>                 frames measured per scene
+//   image-tolerance <dE> <fraction> how far a pixel may be from the golden image (CIE76 delta E), and the fraction of
+//                                   pixels allowed to be further
+//   cpu-threshold <fraction>        how much slower than the baseline a scene's CPU or GPU time may get
+//   gpu-threshold <fraction>
+//   min-slack <ms>                  slowdowns smaller than this always pass, tiny timings are mostly noise
+//   scene <name>                    starts a scene, the commands after it set it up:
+//   camera <x> <y> <z> <yaw> <pitch> <zoom>
+//   set <shadows|atlas|culling|wireframe> <0|1>
+struct RegressionScript
+{
+    int width = 1280;
+    int height = 720;
+    int warmupFrames = 10;
+    int measuredFrames = 60;
+    float colorTolerance = 2.3f;
+    float maxDifferentPixels = 0.001f;
+    float cpuThreshold = 0.2f;
+    float gpuThreshold = 0.2f;
+    float minSlack = 0.25f;
+    std::vector<RegressionScene> scenes;
+
+    // Returns false with a message in error if the script can't be read or has a mistake.
+    bool Load(const std::string& path, std::string& error);
+};
+
+struct ImageComparison
+{
+    int differentPixels = 0;
+    float differentFraction = 0.0f;
+    float maxDifference = 0.0f;
+    // The actual image dimmed to gray, with differing pixels in red, brighter the further off they are.
+    std::vector<unsigned char> diffImage;
+};
+
+// Compare RGB images of the same size, top row first. A pixel counts as matching if it's within tolerance of any golden
+// pixel next to it, so edges moving by a pixel between drivers don't fail.
+ImageComparison CompareImages(const unsigned char* actual, const unsigned char* golden, int width, int height, float tolerance);
+// Read a PNG written by writePNG() as RGB, top row first.
+bool ReadGoldenImage(const std::string& path, std::vector<unsigned char>& pixels, int& width, int& height);
+
+// Median milliseconds per frame a scene took on the machine the baselines were recorded on.
+struct TimingBaseline
+{
+    double cpuTime = 0.0;
+    double gpuTime = 0.0;
+};
+
+// Baselines are a CSV with a header and one scene,cpu_ms,gpu_ms row per scene.
+bool LoadTimingBaselines(const std::string& path, std::map<std::string, TimingBaseline>& baselines);
+bool SaveTimingBaselines(const std::string& path, const std::map<std::string, TimingBaseline>& baselines);
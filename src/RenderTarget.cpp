@@ -0,0 +1,62 @@
+﻿#include "RenderTarget.h"
+
+#include <cstring>
+#include <glad/glad.h>
+
+#include "GpuResources.h"
+
+RenderTarget::RenderTarget(int width, int height) : width(width), height(height)
+{
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    TRACK_GPU_RESOURCE(GpuResourceType::Renderbuffer, colorBuffer, (size_t)width * height * 4, "Render target color");
+    TRACK_GPU_RESOURCE(GpuResourceType::Renderbuffer, depthBuffer, (size_t)width * height * 4, "Render target depth");
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+RenderTarget::~RenderTarget()
+{
+    glDeleteFramebuffers(1, &framebuffer);
+    GpuResourceTracker& tracker = GpuResourceTracker::Get();
+    tracker.Untrack(GpuResourceType::Renderbuffer, depthBuffer);
+    tracker.Untrack(GpuResourceType::Renderbuffer, colorBuffer);
+    glDeleteRenderbuffers(1, &depthBuffer);
+    glDeleteRenderbuffers(1, &colorBuffer);
+}
+
+std::vector<unsigned char> RenderTarget::ReadPixels() const
+{
+    const size_t rowBytes = (size_t)width * 3;
+    std::vector<unsigned char> pixels(rowBytes * height);
+
+    GLint previous = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previous);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, previous);
+
+    // OpenGL returns the bottom row first.
+    std::vector<unsigned char> row(rowBytes);
+    for (int y = 0; y < height / 2; y++)
+    {
+        unsigned char* top = pixels.data() + y * rowBytes;
+        unsigned char* bottom = pixels.data() + (height - 1 - y) * rowBytes;
+        std::memcpy(row.data(), top, rowBytes);
+        std::memcpy(top, bottom, rowBytes);
+        std::memcpy(bottom, row.data(), rowBytes);
+    }
+    return pixels;
+}
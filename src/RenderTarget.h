@@ -0,0 +1,31 @@
+﻿#pragma once
+
+#include <vector>
+
+// An offscreen color and depth target, for rendering without a window. The scene draws into it exactly as it would
+// into the default framebuffer.
+class RenderTarget
+{
+public:
+    RenderTarget(int width, int height);
+    ~RenderTarget();
+    RenderTarget(const RenderTarget&) = delete;
+    RenderTarget& operator=(const RenderTarget&) = delete;
+
+    bool IsComplete() const { return complete; }
+    unsigned int GetFramebuffer() const { return framebuffer; }
+    int GetWidth() const { return width; }
+    int GetHeight() const { return height; }
+
+    // Read the color attachment back as RGB, top row first. Alpha is left out, it's whatever the shaders wrote. Waits
+    // for rendering to finish.
+    std::vector<unsigned char> ReadPixels() const;
+
+private:
+    int width;
+    int height;
+    unsigned int framebuffer = 0;
+    unsigned int colorBuffer = 0;
+    unsigned int depthBuffer = 0;
+    bool complete = false;
+};
@@ -2,39 +2,13 @@
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include "AssetPack.h"
+#include "GpuResources.h"
+
 Shader::Shader(const char* vertexPath, const char* fragmentPath)
 {
-    std::string vertexCode;
-    std::string fragmentCode;
-    std::ifstream vShaderFile;
-    std::ifstream fShaderFile;
-
-    vShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-    fShaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
-
-    try
-    {
-        // Open file streams.
-        vShaderFile.open(vertexPath);
-        fShaderFile.open(fragmentPath);
-        std::stringstream vShaderStream, fShaderStream;
-
-        // Read file buffer contents into streams.
-        vShaderStream << vShaderFile.rdbuf();
-        fShaderStream << fShaderFile.rdbuf();
-
-        // Done reading - close file handlers.
-        vShaderFile.close();
-        fShaderFile.close();
-
-        // Convert stream into string.
-        vertexCode = vShaderStream.str();
-        fragmentCode = fShaderStream.str();
-    }
-    catch (std::ifstream::failure& e)
-    {
-        std::cout << "Error: shader file couldn't be read:\n" << e.what() << "\n";
-    }
+    std::string vertexCode = ReadSource(vertexPath);
+    std::string fragmentCode = ReadSource(fragmentPath);
 
     // Convert read shader code to C-like strings (with null terminator).
     const char* vShaderCode = vertexCode.c_str();
@@ -82,38 +56,87 @@ Shader::Shader(const char* vertexPath, const char* fragmentPath)
     {
         glGetProgramInfoLog(ID, 512, NULL, infoLog);
     }
+    GLint binaryLength = 0;
+    glGetProgramiv(ID, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+    TRACK_GPU_RESOURCE(GpuResourceType::Program, ID, (size_t)binaryLength, std::string(vertexPath) + ", " + fragmentPath);
 
     // Shaders aren't needed anymore after linking them to a program.
     glDeleteShader(vertexShader);
     glDeleteShader(fragmentShader);
 }
 
+Shader::Shader(unsigned int programID) : ID(programID)
+{
+}
+
+std::string Shader::ReadSource(const char* path)
+{
+    // Sources in the mounted asset pack are copied straight out of its mapping.
+    AssetView source;
+    if (FindMountedAsset(path, source)) return std::string((const char*)source.data, source.size);
+
+    std::ifstream shaderFile;
+    shaderFile.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+
+    try
+    {
+        // Open file stream and read its buffer contents into a string stream.
+        shaderFile.open(path);
+        std::stringstream shaderStream;
+        shaderStream << shaderFile.rdbuf();
+        shaderFile.close();
+
+        return shaderStream.str();
+    }
+    catch (std::ifstream::failure& e)
+    {
+        std::cout << "Error: shader file couldn't be read:\n" << path << "\n" << e.what() << "\n";
+    }
+
+    return std::string();
+}
+
 void Shader::use() const
 {
     glUseProgram(ID);
 }
 
-void Shader::setBool(const std::string& name, bool value) const
+void Shader::setBool(const char* name, bool value) const
+{
+    glUniform1i(glGetUniformLocation(ID, name), (int)value);
+}
+
+void Shader::setInt(const char* name, int value) const
+{
+    glUniform1i(glGetUniformLocation(ID, name), value);
+}
+
+void Shader::setIntArray(const char* name, const int* values, int count) const
+{
+    glUniform1iv(glGetUniformLocation(ID, name), count, values);
+}
+
+void Shader::setFloat(const char* name, float value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), (int)value);
+    glUniform1f(glGetUniformLocation(ID, name), value);
 }
 
-void Shader::setInt(const std::string& name, int value) const
+void Shader::setMat3(const char* name, const glm::mat3& value) const
 {
-    glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+    glUniformMatrix3fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
-void Shader::setFloat(const std::string& name, float value) const
+void Shader::setMat4(const char* name, const glm::mat4& value) const
 {
-    glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+    glUniformMatrix4fv(glGetUniformLocation(ID, name), 1, GL_FALSE, glm::value_ptr(value));
 }
 
-void Shader::setMat4(const std::string& name, const glm::mat4& value) const
+void Shader::setVec3(const char* name, const glm::vec3& value) const
 {
-    glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+    glUniform3fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
 }
 
-void Shader::setVec3(const std::string& name, const glm::vec3& value) const
+void Shader::setVec4(const char* name, const glm::vec4& value) const
 {
-    glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, glm::value_ptr(value));
+    glUniform4fv(glGetUniformLocation(ID, name), 1, glm::value_ptr(value));
 }
@@ -16,13 +16,21 @@ public:
 
     // Constructor that reads and builds the shaders.
     Shader(const char* vertexPath, const char* fragmentPath);
+    // Wrap an already linked program (e.g. one built by the ShaderCompiler).
+    explicit Shader(unsigned int programID);
+
+    // Read a whole shader source file into a string. Returns an empty string on failure.
+    static std::string ReadSource(const char* path);
 
     // Activate the shader.
     void use() const;
 
-    void setBool(const std::string& name, bool value) const;
-    void setInt(const std::string& name, int value) const;
-    void setFloat(const std::string& name, float value) const;
-    void setMat4(const std::string& name, const glm::mat4& value) const;
-    void setVec3(const std::string& name, const glm::vec3& value) const;
+    void setBool(const char* name, bool value) const;
+    void setInt(const char* name, int value) const;
+    void setIntArray(const char* name, const int* values, int count) const;
+    void setFloat(const char* name, float value) const;
+    void setMat3(const char* name, const glm::mat3& value) const;
+    void setMat4(const char* name, const glm::mat4& value) const;
+    void setVec3(const char* name, const glm::vec3& value) const;
+    void setVec4(const char* name, const glm::vec4& value) const;
 };
@@ -0,0 +1,236 @@
+﻿#include "ShaderCompiler.h"
+
+#include <cstring>
+
+#include "GpuResources.h"
+
+// Not part of the generated GLAD headers, so define the token from GL_KHR_parallel_shader_compile ourselves.
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+namespace
+{
+    // Fallback program shown while the real shaders are still compiling. Uses the same vertex layout and
+    // transformation uniforms as the model shader, so it can be drawn in its place.
+    const char* fallbackVertexSource = R"(#version 460 core
+layout (location = 0) in vec3 aPos;
+uniform mat4 model;
+uniform mat4 view;
+uniform mat4 projection;
+void main()
+{
+    gl_Position = projection * view * model * vec4(aPos, 1.0);
+}
+)";
+
+    const char* fallbackFragmentSource = R"(#version 460 core
+out vec4 fragColor;
+void main()
+{
+    fragColor = vec4(0.5, 0.5, 0.5, 1.0);
+}
+)";
+
+    bool hasExtension(const char* name)
+    {
+        int extensionCount = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+        for (int i = 0; i < extensionCount; i++)
+        {
+            const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+            if (extension && std::strcmp(extension, name) == 0) return true;
+        }
+        return false;
+    }
+
+    unsigned int createShader(GLenum type, const char* source)
+    {
+        unsigned int shader = glCreateShader(type);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        return shader;
+    }
+
+    void printShaderLog(unsigned int shader, const std::string& path)
+    {
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            char infoLog[512];
+            glGetShaderInfoLog(shader, 512, NULL, infoLog);
+            std::cout << "Error: shader compilation failed (" << path << "):\n" << infoLog << "\n";
+        }
+    }
+
+    // #version has to stay the first statement, so permutation defines go on the line after it.
+    std::string insertDefines(const std::string& source, const std::string& defines)
+    {
+        if (defines.empty()) return source;
+        size_t version = source.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : source.find('\n', version);
+        if (lineEnd == std::string::npos) return defines + source;
+        return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
+    }
+}
+
+ShaderCompiler::ShaderCompiler(bool batched) : batched(batched)
+{
+    parallelCompile = hasExtension("GL_KHR_parallel_shader_compile");
+
+    // The fallback is tiny, so compiling it synchronously is fine.
+    unsigned int vertexShader = createShader(GL_VERTEX_SHADER, fallbackVertexSource);
+    unsigned int fragmentShader = createShader(GL_FRAGMENT_SHADER, fallbackFragmentSource);
+    fallbackProgram = glCreateProgram();
+    glAttachShader(fallbackProgram, vertexShader);
+    glAttachShader(fallbackProgram, fragmentShader);
+    glLinkProgram(fallbackProgram);
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+    TRACK_GPU_RESOURCE(GpuResourceType::Program, fallbackProgram, 0, "Fallback shader");
+}
+
+ShaderCompiler::~ShaderCompiler()
+{
+    GpuResourceTracker& tracker = GpuResourceTracker::Get();
+    for (const PendingProgram& program : programs)
+    {
+        if (program.program == 0) continue;
+        tracker.Untrack(GpuResourceType::Program, program.program);
+        glDeleteProgram(program.program);
+    }
+    tracker.Untrack(GpuResourceType::Program, fallbackProgram);
+    glDeleteProgram(fallbackProgram);
+}
+
+unsigned int ShaderCompiler::Add(const char* vertexPath, const char* fragmentPath, const std::string& defines)
+{
+    PendingProgram program;
+    program.vertexPath = vertexPath;
+    program.fragmentPath = fragmentPath;
+    program.defines = defines;
+    programs.push_back(program);
+
+    return (unsigned int)programs.size() - 1;
+}
+
+void ShaderCompiler::Submit()
+{
+    submitTime = std::chrono::steady_clock::now();
+    compileTime = -1.0;
+
+    for (PendingProgram& program : programs)
+    {
+        if (program.state != ProgramState::Queued) continue;
+
+        startProgram(program);
+
+        // Serial mode waits for each program right away, just like the Shader constructor.
+        if (!batched) finishProgram(program);
+    }
+
+    updateCompileTime();
+}
+
+void ShaderCompiler::Poll()
+{
+    for (PendingProgram& program : programs)
+    {
+        if (program.state != ProgramState::Compiling) continue;
+
+        // Without the extension there is no way to ask without blocking, so just wait for the results.
+        if (parallelCompile)
+        {
+            int completed = GL_FALSE;
+            glGetProgramiv(program.program, GL_COMPLETION_STATUS_KHR, &completed);
+            if (!completed) continue;
+        }
+
+        finishProgram(program);
+    }
+
+    updateCompileTime();
+}
+
+bool ShaderCompiler::IsReady(unsigned int handle) const
+{
+    return handle < programs.size() && programs[handle].state == ProgramState::Ready;
+}
+
+bool ShaderCompiler::AllReady() const
+{
+    for (const PendingProgram& program : programs)
+    {
+        if (program.state == ProgramState::Queued || program.state == ProgramState::Compiling) return false;
+    }
+    return true;
+}
+
+Shader ShaderCompiler::Get(unsigned int handle) const
+{
+    if (IsReady(handle)) return Shader(programs[handle].program);
+    return Shader(fallbackProgram);
+}
+
+void ShaderCompiler::startProgram(PendingProgram& program)
+{
+    std::string vertexCode = insertDefines(Shader::ReadSource(program.vertexPath.c_str()), program.defines);
+    std::string fragmentCode = insertDefines(Shader::ReadSource(program.fragmentPath.c_str()), program.defines);
+
+    // Compile and link without querying any status, so the driver is free to work on all of them at once.
+    program.vertexShader = createShader(GL_VERTEX_SHADER, vertexCode.c_str());
+    program.fragmentShader = createShader(GL_FRAGMENT_SHADER, fragmentCode.c_str());
+
+    program.program = glCreateProgram();
+    glAttachShader(program.program, program.vertexShader);
+    glAttachShader(program.program, program.fragmentShader);
+    glLinkProgram(program.program);
+    // Sized once linked, asking now would wait for the driver.
+    TRACK_GPU_RESOURCE(GpuResourceType::Program, program.program, 0, program.vertexPath + ", " + program.fragmentPath + (program.defines.empty() ? "" : " (permutation)"));
+
+    program.state = ProgramState::Compiling;
+}
+
+void ShaderCompiler::finishProgram(PendingProgram& program)
+{
+    int success;
+    glGetProgramiv(program.program, GL_LINK_STATUS, &success);
+    if (success)
+    {
+        program.state = ProgramState::Ready;
+        GLint binaryLength = 0;
+        glGetProgramiv(program.program, GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+        GpuResourceTracker::Get().SetSize(GpuResourceType::Program, program.program, (size_t)binaryLength);
+    }
+    else
+    {
+        // Linking fails if either stage failed to compile, so report whichever went wrong.
+        printShaderLog(program.vertexShader, program.vertexPath);
+        printShaderLog(program.fragmentShader, program.fragmentPath);
+
+        char infoLog[512];
+        glGetProgramInfoLog(program.program, 512, NULL, infoLog);
+        std::cout << "Error: shader program linking failed:\n" << infoLog << "\n";
+
+        GpuResourceTracker::Get().Untrack(GpuResourceType::Program, program.program);
+        glDeleteProgram(program.program);
+        program.program = 0;
+        program.state = ProgramState::Failed;
+    }
+
+    // Shaders aren't needed anymore after linking them to a program.
+    glDeleteShader(program.vertexShader);
+    glDeleteShader(program.fragmentShader);
+    program.vertexShader = 0;
+    program.fragmentShader = 0;
+}
+
+void ShaderCompiler::updateCompileTime()
+{
+    if (compileTime >= 0.0 || !AllReady()) return;
+
+    compileTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - submitTime).count();
+    std::cout << "Shader compilation (" << (batched ? "batched" : "serial") << "): " << programs.size()
+        << " programs in " << compileTime << " ms\n";
+}
@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "Shader.h"
+
+// Compiles a batch of shader programs. In batched mode, all shaders are submitted to the driver up front and their
+// completion is polled without blocking (using GL_KHR_parallel_shader_compile where available). In serial mode, every
+// program is compiled and checked one after the other, like the Shader constructor does.
+// Until a program has finished compiling, Get() hands out a simple fallback program instead.
+class ShaderCompiler
+{
+public:
+    // Needs a current OpenGL context, since the fallback program is built right away.
+    ShaderCompiler(bool batched = true);
+    // Deletes every program, including ones handed out through Get().
+    ~ShaderCompiler();
+    ShaderCompiler(const ShaderCompiler&) = delete;
+    ShaderCompiler& operator=(const ShaderCompiler&) = delete;
+
+    // Queue a program for compilation. The returned handle is used to retrieve the program later on. defines (e.g.
+    // "#define PACKED_MATERIAL\n") go right after the #version line of both shaders, to build a permutation.
+    unsigned int Add(const char* vertexPath, const char* fragmentPath, const std::string& defines = "");
+    // Submit all queued programs to the driver.
+    void Submit();
+    // Check which submitted programs have finished. Never blocks if parallel compilation is supported.
+    void Poll();
+
+    bool IsReady(unsigned int handle) const;
+    bool AllReady() const;
+    // Returns the requested program if it is ready, otherwise the fallback program.
+    Shader Get(unsigned int handle) const;
+
+    bool IsBatched() const { return batched; }
+    bool HasParallelCompile() const { return parallelCompile; }
+    // Wall time from Submit() until the last program finished, in milliseconds. Negative while still compiling.
+    double GetCompileTime() const { return compileTime; }
+
+private:
+    enum class ProgramState
+    {
+        Queued,
+        Compiling,
+        Ready,
+        Failed
+    };
+
+    struct PendingProgram
+    {
+        std::string vertexPath;
+        std::string fragmentPath;
+        std::string defines;
+        unsigned int vertexShader = 0;
+        unsigned int fragmentShader = 0;
+        unsigned int program = 0;
+        ProgramState state = ProgramState::Queued;
+    };
+
+    std::vector<PendingProgram> programs;
+    unsigned int fallbackProgram = 0;
+    bool batched;
+    bool parallelCompile = false;
+    double compileTime = -1.0;
+    std::chrono::steady_clock::time_point submitTime;
+
+    void startProgram(PendingProgram& program);
+    void finishProgram(PendingProgram& program);
+    void updateCompileTime();
+};
@@ -0,0 +1,221 @@
+﻿#include "ShadowAtlas.h"
+#include "FrameArena.h"
+#include "GpuResources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtc/matrix_transform.hpp>
+
+namespace
+{
+    // Light IDs used with the scheduler: point lights use their index, the spot light comes after them.
+    const int spotLightId = NR_POINT_LIGHTS;
+    const float shadowNearPlane = 0.05f;
+
+    // Cube face directions in the usual +X, -X, +Y, -Y, +Z, -Z order. The shader picks faces in the same order.
+    const glm::vec3 faceDirections[6] = {
+        glm::vec3( 1.0f,  0.0f,  0.0f), glm::vec3(-1.0f,  0.0f,  0.0f),
+        glm::vec3( 0.0f,  1.0f,  0.0f), glm::vec3( 0.0f, -1.0f,  0.0f),
+        glm::vec3( 0.0f,  0.0f,  1.0f), glm::vec3( 0.0f,  0.0f, -1.0f)
+    };
+    const glm::vec3 faceUps[6] = {
+        glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f),
+        glm::vec3(0.0f,  0.0f,  1.0f), glm::vec3(0.0f,  0.0f, -1.0f),
+        glm::vec3(0.0f, -1.0f,  0.0f), glm::vec3(0.0f, -1.0f,  0.0f)
+    };
+
+    // FNV-1a over raw float values, enough to notice when anything about a light's view changed.
+    uint64_t hashFloats(std::initializer_list<float> values)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (float value : values)
+        {
+            uint32_t bits;
+            std::memcpy(&bits, &value, sizeof(bits));
+            for (int i = 0; i < 4; i++)
+            {
+                hash ^= (bits >> (i * 8)) & 0xFF;
+                hash *= 1099511628211ull;
+            }
+        }
+        return hash;
+    }
+
+    // Rough fraction of the screen height a light's range covers, seen from the camera.
+    float screenCoverage(const glm::vec3& lightPosition, float range, const glm::vec3& cameraPosition, float fovY)
+    {
+        float distance = glm::length(lightPosition - cameraPosition);
+        if (distance <= range) return 1.0f;
+        return std::min(1.0f, range / (distance * std::tan(fovY * 0.5f)));
+    }
+}
+
+ShadowAtlas::ShadowAtlas() : scheduler(atlasSize, 128, 1024)
+{
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, atlasSize, atlasSize);
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, depthTexture, (size_t)atlasSize * atlasSize * 4, "Shadow atlas");
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+ShadowAtlas::~ShadowAtlas()
+{
+    glDeleteFramebuffers(1, &framebuffer);
+    GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, depthTexture);
+    glDeleteTextures(1, &depthTexture);
+}
+
+int ShadowAtlas::GetTileSize(int lightId) const
+{
+    for (const ShadowAtlasScheduler::Assignment& assignment : scheduler.GetAssignments())
+    {
+        if (assignment.lightId == lightId) return assignment.tiles[0].size;
+    }
+    return 0;
+}
+
+void ShadowAtlas::Update(const PointLight* pointLights, const SpotLight& spotLight, const glm::vec3& cameraPosition,
+    float fovY, const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters)
+{
+    renderedTiles = 0;
+    for (Slot& slot : slots)
+    {
+        slot.active = false;
+    }
+    if (!enabled) return;
+
+    // Build a request for every shadow casting light. Importance is screen coverage weighted by brightness.
+    std::vector<ShadowAtlasScheduler::Request> requests;
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        const PointLight& light = pointLights[i];
+        if (!light.castShadows) continue;
+
+        float coverage = screenCoverage(light.position, shadowRange, cameraPosition, fovY);
+
+        ShadowAtlasScheduler::Request request;
+        request.lightId = i;
+        request.faceCount = 6;
+        request.importance = coverage * std::max(light.color.r, std::max(light.color.g, light.color.b));
+        request.desiredSize = (int)(coverage * scheduler.GetMaxTileSize());
+        request.viewHash = hashFloats({ light.position.x, light.position.y, light.position.z, shadowRange });
+        requests.push_back(request);
+    }
+    if (spotLight.castShadows)
+    {
+        // The spot light is attached to the camera, so it always covers the whole screen.
+        ShadowAtlasScheduler::Request request;
+        request.lightId = spotLightId;
+        request.faceCount = 1;
+        request.importance = 1.0f + std::max(spotLight.color.r, std::max(spotLight.color.g, spotLight.color.b));
+        request.desiredSize = scheduler.GetMaxTileSize();
+        request.viewHash = hashFloats({ spotLight.position.x, spotLight.position.y, spotLight.position.z,
+            spotLight.direction.x, spotLight.direction.y, spotLight.direction.z, spotLight.outerCutOff, shadowRange });
+        requests.push_back(request);
+    }
+
+    const std::vector<ShadowAtlasScheduler::Assignment>& assignments = scheduler.Schedule(requests, casterVersion);
+
+    // Render whatever changed into the atlas.
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glEnable(GL_SCISSOR_TEST);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+    depthShader.use();
+
+    for (const ShadowAtlasScheduler::Assignment& assignment : assignments)
+    {
+        if (assignment.lightId == spotLightId)
+        {
+            // Cover the outer cone, plus a little so PCF at the edge doesn't sample outside.
+            glm::vec3 up = std::abs(spotLight.direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+            glm::mat4 lightView = glm::lookAt(spotLight.position, spotLight.position + spotLight.direction, up);
+            float fov = std::min(glm::radians(spotLight.outerCutOff * 2.0f + 5.0f), glm::radians(179.0f));
+            glm::mat4 lightProjection = glm::perspective(fov, 1.0f, shadowNearPlane, shadowRange);
+
+            Slot& slot = slots[spotLightSlot];
+            slot.active = true;
+            slot.tile = assignment.tiles[0];
+            slot.lightSpaceMatrix = lightProjection * lightView;
+            if (assignment.needsRender) renderTile(slot.tile, slot.lightSpaceMatrix, depthShader, drawCasters);
+        }
+        else
+        {
+            const glm::vec3& position = pointLights[assignment.lightId].position;
+            glm::mat4 lightProjection = glm::perspective(glm::radians(90.0f), 1.0f, shadowNearPlane, shadowRange);
+
+            for (int face = 0; face < 6; face++)
+            {
+                Slot& slot = slots[assignment.lightId * 6 + face];
+                slot.active = true;
+                slot.tile = assignment.tiles[face];
+                slot.lightSpaceMatrix = lightProjection * glm::lookAt(position, position + faceDirections[face], faceUps[face]);
+                if (assignment.needsRender) renderTile(slot.tile, slot.lightSpaceMatrix, depthShader, drawCasters);
+            }
+        }
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glDisable(GL_SCISSOR_TEST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void ShadowAtlas::renderTile(const ShadowTile& tile, const glm::mat4& lightSpaceMatrix, const Shader& depthShader,
+    const std::function<void(const Shader&)>& drawCasters)
+{
+    // The scissor keeps the clear from wiping the other tiles.
+    glViewport(tile.x, tile.y, tile.size, tile.size);
+    glScissor(tile.x, tile.y, tile.size, tile.size);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    depthShader.setMat4("lightSpaceMatrix", lightSpaceMatrix);
+    drawCasters(depthShader);
+    renderedTiles++;
+}
+
+void ShadowAtlas::Bind(const Shader& shader, const glm::mat4& view) const
+{
+    shader.setInt("shadowAtlas", textureUnit);
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D, depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Lighting happens in view space. Point lights pick their cube face by world space direction.
+    const glm::mat4 inverseView = glm::inverse(view);
+    shader.setMat3("shadowViewToWorld", glm::mat3(inverseView));
+    shader.setFloat("shadowBias", depthBias);
+
+    FrameArena& arena = FrameArena::Get();
+    for (int i = 0; i < NR_POINT_LIGHTS; i++)
+    {
+        shader.setInt(arena.Format("pointLights[%d].shadowTile", i), slots[i * 6].active ? i * 6 : -1);
+    }
+    shader.setInt("spotLight.shadowTile", slots[spotLightSlot].active ? spotLightSlot : -1);
+
+    for (int i = 0; i < slotCount; i++)
+    {
+        if (!slots[i].active) continue;
+
+        const ShadowTile& tile = slots[i].tile;
+        shader.setMat4(arena.Format("shadowTileMatrices[%d]", i), slots[i].lightSpaceMatrix * inverseView);
+        shader.setVec4(arena.Format("shadowTileRects[%d]", i), glm::vec4(tile.x, tile.y, tile.size, tile.size) / (float)atlasSize);
+    }
+}
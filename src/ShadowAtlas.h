@@ -0,0 +1,63 @@
+﻿#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "Lights.h"
+#include "Shader.h"
+#include "ShadowAtlasScheduler.h"
+
+// Shadows for the point lights and the spot light, all rendered into tiles of one big depth texture.
+// Tile sizes scale with how much of the screen a light can affect, and tiles are only re-rendered when the light's view
+// or the shadow casters changed.
+class ShadowAtlas
+{
+public:
+    // Texture unit the atlas is bound to, next to the cascaded shadow map.
+    static constexpr int textureUnit = 9;
+    static constexpr int atlasSize = 4096;
+    // Tile slots in the shader: six per point light, followed by one for the spot light.
+    static constexpr int spotLightSlot = NR_POINT_LIGHTS * 6;
+    static constexpr int slotCount = spotLightSlot + 1;
+
+    bool enabled = true;
+    // Far plane of the light projections. Also used to estimate how much of the screen a light can affect.
+    float shadowRange = 15.0f;
+    float depthBias = 0.0005f;
+
+    ShadowAtlas();
+    ~ShadowAtlas();
+    ShadowAtlas(const ShadowAtlas&) = delete;
+    ShadowAtlas& operator=(const ShadowAtlas&) = delete;
+
+    // Schedule tiles for all shadow casting lights and render the ones that changed.
+    void Update(const PointLight* pointLights, const SpotLight& spotLight, const glm::vec3& cameraPosition, float fovY,
+        const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters);
+    // Send tile matrices and rectangles to a lighting shader and bind the atlas.
+    void Bind(const Shader& shader, const glm::mat4& view) const;
+    // Force every light to re-render, e.g. after shadow casting geometry changed.
+    void InvalidateCasters() { casterVersion++; }
+
+    const ShadowAtlasScheduler& GetScheduler() const { return scheduler; }
+    int GetRenderedTileCount() const { return renderedTiles; }
+    // Tile size of a light's tiles, 0 if it currently has none.
+    int GetTileSize(int lightId) const;
+
+private:
+    struct Slot
+    {
+        bool active = false;
+        glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
+        ShadowTile tile;
+    };
+
+    ShadowAtlasScheduler scheduler;
+    Slot slots[slotCount];
+    unsigned int depthTexture = 0;
+    unsigned int framebuffer = 0;
+    unsigned int casterVersion = 0;
+    int renderedTiles = 0;
+
+    void renderTile(const ShadowTile& tile, const glm::mat4& lightSpaceMatrix, const Shader& depthShader,
+        const std::function<void(const Shader&)>& drawCasters);
+};
@@ -0,0 +1,248 @@
+﻿#include "ShadowAtlasScheduler.h"
+
+#include <algorithm>
+
+namespace
+{
+    int roundUpToPowerOfTwo(int value)
+    {
+        int result = 1;
+        while (result < value) result <<= 1;
+        return result;
+    }
+}
+
+ShadowAtlasAllocator::ShadowAtlasAllocator(int atlasSize, int minTileSize) : atlasSize(atlasSize), minTileSize(minTileSize)
+{
+    Clear();
+}
+
+int ShadowAtlasAllocator::levelOf(int size) const
+{
+    int level = 0;
+    for (int levelSize = atlasSize; levelSize > size; levelSize >>= 1)
+    {
+        level++;
+    }
+    return level;
+}
+
+void ShadowAtlasAllocator::Clear()
+{
+    freeTiles.assign(levelOf(minTileSize) + 1, std::vector<ShadowTile>());
+    ShadowTile root;
+    root.size = atlasSize;
+    freeTiles[0].push_back(root);
+    usedArea = 0;
+}
+
+bool ShadowAtlasAllocator::Allocate(int size, ShadowTile& tile)
+{
+    if (size < minTileSize || size > atlasSize) return false;
+
+    // Find the smallest free tile that's at least as big as requested.
+    int targetLevel = levelOf(size);
+    int level = targetLevel;
+    while (level >= 0 && freeTiles[level].empty())
+    {
+        level--;
+    }
+    if (level < 0) return false;
+
+    ShadowTile current = freeTiles[level].back();
+    freeTiles[level].pop_back();
+
+    // Split it down to the requested size, keeping the other three quarters around as free tiles.
+    while (level < targetLevel)
+    {
+        level++;
+        int half = current.size / 2;
+        freeTiles[level].push_back({ current.x + half, current.y, half });
+        freeTiles[level].push_back({ current.x, current.y + half, half });
+        freeTiles[level].push_back({ current.x + half, current.y + half, half });
+        current.size = half;
+    }
+
+    tile = current;
+    usedArea += (long long)size * size;
+    return true;
+}
+
+void ShadowAtlasAllocator::Free(const ShadowTile& tile)
+{
+    usedArea -= (long long)tile.size * tile.size;
+
+    ShadowTile current = tile;
+    int level = levelOf(current.size);
+    while (level > 0)
+    {
+        // Merge with the three siblings if all of them are free as well.
+        int parentSize = current.size * 2;
+        int parentX = current.x - current.x % parentSize;
+        int parentY = current.y - current.y % parentSize;
+
+        std::vector<ShadowTile>& list = freeTiles[level];
+        int siblings = 0;
+        for (const ShadowTile& t : list)
+        {
+            if (t.x - t.x % parentSize == parentX && t.y - t.y % parentSize == parentY) siblings++;
+        }
+        if (siblings < 3) break;
+
+        list.erase(std::remove_if(list.begin(), list.end(), [&](const ShadowTile& t)
+            {
+                return t.x - t.x % parentSize == parentX && t.y - t.y % parentSize == parentY;
+            }), list.end());
+
+        current = { parentX, parentY, parentSize };
+        level--;
+    }
+
+    freeTiles[level].push_back(current);
+}
+
+ShadowAtlasScheduler::ShadowAtlasScheduler(int atlasSize, int minTileSize, int maxTileSize)
+    : allocator(atlasSize, minTileSize), minTileSize(minTileSize), maxTileSize(maxTileSize)
+{
+}
+
+void ShadowAtlasScheduler::Clear()
+{
+    allocator.Clear();
+    entries.clear();
+    assignments.clear();
+}
+
+bool ShadowAtlasScheduler::allocateEntry(Entry& entry, int faceCount, int size)
+{
+    for (int i = 0; i < faceCount; i++)
+    {
+        if (!allocator.Allocate(size, entry.tiles[i]))
+        {
+            // All faces or nothing.
+            for (int j = 0; j < i; j++)
+            {
+                allocator.Free(entry.tiles[j]);
+            }
+            return false;
+        }
+    }
+    entry.faceCount = faceCount;
+    return true;
+}
+
+void ShadowAtlasScheduler::freeEntry(Entry& entry)
+{
+    for (int i = 0; i < entry.faceCount; i++)
+    {
+        allocator.Free(entry.tiles[i]);
+    }
+    entry.faceCount = 0;
+}
+
+bool ShadowAtlasScheduler::evictLeastRecentlyUsed(bool unrequestedOnly)
+{
+    // Only lights that weren't handled yet this frame can lose their tiles.
+    auto oldest = entries.end();
+    for (auto it = entries.begin(); it != entries.end(); ++it)
+    {
+        if (it->second.lastUsedFrame == frame) continue;
+        if (unrequestedOnly && it->second.lastRequestedFrame == frame) continue;
+        if (oldest == entries.end() || it->second.lastUsedFrame < oldest->second.lastUsedFrame) oldest = it;
+    }
+    if (oldest == entries.end()) return false;
+
+    freeEntry(oldest->second);
+    entries.erase(oldest);
+    evictions++;
+    return true;
+}
+
+const std::vector<ShadowAtlasScheduler::Assignment>& ShadowAtlasScheduler::Schedule(std::vector<Request> requests, unsigned int casterVersion)
+{
+    frame++;
+    assignments.clear();
+
+    // Most important lights first, so they get the space they want.
+    std::sort(requests.begin(), requests.end(), [](const Request& a, const Request& b) { return a.importance > b.importance; });
+    for (const Request& request : requests)
+    {
+        auto it = entries.find(request.lightId);
+        if (it != entries.end()) it->second.lastRequestedFrame = frame;
+    }
+
+    for (const Request& request : requests)
+    {
+        int size = std::clamp(roundUpToPowerOfTwo(request.desiredSize), minTileSize, maxTileSize);
+
+        auto it = entries.find(request.lightId);
+        bool hasOld = it != entries.end() && it->second.faceCount == request.faceCount;
+        if (hasOld && size < it->second.tiles[0].size && request.desiredSize > it->second.tiles[0].size / 2 * shrinkThreshold)
+        {
+            size = it->second.tiles[0].size;
+        }
+        if (hasOld && it->second.tiles[0].size < size)
+        {
+            // Try to grow, but keep the current tiles if there's no room. Growing may only evict lights that aren't
+            // needed this frame, otherwise two lights could keep taking each other's tiles every frame.
+            it->second.lastUsedFrame = frame;
+
+            Entry grown;
+            bool allocated = allocateEntry(grown, request.faceCount, size);
+            while (!allocated && evictLeastRecentlyUsed(true))
+            {
+                allocated = allocateEntry(grown, request.faceCount, size);
+            }
+            if (allocated)
+            {
+                freeEntry(it->second);
+                it->second = grown;
+            }
+        }
+        else if (!hasOld || it->second.tiles[0].size != size)
+        {
+            // Give up the old tiles (if any) before looking for new ones.
+            if (it != entries.end())
+            {
+                freeEntry(it->second);
+                entries.erase(it);
+            }
+
+            // Evict old tiles until it fits. If it still doesn't, settle for smaller tiles.
+            Entry entry;
+            bool allocated = false;
+            while (!allocated && size >= minTileSize)
+            {
+                allocated = allocateEntry(entry, request.faceCount, size);
+                while (!allocated && evictLeastRecentlyUsed(false))
+                {
+                    allocated = allocateEntry(entry, request.faceCount, size);
+                }
+                if (!allocated) size /= 2;
+            }
+            if (!allocated) continue;
+
+            it = entries.emplace(request.lightId, entry).first;
+        }
+
+        Entry& entry = it->second;
+        entry.lastUsedFrame = frame;
+
+        Assignment assignment;
+        assignment.lightId = request.lightId;
+        assignment.faceCount = entry.faceCount;
+        for (int i = 0; i < entry.faceCount; i++)
+        {
+            assignment.tiles[i] = entry.tiles[i];
+        }
+        // Only re-render if the tiles are new or what the light sees has changed.
+        assignment.needsRender = !entry.rendered || entry.viewHash != request.viewHash || entry.casterVersion != casterVersion;
+        assignments.push_back(assignment);
+
+        entry.rendered = true;
+        entry.viewHash = request.viewHash;
+        entry.casterVersion = casterVersion;
+    }
+
+    return assignments;
+}
@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+// A square tile inside the shadow atlas, in texels.
+struct ShadowTile
+{
+    int x = 0;
+    int y = 0;
+    int size = 0;
+};
+
+// Quadtree (buddy) allocator for power-of-two tiles inside a square atlas. Pure CPU code without any GL calls.
+// Freed tiles are merged with their three siblings again once all of them are free.
+class ShadowAtlasAllocator
+{
+public:
+    ShadowAtlasAllocator(int atlasSize, int minTileSize);
+
+    // Allocate a tile of the given power-of-two size. Returns false if there's no free space left for it.
+    bool Allocate(int size, ShadowTile& tile);
+    void Free(const ShadowTile& tile);
+    void Clear();
+
+    int GetAtlasSize() const { return atlasSize; }
+    // Number of texels currently handed out.
+    long long GetUsedArea() const { return usedArea; }
+
+private:
+    int atlasSize;
+    int minTileSize;
+    long long usedArea = 0;
+    // Free tiles, one list per quadtree level. Level 0 is the whole atlas.
+    std::vector<std::vector<ShadowTile>> freeTiles;
+
+    int levelOf(int size) const;
+};
+
+// Decides which lights get shadow tiles of what size, and which of them need to be re-rendered this frame.
+// Tiles of lights that aren't requested anymore stay cached until their space is needed, at which point the least
+// recently used ones are evicted first. Tiles grow as soon as a light wants more detail, but only shrink once it wants
+// clearly less, so a light near a size boundary doesn't re-render at a new size every frame. Pure CPU code without any
+// GL calls.
+class ShadowAtlasScheduler
+{
+public:
+    // Tiles shrink to half once the desired size drops to this fraction of that half.
+    static constexpr float shrinkThreshold = 0.75f;
+
+    struct Request
+    {
+        int lightId = 0;
+        // 6 for point lights (one tile per cube face), 1 for spot lights.
+        int faceCount = 1;
+        // Lights with higher importance get their tiles first and may evict less important ones.
+        float importance = 0.0f;
+        int desiredSize = 0;
+        // Hash of everything that affects what the light sees (position, direction, projection).
+        uint64_t viewHash = 0;
+    };
+
+    struct Assignment
+    {
+        int lightId = 0;
+        int faceCount = 0;
+        ShadowTile tiles[6];
+        bool needsRender = false;
+    };
+
+    ShadowAtlasScheduler(int atlasSize, int minTileSize, int maxTileSize);
+
+    // Assign tiles for this frame. casterVersion should change whenever shadow casting geometry changes.
+    const std::vector<Assignment>& Schedule(std::vector<Request> requests, unsigned int casterVersion);
+    // Drop all tiles, e.g. after the atlas was reallocated.
+    void Clear();
+
+    const std::vector<Assignment>& GetAssignments() const { return assignments; }
+    const ShadowAtlasAllocator& GetAllocator() const { return allocator; }
+    int GetMinTileSize() const { return minTileSize; }
+    int GetMaxTileSize() const { return maxTileSize; }
+    int GetEvictionCount() const { return evictions; }
+
+private:
+    struct Entry
+    {
+        int faceCount = 0;
+        ShadowTile tiles[6];
+        uint64_t viewHash = 0;
+        unsigned int casterVersion = 0;
+        long long lastUsedFrame = 0;
+        long long lastRequestedFrame = 0;
+        bool rendered = false;
+    };
+
+    ShadowAtlasAllocator allocator;
+    int minTileSize;
+    int maxTileSize;
+    long long frame = 0;
+    int evictions = 0;
+    std::unordered_map<int, Entry> entries;
+    std::vector<Assignment> assignments;
+
+    bool allocateEntry(Entry& entry, int faceCount, int size);
+    void freeEntry(Entry& entry);
+    bool evictLeastRecentlyUsed(bool unrequestedOnly);
+};
@@ -0,0 +1,247 @@
+﻿#include "ShadowCascades.h"
+#include "FrameArena.h"
+#include "GpuResources.h"
+
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/matrix_transform.hpp>
+
+CascadedShadowMap::CascadedShadowMap()
+{
+    for (int i = 0; i < maxCascades; i++)
+    {
+        glGenQueries(1, &cascades[i].timerQuery);
+    }
+    glGenFramebuffers(1, &framebuffer);
+}
+
+CascadedShadowMap::~CascadedShadowMap()
+{
+    for (int i = 0; i < maxCascades; i++)
+    {
+        glDeleteQueries(1, &cascades[i].timerQuery);
+    }
+    glDeleteFramebuffers(1, &framebuffer);
+    GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, depthTexture);
+    glDeleteTextures(1, &depthTexture);
+}
+
+void CascadedShadowMap::allocate()
+{
+    GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, depthTexture);
+    glDeleteTextures(1, &depthTexture);
+
+    // One depth layer per cascade, sampled with hardware depth comparison.
+    glGenTextures(1, &depthTexture);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, resolution, resolution, cascadeCount);
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, depthTexture, (size_t)resolution * resolution * cascadeCount * 4, "Shadow cascades");
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    // Everything outside of the shadow map is lit.
+    const float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    allocatedResolution = resolution;
+    allocatedCascades = cascadeCount;
+
+    // New storage means all cached contents are gone.
+    for (int i = 0; i < maxCascades; i++)
+    {
+        cascades[i].valid = false;
+    }
+}
+
+void CascadedShadowMap::InvalidateStatic()
+{
+    for (int i = 0; i < maxCascades; i++)
+    {
+        cascades[i].valid = false;
+    }
+}
+
+void CascadedShadowMap::Update(const glm::mat4& view, float fovY, float aspect, float nearPlane,
+    const glm::vec3& lightDirection, const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters)
+{
+    cascadeCount = std::clamp(cascadeCount, 1, maxCascades);
+    if (resolution != allocatedResolution || cascadeCount != allocatedCascades) allocate();
+
+    for (int i = 0; i < maxCascades; i++)
+    {
+        cascades[i].updatedThisFrame = false;
+    }
+    // A zero direction (possible through the UI) has no meaningful light space.
+    if (!enabled || glm::length(lightDirection) < 0.0001f) return;
+
+    const glm::vec3 direction = glm::normalize(lightDirection);
+    const glm::mat4 inverseView = glm::inverse(view);
+    const float tanHalfFovY = std::tan(fovY * 0.5f);
+    const float tanHalfFovX = tanHalfFovY * aspect;
+
+    float splitNear = nearPlane;
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        Cascade& cascade = cascades[i];
+
+        // Practical split scheme: blend between uniform and logarithmic split distances.
+        float fraction = (float)(i + 1) / cascadeCount;
+        float uniformSplit = nearPlane + (shadowDistance - nearPlane) * fraction;
+        float logSplit = nearPlane * std::pow(shadowDistance / nearPlane, fraction);
+        float splitFar = uniformSplit + (logSplit - uniformSplit) * splitLambda;
+        cascade.splitFar = splitFar;
+
+        // Bounding sphere of the frustum slice. Its radius only depends on the slice's shape, not on the camera's
+        // orientation, so the cascade's size doesn't change (and its texels don't swim) when the camera rotates.
+        glm::vec3 corners[8];
+        int corner = 0;
+        for (float depth : { splitNear, splitFar })
+        {
+            for (float x : { -1.0f, 1.0f })
+            {
+                for (float y : { -1.0f, 1.0f })
+                {
+                    glm::vec4 viewCorner = glm::vec4(x * tanHalfFovX * depth, y * tanHalfFovY * depth, -depth, 1.0f);
+                    corners[corner++] = glm::vec3(inverseView * viewCorner);
+                }
+            }
+        }
+        glm::vec3 center = glm::vec3(0.0f);
+        for (const glm::vec3& c : corners) center += c;
+        center /= 8.0f;
+        float radius = 0.0f;
+        for (const glm::vec3& c : corners) radius = std::max(radius, glm::length(c - center));
+        // Round up a little, so floating point noise can't change the size from frame to frame.
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        splitNear = splitFar;
+
+        bool cached = i >= firstCachedCascade;
+        bool needsUpdate = !cached || !cascade.valid;
+        if (cached && !needsUpdate)
+        {
+            bool lightChanged = glm::dot(direction, cascade.lightDirection) < 0.9999f;
+            bool leftCoverage = glm::length(center - cascade.center) + radius > cascade.radius;
+            bool intervalElapsed = cachedUpdateInterval > 0 && cascade.framesSinceUpdate >= cachedUpdateInterval;
+            needsUpdate = lightChanged || leftCoverage || intervalElapsed;
+        }
+
+        if (!needsUpdate)
+        {
+            cascade.framesSinceUpdate++;
+            continue;
+        }
+
+        fitCascade(cascade, center, cached ? radius * cacheMargin : radius, direction);
+        renderCascade(i, depthShader, drawCasters);
+    }
+}
+
+void CascadedShadowMap::fitCascade(Cascade& cascade, const glm::vec3& center, float radius, const glm::vec3& lightDirection) const
+{
+    // Casters between the light and the slice must still end up in the map, so extend the depth range towards the light.
+    const float casterMargin = 50.0f;
+
+    glm::vec3 up = std::abs(lightDirection.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+    glm::mat4 lightView = glm::lookAt(glm::vec3(0.0f), lightDirection, up);
+
+    // Snap the cascade center to whole texels in light space, so the rasterized shadow edges stay put as the camera moves.
+    glm::vec3 lightCenter = glm::vec3(lightView * glm::vec4(center, 1.0f));
+    float texelSize = 2.0f * radius / resolution;
+    lightCenter.x = std::floor(lightCenter.x / texelSize) * texelSize;
+    lightCenter.y = std::floor(lightCenter.y / texelSize) * texelSize;
+
+    // The light looks down its negative Z axis, so distances along the light direction are -z.
+    glm::mat4 lightProjection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius, lightCenter.y - radius,
+        lightCenter.y + radius, -lightCenter.z - radius - casterMargin, -lightCenter.z + radius);
+
+    cascade.lightSpaceMatrix = lightProjection * lightView;
+    cascade.center = center;
+    cascade.radius = radius;
+    cascade.lightDirection = lightDirection;
+}
+
+void CascadedShadowMap::renderCascade(int index, const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters)
+{
+    Cascade& cascade = cascades[index];
+
+    // Pick up the result of the previous measurement if it's there, without waiting for it.
+    if (cascade.queryPending)
+    {
+        unsigned int available = 0;
+        glGetQueryObjectuiv(cascade.timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(cascade.timerQuery, GL_QUERY_RESULT, &elapsed);
+            cascade.renderTime = elapsed / 1000000.0f;
+            cascade.queryPending = false;
+        }
+    }
+    bool timed = !cascade.queryPending;
+    if (timed) glBeginQuery(GL_TIME_ELAPSED, cascade.timerQuery);
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depthTexture, 0, index);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    glViewport(0, 0, resolution, resolution);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Push depth values away a little to fight shadow acne on surfaces facing the light.
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(2.0f, 4.0f);
+
+    depthShader.use();
+    depthShader.setMat4("lightSpaceMatrix", cascade.lightSpaceMatrix);
+    drawCasters(depthShader);
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    if (timed)
+    {
+        glEndQuery(GL_TIME_ELAPSED);
+        cascade.queryPending = true;
+    }
+
+    cascade.valid = true;
+    cascade.framesSinceUpdate = 0;
+    cascade.updatedThisFrame = true;
+    cascade.updateCount++;
+}
+
+void CascadedShadowMap::Bind(const Shader& shader, const glm::mat4& view) const
+{
+    // Always point the sampler at our own unit, even when disabled, so it never shares a unit with a 2D material sampler.
+    shader.setInt("shadowMap", textureUnit);
+
+    // Until every cascade has been rendered once, there's nothing sensible to sample.
+    bool ready = enabled && allocatedCascades == cascadeCount;
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        ready = ready && cascades[i].valid;
+    }
+    shader.setInt("cascadeCount", ready ? cascadeCount : 0);
+
+    glActiveTexture(GL_TEXTURE0 + textureUnit);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, depthTexture);
+    glActiveTexture(GL_TEXTURE0);
+
+    // Lighting happens in view space, so fold the inverse view matrix into the light matrices.
+    const glm::mat4 inverseView = glm::inverse(view);
+    FrameArena& arena = FrameArena::Get();
+    for (int i = 0; i < cascadeCount; i++)
+    {
+        shader.setMat4(arena.Format("cascadeMatrices[%d]", i), cascades[i].lightSpaceMatrix * inverseView);
+        shader.setFloat(arena.Format("cascadeSplits[%d]", i), cascades[i].splitFar);
+    }
+}
@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include <functional>
+#include <glm/glm.hpp>
+
+#include "Shader.h"
+
+// Cascaded shadow maps for the directional light. The view frustum is split into several slices, each of which gets its
+// own layer in a depth texture array. Cascades are fit to a bounding sphere of their slice and snapped to whole texels,
+// so the shadows don't shimmer when the camera moves or rotates.
+// Near cascades are re-rendered every frame. Far cascades are fit with some extra margin and cached: they are only
+// re-rendered when the light direction changes, static geometry is invalidated or the camera leaves the cached area.
+class CascadedShadowMap
+{
+public:
+    static constexpr int maxCascades = 4;
+    // Texture unit the shadow map is bound to, well above the units used by mesh materials.
+    static constexpr int textureUnit = 8;
+
+    // Settings, adjustable at runtime.
+    bool enabled = true;
+    int cascadeCount = 4;
+    int resolution = 2048;
+    float shadowDistance = 50.0f;
+    // Blend between uniform (0) and logarithmic (1) split distances.
+    float splitLambda = 0.75f;
+    // Cascades starting at this index are cached, all cascades before it are updated every frame.
+    int firstCachedCascade = 2;
+    // Frames after which cached cascades are re-rendered anyway. 0 means only when they are invalidated.
+    int cachedUpdateInterval = 0;
+    // How much larger than needed cached cascades are fit, so the camera can move a bit before they must be updated.
+    float cacheMargin = 1.25f;
+
+    CascadedShadowMap();
+    ~CascadedShadowMap();
+    CascadedShadowMap(const CascadedShadowMap&) = delete;
+    CascadedShadowMap& operator=(const CascadedShadowMap&) = delete;
+
+    // Fit all cascades to the current view and re-render those that need it. drawCasters is called once per rendered
+    // cascade and should draw all shadow casting geometry using the given depth shader.
+    void Update(const glm::mat4& view, float fovY, float aspect, float nearPlane, const glm::vec3& lightDirection,
+        const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters);
+    // Send the cascade data to a lighting shader and bind the shadow map.
+    void Bind(const Shader& shader, const glm::mat4& view) const;
+    // Force all cached cascades to re-render, e.g. after static geometry changed.
+    void InvalidateStatic();
+
+    // GPU time of the last timed render of a cascade in milliseconds.
+    float GetRenderTime(int cascade) const { return cascades[cascade].renderTime; }
+    // Whether the cascade was re-rendered during the last Update().
+    bool WasUpdated(int cascade) const { return cascades[cascade].updatedThisFrame; }
+    int GetUpdateCount(int cascade) const { return cascades[cascade].updateCount; }
+    float GetSplitDistance(int cascade) const { return cascades[cascade].splitFar; }
+
+private:
+    struct Cascade
+    {
+        glm::mat4 lightSpaceMatrix = glm::mat4(1.0f);
+        float splitFar = 0.0f;
+
+        // Coverage of the currently rendered contents, used to decide whether a cached cascade is still valid.
+        glm::vec3 center = glm::vec3(0.0f);
+        float radius = 0.0f;
+        glm::vec3 lightDirection = glm::vec3(0.0f);
+        bool valid = false;
+        int framesSinceUpdate = 0;
+        bool updatedThisFrame = false;
+        int updateCount = 0;
+
+        unsigned int timerQuery = 0;
+        bool queryPending = false;
+        float renderTime = 0.0f;
+    };
+
+    Cascade cascades[maxCascades];
+    unsigned int depthTexture = 0;
+    unsigned int framebuffer = 0;
+    int allocatedResolution = 0;
+    int allocatedCascades = 0;
+
+    void allocate();
+    void fitCascade(Cascade& cascade, const glm::vec3& center, float radius, const glm::vec3& lightDirection) const;
+    void renderCascade(int index, const Shader& depthShader, const std::function<void(const Shader&)>& drawCasters);
+};
@@ -0,0 +1,199 @@
+﻿#include "TextureAtlas.h"
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "GpuResources.h"
+#include "stb_image.h"
+#include "Util.h"
+
+// imgui_draw.cpp keeps its copy of the packer static, so this file gets its own.
+#define STBRP_STATIC
+#define STB_RECT_PACK_IMPLEMENTATION
+#include "imgui/imstb_rectpack.h"
+
+namespace
+{
+    // Copy an image into a page with its edge texels repeated over the gutter, converted to RGBA the way OpenGL
+    // samples it when uploaded on its own.
+    void blit(const ImageData& image, AtlasPage& page, int slot, int x0, int y0, int gutter)
+    {
+        const unsigned char* source = image.pixels.get();
+        const int width = image.width, height = image.height, components = image.components;
+        unsigned char* target = page.slots[slot].data();
+        for (int y = -gutter; y < height + gutter; y++)
+        {
+            const unsigned char* row = source + (size_t)std::clamp(y, 0, height - 1) * width * components;
+            unsigned char* out = target + ((size_t)(y0 + y) * page.width + x0 - gutter) * 4;
+            for (int x = -gutter; x < width + gutter; x++, out += 4)
+            {
+                const unsigned char* texel = row + std::clamp(x, 0, width - 1) * components;
+                // Two channel images are gray and alpha.
+                const bool gray = image.grayscale || components == 2;
+                out[0] = texel[0];
+                out[1] = components >= 3 ? texel[1] : gray ? texel[0] : 0;
+                out[2] = components >= 3 ? texel[2] : gray ? texel[0] : 0;
+                out[3] = components == 4 ? texel[3] : components == 2 ? texel[1] : 255;
+            }
+        }
+    }
+}
+
+TextureAtlasBuilder::TextureAtlasBuilder(const AtlasSettings& settings, int slotCount)
+    : settings(settings), slotCount(slotCount)
+{
+}
+
+int TextureAtlasBuilder::AddMaterial(const std::vector<std::string>& paths)
+{
+    materials.push_back(paths);
+    materials.back().resize(slotCount);
+    placements.push_back(AtlasPlacement());
+    return (int)materials.size() - 1;
+}
+
+void TextureAtlasBuilder::Build()
+{
+    pages.clear();
+    atlasedMaterials = atlasedTextures = 0;
+    if (!settings.enabled) return;
+
+    // Only read images whose header says they're small enough, large ones are loaded as usual later on.
+    std::vector<std::string> paths;
+    std::vector<char> candidates(materials.size(), 0);
+    for (size_t m = 0; m < materials.size(); m++)
+    {
+        bool small = false;
+        for (const std::string& path : materials[m])
+        {
+            int width, height, components;
+            if (path.empty()) continue;
+            small = stbi_info(path.c_str(), &width, &height, &components) &&
+                width <= settings.maxTextureSize && height <= settings.maxTextureSize;
+            if (!small) break;
+        }
+        if (!small) continue;
+
+        candidates[m] = 1;
+        for (const std::string& path : materials[m])
+        {
+            if (!path.empty() && std::find(paths.begin(), paths.end(), path) == paths.end()) paths.push_back(path);
+        }
+    }
+    if (paths.empty()) return;
+
+    std::vector<ImageData> images;
+    std::vector<char> succeeded;
+    readImagesParallel(paths, images, succeeded);
+    auto findImage = [&](const std::string& path) -> const ImageData*
+    {
+        size_t i = std::find(paths.begin(), paths.end(), path) - paths.begin();
+        if (!succeeded[i] || images[i].compressed) return nullptr;
+        return &images[i];
+    };
+
+    // Pack in grid cells, which keeps every texture aligned for the mip levels we keep.
+    const int cell = 1 << std::max(0, settings.mipLevels - 1);
+    const int gutter = settings.mipLevels > 1 ? cell : 0;
+    const int pageCells = settings.pageSize / cell;
+    std::vector<stbrp_rect> rects;
+    for (size_t m = 0; m < materials.size(); m++)
+    {
+        if (!candidates[m]) continue;
+
+        int width = 0, height = 0;
+        bool qualifies = true;
+        for (const std::string& path : materials[m])
+        {
+            if (path.empty()) continue;
+            const ImageData* image = findImage(path);
+            qualifies = image && (width == 0 || (image->width == width && image->height == height));
+            if (!qualifies) break;
+            width = image->width;
+            height = image->height;
+        }
+        if (!qualifies || width == 0) continue;
+
+        stbrp_rect rect = {};
+        rect.id = (int)m;
+        rect.w = (width + 2 * gutter + cell - 1) / cell;
+        rect.h = (height + 2 * gutter + cell - 1) / cell;
+        if (rect.w <= pageCells && rect.h <= pageCells) rects.push_back(rect);
+    }
+
+    std::vector<stbrp_node> nodes(pageCells);
+    while (!rects.empty())
+    {
+        stbrp_context context;
+        stbrp_init_target(&context, pageCells, pageCells, nodes.data(), (int)nodes.size());
+        stbrp_pack_rects(&context, rects.data(), (int)rects.size());
+        // Every rect fits an empty page, but don't spin if the packer places nothing anyway.
+        if (std::none_of(rects.begin(), rects.end(), [](const stbrp_rect& rect) { return rect.was_packed != 0; })) break;
+
+        // Crop the page to what was packed into it.
+        AtlasPage page;
+        for (const stbrp_rect& rect : rects)
+        {
+            if (!rect.was_packed) continue;
+            page.width = std::max(page.width, (rect.x + rect.w) * cell);
+            page.height = std::max(page.height, (rect.y + rect.h) * cell);
+        }
+        page.slots.resize(slotCount);
+
+        const int pageIndex = (int)pages.size();
+        std::vector<stbrp_rect> remaining;
+        for (const stbrp_rect& rect : rects)
+        {
+            if (!rect.was_packed)
+            {
+                remaining.push_back(rect);
+                continue;
+            }
+
+            const int x0 = rect.x * cell + gutter, y0 = rect.y * cell + gutter;
+            const std::vector<std::string>& slots = materials[rect.id];
+            int width = 0, height = 0;
+            for (int slot = 0; slot < slotCount; slot++)
+            {
+                if (slots[slot].empty()) continue;
+                const ImageData* image = findImage(slots[slot]);
+                width = image->width;
+                height = image->height;
+                if (page.slots[slot].empty()) page.slots[slot].assign((size_t)page.width * page.height * 4, 0);
+                blit(*image, page, slot, x0, y0, gutter);
+                atlasedTextures++;
+            }
+
+            AtlasPlacement& placement = placements[rect.id];
+            placement.page = pageIndex;
+            placement.offset = glm::vec2((float)x0 / page.width, (float)y0 / page.height);
+            placement.scale = glm::vec2((float)width / page.width, (float)height / page.height);
+            page.usedTexels += (long long)width * height;
+            atlasedMaterials++;
+        }
+        pages.push_back(std::move(page));
+        rects = std::move(remaining);
+    }
+}
+
+unsigned int UploadAtlasPage(const AtlasPage& page, int slot, const AtlasSettings& settings)
+{
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, page.width, page.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, page.slots[slot].data());
+
+    // Smaller levels would mix neighbouring textures, so the chain stops where the gutters do.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, std::max(0, settings.mipLevels - 1));
+    glGenerateMipmap(GL_TEXTURE_2D);
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, textureID, GpuResourceTracker::GetMipChainBytes(page.width, page.height, 4, std::max(1, settings.mipLevels)),
+        "Texture atlas");
+
+    // Meshes only use atlases when their texture coordinates stay inside the texture, so there's nothing to wrap.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return textureID;
+}
@@ -0,0 +1,67 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct AtlasSettings
+{
+    bool enabled = true;
+    // Only textures at most this many texels wide and high are packed.
+    int maxTextureSize = 256;
+    int pageSize = 2048;
+    // Mip levels an atlas page keeps. Textures are placed on a grid of 2^(mipLevels - 1) texels with a gutter of their
+    // edge texels as wide around them, so no kept level filters in texels of a neighbour.
+    int mipLevels = 4;
+};
+
+// Where a material's textures ended up: atlas coordinates are offset + uv * scale.
+struct AtlasPlacement
+{
+    int page = -1;
+    glm::vec2 offset = glm::vec2(0.0f);
+    glm::vec2 scale = glm::vec2(1.0f);
+};
+
+// One atlas page: an RGBA8 image per texture slot, all with the same layout. Slots none of the page's materials use
+// are left empty.
+struct AtlasPage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<unsigned char>> slots;
+    // Texels covered by source textures, without gutters.
+    long long usedTexels = 0;
+};
+
+// Packs the textures of materials that only use small images into shared pages at import time, so meshes with those
+// materials can share one texture per slot. A material qualifies when each of its slots (e.g. diffuse and specular)
+// is an uncompressed image no larger than maxTextureSize and all of them have the same size. Pure CPU code without any
+// GL calls; UploadAtlasPage() creates the textures.
+class TextureAtlasBuilder
+{
+public:
+    TextureAtlasBuilder(const AtlasSettings& settings, int slotCount);
+
+    // Add a material with one image path per slot, empty for slots it doesn't use. Returns its index.
+    int AddMaterial(const std::vector<std::string>& paths);
+    // Read the images of every material, decoding them in parallel, and pack the ones that qualify.
+    void Build();
+
+    const AtlasPlacement& GetPlacement(int material) const { return placements[material]; }
+    const std::vector<AtlasPage>& GetPages() const { return pages; }
+    int GetAtlasedMaterialCount() const { return atlasedMaterials; }
+    int GetAtlasedTextureCount() const { return atlasedTextures; }
+
+private:
+    AtlasSettings settings;
+    int slotCount;
+    std::vector<std::vector<std::string>> materials;
+    std::vector<AtlasPlacement> placements;
+    std::vector<AtlasPage> pages;
+    int atlasedMaterials = 0;
+    int atlasedTextures = 0;
+};
+
+// Upload one slot of a page with settings.mipLevels mip levels. Returns the texture name.
+unsigned int UploadAtlasPage(const AtlasPage& page, int slot, const AtlasSettings& settings);
@@ -0,0 +1,637 @@
+﻿#include "TextureCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_COMPRESSION_SSE2 1
+#endif
+
+// S3TC isn't core OpenGL, so GLAD doesn't define these. Every desktop driver supports it though.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+namespace
+{
+    // A 4x4 block of pixels, stored per channel so the SIMD paths can work on four pixels at once.
+    struct Block
+    {
+        float channels[4][16];
+    };
+
+    // Fetch the 4x4 block at (blockX, blockY), repeating edge pixels for partial blocks.
+    void fetchBlock(const unsigned char* rgba, int width, int height, int blockX, int blockY, Block& block)
+    {
+        for (int y = 0; y < 4; y++)
+        {
+            int sourceY = std::min(blockY * 4 + y, height - 1);
+            for (int x = 0; x < 4; x++)
+            {
+                int sourceX = std::min(blockX * 4 + x, width - 1);
+                const unsigned char* pixel = rgba + ((size_t)sourceY * width + sourceX) * 4;
+                for (int c = 0; c < 4; c++)
+                {
+                    block.channels[c][y * 4 + x] = pixel[c];
+                }
+            }
+        }
+    }
+
+    // Split the block rows of an image across threads.
+    template <typename Function>
+    void forEachBlockRow(int blockRows, int threadCount, Function function)
+    {
+        if (threadCount <= 0) threadCount = std::max(1u, std::thread::hardware_concurrency());
+        threadCount = std::min(threadCount, blockRows);
+        if (threadCount <= 1)
+        {
+            function(0, blockRows);
+            return;
+        }
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < threadCount; t++)
+        {
+            threads.emplace_back(function, blockRows * t / threadCount, blockRows * (t + 1) / threadCount);
+        }
+        for (std::thread& thread : threads)
+        {
+            thread.join();
+        }
+    }
+
+    // Project every pixel onto the line origin + s * direction and round to the nearest of maxIndex + 1 evenly spaced
+    // points. direction must already be scaled by maxIndex / |direction|^2. Since all palette entries of a block lie on
+    // one line, this picks the same entries as a full nearest-color search.
+    void projectToIndices(const Block& block, int channelCount, const float origin[4], const float direction[4], int maxIndex, int indices[16])
+    {
+#ifdef TEXTURE_COMPRESSION_SSE2
+        const __m128 zero = _mm_setzero_ps();
+        const __m128 maximum = _mm_set1_ps((float)maxIndex);
+        for (int i = 0; i < 16; i += 4)
+        {
+            __m128 t = zero;
+            for (int c = 0; c < channelCount; c++)
+            {
+                __m128 offset = _mm_sub_ps(_mm_loadu_ps(&block.channels[c][i]), _mm_set1_ps(origin[c]));
+                t = _mm_add_ps(t, _mm_mul_ps(offset, _mm_set1_ps(direction[c])));
+            }
+            t = _mm_min_ps(_mm_max_ps(t, zero), maximum);
+            // Rounds to nearest with the default MXCSR rounding mode.
+            _mm_storeu_si128((__m128i*)&indices[i], _mm_cvtps_epi32(t));
+        }
+#else
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channelCount; c++)
+            {
+                t += (block.channels[c][i] - origin[c]) * direction[c];
+            }
+            indices[i] = (int)std::lround(std::clamp(t, 0.0f, (float)maxIndex));
+        }
+#endif
+    }
+
+    // Fit a line through the block's colors: returns the two extreme points along the principal axis.
+    void fitEndpoints(const Block& block, int channelCount, float low[4], float high[4])
+    {
+        float mean[4] = {};
+        for (int c = 0; c < channelCount; c++)
+        {
+            for (int i = 0; i < 16; i++) mean[c] += block.channels[c][i];
+            mean[c] /= 16.0f;
+        }
+
+        float covariance[4][4] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            for (int a = 0; a < channelCount; a++)
+            {
+                for (int b = 0; b < channelCount; b++)
+                {
+                    covariance[a][b] += (block.channels[a][i] - mean[a]) * (block.channels[b][i] - mean[b]);
+                }
+            }
+        }
+
+        // A few rounds of power iteration are plenty to find the dominant axis.
+        float axis[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = {};
+            float length = 0.0f;
+            for (int a = 0; a < channelCount; a++)
+            {
+                for (int b = 0; b < channelCount; b++) next[a] += covariance[a][b] * axis[b];
+                length = std::max(length, std::abs(next[a]));
+            }
+            if (length < 1e-6f) break;
+            for (int a = 0; a < channelCount; a++) axis[a] = next[a] / length;
+        }
+
+        float minT = 0.0f, maxT = 0.0f;
+        float axisLengthSq = 0.0f;
+        for (int c = 0; c < channelCount; c++) axisLengthSq += axis[c] * axis[c];
+        for (int i = 0; i < 16; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channelCount; c++) t += (block.channels[c][i] - mean[c]) * axis[c];
+            t /= axisLengthSq;
+            minT = std::min(minT, t);
+            maxT = std::max(maxT, t);
+        }
+
+        for (int c = 0; c < channelCount; c++)
+        {
+            low[c] = std::clamp(mean[c] + axis[c] * minT, 0.0f, 255.0f);
+            high[c] = std::clamp(mean[c] + axis[c] * maxT, 0.0f, 255.0f);
+        }
+    }
+
+    uint16_t toRGB565(const float color[4])
+    {
+        int r = (int)std::lround(color[0] * 31.0f / 255.0f);
+        int g = (int)std::lround(color[1] * 63.0f / 255.0f);
+        int b = (int)std::lround(color[2] * 31.0f / 255.0f);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    void fromRGB565(uint16_t color, int rgb[3])
+    {
+        int r = (color >> 11) & 31, g = (color >> 5) & 63, b = color & 31;
+        rgb[0] = (r << 3) | (r >> 2);
+        rgb[1] = (g << 2) | (g >> 4);
+        rgb[2] = (b << 3) | (b >> 2);
+    }
+
+    void writeLittleEndian(unsigned char* output, uint64_t value, int bytes)
+    {
+        for (int i = 0; i < bytes; i++)
+        {
+            output[i] = (unsigned char)(value >> (i * 8));
+        }
+    }
+
+    uint64_t readLittleEndian(const unsigned char* input, int bytes)
+    {
+        uint64_t value = 0;
+        for (int i = 0; i < bytes; i++)
+        {
+            value |= (uint64_t)input[i] << (i * 8);
+        }
+        return value;
+    }
+
+    void encodeBC1(const Block& block, unsigned char output[8])
+    {
+        float low[4], high[4];
+        fitEndpoints(block, 3, low, high);
+
+        // Pull the endpoints in a little, which lowers the average error of the in-between palette entries.
+        for (int c = 0; c < 3; c++)
+        {
+            float inset = (high[c] - low[c]) / 16.0f;
+            low[c] += inset;
+            high[c] -= inset;
+        }
+
+        uint16_t color0 = toRGB565(high);
+        uint16_t color1 = toRGB565(low);
+        // color0 > color1 selects the four color mode without transparency.
+        if (color0 < color1) std::swap(color0, color1);
+
+        uint32_t packedIndices = 0;
+        if (color0 != color1)
+        {
+            int rgb0[3], rgb1[3];
+            fromRGB565(color0, rgb0);
+            fromRGB565(color1, rgb1);
+
+            float origin[4], direction[4];
+            float lengthSq = 0.0f;
+            for (int c = 0; c < 3; c++)
+            {
+                origin[c] = (float)rgb0[c];
+                direction[c] = (float)(rgb1[c] - rgb0[c]);
+                lengthSq += direction[c] * direction[c];
+            }
+            for (int c = 0; c < 3; c++) direction[c] *= 3.0f / lengthSq;
+
+            int steps[16];
+            projectToIndices(block, 3, origin, direction, 3, steps);
+
+            // Palette order is color0, color1, 2/3 color0 + 1/3 color1, 1/3 color0 + 2/3 color1.
+            static const int stepToIndex[4] = { 0, 2, 3, 1 };
+            for (int i = 0; i < 16; i++)
+            {
+                packedIndices |= stepToIndex[steps[i]] << (i * 2);
+            }
+        }
+
+        writeLittleEndian(output, color0, 2);
+        writeLittleEndian(output + 2, color1, 2);
+        writeLittleEndian(output + 4, packedIndices, 4);
+    }
+
+    void encodeBC4(const Block& block, int channel, unsigned char output[8])
+    {
+        const float* values = block.channels[channel];
+        float minimum = values[0], maximum = values[0];
+        for (int i = 1; i < 16; i++)
+        {
+            minimum = std::min(minimum, values[i]);
+            maximum = std::max(maximum, values[i]);
+        }
+
+        int alpha0 = (int)maximum;
+        int alpha1 = (int)minimum;
+        uint64_t packedIndices = 0;
+        if (alpha0 != alpha1)
+        {
+            // alpha0 > alpha1 selects the mode with six interpolated values.
+            Block single;
+            std::memcpy(single.channels[0], values, sizeof(single.channels[0]));
+            float origin[4] = { (float)alpha1 };
+            float direction[4] = { 7.0f / (alpha0 - alpha1) };
+
+            int steps[16];
+            projectToIndices(single, 1, origin, direction, 7, steps);
+
+            // Palette order is alpha0, alpha1, then six steps going from alpha0 towards alpha1.
+            for (int i = 0; i < 16; i++)
+            {
+                int index = steps[i] == 7 ? 0 : steps[i] == 0 ? 1 : 8 - steps[i];
+                packedIndices |= (uint64_t)index << (i * 3);
+            }
+        }
+
+        output[0] = (unsigned char)alpha0;
+        output[1] = (unsigned char)alpha1;
+        writeLittleEndian(output + 2, packedIndices, 6);
+    }
+
+    // Writes bit fields in BC7's little-endian bit order.
+    struct BitWriter
+    {
+        unsigned char* data;
+        int position = 0;
+
+        void Write(uint32_t value, int bits)
+        {
+            for (int i = 0; i < bits; i++, position++)
+            {
+                if ((value >> i) & 1) data[position >> 3] |= (unsigned char)(1 << (position & 7));
+            }
+        }
+    };
+
+    struct BitReader
+    {
+        const unsigned char* data;
+        int position = 0;
+
+        uint32_t Read(int bits)
+        {
+            uint32_t value = 0;
+            for (int i = 0; i < bits; i++, position++)
+            {
+                value |= (uint32_t)((data[position >> 3] >> (position & 7)) & 1) << i;
+            }
+            return value;
+        }
+    };
+
+    // BC7 mode 6: one subset, 7-bit RGBA endpoints with a shared low bit per endpoint, 4-bit indices.
+    void encodeBC7(const Block& block, unsigned char output[16])
+    {
+        float low[4], high[4];
+        fitEndpoints(block, 4, low, high);
+
+        // Quantize both endpoints, choosing the p-bit (shared lowest bit) that fits each one best.
+        int endpoints[2][4];
+        int pBits[2];
+        const float* targets[2] = { low, high };
+        for (int e = 0; e < 2; e++)
+        {
+            float bestError = 1e30f;
+            for (int p = 0; p < 2; p++)
+            {
+                int quantized[4];
+                float error = 0.0f;
+                for (int c = 0; c < 4; c++)
+                {
+                    quantized[c] = std::clamp((int)std::lround((targets[e][c] - p) / 2.0f), 0, 127);
+                    float difference = (quantized[c] * 2 + p) - targets[e][c];
+                    error += difference * difference;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    pBits[e] = p;
+                    std::copy(quantized, quantized + 4, endpoints[e]);
+                }
+            }
+        }
+
+        float origin[4], direction[4];
+        float lengthSq = 0.0f;
+        for (int c = 0; c < 4; c++)
+        {
+            origin[c] = (float)(endpoints[0][c] * 2 + pBits[0]);
+            direction[c] = (float)(endpoints[1][c] * 2 + pBits[1]) - origin[c];
+            lengthSq += direction[c] * direction[c];
+        }
+
+        int indices[16] = {};
+        if (lengthSq > 0.0f)
+        {
+            // The 4-bit interpolation weights are round(i * 64 / 15), so evenly spaced steps are a close match.
+            for (int c = 0; c < 4; c++) direction[c] *= 15.0f / lengthSq;
+            projectToIndices(block, 4, origin, direction, 15, indices);
+        }
+
+        // The first index is stored without its highest bit, so it has to be below 8. Swap endpoints if it isn't.
+        if (indices[0] >= 8)
+        {
+            std::swap(endpoints[0], endpoints[1]);
+            std::swap(pBits[0], pBits[1]);
+            for (int i = 0; i < 16; i++) indices[i] = 15 - indices[i];
+        }
+
+        std::memset(output, 0, 16);
+        BitWriter writer = { output };
+        writer.Write(1 << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            writer.Write(endpoints[0][c], 7);
+            writer.Write(endpoints[1][c], 7);
+        }
+        writer.Write(pBits[0], 1);
+        writer.Write(pBits[1], 1);
+        writer.Write(indices[0], 3);
+        for (int i = 1; i < 16; i++)
+        {
+            writer.Write(indices[i], 4);
+        }
+    }
+
+    void compressBlock(const Block& block, BlockFormat format, unsigned char* output)
+    {
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            encodeBC1(block, output);
+            break;
+        case BlockFormat::BC3:
+            encodeBC4(block, 3, output);
+            encodeBC1(block, output + 8);
+            break;
+        case BlockFormat::BC4:
+            encodeBC4(block, 0, output);
+            break;
+        case BlockFormat::BC5:
+            encodeBC4(block, 0, output);
+            encodeBC4(block, 1, output + 8);
+            break;
+        case BlockFormat::BC7:
+            encodeBC7(block, output);
+            break;
+        }
+    }
+
+    // Decoded blocks are always RGBA8, 16 pixels in row order.
+    void decodeBC1(const unsigned char* input, unsigned char pixels[64], bool alwaysFourColors)
+    {
+        uint16_t color0 = (uint16_t)readLittleEndian(input, 2);
+        uint16_t color1 = (uint16_t)readLittleEndian(input + 2, 2);
+        uint32_t indices = (uint32_t)readLittleEndian(input + 4, 4);
+
+        int palette[4][4];
+        fromRGB565(color0, palette[0]);
+        fromRGB565(color1, palette[1]);
+        palette[0][3] = palette[1][3] = 255;
+        for (int c = 0; c < 3; c++)
+        {
+            if (color0 > color1 || alwaysFourColors)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            else
+            {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+        palette[2][3] = 255;
+        palette[3][3] = (color0 > color1 || alwaysFourColors) ? 255 : 0;
+
+        for (int i = 0; i < 16; i++)
+        {
+            const int* color = palette[(indices >> (i * 2)) & 3];
+            for (int c = 0; c < 4; c++) pixels[i * 4 + c] = (unsigned char)color[c];
+        }
+    }
+
+    void decodeBC4(const unsigned char* input, unsigned char pixels[64], int channel)
+    {
+        int palette[8];
+        palette[0] = input[0];
+        palette[1] = input[1];
+        if (palette[0] > palette[1])
+        {
+            for (int i = 2; i < 8; i++) palette[i] = ((8 - i) * palette[0] + (i - 1) * palette[1]) / 7;
+        }
+        else
+        {
+            for (int i = 2; i < 6; i++) palette[i] = ((6 - i) * palette[0] + (i - 1) * palette[1]) / 5;
+            palette[6] = 0;
+            palette[7] = 255;
+        }
+
+        uint64_t indices = readLittleEndian(input + 2, 6);
+        for (int i = 0; i < 16; i++)
+        {
+            pixels[i * 4 + channel] = (unsigned char)palette[(indices >> (i * 3)) & 7];
+        }
+    }
+
+    void decodeBC7(const unsigned char* input, unsigned char pixels[64])
+    {
+        BitReader reader = { input };
+        if (reader.Read(7) != (1 << 6))
+        {
+            // Not mode 6. Blocks from other encoders can use any mode, mark them instead of decoding garbage.
+            for (int i = 0; i < 16; i++)
+            {
+                pixels[i * 4 + 0] = 255; pixels[i * 4 + 1] = 0; pixels[i * 4 + 2] = 255; pixels[i * 4 + 3] = 255;
+            }
+            return;
+        }
+
+        int endpoints[2][4];
+        for (int c = 0; c < 4; c++)
+        {
+            endpoints[0][c] = reader.Read(7);
+            endpoints[1][c] = reader.Read(7);
+        }
+        int pBits[2] = { (int)reader.Read(1), (int)reader.Read(1) };
+        for (int e = 0; e < 2; e++)
+        {
+            for (int c = 0; c < 4; c++) endpoints[e][c] = endpoints[e][c] * 2 + pBits[e];
+        }
+
+        static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        for (int i = 0; i < 16; i++)
+        {
+            int index = reader.Read(i == 0 ? 3 : 4);
+            for (int c = 0; c < 4; c++)
+            {
+                pixels[i * 4 + c] = (unsigned char)(((64 - weights[index]) * endpoints[0][c] + weights[index] * endpoints[1][c] + 32) >> 6);
+            }
+        }
+    }
+
+    void decompressBlock(const unsigned char* input, BlockFormat format, unsigned char pixels[64])
+    {
+        // Channels a format doesn't store read as 0, and alpha as 1, just like sampling them in OpenGL.
+        for (int i = 0; i < 16; i++)
+        {
+            pixels[i * 4 + 0] = pixels[i * 4 + 1] = pixels[i * 4 + 2] = 0;
+            pixels[i * 4 + 3] = 255;
+        }
+
+        switch (format)
+        {
+        case BlockFormat::BC1:
+            decodeBC1(input, pixels, false);
+            break;
+        case BlockFormat::BC3:
+            decodeBC1(input + 8, pixels, true);
+            decodeBC4(input, pixels, 3);
+            break;
+        case BlockFormat::BC4:
+            decodeBC4(input, pixels, 0);
+            break;
+        case BlockFormat::BC5:
+            decodeBC4(input, pixels, 0);
+            decodeBC4(input + 8, pixels, 1);
+            break;
+        case BlockFormat::BC7:
+            decodeBC7(input, pixels);
+            break;
+        }
+    }
+}
+
+const char* GetBlockFormatName(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1: return "BC1";
+    case BlockFormat::BC3: return "BC3";
+    case BlockFormat::BC4: return "BC4";
+    case BlockFormat::BC5: return "BC5";
+    case BlockFormat::BC7: return "BC7";
+    }
+    return "Unknown";
+}
+
+int GetBlockSize(BlockFormat format)
+{
+    return (format == BlockFormat::BC1 || format == BlockFormat::BC4) ? 8 : 16;
+}
+
+size_t GetCompressedSize(BlockFormat format, int width, int height)
+{
+    size_t blocksX = (width + 3) / 4;
+    size_t blocksY = (height + 3) / 4;
+    return blocksX * blocksY * GetBlockSize(format);
+}
+
+unsigned int GetGLFormat(BlockFormat format)
+{
+    switch (format)
+    {
+    case BlockFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case BlockFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case BlockFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+    case BlockFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+    case BlockFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return 0;
+}
+
+const int* GetGLSwizzle(BlockFormat format)
+{
+    static const int grayscaleSwizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+    static const int identitySwizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    return format == BlockFormat::BC4 ? grayscaleSwizzle : identitySwizzle;
+}
+
+BlockFormat ChooseBlockFormat(const std::string& textureType, bool hasAlpha)
+{
+    if (textureType == "texture_specular" || textureType == "texture_roughness" || textureType == "texture_ao") return BlockFormat::BC4;
+    if (textureType == "texture_normal") return BlockFormat::BC5;
+    return hasAlpha ? BlockFormat::BC7 : BlockFormat::BC1;
+}
+
+void CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format, unsigned char* output, int threadCount)
+{
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const int blockSize = GetBlockSize(format);
+
+    forEachBlockRow(blocksY, threadCount, [=](int rowBegin, int rowEnd)
+        {
+            Block block;
+            for (int blockY = rowBegin; blockY < rowEnd; blockY++)
+            {
+                for (int blockX = 0; blockX < blocksX; blockX++)
+                {
+                    fetchBlock(rgba, width, height, blockX, blockY, block);
+                    compressBlock(block, format, output + ((size_t)blockY * blocksX + blockX) * blockSize);
+                }
+            }
+        });
+}
+
+void DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba, int threadCount)
+{
+    const int blocksX = (width + 3) / 4;
+    const int blocksY = (height + 3) / 4;
+    const int blockSize = GetBlockSize(format);
+
+    forEachBlockRow(blocksY, threadCount, [=](int rowBegin, int rowEnd)
+        {
+            unsigned char pixels[64];
+            for (int blockY = rowBegin; blockY < rowEnd; blockY++)
+            {
+                for (int blockX = 0; blockX < blocksX; blockX++)
+                {
+                    decompressBlock(blocks + ((size_t)blockY * blocksX + blockX) * blockSize, format, pixels);
+
+                    // Only copy the pixels that are inside the image.
+                    for (int y = 0; y < 4 && blockY * 4 + y < height; y++)
+                    {
+                        for (int x = 0; x < 4 && blockX * 4 + x < width; x++)
+                        {
+                            std::memcpy(rgba + ((size_t)(blockY * 4 + y) * width + blockX * 4 + x) * 4, pixels + (y * 4 + x) * 4, 4);
+                        }
+                    }
+                }
+            }
+        });
+}
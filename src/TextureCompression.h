@@ -0,0 +1,32 @@
+﻿#pragma once
+
+#include <cstddef>
+#include <string>
+
+// Block compressed texture formats, all of which work on 4x4 pixel blocks.
+enum class BlockFormat
+{
+    BC1, // RGB, 8 bytes per block. For opaque color maps.
+    BC3, // RGBA, 16 bytes per block. BC1 color plus a separate BC4 alpha block.
+    BC4, // Single channel, 8 bytes per block. For specular, roughness, AO and other scalar maps.
+    BC5, // Two channels, 16 bytes per block. For normal maps, only produced offline so far: Model doesn't load them yet.
+    BC7  // RGBA, 16 bytes per block. Highest quality, only mode 6 is produced by the encoder.
+};
+
+const char* GetBlockFormatName(BlockFormat format);
+int GetBlockSize(BlockFormat format);
+// Size of a whole compressed image. Partial blocks at the edges still take up a whole block.
+size_t GetCompressedSize(BlockFormat format, int width, int height);
+// OpenGL internal format to upload the compressed data with.
+unsigned int GetGLFormat(BlockFormat format);
+// GL_TEXTURE_SWIZZLE_RGBA for the format. BC4 only stores red, spread it out so it samples as gray like the
+// uncompressed map did.
+const int* GetGLSwizzle(BlockFormat format);
+
+// Pick a format based on the material texture type (as used by Model) and the image contents.
+BlockFormat ChooseBlockFormat(const std::string& textureType, bool hasAlpha);
+
+// Compress an RGBA8 image. output needs room for GetCompressedSize() bytes. threadCount 0 uses all hardware threads.
+void CompressImage(const unsigned char* rgba, int width, int height, BlockFormat format, unsigned char* output, int threadCount = 0);
+// Decompress into an RGBA8 image. Only BC7 mode 6 blocks (what our encoder writes) are supported for BC7.
+void DecompressImage(const unsigned char* blocks, int width, int height, BlockFormat format, unsigned char* rgba, int threadCount = 0);
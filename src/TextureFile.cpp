@@ -0,0 +1,405 @@
+﻿#include "TextureFile.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <glad/glad.h>
+
+#include "AssetPack.h"
+#include "GpuResources.h"
+
+namespace
+{
+    const unsigned char ktx2Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    const size_t ktx2HeaderSize = 80;
+    const size_t ktx2LevelIndexEntrySize = 24;
+
+    // VkFormat values of the block formats, as stored in KTX2 files.
+    struct FormatMapping
+    {
+        BlockFormat format;
+        uint32_t vkFormat;
+        uint32_t dxgiFormat;
+        // Khronos data format descriptor color model.
+        uint32_t colorModel;
+    };
+
+    const FormatMapping formatMappings[] = {
+        { BlockFormat::BC1, 131, 71, 128 },
+        { BlockFormat::BC3, 137, 77, 130 },
+        { BlockFormat::BC4, 139, 80, 131 },
+        { BlockFormat::BC5, 141, 83, 132 },
+        { BlockFormat::BC7, 145, 98, 134 }
+    };
+
+    const FormatMapping* findMapping(BlockFormat format)
+    {
+        for (const FormatMapping& mapping : formatMappings)
+        {
+            if (mapping.format == format) return &mapping;
+        }
+        return nullptr;
+    }
+
+    bool readFile(const std::string& path, std::vector<unsigned char>& data)
+    {
+        AssetView packed;
+        if (FindMountedAsset(path, packed))
+        {
+            data.assign(packed.data, packed.data + packed.size);
+            return true;
+        }
+
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+
+        std::streamsize size = file.tellg();
+        file.seekg(0, std::ios::beg);
+        data.resize((size_t)size);
+        return (bool)file.read((char*)data.data(), size);
+    }
+
+    uint32_t read32(const unsigned char* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    uint64_t read64(const unsigned char* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    void append32(std::vector<unsigned char>& data, uint32_t value)
+    {
+        const unsigned char* bytes = (const unsigned char*)&value;
+        data.insert(data.end(), bytes, bytes + 4);
+    }
+
+    void append64(std::vector<unsigned char>& data, uint64_t value)
+    {
+        const unsigned char* bytes = (const unsigned char*)&value;
+        data.insert(data.end(), bytes, bytes + 8);
+    }
+
+    void write32(std::vector<unsigned char>& data, size_t offset, uint32_t value)
+    {
+        std::memcpy(data.data() + offset, &value, sizeof(value));
+    }
+
+    void write64(std::vector<unsigned char>& data, size_t offset, uint64_t value)
+    {
+        std::memcpy(data.data() + offset, &value, sizeof(value));
+    }
+
+    // Basic data format descriptor for a block compressed format, which KTX2 requires even though we never read it.
+    std::vector<unsigned char> buildDataFormatDescriptor(const FormatMapping& mapping)
+    {
+        const int blockSize = GetBlockSize(mapping.format);
+
+        // One sample per stored block: color and alpha for BC3, red and green for BC5, otherwise just color.
+        struct Sample { uint32_t bitOffset; uint32_t channel; };
+        std::vector<Sample> samples;
+        if (mapping.format == BlockFormat::BC3) samples = { { 0, 15 }, { 64, 0 } };
+        else if (mapping.format == BlockFormat::BC5) samples = { { 0, 0 }, { 64, 1 } };
+        else samples = { { 0, 0 } };
+        const uint32_t bitLength = mapping.format == BlockFormat::BC7 ? 127 : 63;
+
+        std::vector<unsigned char> descriptor;
+        uint32_t blockByteSize = 24 + 16 * (uint32_t)samples.size();
+        append32(descriptor, 4 + blockByteSize); // Total size, including this field.
+        append32(descriptor, 0); // Khronos vendor, basic descriptor type.
+        append32(descriptor, 2 | (blockByteSize << 16)); // Version 2 and descriptor block size.
+        // Color model, BT.709 primaries, linear transfer function, straight alpha.
+        append32(descriptor, mapping.colorModel | (1 << 8) | (1 << 16));
+        append32(descriptor, 3 | (3 << 8)); // 4x4 texel blocks (stored minus one).
+        append32(descriptor, (uint32_t)blockSize); // Bytes in plane 0.
+        append32(descriptor, 0); // Bytes in planes 4 to 7.
+        for (const Sample& sample : samples)
+        {
+            append32(descriptor, sample.bitOffset | (bitLength << 16) | (sample.channel << 24));
+            append32(descriptor, 0); // Sample position.
+            append32(descriptor, 0); // Lower.
+            append32(descriptor, 0xFFFFFFFF); // Upper.
+        }
+        return descriptor;
+    }
+
+    size_t alignUp(size_t value, size_t alignment)
+    {
+        return (value + alignment - 1) / alignment * alignment;
+    }
+}
+
+namespace
+{
+    // Parse the header and level index of a KTX2 file. data only needs to hold those, not the level data.
+    bool parseKTX2Layout(const std::vector<unsigned char>& data, const std::string& path, KTX2Layout& layout)
+    {
+        if (data.size() < ktx2HeaderSize || std::memcmp(data.data(), ktx2Identifier, sizeof(ktx2Identifier)) != 0)
+        {
+            std::cout << "KTX2 file has an invalid header: " << path << "\n";
+            return false;
+        }
+
+        uint32_t vkFormat = read32(&data[12]);
+        uint32_t width = read32(&data[20]);
+        uint32_t height = read32(&data[24]);
+        uint32_t depth = read32(&data[28]);
+        uint32_t layerCount = read32(&data[32]);
+        uint32_t faceCount = read32(&data[36]);
+        uint32_t levelCount = std::max(read32(&data[40]), 1u);
+        uint32_t supercompression = read32(&data[44]);
+
+        if (depth > 1 || layerCount > 1 || faceCount != 1 || supercompression != 0)
+        {
+            std::cout << "KTX2 file isn't a plain 2D texture: " << path << "\n";
+            return false;
+        }
+
+        const FormatMapping* mapping = nullptr;
+        for (const FormatMapping& m : formatMappings)
+        {
+            if (m.vkFormat == vkFormat) mapping = &m;
+        }
+        if (!mapping)
+        {
+            std::cout << "KTX2 file has an unsupported format (" << vkFormat << "): " << path << "\n";
+            return false;
+        }
+        if (data.size() < ktx2HeaderSize + levelCount * ktx2LevelIndexEntrySize) return false;
+
+        layout.format = mapping->format;
+        layout.width = (int)width;
+        layout.height = (int)height;
+        layout.levels.resize(levelCount);
+        for (uint32_t level = 0; level < levelCount; level++)
+        {
+            const unsigned char* entry = &data[ktx2HeaderSize + level * ktx2LevelIndexEntrySize];
+            layout.levels[level].offset = read64(entry);
+            layout.levels[level].size = read64(entry + 8);
+        }
+        return true;
+    }
+}
+
+bool ReadKTX2(const std::string& path, CompressedImage& image)
+{
+    std::vector<unsigned char> data;
+    if (!readFile(path, data)) return false;
+
+    KTX2Layout layout;
+    if (!parseKTX2Layout(data, path, layout)) return false;
+
+    image.format = layout.format;
+    image.width = layout.width;
+    image.height = layout.height;
+    image.levels.assign(layout.levels.size(), std::vector<unsigned char>());
+    for (size_t level = 0; level < layout.levels.size(); level++)
+    {
+        uint64_t offset = layout.levels[level].offset;
+        uint64_t length = layout.levels[level].size;
+        if (offset + length > data.size()) return false;
+
+        image.levels[level].assign(data.begin() + (size_t)offset, data.begin() + (size_t)(offset + length));
+    }
+    return true;
+}
+
+bool ReadKTX2Layout(const std::string& path, KTX2Layout& layout)
+{
+    // A packed file is parsed in place, the level index can't run past its end.
+    AssetView packed;
+    if (FindMountedAsset(path, packed))
+    {
+        size_t size = std::min(packed.size, ktx2HeaderSize);
+        if (size == ktx2HeaderSize && std::memcmp(packed.data, ktx2Identifier, sizeof(ktx2Identifier)) == 0)
+        {
+            size = std::min(packed.size, ktx2HeaderSize + std::max(read32(packed.data + 40), 1u) * ktx2LevelIndexEntrySize);
+        }
+        return parseKTX2Layout(std::vector<unsigned char>(packed.data, packed.data + size), path, layout);
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    // Fixed size header first, it tells how large the level index following it is.
+    std::vector<unsigned char> data(ktx2HeaderSize);
+    if (!file.read((char*)data.data(), ktx2HeaderSize)) return false;
+    if (std::memcmp(data.data(), ktx2Identifier, sizeof(ktx2Identifier)) == 0)
+    {
+        uint32_t levelCount = std::max(read32(&data[40]), 1u);
+        data.resize(ktx2HeaderSize + levelCount * ktx2LevelIndexEntrySize);
+        if (!file.read((char*)data.data() + ktx2HeaderSize, levelCount * ktx2LevelIndexEntrySize)) return false;
+    }
+    return parseKTX2Layout(data, path, layout);
+}
+
+bool ReadKTX2Level(const std::string& path, const KTX2Layout& layout, int level, std::vector<unsigned char>& data)
+{
+    if (level < 0 || level >= (int)layout.levels.size()) return false;
+
+    AssetView packed;
+    if (FindMountedAsset(path, packed))
+    {
+        const uint64_t offset = layout.levels[level].offset;
+        const uint64_t size = layout.levels[level].size;
+        if (offset + size > packed.size) return false;
+        data.assign(packed.data + offset, packed.data + offset + size);
+        return true;
+    }
+
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return false;
+
+    data.resize((size_t)layout.levels[level].size);
+    file.seekg((std::streamoff)layout.levels[level].offset);
+    return (bool)file.read((char*)data.data(), (std::streamsize)data.size());
+}
+
+bool WriteKTX2(const std::string& path, const CompressedImage& image)
+{
+    const FormatMapping* mapping = findMapping(image.format);
+    if (!mapping || image.levels.empty()) return false;
+
+    const uint32_t levelCount = (uint32_t)image.levels.size();
+    std::vector<unsigned char> descriptor = buildDataFormatDescriptor(*mapping);
+
+    std::vector<unsigned char> data(ktx2Identifier, ktx2Identifier + sizeof(ktx2Identifier));
+    append32(data, mapping->vkFormat);
+    append32(data, 1); // Type size, 1 for block compressed formats.
+    append32(data, (uint32_t)image.width);
+    append32(data, (uint32_t)image.height);
+    append32(data, 0); // Depth.
+    append32(data, 0); // Layers.
+    append32(data, 1); // Faces.
+    append32(data, levelCount);
+    append32(data, 0); // No supercompression.
+
+    const size_t levelIndexOffset = ktx2HeaderSize;
+    const size_t descriptorOffset = levelIndexOffset + levelCount * ktx2LevelIndexEntrySize;
+    append32(data, (uint32_t)descriptorOffset);
+    append32(data, (uint32_t)descriptor.size());
+    append32(data, 0); // No key/value data.
+    append32(data, 0);
+    append64(data, 0); // No supercompression global data.
+    append64(data, 0);
+
+    data.resize(descriptorOffset, 0);
+    data.insert(data.end(), descriptor.begin(), descriptor.end());
+
+    // Mip levels are stored smallest first, each aligned to the block size.
+    const size_t alignment = GetBlockSize(image.format);
+    for (int level = (int)levelCount - 1; level >= 0; level--)
+    {
+        data.resize(alignUp(data.size(), alignment), 0);
+        size_t entry = levelIndexOffset + level * ktx2LevelIndexEntrySize;
+        write64(data, entry, data.size());
+        write64(data, entry + 8, image.levels[level].size());
+        write64(data, entry + 16, image.levels[level].size());
+        data.insert(data.end(), image.levels[level].begin(), image.levels[level].end());
+    }
+
+    std::ofstream file(path, std::ios::binary);
+    if (!file) return false;
+    return (bool)file.write((const char*)data.data(), data.size());
+}
+
+bool ReadDDS(const std::string& path, CompressedImage& image)
+{
+    std::vector<unsigned char> data;
+    if (!readFile(path, data)) return false;
+
+    // Magic, then a 124 byte header. The pixel format's FourCC is at offset 84 from the file start.
+    if (data.size() < 128 || std::memcmp(data.data(), "DDS ", 4) != 0)
+    {
+        std::cout << "DDS file has an invalid header: " << path << "\n";
+        return false;
+    }
+
+    uint32_t height = read32(&data[12]);
+    uint32_t width = read32(&data[16]);
+    uint32_t levelCount = std::max(read32(&data[28]), 1u);
+    const char* fourCC = (const char*)&data[84];
+    size_t dataOffset = 128;
+
+    bool found = false;
+    if (std::memcmp(fourCC, "DX10", 4) == 0)
+    {
+        if (data.size() < 148) return false;
+        uint32_t dxgiFormat = read32(&data[128]);
+        for (const FormatMapping& mapping : formatMappings)
+        {
+            if (mapping.dxgiFormat == dxgiFormat)
+            {
+                image.format = mapping.format;
+                found = true;
+            }
+        }
+        dataOffset = 148;
+    }
+    else if (std::memcmp(fourCC, "DXT1", 4) == 0) { image.format = BlockFormat::BC1; found = true; }
+    else if (std::memcmp(fourCC, "DXT5", 4) == 0) { image.format = BlockFormat::BC3; found = true; }
+    else if (std::memcmp(fourCC, "ATI1", 4) == 0 || std::memcmp(fourCC, "BC4U", 4) == 0) { image.format = BlockFormat::BC4; found = true; }
+    else if (std::memcmp(fourCC, "ATI2", 4) == 0 || std::memcmp(fourCC, "BC5U", 4) == 0) { image.format = BlockFormat::BC5; found = true; }
+
+    if (!found)
+    {
+        std::cout << "DDS file has an unsupported format: " << path << "\n";
+        return false;
+    }
+
+    image.width = (int)width;
+    image.height = (int)height;
+    image.levels.clear();
+
+    // Levels follow each other directly, largest first.
+    size_t offset = dataOffset;
+    int levelWidth = image.width, levelHeight = image.height;
+    for (uint32_t level = 0; level < levelCount; level++)
+    {
+        size_t size = GetCompressedSize(image.format, levelWidth, levelHeight);
+        if (offset + size > data.size()) break;
+
+        image.levels.emplace_back(data.begin() + offset, data.begin() + offset + size);
+        offset += size;
+        levelWidth = std::max(levelWidth / 2, 1);
+        levelHeight = std::max(levelHeight / 2, 1);
+    }
+    return !image.levels.empty();
+}
+
+unsigned int UploadCompressedTexture(const CompressedImage& image, unsigned int textureID)
+{
+    if (textureID == 0) glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    // Upload the pre-built mip chain as is, there's nothing left for the driver to do.
+    const GLenum format = GetGLFormat(image.format);
+    int width = image.width, height = image.height;
+    size_t bytes = 0;
+    for (size_t level = 0; level < image.levels.size(); level++)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)level, format, width, height, 0, (GLsizei)image.levels[level].size(), image.levels[level].data());
+        width = std::max(width / 2, 1);
+        height = std::max(height / 2, 1);
+        bytes += image.levels[level].size();
+    }
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, textureID, bytes, "Compressed texture");
+
+    // Only sample the levels that actually exist, otherwise the texture is incomplete.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)image.levels.size() - 1);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, GetGLSwizzle(image.format));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include <string>
+#include <vector>
+
+#include "TextureCompression.h"
+
+// A block compressed image with its whole mip chain, level 0 being the full resolution.
+struct CompressedImage
+{
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0;
+    int height = 0;
+    std::vector<std::vector<unsigned char>> levels;
+};
+
+// KTX2 container (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html). Only uncompressed (no supercompression)
+// 2D images in one of our block formats are supported.
+bool ReadKTX2(const std::string& path, CompressedImage& image);
+bool WriteKTX2(const std::string& path, const CompressedImage& image);
+
+// Where each mip level of a KTX2 file is stored, so levels can be read one at a time.
+struct KTX2Level
+{
+    unsigned long long offset = 0;
+    unsigned long long size = 0;
+};
+
+struct KTX2Layout
+{
+    BlockFormat format = BlockFormat::BC1;
+    int width = 0;
+    int height = 0;
+    std::vector<KTX2Level> levels;
+};
+
+// Read only the header and level index of a KTX2 file.
+bool ReadKTX2Layout(const std::string& path, KTX2Layout& layout);
+// Read a single mip level of a KTX2 file. Safe to call from any thread.
+bool ReadKTX2Level(const std::string& path, const KTX2Layout& layout, int level, std::vector<unsigned char>& data);
+// DirectDraw Surface, with either the legacy FourCC codes or the DX10 extended header.
+bool ReadDDS(const std::string& path, CompressedImage& image);
+
+// Create a texture object (or reuse textureID if it isn't 0) and upload all mip levels with glCompressedTexImage2D.
+unsigned int UploadCompressedTexture(const CompressedImage& image, unsigned int textureID = 0);
@@ -0,0 +1,282 @@
+﻿#include "TextureManager.h"
+
+#include <algorithm>
+
+#include <glad/glad.h>
+
+#include "GpuResources.h"
+#include "TextureStreamer.h"
+#include "Util.h"
+
+TextureManager::TextureManager(TextureStreamer* streamer)
+    : streamer(streamer)
+{
+}
+
+TextureManager::~TextureManager()
+{
+    for (auto& entry : textures)
+    {
+        if (entry.second.streamed) streamer->Unload(entry.first);
+        else
+        {
+            GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, entry.first);
+            glDeleteTextures(1, &entry.first);
+        }
+    }
+}
+
+unsigned int TextureManager::Acquire(const std::string& path)
+{
+    auto found = idByPath.find(path);
+    if (found != idByPath.end())
+    {
+        textures[found->second].references++;
+        return found->second;
+    }
+
+    TextureInfo texture;
+    texture.path = path;
+    texture.references = 1;
+    texture.lastUsedFrame = frame;
+    texture.id = streamer ? streamer->Load(path + ".ktx2") : 0;
+    texture.streamed = texture.id != 0;
+    load(texture);
+
+    idByPath[path] = texture.id;
+    textures[texture.id] = texture;
+    return texture.id;
+}
+
+void TextureManager::Preload(const std::vector<std::string>& paths)
+{
+    // Streamed textures only read their smallest levels here, the rest is decoded up front in parallel.
+    std::vector<std::string> decodePaths;
+    for (const std::string& path : paths)
+    {
+        if (idByPath.count(path) || std::find(decodePaths.begin(), decodePaths.end(), path) != decodePaths.end()) continue;
+
+        unsigned int id = streamer ? streamer->Load(path + ".ktx2") : 0;
+        if (id == 0)
+        {
+            decodePaths.push_back(path);
+            continue;
+        }
+
+        TextureInfo texture;
+        texture.path = path;
+        texture.id = id;
+        texture.streamed = true;
+        texture.resident = true;
+        texture.lastUsedFrame = frame;
+        measure(texture);
+        idByPath[path] = id;
+        textures[id] = texture;
+    }
+
+    std::vector<ImageData> images;
+    std::vector<char> succeeded;
+    readImagesParallel(decodePaths, images, succeeded);
+
+    // Uploads have to happen on this thread, which owns the GL context.
+    for (size_t i = 0; i < decodePaths.size(); i++)
+    {
+        if (!succeeded[i]) continue;
+
+        TextureInfo texture;
+        texture.path = decodePaths[i];
+        texture.id = uploadImage(images[i]);
+        texture.resident = true;
+        texture.lastUsedFrame = frame;
+        measure(texture);
+        idByPath[texture.path] = texture.id;
+        textures[texture.id] = texture;
+    }
+}
+
+unsigned int TextureManager::Adopt(const std::string& name, unsigned int id)
+{
+    TextureInfo texture;
+    texture.path = name;
+    texture.id = id;
+    texture.references = 1;
+    texture.generated = true;
+    texture.resident = true;
+    texture.lastUsedFrame = frame;
+    measure(texture);
+    idByPath[name] = id;
+    textures[id] = texture;
+    return id;
+}
+
+void TextureManager::Release(unsigned int id)
+{
+    auto found = textures.find(id);
+    if (found == textures.end() || --found->second.references > 0) return;
+
+    if (found->second.streamed) streamer->Unload(id);
+    else
+    {
+        GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, id);
+        glDeleteTextures(1, &id);
+    }
+    idByPath.erase(found->second.path);
+    textures.erase(found);
+}
+
+void TextureManager::Use(unsigned int id)
+{
+    auto found = textures.find(id);
+    if (found == textures.end()) return;
+
+    TextureInfo& texture = found->second;
+    texture.lastUsedFrame = frame;
+    if (!texture.resident)
+    {
+        load(texture);
+        currentStats.reloads++;
+    }
+}
+
+bool TextureManager::Reload(unsigned int id)
+{
+    auto found = textures.find(id);
+    if (found == textures.end() || found->second.streamed || found->second.generated) return false;
+
+    load(found->second);
+    currentStats.reloads++;
+    return found->second.resident;
+}
+
+void TextureManager::ReloadAll()
+{
+    for (auto& entry : textures)
+    {
+        Reload(entry.first);
+    }
+}
+
+void TextureManager::EndFrame()
+{
+    size_t residentBytes = 0;
+    for (auto& entry : textures)
+    {
+        if (entry.second.streamed) entry.second.bytes = streamer->GetResidentBytes(entry.first);
+        residentBytes += entry.second.bytes;
+    }
+
+    // Least recently used first, and only textures that haven't been used for a while.
+    while (evictionEnabled && residentBytes > GetBudgetBytes())
+    {
+        TextureInfo* oldest = nullptr;
+        for (auto& entry : textures)
+        {
+            TextureInfo& texture = entry.second;
+            if (!texture.resident || texture.streamed || texture.generated || texture.lastUsedFrame > frame - evictAfterFrames) continue;
+            if (!oldest || texture.lastUsedFrame < oldest->lastUsedFrame) oldest = &texture;
+        }
+        if (!oldest) break;
+
+        residentBytes -= oldest->bytes;
+        evict(*oldest);
+        currentStats.evictions++;
+    }
+
+    currentStats.residentBytes = residentBytes;
+    for (const auto& entry : textures)
+    {
+        if (entry.second.resident) currentStats.residentTextures++;
+    }
+
+    frameStats = currentStats;
+    currentStats = FrameStats();
+    frame++;
+}
+
+std::vector<TextureManager::TextureInfo> TextureManager::GetTextureInfo() const
+{
+    std::vector<TextureInfo> info;
+    for (const auto& entry : textures)
+    {
+        info.push_back(entry.second);
+    }
+    std::sort(info.begin(), info.end(), [](const TextureInfo& a, const TextureInfo& b) { return a.path < b.path; });
+    return info;
+}
+
+void TextureManager::load(TextureInfo& texture)
+{
+    // Streamed textures are already loaded by the streamer, everything else (re)loads into its existing name.
+    if (!texture.streamed) texture.id = loadTexture(texture.path.c_str(), texture.id);
+    texture.resident = true;
+    measure(texture);
+}
+
+void TextureManager::measure(TextureInfo& texture) const
+{
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+
+    GLint baseLevel = 0, maxLevel = 0;
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, &baseLevel);
+    glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+
+    // Ask the driver what each level actually is instead of trusting the source file.
+    texture.width = texture.height = texture.levelCount = 0;
+    texture.bytes = 0;
+    for (GLint level = 0; level <= std::min(maxLevel, 16); level++)
+    {
+        GLint width = 0, height = 0, compressed = 0;
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+        if (width == 0 || height == 0)
+        {
+            // Levels below the base level of a streamed texture may not be loaded.
+            if (level < baseLevel) continue;
+            break;
+        }
+        if (texture.levelCount == 0)
+        {
+            texture.width = width << level;
+            texture.height = height << level;
+        }
+        texture.levelCount = level + 1;
+
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+        if (compressed)
+        {
+            GLint size = 0;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+            texture.bytes += size;
+        }
+        else
+        {
+            GLint bits[4] = {};
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_RED_SIZE, &bits[0]);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_GREEN_SIZE, &bits[1]);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_BLUE_SIZE, &bits[2]);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_ALPHA_SIZE, &bits[3]);
+            int bytesPerTexel = (bits[0] + bits[1] + bits[2] + bits[3] + 7) / 8;
+            // Drivers pad three byte texels to four.
+            if (bytesPerTexel == 3) bytesPerTexel = 4;
+            texture.bytes += (size_t)width * height * bytesPerTexel;
+        }
+    }
+
+    // The driver's numbers beat the tracker's estimate, and the path says more than where the texture was created.
+    GpuResourceTracker& tracker = GpuResourceTracker::Get();
+    tracker.SetSize(GpuResourceType::Texture, texture.id, texture.bytes);
+    tracker.SetOwner(GpuResourceType::Texture, texture.id, texture.path);
+}
+
+void TextureManager::evict(TextureInfo& texture)
+{
+    // Redefine every level as empty. That releases the storage but keeps the name valid for the meshes referring to it.
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    for (int level = 0; level < texture.levelCount; level++)
+    {
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    texture.resident = false;
+    texture.bytes = 0;
+    GpuResourceTracker::Get().SetSize(GpuResourceType::Texture, texture.id, 0);
+}
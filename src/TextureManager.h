@@ -0,0 +1,84 @@
+﻿#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TextureStreamer;
+
+// Owns every texture loaded from a file. Textures are shared by path and reference counted, their VRAM use is tracked
+// per texture (all mip levels, at the size of their actual format), and textures that haven't been used for a while are
+// evicted when the total goes over budget. Evicted textures keep their texture name and are reloaded the next time
+// they're used.
+class TextureManager
+{
+public:
+    struct TextureInfo
+    {
+        std::string path;
+        unsigned int id = 0;
+        int width = 0;
+        int height = 0;
+        int levelCount = 0;
+        size_t bytes = 0;
+        bool resident = false;
+        // Mip levels are managed by the texture streamer, they are never evicted as a whole.
+        bool streamed = false;
+        // Built in memory (e.g. an atlas page) rather than loaded from a file, so it's never evicted or reloaded.
+        bool generated = false;
+        int references = 0;
+        long long lastUsedFrame = 0;
+    };
+
+    struct FrameStats
+    {
+        size_t residentBytes = 0;
+        int residentTextures = 0;
+        int evictions = 0;
+        int reloads = 0;
+    };
+
+    bool evictionEnabled = true;
+    int budgetMegabytes = 256;
+    // Only textures that weren't used for this many frames are evicted.
+    int evictAfterFrames = 60;
+
+    // Textures with a KTX2 version are handed to the streamer if one is given.
+    explicit TextureManager(TextureStreamer* streamer = nullptr);
+    ~TextureManager();
+    TextureManager(const TextureManager&) = delete;
+    TextureManager& operator=(const TextureManager&) = delete;
+
+    // Load a texture, or add a reference to it if it's already loaded. Returns the texture name.
+    unsigned int Acquire(const std::string& path);
+    // Load textures that will be acquired soon, decoding the images on several threads at once. Doesn't add references.
+    void Preload(const std::vector<std::string>& paths);
+    // Take over a texture that was built in memory, with one reference. name takes the place of its path.
+    unsigned int Adopt(const std::string& name, unsigned int id);
+    // Drop a reference, the texture is deleted once nobody uses it anymore.
+    void Release(unsigned int id);
+    // Mark a texture as used this frame, reloading it first if it was evicted.
+    void Use(unsigned int id);
+    // Read a texture from disk again, e.g. after the file changed.
+    bool Reload(unsigned int id);
+    void ReloadAll();
+    // Evict textures until the budget is met and finish this frame's stats.
+    void EndFrame();
+
+    std::vector<TextureInfo> GetTextureInfo() const;
+    // Stats of the last finished frame.
+    const FrameStats& GetFrameStats() const { return frameStats; }
+    size_t GetBudgetBytes() const { return (size_t)budgetMegabytes * 1024 * 1024; }
+
+private:
+    TextureStreamer* streamer;
+    std::unordered_map<unsigned int, TextureInfo> textures;
+    std::unordered_map<std::string, unsigned int> idByPath;
+    long long frame = 0;
+    FrameStats currentStats;
+    FrameStats frameStats;
+
+    void load(TextureInfo& texture);
+    void measure(TextureInfo& texture) const;
+    void evict(TextureInfo& texture);
+};
@@ -0,0 +1,314 @@
+﻿#include "TextureStreamer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include <glad/glad.h>
+
+#include "FrameArena.h"
+#include "GpuResources.h"
+#include "Mesh.h"
+#include "Profiler.h"
+
+TextureStreamer::TextureStreamer()
+{
+    loader = std::thread(&TextureStreamer::loaderThread, this);
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    loader.join();
+
+    for (const Entry& entry : entries)
+    {
+        if (entry.id != 0) GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, entry.id);
+        glDeleteTextures(1, &entry.id);
+    }
+}
+
+unsigned int TextureStreamer::Load(const std::string& path)
+{
+    Entry entry;
+    entry.path = path;
+    if (!ReadKTX2Layout(path, entry.layout)) return 0;
+
+    // Everything from the first level that fits the minimum resident size down to 1x1 is loaded right away.
+    const int levelCount = (int)entry.layout.levels.size();
+    entry.minimumLevel = levelCount - 1;
+    for (int level = 0; level < levelCount; level++)
+    {
+        if (std::max(entry.layout.width >> level, entry.layout.height >> level) <= minimumResidentSize)
+        {
+            entry.minimumLevel = level;
+            break;
+        }
+    }
+
+    std::vector<std::vector<unsigned char>> levels(levelCount);
+    for (int level = entry.minimumLevel; level < levelCount; level++)
+    {
+        if (!ReadKTX2Level(path, entry.layout, level, levels[level])) return 0;
+    }
+
+    glGenTextures(1, &entry.id);
+    glBindTexture(GL_TEXTURE_2D, entry.id);
+    const GLenum format = GetGLFormat(entry.layout.format);
+    for (int level = entry.minimumLevel; level < levelCount; level++)
+    {
+        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, std::max(entry.layout.width >> level, 1),
+            std::max(entry.layout.height >> level, 1), 0, (GLsizei)levels[level].size(), levels[level].data());
+        residentBytes += levels[level].size();
+    }
+
+    entry.residentLevel = entry.minimumLevel;
+    entry.neededLevel = entry.minimumLevel;
+    entry.lastNeededFrame.assign(levelCount, 0);
+    setResidentLevel(entry);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA, GetGLSwizzle(entry.layout.format));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, entry.id, residentSize(entry), path);
+    entryByID[entry.id] = entries.size();
+    entries.push_back(std::move(entry));
+    return entries.back().id;
+}
+
+void TextureStreamer::Unload(unsigned int id)
+{
+    auto found = entryByID.find(id);
+    if (found == entryByID.end()) return;
+
+    Entry& entry = entries[found->second];
+    residentBytes -= residentSize(entry);
+    GpuResourceTracker::Get().Untrack(GpuResourceType::Texture, entry.id);
+    glDeleteTextures(1, &entry.id);
+    entry.id = 0;
+    entryByID.erase(found);
+}
+
+void TextureStreamer::BeginFrame()
+{
+    frame++;
+    for (Entry& entry : entries)
+    {
+        entry.neededLevel = enabled ? entry.minimumLevel : 0;
+    }
+}
+
+void TextureStreamer::RequestMeshTextures(const Mesh& mesh, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition, float pixelsPerUnit)
+{
+    if (!enabled) return;
+
+    // World units per object space unit, the largest axis scale so we never underestimate the detail needed.
+    float scale = std::max(glm::length(glm::vec3(modelMatrix[0])), std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+    if (mesh.uvDensity <= 0.0f || scale <= 0.0f) return;
+
+    // The closest point of the mesh decides how large its texels can get on screen.
+    const Bounds bounds = mesh.bounds.Transform(modelMatrix);
+    const glm::vec3 closest = glm::clamp(cameraPosition, bounds.min, bounds.max);
+    const float distance = std::max(glm::length(cameraPosition - closest), 0.01f);
+    const float pixelsPerWorldUnit = pixelsPerUnit / distance;
+
+    for (const Texture& texture : mesh.textures)
+    {
+        auto found = entryByID.find(texture.id);
+        if (found == entryByID.end()) continue;
+        Entry& entry = entries[found->second];
+
+        // Mip level at which one texel covers about one pixel.
+        float texelsPerWorldUnit = mesh.uvDensity / scale * (float)std::max(entry.layout.width, entry.layout.height);
+        float level = std::log2(texelsPerWorldUnit / pixelsPerWorldUnit) + mipBias;
+        int neededLevel = std::max(0, std::min(entry.minimumLevel, (int)std::floor(level)));
+        entry.neededLevel = std::min(entry.neededLevel, neededLevel);
+    }
+}
+
+void TextureStreamer::Update()
+{
+    uploads = 0;
+
+    // Upload what the loader finished, in the order it finished.
+    FrameVector<LoadResult> finished;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        int count = std::min((int)results.size(), maxUploadsPerFrame);
+        finished.assign(std::make_move_iterator(results.begin()), std::make_move_iterator(results.begin() + count));
+        results.erase(results.begin(), results.begin() + count);
+    }
+    for (LoadResult& result : finished)
+    {
+        Entry& entry = entries[result.entry];
+        entry.loading = false;
+        pendingLoads--;
+        loadingBytes -= levelSize(entry, result.level);
+        if (entry.id == 0) continue;
+
+        // Only a level directly above the resident ones keeps the mip chain complete.
+        if (!result.succeeded || result.level != entry.residentLevel - 1) continue;
+
+        glBindTexture(GL_TEXTURE_2D, entry.id);
+        glCompressedTexImage2D(GL_TEXTURE_2D, result.level, GetGLFormat(entry.layout.format), std::max(entry.layout.width >> result.level, 1),
+            std::max(entry.layout.height >> result.level, 1), 0, (GLsizei)result.data.size(), result.data.data());
+        entry.residentLevel = result.level;
+        setResidentLevel(entry);
+        residentBytes += result.data.size();
+        GpuResourceTracker::Get().SetSize(GpuResourceType::Texture, entry.id, residentSize(entry));
+        uploads++;
+    }
+
+    for (Entry& entry : entries)
+    {
+        for (int level = entry.neededLevel; level < (int)entry.lastNeededFrame.size(); level++)
+        {
+            entry.lastNeededFrame[level] = frame;
+        }
+    }
+
+    // The budget may have shrunk, free up memory until everything fits again, needed or not.
+    const size_t budget = enabled ? GetBudgetBytes() : SIZE_MAX;
+    while (residentBytes + loadingBytes > budget && evictLeastRecentlyNeeded(frame + 1))
+    {
+    }
+
+    // Textures furthest from the detail they need go first.
+    FrameVector<size_t> order;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].id != 0 && !entries[i].loading && entries[i].neededLevel < entries[i].residentLevel) order.push_back(i);
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+    {
+        return entries[a].residentLevel - entries[a].neededLevel > entries[b].residentLevel - entries[b].neededLevel;
+    });
+
+    for (size_t index : order)
+    {
+        Entry& entry = entries[index];
+        const int level = entry.residentLevel - 1;
+        const size_t size = levelSize(entry, level);
+
+        // Make room by dropping levels that weren't needed this frame.
+        while (residentBytes + loadingBytes + size > budget && evictLeastRecentlyNeeded(frame))
+        {
+        }
+        if (residentBytes + loadingBytes + size > budget) continue;
+
+        entry.loading = true;
+        pendingLoads++;
+        loadingBytes += size;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            requests.push_back({ index, level, entry.path, entry.layout });
+        }
+        condition.notify_one();
+    }
+}
+
+std::vector<TextureStreamer::TextureInfo> TextureStreamer::GetTextureInfo() const
+{
+    std::vector<TextureInfo> info;
+    for (const Entry& entry : entries)
+    {
+        if (entry.id == 0) continue;
+
+        TextureInfo texture;
+        texture.path = entry.path;
+        texture.width = entry.layout.width;
+        texture.height = entry.layout.height;
+        texture.levelCount = (int)entry.layout.levels.size();
+        texture.residentLevel = entry.residentLevel;
+        texture.neededLevel = entry.neededLevel;
+        texture.loading = entry.loading;
+        texture.residentBytes = residentSize(entry);
+        info.push_back(texture);
+    }
+    return info;
+}
+
+size_t TextureStreamer::GetResidentBytes(unsigned int id) const
+{
+    auto found = entryByID.find(id);
+    return found != entryByID.end() ? residentSize(entries[found->second]) : 0;
+}
+
+void TextureStreamer::loaderThread()
+{
+    Profiler::Get().SetThreadName("Texture loader");
+    while (true)
+    {
+        LoadRequest request;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() { return stopping || !requests.empty(); });
+            if (stopping) return;
+            request = std::move(requests.front());
+            requests.pop_front();
+        }
+
+        LoadResult result;
+        result.entry = request.entry;
+        result.level = request.level;
+        {
+            ProfileScope scope("Read texture level");
+            Profiler::Get().Mark("Texture level load", request.path.c_str());
+            result.succeeded = ReadKTX2Level(request.path, request.layout, request.level, result.data);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        results.push_back(std::move(result));
+    }
+}
+
+size_t TextureStreamer::levelSize(const Entry& entry, int level) const
+{
+    return (size_t)entry.layout.levels[level].size;
+}
+
+size_t TextureStreamer::residentSize(const Entry& entry) const
+{
+    size_t size = 0;
+    for (int level = entry.residentLevel; level < (int)entry.layout.levels.size(); level++)
+    {
+        size += levelSize(entry, level);
+    }
+    return size;
+}
+
+void TextureStreamer::setResidentLevel(const Entry& entry) const
+{
+    // Sampling never reaches below the base level, so the levels above it don't need to exist.
+    glBindTexture(GL_TEXTURE_2D, entry.id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, entry.residentLevel);
+}
+
+bool TextureStreamer::evictLeastRecentlyNeeded(long long neededBefore)
+{
+    Entry* oldest = nullptr;
+    for (Entry& entry : entries)
+    {
+        if (entry.id == 0 || entry.residentLevel >= entry.minimumLevel) continue;
+        if (entry.lastNeededFrame[entry.residentLevel] >= neededBefore) continue;
+        if (!oldest || entry.lastNeededFrame[entry.residentLevel] < oldest->lastNeededFrame[oldest->residentLevel]) oldest = &entry;
+    }
+    if (!oldest) return false;
+
+    // Redefine the level as empty, which releases its storage.
+    const int level = oldest->residentLevel;
+    oldest->residentLevel++;
+    setResidentLevel(*oldest);
+    glCompressedTexImage2D(GL_TEXTURE_2D, level, GetGLFormat(oldest->layout.format), 0, 0, 0, 0, nullptr);
+    residentBytes -= levelSize(*oldest, level);
+    GpuResourceTracker::Get().SetSize(GpuResourceType::Texture, oldest->id, residentSize(*oldest));
+    evictions++;
+    return true;
+}
@@ -0,0 +1,128 @@
+﻿#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "TextureFile.h"
+
+class Mesh;
+
+// Streams the mip levels of KTX2 textures in and out of VRAM. Only the small levels are loaded up front; every frame
+// the renderer reports how much texture detail each visible mesh needs, and finer levels are read from disk on a
+// background thread and uploaded until the memory budget is used up. Under memory pressure the levels that were needed
+// least recently are dropped first.
+class TextureStreamer
+{
+public:
+    struct TextureInfo
+    {
+        std::string path;
+        int width = 0;
+        int height = 0;
+        int levelCount = 0;
+        // Finest level currently in VRAM.
+        int residentLevel = 0;
+        // Finest level needed by any mesh this frame.
+        int neededLevel = 0;
+        size_t residentBytes = 0;
+        bool loading = false;
+    };
+
+    // When disabled, every texture streams in completely, regardless of the budget.
+    bool enabled = true;
+    int budgetMegabytes = 64;
+    // Levels this size and smaller are loaded with the texture and never evicted.
+    int minimumResidentSize = 64;
+    // Added to the estimated mip level, positive values trade sharpness for memory.
+    float mipBias = 0.0f;
+    // Levels uploaded per frame at most, to keep upload hitches small.
+    int maxUploadsPerFrame = 4;
+
+    TextureStreamer();
+    ~TextureStreamer();
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // Create a streamed texture from a KTX2 file. Returns 0 if the file doesn't exist or can't be read.
+    unsigned int Load(const std::string& path);
+    // Delete a streamed texture.
+    void Unload(unsigned int id);
+    // Start collecting mip requests for a new frame.
+    void BeginFrame();
+    // Request the mip levels a visible mesh needs for its textures. pixelsPerUnit is the projected size in pixels of
+    // one world unit at a distance of one unit.
+    void RequestMeshTextures(const Mesh& mesh, const glm::mat4& modelMatrix, const glm::vec3& cameraPosition, float pixelsPerUnit);
+    // Upload finished loads, evict levels that no longer fit and queue new loads.
+    void Update();
+
+    std::vector<TextureInfo> GetTextureInfo() const;
+    // VRAM used by the resident levels of one texture, 0 if it isn't a streamed texture.
+    size_t GetResidentBytes(unsigned int id) const;
+    size_t GetResidentBytes() const { return residentBytes; }
+    size_t GetBudgetBytes() const { return (size_t)budgetMegabytes * 1024 * 1024; }
+    int GetPendingLoadCount() const { return pendingLoads; }
+    int GetUploadCount() const { return uploads; }
+    int GetEvictionCount() const { return evictions; }
+
+private:
+    struct Entry
+    {
+        std::string path;
+        // 0 once unloaded. Entries stay in place since pending loads refer to them by index.
+        unsigned int id = 0;
+        KTX2Layout layout;
+        int residentLevel = 0;
+        int minimumLevel = 0;
+        int neededLevel = 0;
+        // Last frame each level was needed, indexed by level.
+        std::vector<long long> lastNeededFrame;
+        bool loading = false;
+    };
+
+    struct LoadRequest
+    {
+        size_t entry;
+        int level;
+        std::string path;
+        KTX2Layout layout;
+    };
+
+    struct LoadResult
+    {
+        size_t entry;
+        int level;
+        bool succeeded;
+        std::vector<unsigned char> data;
+    };
+
+    std::vector<Entry> entries;
+    std::unordered_map<unsigned int, size_t> entryByID;
+    long long frame = 0;
+    size_t residentBytes = 0;
+    size_t loadingBytes = 0;
+    int pendingLoads = 0;
+    int uploads = 0;
+    int evictions = 0;
+
+    std::thread loader;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<LoadRequest> requests;
+    std::vector<LoadResult> results;
+    bool stopping = false;
+
+    void loaderThread();
+    size_t levelSize(const Entry& entry, int level) const;
+    size_t residentSize(const Entry& entry) const;
+    void setResidentLevel(const Entry& entry) const;
+    // Drop the finest level of the texture whose finest level was needed least recently, if that was before the given
+    // frame. Returns false if there was nothing to evict.
+    bool evictLeastRecentlyNeeded(long long neededBefore);
+};
@@ -0,0 +1,491 @@
+﻿#include "TextureTool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+
+#include "stb_image.h"
+#include "TextureCompression.h"
+#include "TextureFile.h"
+#include "Util.h"
+
+namespace
+{
+    struct SourceTexture
+    {
+        std::string path;
+        std::string type;
+    };
+
+    struct LoadedTexture
+    {
+        std::string path;
+        std::string type;
+        int width = 0;
+        int height = 0;
+        int components = 0;
+        bool hasAlpha = false;
+        std::vector<unsigned char> rgba;
+    };
+
+    struct TextureResult
+    {
+        bool written = false;
+        BlockFormat format = BlockFormat::BC1;
+        size_t uncompressedBytes = 0;
+        size_t compressedBytes = 0;
+        size_t pixels = 0;
+        double mipTime = 0.0;
+        double encodeTime = 0.0;
+        double decodeTime = 0.0;
+        double psnr = 0.0;
+    };
+
+    double secondsSince(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // Run function(index) for every index in [0, count) on up to threadCount threads. Items are handed out one at a
+    // time since textures differ a lot in size.
+    template <typename Function>
+    void parallelFor(size_t count, unsigned int threadCount, Function function)
+    {
+        threadCount = (unsigned int)std::min<size_t>(std::max(threadCount, 1u), count);
+        std::atomic<size_t> next(0);
+        auto worker = [&]()
+        {
+            for (size_t index = next++; index < count; index = next++) function(index);
+        };
+
+        std::vector<std::thread> threads;
+        for (unsigned int t = 1; t < threadCount; t++) threads.emplace_back(worker);
+        worker();
+        for (std::thread& thread : threads) thread.join();
+    }
+
+    unsigned int hardwareThreads()
+    {
+        return std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    std::vector<std::string> listImages(const char* directory, const char* extension)
+    {
+        std::vector<std::string> paths;
+        std::error_code error;
+        for (const auto& file : std::filesystem::directory_iterator(directory, error))
+        {
+            if (file.path().extension() == extension) paths.push_back(file.path().string());
+        }
+        std::sort(paths.begin(), paths.end());
+        if (paths.empty()) std::cout << "No " << extension << " images in " << directory << "\n";
+        return paths;
+    }
+
+    // Peak signal to noise ratio over the channels a format stores.
+    double computePSNR(const unsigned char* a, const unsigned char* b, size_t pixelCount, BlockFormat format)
+    {
+        int channels = format == BlockFormat::BC4 ? 1 : format == BlockFormat::BC5 ? 2 : format == BlockFormat::BC1 ? 3 : 4;
+        double squaredError = 0.0;
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                double difference = (double)a[i * 4 + c] - b[i * 4 + c];
+                squaredError += difference * difference;
+            }
+        }
+        double meanSquaredError = squaredError / ((double)pixelCount * channels);
+        if (meanSquaredError == 0.0) return 99.0;
+        return 10.0 * std::log10(255.0 * 255.0 / meanSquaredError);
+    }
+
+    bool collectTextures(const char* modelPath, std::vector<SourceTexture>& textures)
+    {
+        // Material references only, no need for Assimp to process any geometry.
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(modelPath, 0);
+        if (!scene)
+        {
+            std::cout << "ERROR::ASSIMP::" << importer.GetErrorString() << "\n";
+            return false;
+        }
+
+        std::string path = modelPath;
+        std::string directory = path.substr(0, path.find_last_of("\\/"));
+
+        const std::pair<aiTextureType, const char*> types[] = {
+            { aiTextureType_DIFFUSE, "texture_diffuse" },
+            { aiTextureType_SPECULAR, "texture_specular" },
+            { aiTextureType_NORMALS, "texture_normal" }
+        };
+
+        for (unsigned int m = 0; m < scene->mNumMaterials; m++)
+        {
+            aiMaterial* material = scene->mMaterials[m];
+            for (const auto& type : types)
+            {
+                for (unsigned int i = 0; i < material->GetTextureCount(type.first); i++)
+                {
+                    aiString texturePath;
+                    material->GetTexture(type.first, i, &texturePath);
+                    std::string fullPath = directory + '/' + texturePath.C_Str();
+
+                    bool known = false;
+                    for (const SourceTexture& texture : textures)
+                    {
+                        known = known || texture.path == fullPath;
+                    }
+                    if (!known) textures.push_back({ fullPath, type.second });
+                }
+            }
+        }
+        return true;
+    }
+
+    bool loadTexture(const SourceTexture& source, LoadedTexture& texture)
+    {
+        unsigned char* data = stbi_load(source.path.c_str(), &texture.width, &texture.height, &texture.components, 4);
+        if (!data)
+        {
+            return false;
+        }
+        texture.path = source.path;
+        texture.type = source.type;
+        texture.rgba.assign(data, data + (size_t)texture.width * texture.height * 4);
+        stbi_image_free(data);
+
+        texture.hasAlpha = false;
+        if (texture.components == 4)
+        {
+            for (size_t i = 3; i < texture.rgba.size() && !texture.hasAlpha; i += 4) texture.hasAlpha = texture.rgba[i] < 255;
+        }
+        return true;
+    }
+
+    MipSettings getMipSettings(const LoadedTexture& texture, MipFilter filter)
+    {
+        // Only color maps are authored in sRGB, everything else holds plain data.
+        MipSettings settings;
+        settings.filter = filter;
+        settings.srgb = texture.type == "texture_diffuse";
+        settings.premultiplyAlpha = texture.hasAlpha && settings.srgb;
+        settings.normalMap = texture.type == "texture_normal";
+        return settings;
+    }
+
+    void processTexture(const LoadedTexture& texture, MipFilter filter, TextureResult& result)
+    {
+        result.format = ChooseBlockFormat(texture.type, texture.hasAlpha);
+
+        auto start = std::chrono::steady_clock::now();
+        std::vector<std::vector<unsigned char>> mips;
+        GenerateMipChain(texture.rgba.data(), texture.width, texture.height, getMipSettings(texture, filter), mips);
+        result.mipTime = secondsSince(start);
+
+        CompressedImage image;
+        image.format = result.format;
+        image.width = texture.width;
+        image.height = texture.height;
+
+        // loadTexture stores single channel images as GL_RED and everything else as four bytes per pixel.
+        const int uncompressedBytesPerPixel = texture.components == 1 ? 1 : 4;
+        int levelWidth = texture.width, levelHeight = texture.height;
+        for (const std::vector<unsigned char>& level : mips)
+        {
+            std::vector<unsigned char> blocks(GetCompressedSize(image.format, levelWidth, levelHeight));
+
+            // Already running one texture per core, so each texture is compressed on a single thread.
+            start = std::chrono::steady_clock::now();
+            CompressImage(level.data(), levelWidth, levelHeight, image.format, blocks.data(), 1);
+            result.encodeTime += secondsSince(start);
+
+            if (image.levels.empty())
+            {
+                std::vector<unsigned char> decoded((size_t)levelWidth * levelHeight * 4);
+                start = std::chrono::steady_clock::now();
+                DecompressImage(blocks.data(), levelWidth, levelHeight, image.format, decoded.data(), 1);
+                result.decodeTime += secondsSince(start);
+                result.psnr = computePSNR(level.data(), decoded.data(), (size_t)levelWidth * levelHeight, image.format);
+            }
+
+            result.pixels += (size_t)levelWidth * levelHeight;
+            result.uncompressedBytes += (size_t)levelWidth * levelHeight * uncompressedBytesPerPixel;
+            result.compressedBytes += blocks.size();
+            image.levels.push_back(std::move(blocks));
+
+            levelWidth = std::max(levelWidth / 2, 1);
+            levelHeight = std::max(levelHeight / 2, 1);
+        }
+
+        result.written = WriteKTX2(texture.path + ".ktx2", image);
+    }
+}
+
+int runTextureCompression(const char* modelPath, MipFilter mipFilter)
+{
+    std::vector<SourceTexture> sources;
+    if (!collectTextures(modelPath, sources)) return 1;
+
+    // Has to match how textures are loaded at runtime.
+    stbi_set_flip_vertically_on_load(true);
+
+    std::vector<LoadedTexture> textures(sources.size());
+    std::vector<char> loaded(sources.size());
+    std::vector<TextureResult> results(sources.size());
+    const unsigned int threadCount = hardwareThreads();
+
+    auto start = std::chrono::steady_clock::now();
+    parallelFor(sources.size(), threadCount, [&](size_t i)
+    {
+        loaded[i] = loadTexture(sources[i], textures[i]);
+        if (loaded[i]) processTexture(textures[i], mipFilter, results[i]);
+        // Free the source image as soon as possible, there may be a lot of large textures.
+        textures[i].rgba = std::vector<unsigned char>();
+    });
+    double wallTime = secondsSince(start);
+
+    TextureResult total;
+    size_t sourcePixels = 0;
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const TextureResult& result = results[i];
+        if (!loaded[i])
+        {
+            std::cout << "Texture failed to load at path: " << sources[i].path << "\n";
+            continue;
+        }
+        if (!result.written)
+        {
+            std::cout << "Failed to write " << sources[i].path << ".ktx2\n";
+            continue;
+        }
+
+        const LoadedTexture& texture = textures[i];
+        char line[256];
+        snprintf(line, sizeof(line), "%-40s %s %5dx%-5d %8.2f MB -> %6.2f MB  mips %6.1f MP/s  encode %6.1f MP/s  decode %7.1f MP/s  PSNR %5.2f dB",
+            texture.path.c_str(), GetBlockFormatName(result.format), texture.width, texture.height, result.uncompressedBytes / 1048576.0,
+            result.compressedBytes / 1048576.0, (double)texture.width * texture.height / result.mipTime / 1e6,
+            result.pixels / result.encodeTime / 1e6, (double)texture.width * texture.height / result.decodeTime / 1e6, result.psnr);
+        std::cout << line << "\n";
+
+        total.uncompressedBytes += result.uncompressedBytes;
+        total.compressedBytes += result.compressedBytes;
+        total.pixels += result.pixels;
+        total.mipTime += result.mipTime;
+        total.encodeTime += result.encodeTime;
+        sourcePixels += (size_t)texture.width * texture.height;
+    }
+
+    if (sourcePixels > 0)
+    {
+        // Every texture is processed on one core, so the summed per texture times give per core throughput.
+        char line[256];
+        snprintf(line, sizeof(line), "Total: %.2f MB -> %.2f MB of VRAM (%.1f%%), %s mips %.1f MP/s per core, encode %.1f MP/s per core, %.2f s on %u threads",
+            total.uncompressedBytes / 1048576.0, total.compressedBytes / 1048576.0, 100.0 * total.compressedBytes / total.uncompressedBytes,
+            GetMipFilterName(mipFilter), sourcePixels / total.mipTime / 1e6, total.pixels / total.encodeTime / 1e6, wallTime, threadCount);
+        std::cout << line << "\n";
+    }
+    return 0;
+}
+
+int runMipBenchmark(const char* modelPath)
+{
+    std::vector<SourceTexture> sources;
+    if (!collectTextures(modelPath, sources)) return 1;
+
+    std::vector<LoadedTexture> textures;
+    size_t sourcePixels = 0;
+    for (const SourceTexture& source : sources)
+    {
+        LoadedTexture texture;
+        if (!loadTexture(source, texture))
+        {
+            std::cout << "Texture failed to load at path: " << source.path << "\n";
+            continue;
+        }
+        sourcePixels += (size_t)texture.width * texture.height;
+        textures.push_back(std::move(texture));
+    }
+    if (textures.empty()) return 1;
+
+    const unsigned int threadCount = hardwareThreads();
+    const int iterations = 3;
+
+    std::cout << "Mip generation, " << textures.size() << " textures, " << sourcePixels / 1e6 << " MP at level 0\n";
+    for (MipFilter filter : { MipFilter::Box, MipFilter::Kaiser })
+    {
+        // Best of a few runs, both on one core and with one texture per core.
+        double singleTime = 1e30, parallelTime = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            auto start = std::chrono::steady_clock::now();
+            parallelFor(textures.size(), 1, [&](size_t t)
+            {
+                std::vector<std::vector<unsigned char>> mips;
+                GenerateMipChain(textures[t].rgba.data(), textures[t].width, textures[t].height, getMipSettings(textures[t], filter), mips);
+            });
+            singleTime = std::min(singleTime, secondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            parallelFor(textures.size(), threadCount, [&](size_t t)
+            {
+                std::vector<std::vector<unsigned char>> mips;
+                GenerateMipChain(textures[t].rgba.data(), textures[t].width, textures[t].height, getMipSettings(textures[t], filter), mips);
+            });
+            parallelTime = std::min(parallelTime, secondsSince(start));
+        }
+
+        unsigned int usedThreads = (unsigned int)std::min<size_t>(threadCount, textures.size());
+        char line[256];
+        snprintf(line, sizeof(line), "%-6s  1 thread: %7.1f MP/s   %2u threads: %7.1f MP/s (%.1f MP/s per core)",
+            GetMipFilterName(filter), sourcePixels / singleTime / 1e6, usedThreads, sourcePixels / parallelTime / 1e6,
+            sourcePixels / parallelTime / 1e6 / usedThreads);
+        std::cout << line << "\n";
+    }
+    return 0;
+}
+
+int runImageDecodeBenchmark(const char* directory, const char* extension)
+{
+    std::vector<std::string> paths = listImages(directory, extension);
+    if (paths.empty()) return 1;
+
+    const int iterations = 10;
+    auto decode = [](const std::string& path, double& time, double& megapixels)
+    {
+        // Best of a few runs.
+        time = 1e30;
+        for (int i = 0; i < iterations; i++)
+        {
+            int width, height, components;
+            auto start = std::chrono::steady_clock::now();
+            unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 0);
+            time = std::min(time, secondsSince(start));
+            if (!data) return false;
+            megapixels = (double)width * height / 1e6;
+            stbi_image_free(data);
+        }
+        return true;
+    };
+
+    double totalStock = 0.0, totalAccelerated = 0.0, totalMegapixels = 0.0;
+    for (const std::string& path : paths)
+    {
+        double stockTime, acceleratedTime, megapixels = 0.0;
+        stbi_set_png_accelerated(0);
+        bool loaded = decode(path, stockTime, megapixels);
+        stbi_set_png_accelerated(1);
+        loaded = loaded && decode(path, acceleratedTime, megapixels);
+        if (!loaded)
+        {
+            std::cout << "Failed to decode " << path << ": " << stbi_failure_reason() << "\n";
+            continue;
+        }
+
+        char line[256];
+        snprintf(line, sizeof(line), "%-40s %6.2f MP  stock %7.2f ms (%6.1f MP/s)  accelerated %7.2f ms (%6.1f MP/s)  %.2fx",
+            path.c_str(), megapixels, stockTime * 1e3, megapixels / stockTime, acceleratedTime * 1e3, megapixels / acceleratedTime,
+            stockTime / acceleratedTime);
+        std::cout << line << "\n";
+        totalStock += stockTime;
+        totalAccelerated += acceleratedTime;
+        totalMegapixels += megapixels;
+    }
+    if (totalMegapixels == 0.0) return 1;
+
+    // Independent images can also be decoded side by side.
+    const unsigned int threadCount = hardwareThreads();
+    double parallelTime = 1e30;
+    for (int i = 0; i < iterations; i++)
+    {
+        auto start = std::chrono::steady_clock::now();
+        parallelFor(paths.size(), threadCount, [&](size_t index)
+        {
+            int width, height, components;
+            stbi_image_free(stbi_load(paths[index].c_str(), &width, &height, &components, 0));
+        });
+        parallelTime = std::min(parallelTime, secondsSince(start));
+    }
+
+    char line[256];
+    snprintf(line, sizeof(line), "Total: stock %.2f ms, accelerated %.2f ms (%.2fx, %.1f MP/s), accelerated on %u threads %.2f ms (%.1f MP/s)",
+        totalStock * 1e3, totalAccelerated * 1e3, totalStock / totalAccelerated, totalMegapixels / totalAccelerated,
+        (unsigned int)std::min<size_t>(threadCount, paths.size()), parallelTime * 1e3, totalMegapixels / parallelTime);
+    std::cout << line << "\n";
+    return 0;
+}
+
+int runJpegDecodeBenchmark(const char* directory)
+{
+    std::vector<std::string> paths = listImages(directory, ".jpg");
+    if (paths.empty()) return 1;
+
+    // Files are read up front so only decoding is timed. Both decoders produce the same pixels, the parallel one
+    // straight into a buffer that is allocated once, like a mapped pixel buffer would be.
+    const int iterations = 10;
+    const unsigned int threadCount = hardwareThreads();
+    double totalSerial = 0.0, totalParallel = 0.0, totalMegapixels = 0.0;
+    for (const std::string& path : paths)
+    {
+        std::ifstream file(path, std::ios::binary);
+        std::vector<unsigned char> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        int width, height, components;
+        if (!stbi_info_from_memory(data.data(), (int)data.size(), &width, &height, &components))
+        {
+            std::cout << "Failed to read " << path << ": " << stbi_failure_reason() << "\n";
+            continue;
+        }
+
+        std::vector<unsigned char> pixels((size_t)width * height * components);
+        double serialTime = 1e30, parallelTime = 1e30;
+        bool decoded = true, identical = true;
+        for (int i = 0; i < iterations && decoded; i++)
+        {
+            int x, y, n;
+            auto start = std::chrono::steady_clock::now();
+            unsigned char* serial = stbi_load_from_memory(data.data(), (int)data.size(), &x, &y, &n, 0);
+            serialTime = std::min(serialTime, secondsSince(start));
+
+            start = std::chrono::steady_clock::now();
+            decoded = serial && decodeJpegParallel(data.data(), (int)data.size(), pixels.data(), width * components, components);
+            parallelTime = std::min(parallelTime, secondsSince(start));
+            identical = identical && decoded && std::equal(pixels.begin(), pixels.end(), serial);
+            stbi_image_free(serial);
+        }
+        if (!decoded)
+        {
+            std::cout << "Failed to decode " << path << ": " << stbi_failure_reason() << "\n";
+            continue;
+        }
+
+        double megapixels = (double)width * height / 1e6;
+        char line[256];
+        snprintf(line, sizeof(line), "%-40s %6.2f MP  1 thread %7.2f ms (%6.1f MP/s)  %2u threads %7.2f ms (%6.1f MP/s)  %.2fx%s",
+            path.c_str(), megapixels, serialTime * 1e3, megapixels / serialTime, threadCount, parallelTime * 1e3,
+            megapixels / parallelTime, serialTime / parallelTime, identical ? "" : "  MISMATCH");
+        std::cout << line << "\n";
+        totalSerial += serialTime;
+        totalParallel += parallelTime;
+        totalMegapixels += megapixels;
+    }
+    if (totalMegapixels == 0.0) return 1;
+
+    char line[256];
+    snprintf(line, sizeof(line), "Total: 1 thread %.2f ms (%.1f MP/s), %u threads %.2f ms (%.1f MP/s), %.2fx",
+        totalSerial * 1e3, totalMegapixels / totalSerial, threadCount, totalParallel * 1e3, totalMegapixels / totalParallel,
+        totalSerial / totalParallel);
+    std::cout << line << "\n";
+    return 0;
+}
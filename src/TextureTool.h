@@ -0,0 +1,18 @@
+﻿#pragma once
+
+#include "MipGenerator.h"
+
+// Offline texture compression: finds every material texture of a model, generates its mip chain, compresses every
+// level to the block format that suits the texture type and writes it next to the source image as <image>.ktx2, where
+// loadTexture() picks it up instead of the original. Textures are processed in parallel, one per core. Prints VRAM
+// savings and mip generation/encode/decode throughput. Doesn't need a GL context.
+int runTextureCompression(const char* modelPath, MipFilter mipFilter);
+// Measure mip chain generation throughput for a model's textures with each filter, both on a single core and spread
+// over all of them.
+int runMipBenchmark(const char* modelPath);
+// Measure how fast every image with the given extension in a directory decodes: each image with the stock and the
+// accelerated decoder, then all of them one after another and in parallel.
+int runImageDecodeBenchmark(const char* directory, const char* extension);
+// Compare decoding every JPEG in a directory on one thread with stbi_load against the parallel decoder on all of them,
+// and check that both give the same pixels.
+int runJpegDecodeBenchmark(const char* directory);
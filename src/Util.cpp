@@ -1,53 +1,323 @@
 ﻿#define STB_IMAGE_IMPLEMENTATION
 
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <string>
 #include <glad/glad.h>
 #include "stb_image.h"
+#include "AssetPack.h"
+#include "GpuResources.h"
+#include "JobSystem.h"
+#include "Profiler.h"
+#include "TextureFile.h"
 #include "Util.h"
 
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const * path)
+namespace
+{
+    // JPEGs smaller than this aren't worth splitting over threads.
+    constexpr int parallelJpegPixels = 1024 * 1024;
+    // Color channels this close are considered the same, JPEG chroma noise keeps gray images from matching exactly.
+    constexpr int grayscaleTolerance = 2;
+
+    // stb_image's parallel JPEG decoder leaves threading to us: run task for every index on the job system, one index
+    // per job since it calls this for every batch of rows. Inside a job it only adds work for idle workers to steal.
+    void stbiParallelFor(void*, void (*task)(void* taskData, int index), void* taskData, int count)
+    {
+        JobSystem::Get().ParallelFor(count, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++) task(taskData, (int)i);
+        }, 1);
+    }
+
+    // Store an opaque RGB(A) image whose channels are all the same as just one channel, in place.
+    void collapseGrayscale(ImageData& image)
+    {
+        if (image.components != 3 && image.components != 4) return;
+
+        const size_t pixelCount = (size_t)image.width * image.height;
+        const int components = image.components;
+        unsigned char* pixels = image.pixels.get();
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            const unsigned char* pixel = pixels + i * components;
+            if (std::abs(pixel[0] - pixel[1]) > grayscaleTolerance || std::abs(pixel[1] - pixel[2]) > grayscaleTolerance) return;
+            if (components == 4 && pixel[3] != 255) return;
+        }
+
+        // Every pixel only grows the image, so writing the channel forwards never overwrites one still to be read.
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            const unsigned char* pixel = pixels + i * components;
+            pixels[i] = (unsigned char)((pixel[0] + pixel[1] + pixel[2] + 1) / 3);
+        }
+        image.components = 1;
+        image.grayscale = true;
+    }
+
+    bool readFile(const char* path, std::vector<unsigned char>& data)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file) return false;
+        data.resize((size_t)file.tellg());
+        file.seekg(0);
+        return (bool)file.read((char*)data.data(), data.size());
+    }
+
+    uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0)
+    {
+        static uint32_t table[256];
+        static bool tableReady = false;
+        if (!tableReady)
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int bit = 0; bit < 8; bit++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                table[i] = c;
+            }
+            tableReady = true;
+        }
+
+        crc = ~crc;
+        for (size_t i = 0; i < size; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+        return ~crc;
+    }
+
+    void appendBigEndian(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (int shift = 24; shift >= 0; shift -= 8) out.push_back((unsigned char)(value >> shift));
+    }
+
+    void appendChunk(std::vector<unsigned char>& out, const char type[4], const std::vector<unsigned char>& data)
+    {
+        appendBigEndian(out, (uint32_t)data.size());
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+        appendBigEndian(out, crc32(out.data() + start, out.size() - start));
+    }
+}
+
+bool readImage(char const* path, ImageData& image, bool parallelDecode)
 {
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    // Load image data for texture.
-    int width, height, nrComponents;
-    unsigned char *data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        // Bind data to current texture object and generate mipmaps (lower resolution textures).
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        // Texture wrapping will repeat texture and texture filtering uses mipmaps and linear filtering.
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        // Texture bound, now free image memory.
-        stbi_image_free(data);
+    ProfileScope scope("Read image");
+    Profiler::Get().Mark("Image load", path);
+
+    // Prefer a block compressed version of the image, either written by --compress-textures or a DDS authored next to
+    // it. DDS files are expected to already be stored bottom row first, like the flipped images stb_image gives us.
+    std::string imagePath = path;
+    std::string stem = imagePath.substr(0, imagePath.find_last_of('.'));
+    if (ReadKTX2(imagePath + ".ktx2", image.compressedImage) || ReadDDS(stem + ".dds", image.compressedImage))
+    {
+        image.compressed = true;
+        image.width = image.compressedImage.width;
+        image.height = image.compressedImage.height;
+        return true;
+    }
+
+    image.compressed = false;
+    image.grayscale = false;
+    // Images in the mounted asset pack are decoded straight from its mapping.
+    AssetView file;
+    std::vector<unsigned char> data;
+    if (!FindMountedAsset(imagePath, file))
+    {
+        if (!readFile(path, data)) return false;
+        file.data = data.data();
+        file.size = data.size();
+    }
+
+    // stbi_load reports 3 or 1 components for a JPEG, so the parallel decoder produces the same image.
+    bool jpeg = file.size > 2 && file.data[0] == 0xFF && file.data[1] == 0xD8;
+    if (parallelDecode && jpeg &&
+        stbi_info_from_memory(file.data, (int)file.size, &image.width, &image.height, &image.components) &&
+        image.width * image.height >= parallelJpegPixels)
+    {
+        image.pixels = std::unique_ptr<unsigned char, void (*)(void*)>(
+            (unsigned char*)malloc((size_t)image.width * image.height * image.components), stbi_image_free);
+        if (!image.pixels || !decodeJpegParallel(file.data, (int)file.size, image.pixels.get(),
+            image.width * image.components, image.components)) return false;
     }
     else
     {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
+        image.pixels = std::unique_ptr<unsigned char, void (*)(void*)>(
+            stbi_load_from_memory(file.data, (int)file.size, &image.width, &image.height, &image.components, 0),
+            stbi_image_free);
+        if (!image.pixels) return false;
     }
 
+    collapseGrayscale(image);
+    return true;
+}
+
+bool decodeJpegParallel(const unsigned char* data, int size, unsigned char* out, int outStride, int components)
+{
+    return stbi_jpeg_decode_parallel_from_memory(data, size, out, outStride, components, stbiParallelFor, nullptr) != 0;
+}
+
+void readImagesParallel(const std::vector<std::string>& paths, std::vector<ImageData>& images, std::vector<char>& succeeded)
+{
+    images.resize(paths.size());
+    succeeded.assign(paths.size(), 0);
+
+    // Images differ a lot in size, so hand them out one at a time. Workers that run out of images steal the row
+    // batches of large JPEGs still being decoded.
+    JobSystem::Get().ParallelFor(paths.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++) succeeded[i] = readImage(paths[i].c_str(), images[i], true);
+    }, 1);
+}
+
+ImageData packChannels(const std::vector<const ImageData*>& channels, const unsigned char fill[4])
+{
+    ImageData packed;
+    for (const ImageData* channel : channels)
+    {
+        if (!channel) continue;
+        packed.width = channel->width;
+        packed.height = channel->height;
+    }
+    packed.components = 4;
+
+    const size_t pixelCount = (size_t)packed.width * packed.height;
+    packed.pixels = std::unique_ptr<unsigned char, void (*)(void*)>((unsigned char*)malloc(pixelCount * 4), free);
+    if (!packed.pixels) return ImageData();
+    unsigned char* pixels = packed.pixels.get();
+    for (int c = 0; c < 4; c++)
+    {
+        const ImageData* channel = c < (int)channels.size() ? channels[c] : nullptr;
+        const unsigned char* source = channel ? channel->pixels.get() : nullptr;
+        for (size_t i = 0; i < pixelCount; i++)
+        {
+            pixels[i * 4 + c] = source ? source[i] : fill[c];
+        }
+    }
+    return packed;
+}
+
+unsigned int uploadImage(const ImageData& image, unsigned int textureID)
+{
+    if (image.compressed)
+    {
+        return UploadCompressedTexture(image.compressedImage, textureID);
+    }
+
+    if (textureID == 0) glGenTextures(1, &textureID);
+
+    GLenum format, internalFormat;
+    if (image.components == 1)
+        format = GL_RED, internalFormat = GL_R8;
+    else if (image.components == 2)
+        format = GL_RG, internalFormat = GL_RG8;
+    else if (image.components == 3)
+        format = internalFormat = GL_RGB;
+    else if (image.components == 4)
+        format = internalFormat = GL_RGBA;
+
+    // Bind data to current texture object and generate mipmaps (lower resolution textures). Rows of single channel and
+    // RGB images aren't necessarily 4 byte aligned.
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels.get());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    // Grayscale images only store one of their equal channels, spread it back out when sampling. Two channel images are
+    // gray and alpha. Set either way, since the texture may be reloaded with a different image.
+    const GLint grayscaleSwizzle[4] = { GL_RED, GL_RED, GL_RED, GL_ONE };
+    const GLint grayAlphaSwizzle[4] = { GL_RED, GL_RED, GL_RED, GL_GREEN };
+    const GLint identitySwizzle[4] = { GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA };
+    glTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_SWIZZLE_RGBA,
+        image.components == 2 ? grayAlphaSwizzle : image.grayscale ? grayscaleSwizzle : identitySwizzle);
+
+    // Texture wrapping will repeat texture and texture filtering uses mipmaps and linear filtering.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    // Drivers pad RGB texels to four bytes.
+    const int bytesPerTexel = image.components == 3 ? 4 : image.components;
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, textureID, GpuResourceTracker::GetMipChainBytes(image.width, image.height, bytesPerTexel), "Texture");
     return textureID;
 }
 
+// utility function for loading a 2D texture from file
+// ---------------------------------------------------
+unsigned int loadTexture(char const * path, unsigned int textureID)
+{
+    ImageData image;
+    if (readImage(path, image, true))
+    {
+        return uploadImage(image, textureID);
+    }
+
+    std::cout << "Texture failed to load at path: " << path << std::endl;
+    if (textureID == 0) glGenTextures(1, &textureID);
+    TRACK_GPU_RESOURCE(GpuResourceType::Texture, textureID, 0, path);
+    return textureID;
+}
+
+bool writePNG(const char* path, const unsigned char* pixels, int width, int height, int components)
+{
+    static const unsigned char colorTypes[] = { 0, 0, 4, 2, 6 };
+    if (components < 1 || components > 4) return false;
+
+    // Every row starts with its filter type, none here.
+    const size_t rowBytes = (size_t)width * components;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = 0; y < height; y++)
+    {
+        raw.push_back(0);
+        raw.insert(raw.end(), pixels + y * rowBytes, pixels + (y + 1) * rowBytes);
+    }
+
+    // A zlib stream of stored deflate blocks. It's as big as the pixels, but needs no compressor and writes instantly.
+    std::vector<unsigned char> compressed = { 0x78, 0x01 };
+    const size_t maxBlock = 65535;
+    size_t offset = 0;
+    do
+    {
+        const size_t size = std::min(maxBlock, raw.size() - offset);
+        compressed.push_back(offset + size == raw.size() ? 1 : 0);
+        compressed.push_back((unsigned char)(size & 0xFF));
+        compressed.push_back((unsigned char)(size >> 8));
+        compressed.push_back((unsigned char)(~size & 0xFF));
+        compressed.push_back((unsigned char)((~size >> 8) & 0xFF));
+        compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + size);
+        offset += size;
+    } while (offset < raw.size());
+    uint32_t a = 1, b = 0;
+    for (unsigned char value : raw)
+    {
+        a = (a + value) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(compressed, (b << 16) | a);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, (uint32_t)width);
+    appendBigEndian(header, (uint32_t)height);
+    header.push_back(8);
+    header.push_back(colorTypes[components]);
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+
+    std::vector<unsigned char> png = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    appendChunk(png, "IHDR", header);
+    appendChunk(png, "IDAT", compressed);
+    appendChunk(png, "IEND", {});
+
+    std::ofstream file(path, std::ios::binary);
+    return file && file.write((const char*)png.data(), png.size());
+}
+
 void VertexAttribBuilder::AddAttribute(const int size, const int type)
 {
     if (nextIndex >= maxVertexAttribs) return;
@@ -1,6 +1,46 @@
 ﻿#pragma once
 
-unsigned int loadTexture(char const* path);
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "TextureFile.h"
+
+// An image read from disk, either block compressed or decoded to 8 bits per channel.
+struct ImageData
+{
+    bool compressed = false;
+    CompressedImage compressedImage;
+    int width = 0;
+    int height = 0;
+    int components = 0;
+    // Set when an RGB image was stored as its single channel because all three were the same. It's uploaded as GL_R8
+    // and sampled as (r, r, r, 1), so shaders still see the original colors.
+    bool grayscale = false;
+    std::unique_ptr<unsigned char, void (*)(void*)> pixels{ nullptr, nullptr };
+};
+
+// Read and decode an image file, preferring a block compressed version of it. Large JPEGs are decoded on the job system
+// if parallelDecode is set. Doesn't touch OpenGL, so it can run on any thread.
+bool readImage(char const* path, ImageData& image, bool parallelDecode = false);
+// Decode a JPEG held in memory straight into out, which holds the image's rows outStride bytes apart with components
+// (1 to 4) bytes per pixel. out can be a mapped buffer, nothing else is allocated for the pixels. The work is spread
+// over the job system.
+bool decodeJpegParallel(const unsigned char* data, int size, unsigned char* out, int outStride, int components);
+// Read independent images at the same time on the job system. Workers left over when there are fewer images than
+// threads help decode large JPEGs.
+void readImagesParallel(const std::vector<std::string>& paths, std::vector<ImageData>& images, std::vector<char>& succeeded);
+// Pack single channel images of one size into the channels of an RGBA image, in order. Channels without an image, or
+// beyond the given ones, are set to their entry in fill. Returns an image without pixels if there's no memory for it.
+ImageData packChannels(const std::vector<const ImageData*>& channels, const unsigned char fill[4]);
+// Upload an image from readImage. Loads into textureID instead of a new texture object if it isn't 0.
+unsigned int uploadImage(const ImageData& image, unsigned int textureID = 0);
+// Load a texture from an image file, decoding large JPEGs on the job system. Loads into textureID instead of a new
+// texture object if it isn't 0.
+unsigned int loadTexture(char const* path, unsigned int textureID = 0);
+// Write 8 bit pixels with components (1 to 4) channels per pixel to a PNG, top row first. The image data is stored
+// uncompressed, this is for screenshots and tests rather than assets.
+bool writePNG(const char* path, const unsigned char* pixels, int width, int height, int components);
 
 struct VertexAttribPointer
 {
@@ -517,6 +517,21 @@ STBIDEF void stbi_convert_iphone_png_to_rgb(int flag_true_if_should_convert);
 // flip the image vertically, so the first pixel in the output array is the bottom left
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip);
 
+// local modification: use the SSE2 PNG unfilter kernels and the faster inflate
+// paths (on by default). turning it off gives the stock decoder for comparison.
+STBIDEF void stbi_set_png_accelerated(int flag_true_if_should_accelerate);
+
+// local modification: parallel JPEG decoding. stb_image doesn't create threads itself; the
+// caller's parallel_for must run task(task_data, i) for every i in [0, count), on as many
+// threads as it likes, and return once all of them have finished.
+typedef void stbi_parallel_for(void *user, void (*task)(void *task_data, int index), void *task_data, int count);
+
+// decode a JPEG into the caller's buffer: img_y rows (see stbi_info_from_memory), out_stride
+// bytes apart, of req_comp (1..4) channels. honors stbi_set_flip_vertically_on_load.
+// returns 0 on failure, with stbi_failure_reason set.
+STBIDEF int stbi_jpeg_decode_parallel_from_memory(stbi_uc const *buffer, int len, stbi_uc *out, int out_stride, int req_comp,
+                                                  stbi_parallel_for *parallel_for, void *user);
+
 // as above, but only applies to images loaded on the thread that calls the function
 // this function is only available if your compiler supports thread-local variables;
 // calling it will fail to link if your compiler doesn't
@@ -750,7 +765,7 @@ static int stbi__cpuid3(void)
 
 #define STBI_SIMD_ALIGN(type, name) __declspec(align(16)) type name
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    int info3 = stbi__cpuid3();
@@ -761,7 +776,7 @@ static int stbi__sse2_available(void)
 #else // assume GCC-style if not VC++
 #define STBI_SIMD_ALIGN(type, name) type name __attribute__((aligned(16)))
 
-#if !defined(STBI_NO_JPEG) && defined(STBI_SSE2)
+#if (!defined(STBI_NO_JPEG) || !defined(STBI_NO_PNG)) && defined(STBI_SSE2)
 static int stbi__sse2_available(void)
 {
    // If we're even attempting to compile this on GCC/Clang, that means
@@ -1112,6 +1127,12 @@ static stbi_uc *stbi__hdr_to_ldr(float   *data, int x, int y, int comp);
 #endif
 
 static int stbi__vertically_flip_on_load_global = 0;
+static int stbi__png_accelerated = 1;
+
+STBIDEF void stbi_set_png_accelerated(int flag_true_if_should_accelerate)
+{
+   stbi__png_accelerated = flag_true_if_should_accelerate;
+}
 
 STBIDEF void stbi_set_flip_vertically_on_load(int flag_true_if_should_flip)
 {
@@ -3862,6 +3883,100 @@ static stbi_uc stbi__blinn_8x8(stbi_uc x, stbi_uc y)
    return (stbi_uc) ((t + (t >>8)) >> 8);
 }
 
+// local modification: color convert one resampled row; shared by load_jpeg_image and the
+// parallel decoder
+static void stbi__jpeg_convert_row(stbi__jpeg *z, stbi_uc *out, stbi_uc *coutput[4], int n, int is_rgb)
+{
+   unsigned int i;
+   if (n >= 3) {
+      stbi_uc *y = coutput[0];
+      if (z->s->img_n == 3) {
+         if (is_rgb) {
+            for (i=0; i < z->s->img_x; ++i) {
+               out[0] = y[i];
+               out[1] = coutput[1][i];
+               out[2] = coutput[2][i];
+               out[3] = 255;
+               out += n;
+            }
+         } else {
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+         }
+      } else if (z->s->img_n == 4) {
+         if (z->app14_color_transform == 0) { // CMYK
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(coutput[0][i], m);
+               out[1] = stbi__blinn_8x8(coutput[1][i], m);
+               out[2] = stbi__blinn_8x8(coutput[2][i], m);
+               out[3] = 255;
+               out += n;
+            }
+         } else if (z->app14_color_transform == 2) { // YCCK
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+            for (i=0; i < z->s->img_x; ++i) {
+               stbi_uc m = coutput[3][i];
+               out[0] = stbi__blinn_8x8(255 - out[0], m);
+               out[1] = stbi__blinn_8x8(255 - out[1], m);
+               out[2] = stbi__blinn_8x8(255 - out[2], m);
+               out += n;
+            }
+         } else { // YCbCr + alpha?  Ignore the fourth channel for now
+            z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
+         }
+      } else
+         for (i=0; i < z->s->img_x; ++i) {
+            out[0] = out[1] = out[2] = y[i];
+            out[3] = 255; // not used if n==3
+            out += n;
+         }
+   } else {
+      if (is_rgb) {
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i)
+               *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+         else {
+            for (i=0; i < z->s->img_x; ++i, out += 2) {
+               out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
+               out[1] = 255;
+            }
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
+         for (i=0; i < z->s->img_x; ++i) {
+            stbi_uc m = coutput[3][i];
+            stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
+            stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
+            stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
+            out[0] = stbi__compute_y(r, g, b);
+            out[1] = 255;
+            out += n;
+         }
+      } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
+         for (i=0; i < z->s->img_x; ++i) {
+            out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
+            out[1] = 255;
+            out += n;
+         }
+      } else {
+         stbi_uc *y = coutput[0];
+         if (n == 1)
+            for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
+         else
+            for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
+      }
+   }
+}
+
+// local modification: pick the upsampler for a component's expansion factors
+static resample_row_func stbi__jpeg_resampler(stbi__jpeg *z, int hs, int vs)
+{
+   if      (hs == 1 && vs == 1) return resample_row_1;
+   else if (hs == 1 && vs == 2) return stbi__resample_row_v_2;
+   else if (hs == 2 && vs == 1) return stbi__resample_row_h_2;
+   else if (hs == 2 && vs == 2) return z->resample_row_hv_2_kernel;
+   else                         return stbi__resample_row_generic;
+}
+
 static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
    int n, decode_n, is_rgb;
@@ -3890,7 +4005,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    // resample and color-convert
    {
       int k;
-      unsigned int i,j;
+      unsigned int j;
       stbi_uc *output;
       stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
 
@@ -3911,11 +4026,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
          r->ypos    = 0;
          r->line0   = r->line1 = z->img_comp[k].data;
 
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = stbi__resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = stbi__resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = z->resample_row_hv_2_kernel;
-         else                               r->resample = stbi__resample_row_generic;
+         r->resample = stbi__jpeg_resampler(z, r->hs, r->vs);
       }
 
       // can't error after this so, this is safe
@@ -3939,83 +4050,7 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
                   r->line1 += z->img_comp[k].w2;
             }
          }
-         if (n >= 3) {
-            stbi_uc *y = coutput[0];
-            if (z->s->img_n == 3) {
-               if (is_rgb) {
-                  for (i=0; i < z->s->img_x; ++i) {
-                     out[0] = y[i];
-                     out[1] = coutput[1][i];
-                     out[2] = coutput[2][i];
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else {
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else if (z->s->img_n == 4) {
-               if (z->app14_color_transform == 0) { // CMYK
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(coutput[0][i], m);
-                     out[1] = stbi__blinn_8x8(coutput[1][i], m);
-                     out[2] = stbi__blinn_8x8(coutput[2][i], m);
-                     out[3] = 255;
-                     out += n;
-                  }
-               } else if (z->app14_color_transform == 2) { // YCCK
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-                  for (i=0; i < z->s->img_x; ++i) {
-                     stbi_uc m = coutput[3][i];
-                     out[0] = stbi__blinn_8x8(255 - out[0], m);
-                     out[1] = stbi__blinn_8x8(255 - out[1], m);
-                     out[2] = stbi__blinn_8x8(255 - out[2], m);
-                     out += n;
-                  }
-               } else { // YCbCr + alpha?  Ignore the fourth channel for now
-                  z->YCbCr_to_RGB_kernel(out, y, coutput[1], coutput[2], z->s->img_x, n);
-               }
-            } else
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            if (is_rgb) {
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i)
-                     *out++ = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-               else {
-                  for (i=0; i < z->s->img_x; ++i, out += 2) {
-                     out[0] = stbi__compute_y(coutput[0][i], coutput[1][i], coutput[2][i]);
-                     out[1] = 255;
-                  }
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 0) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  stbi_uc m = coutput[3][i];
-                  stbi_uc r = stbi__blinn_8x8(coutput[0][i], m);
-                  stbi_uc g = stbi__blinn_8x8(coutput[1][i], m);
-                  stbi_uc b = stbi__blinn_8x8(coutput[2][i], m);
-                  out[0] = stbi__compute_y(r, g, b);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else if (z->s->img_n == 4 && z->app14_color_transform == 2) {
-               for (i=0; i < z->s->img_x; ++i) {
-                  out[0] = stbi__blinn_8x8(255 - coutput[0][i], coutput[3][i]);
-                  out[1] = 255;
-                  out += n;
-               }
-            } else {
-               stbi_uc *y = coutput[0];
-               if (n == 1)
-                  for (i=0; i < z->s->img_x; ++i) out[i] = y[i];
-               else
-                  for (i=0; i < z->s->img_x; ++i) { *out++ = y[i]; *out++ = 255; }
-            }
-         }
+         stbi__jpeg_convert_row(z, out, coutput, n, is_rgb);
       }
       stbi__cleanup_jpeg(z);
       *out_x = z->s->img_x;
@@ -4025,6 +4060,386 @@ static stbi_uc *load_jpeg_image(stbi__jpeg *z, int *out_x, int *out_y, int *comp
    }
 }
 
+// local modification: parallel decoding into a caller-provided buffer. stb_image never creates
+// threads; the caller's parallel_for runs the tasks however it likes.
+//
+// baseline scans with restart markers are split at the markers and every run of segments is
+// entropy decoded (and IDCTed) by its own task with a private copy of the decoder state.
+// scans without them are entropy decoded serially a batch of MCU rows at a time, while the
+// other tasks IDCT the previous batch. progressive images decode their scans serially and
+// only the final IDCT is split. upsampling and color conversion then run over bands of
+// output rows.
+
+#define STBI__JPEG_BATCH_ROWS    8   // MCU rows per entropy decode batch
+#define STBI__JPEG_MAX_TASKS   256   // upper bound on restart segment tasks
+#define STBI__JPEG_BAND_ROWS    32   // output rows per color conversion task
+
+typedef struct
+{
+   stbi__jpeg *z;
+   int ok;
+   int units_x, units_y;            // MCUs (or blocks, for single component scans) in the scan
+
+   // restart marker split
+   stbi_uc **segments;
+   int segment_count, segments_per_task;
+   stbi_uc *scan_end;
+
+   // batched entropy decode; coeff[b & 1] holds batch b
+   short *coeff[2][4];
+   int decode_batch, idct_batch;
+
+   // progressive finish, STBI__JPEG_BATCH_ROWS block rows per task
+   int finish_tasks[4];
+
+   // color conversion
+   stbi_uc *out;
+   int out_stride, n, decode_n, is_rgb, flip;
+} stbi__jpeg_parallel;
+
+static int stbi__jpeg_unit_blocks(stbi__jpeg *z, int n, int *hb, int *vb)
+{
+   *hb = z->scan_n == 1 ? 1 : z->img_comp[n].h;
+   *vb = z->scan_n == 1 ? 1 : z->img_comp[n].v;
+   return z->img_comp[n].w2 >> 3;
+}
+
+// decode one MCU of a baseline scan. without coeff the blocks are IDCTed right away, otherwise
+// the dequantized coefficients are stored in coeff[n], whose first block row is MCU row row0
+static int stbi__jpeg_decode_unit(stbi__jpeg *z, int i, int j, short **coeff, int row0)
+{
+   STBI_SIMD_ALIGN(short, data[64]);
+   int k,x,y,hb,vb;
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int ha = z->img_comp[n].ha;
+      int blocks_w = stbi__jpeg_unit_blocks(z, n, &hb, &vb);
+      for (y=0; y < vb; ++y) {
+         for (x=0; x < hb; ++x) {
+            int bx = i*hb + x, by = j*vb + y;
+            if (!stbi__jpeg_decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+ha, z->fast_ac[ha], n, z->dequant[z->img_comp[n].tq])) return 0;
+            if (coeff)
+               memcpy(coeff[n] + 64 * (bx + (by - row0*vb) * blocks_w), data, sizeof(data));
+            else
+               z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*by*8+bx*8, z->img_comp[n].w2, data);
+         }
+      }
+   }
+   return 1;
+}
+
+// decode MCUs [first, first+count) with the same restart handling as stbi__parse_entropy_coded_data
+static int stbi__jpeg_decode_units(stbi__jpeg *z, int first, int count, int units_x, short **coeff, int row0)
+{
+   int u;
+   for (u=first; u < first + count; ++u) {
+      if (!stbi__jpeg_decode_unit(z, u % units_x, u / units_x, coeff, row0)) return 0;
+      if (--z->todo <= 0 && u + 1 < first + count) {
+         if (z->code_bits < 24) stbi__grow_buffer_unsafe(z);
+         if (!STBI__RESTART(z->marker)) return 1;
+         stbi__jpeg_reset(z);
+      }
+   }
+   return 1;
+}
+
+static void stbi__jpeg_restart_task(void *data, int index)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) data;
+   int first = index * p->segments_per_task;
+   int last = first + p->segments_per_task;
+   int total = p->units_x * p->units_y, end_unit;
+   stbi__context s;
+   stbi__jpeg *z;
+   if (first >= p->segment_count) return;
+   if (last > p->segment_count) last = p->segment_count;
+   z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) { p->ok = 0; return; }
+   memcpy(z, p->z, sizeof(stbi__jpeg));
+   stbi__start_mem(&s, p->segments[first], (int) (p->scan_end - p->segments[first]));
+   z->s = &s;
+   stbi__jpeg_reset(z);
+   end_unit = last * z->restart_interval;
+   if (end_unit > total) end_unit = total;
+   if (!stbi__jpeg_decode_units(z, first * z->restart_interval, end_unit - first * z->restart_interval, p->units_x, NULL, 0))
+      p->ok = 0;
+   STBI_FREE(z);
+}
+
+static void stbi__jpeg_idct_row(stbi__jpeg *z, int j, short **coeff, int row0, int units_x)
+{
+   int k,x,y,hb,vb;
+   for (k=0; k < z->scan_n; ++k) {
+      int n = z->order[k];
+      int blocks_w = stbi__jpeg_unit_blocks(z, n, &hb, &vb);
+      for (y=0; y < vb; ++y) {
+         int by = j*vb + y;
+         for (x=0; x < units_x * hb; ++x)
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*by*8+x*8, z->img_comp[n].w2,
+                                 coeff[n] + 64 * (x + (by - row0*vb) * blocks_w));
+      }
+   }
+}
+
+// task 0 entropy decodes the next batch, the rest IDCT one MCU row each of the current batch
+static void stbi__jpeg_batch_task(void *data, int index)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) data;
+   if (index == 0) {
+      if (p->decode_batch >= 0) {
+         int row0 = p->decode_batch * STBI__JPEG_BATCH_ROWS;
+         int rows = p->units_y - row0 < STBI__JPEG_BATCH_ROWS ? p->units_y - row0 : STBI__JPEG_BATCH_ROWS;
+         if (!stbi__jpeg_decode_units(p->z, row0 * p->units_x, rows * p->units_x, p->units_x, p->coeff[p->decode_batch & 1], row0))
+            p->ok = 0;
+      }
+   } else if (p->idct_batch >= 0) {
+      int row0 = p->idct_batch * STBI__JPEG_BATCH_ROWS;
+      int j = row0 + index - 1;
+      if (j < p->units_y)
+         stbi__jpeg_idct_row(p->z, j, p->coeff[p->idct_batch & 1], row0, p->units_x);
+   }
+}
+
+static int stbi__jpeg_parallel_restart_scan(stbi__jpeg_parallel *p, stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__jpeg *z = p->z;
+   stbi_uc *q, *start = z->s->img_buffer, *end = z->s->img_buffer_end;
+   int expected = (p->units_x * p->units_y + z->restart_interval - 1) / z->restart_interval;
+   int tasks;
+
+   // find where every restart interval starts; stuffed zeros and fill bytes aren't markers
+   p->segments = (stbi_uc **) stbi__malloc_mad2(expected, sizeof(stbi_uc *), 0);
+   if (!p->segments) return stbi__err("outofmem", "Out of memory");
+   p->segment_count = 0;
+   p->segments[p->segment_count++] = start;
+   p->scan_end = end;
+   for (q=start; q + 1 < end; ++q) {
+      if (q[0] != 0xff || q[1] == 0x00 || q[1] == 0xff) continue;
+      if (!STBI__RESTART(q[1])) { p->scan_end = q; break; }
+      if (p->segment_count == expected) { p->segment_count = 0; break; }
+      p->segments[p->segment_count++] = q + 2;
+      ++q;
+   }
+   if (p->segment_count != expected) {
+      // the markers don't add up, let the serial decoder make what it can of the scan
+      STBI_FREE(p->segments);
+      return stbi__parse_entropy_coded_data(z);
+   }
+
+   p->segments_per_task = (expected + STBI__JPEG_MAX_TASKS - 1) / STBI__JPEG_MAX_TASKS;
+   tasks = (expected + p->segments_per_task - 1) / p->segments_per_task;
+   p->ok = 1;
+   parallel_for(user, stbi__jpeg_restart_task, p, tasks);
+   STBI_FREE(p->segments);
+   if (!p->ok) return 0;
+
+   // resume marker parsing after the scan, as if the serial decoder had read it
+   z->s->img_buffer = p->scan_end;
+   z->marker = STBI__MARKER_none;
+   return 1;
+}
+
+static int stbi__jpeg_parallel_scan(stbi__jpeg_parallel *p, stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__jpeg *z = p->z;
+   int k,b,batches,hb,vb;
+   void *raw[2][4] = { { NULL } };
+
+   if (z->scan_n == 1) {
+      int n = z->order[0];
+      p->units_x = (z->img_comp[n].x+7) >> 3;
+      p->units_y = (z->img_comp[n].y+7) >> 3;
+   } else {
+      p->units_x = z->img_mcu_x;
+      p->units_y = z->img_mcu_y;
+   }
+   if (z->restart_interval > 0)
+      return stbi__jpeg_parallel_restart_scan(p, parallel_for, user);
+
+   for (b=0; b < 2; ++b) {
+      for (k=0; k < z->scan_n; ++k) {
+         int n = z->order[k];
+         int blocks_w = stbi__jpeg_unit_blocks(z, n, &hb, &vb);
+         raw[b][n] = stbi__malloc_mad3(blocks_w * 64, vb * STBI__JPEG_BATCH_ROWS, sizeof(short), 15);
+         if (!raw[b][n]) break;
+         p->coeff[b][n] = (short *) (((size_t) raw[b][n] + 15) & ~15);
+      }
+      if (k < z->scan_n) break;
+   }
+
+   p->ok = b == 2 ? 1 : stbi__err("outofmem", "Out of memory");
+   if (p->ok) {
+      stbi__jpeg_reset(z);
+      batches = (p->units_y + STBI__JPEG_BATCH_ROWS - 1) / STBI__JPEG_BATCH_ROWS;
+      p->decode_batch = 0;
+      p->idct_batch = -1;
+      stbi__jpeg_batch_task(p, 0);
+      for (b=0; b < batches && p->ok; ++b) {
+         p->decode_batch = b + 1 < batches ? b + 1 : -1;
+         p->idct_batch = b;
+         parallel_for(user, stbi__jpeg_batch_task, p, 1 + STBI__JPEG_BATCH_ROWS);
+      }
+   }
+
+   for (b=0; b < 2; ++b)
+      for (k=0; k < 4; ++k)
+         if (raw[b][k]) STBI_FREE(raw[b][k]);
+   return p->ok;
+}
+
+static void stbi__jpeg_finish_task(void *data, int index)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) data;
+   stbi__jpeg *z = p->z;
+   int i,j,n;
+   for (n=0; n < z->s->img_n && index >= p->finish_tasks[n]; ++n)
+      index -= p->finish_tasks[n];
+   if (n == z->s->img_n) return;
+   {
+      int w = (z->img_comp[n].x+7) >> 3;
+      int h = (z->img_comp[n].y+7) >> 3;
+      int j_end = (index + 1) * STBI__JPEG_BATCH_ROWS < h ? (index + 1) * STBI__JPEG_BATCH_ROWS : h;
+      for (j=index * STBI__JPEG_BATCH_ROWS; j < j_end; ++j) {
+         for (i=0; i < w; ++i) {
+            short *coeff = z->img_comp[n].coeff + 64 * (i + j * z->img_comp[n].coeff_w);
+            stbi__jpeg_dequantize(coeff, z->dequant[z->img_comp[n].tq]);
+            z->idct_block_kernel(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, coeff);
+         }
+      }
+   }
+}
+
+// same output as the row loop in load_jpeg_image, but the resampler state for a row is derived
+// from its index so every band can start anywhere
+static void stbi__jpeg_convert_task(void *data, int index)
+{
+   stbi__jpeg_parallel *p = (stbi__jpeg_parallel *) data;
+   stbi__jpeg *z = p->z;
+   stbi_uc *coutput[4] = { NULL, NULL, NULL, NULL };
+   stbi_uc *linebuf, *scratch;
+   int k, j, y0 = index * STBI__JPEG_BAND_ROWS;
+   int y1 = y0 + STBI__JPEG_BAND_ROWS < (int) z->s->img_y ? y0 + STBI__JPEG_BAND_ROWS : (int) z->s->img_y;
+   int row_bytes = p->n * z->s->img_x;
+
+   // line buffers big enough for upsampling off the edges with upsample factor of 4, plus a
+   // row for 3 channel output, which the converters overrun by a byte
+   linebuf = (stbi_uc *) stbi__malloc_mad2(p->decode_n, z->s->img_x + 3, row_bytes + 1);
+   if (!linebuf) { p->ok = 0; return; }
+   scratch = linebuf + p->decode_n * (z->s->img_x + 3);
+
+   for (j=y0; j < y1; ++j) {
+      stbi_uc *out = p->out + (size_t) p->out_stride * (p->flip ? z->s->img_y - 1 - j : j);
+      for (k=0; k < p->decode_n; ++k) {
+         int hs = z->img_h_max / z->img_comp[k].h;
+         int vs = z->img_v_max / z->img_comp[k].v;
+         int step = (vs >> 1) + j;
+         int wraps = step / vs;
+         int last = z->img_comp[k].y - 1;
+         stbi_uc *line1 = z->img_comp[k].data + z->img_comp[k].w2 * (wraps < last ? wraps : last);
+         stbi_uc *line0 = z->img_comp[k].data + z->img_comp[k].w2 * (wraps - 1 < 0 ? 0 : wraps - 1 < last ? wraps - 1 : last);
+         int y_bot = step % vs >= (vs >> 1);
+         coutput[k] = stbi__jpeg_resampler(z, hs, vs)(linebuf + k * (z->s->img_x + 3),
+                                                      y_bot ? line1 : line0,
+                                                      y_bot ? line0 : line1,
+                                                      (z->s->img_x + hs-1) / hs, hs);
+      }
+      if (p->n == 3) {
+         stbi__jpeg_convert_row(z, scratch, coutput, p->n, p->is_rgb);
+         memcpy(out, scratch, row_bytes);
+      } else {
+         stbi__jpeg_convert_row(z, out, coutput, p->n, p->is_rgb);
+      }
+   }
+   STBI_FREE(linebuf);
+}
+
+static int stbi__jpeg_decode_parallel(stbi__jpeg *z, stbi_uc *out, int out_stride, int req_comp, stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__jpeg_parallel p;
+   int m, ok = 1;
+   memset(&p, 0, sizeof(p));
+   p.z = z;
+   z->s->img_n = 0; // make stbi__cleanup_jpeg safe
+   for (m = 0; m < 4; m++) {
+      z->img_comp[m].raw_data = NULL;
+      z->img_comp[m].raw_coeff = NULL;
+   }
+   z->restart_interval = 0;
+   if (!stbi__decode_jpeg_header(z, STBI__SCAN_load)) { stbi__cleanup_jpeg(z); return 0; }
+
+   // the marker loop of stbi__decode_jpeg_image, with baseline scans decoded in parallel
+   m = stbi__get_marker(z);
+   while (ok && !stbi__EOI(m)) {
+      if (stbi__SOS(m)) {
+         if (!stbi__process_scan_header(z)) { ok = 0; break; }
+         if (z->progressive)
+            ok = stbi__parse_entropy_coded_data(z);
+         else
+            ok = stbi__jpeg_parallel_scan(&p, parallel_for, user);
+         if (!ok) break;
+         if (z->marker == STBI__MARKER_none )
+            z->marker = stbi__skip_jpeg_junk_at_end(z);
+         m = stbi__get_marker(z);
+         if (STBI__RESTART(m))
+            m = stbi__get_marker(z);
+      } else if (stbi__DNL(m)) {
+         int Ld = stbi__get16be(z->s);
+         stbi__uint32 NL = stbi__get16be(z->s);
+         if (Ld != 4) ok = stbi__err("bad DNL len", "Corrupt JPEG");
+         else if (NL != z->s->img_y) ok = stbi__err("bad DNL height", "Corrupt JPEG");
+         m = stbi__get_marker(z);
+      } else {
+         if (!stbi__process_marker(z, m)) break;
+         m = stbi__get_marker(z);
+      }
+   }
+   if (!ok) { stbi__cleanup_jpeg(z); return 0; }
+
+   if (z->progressive) {
+      int n, tasks = 0;
+      for (n=0; n < z->s->img_n; ++n) {
+         p.finish_tasks[n] = (((z->img_comp[n].y+7) >> 3) + STBI__JPEG_BATCH_ROWS - 1) / STBI__JPEG_BATCH_ROWS;
+         tasks += p.finish_tasks[n];
+      }
+      parallel_for(user, stbi__jpeg_finish_task, &p, tasks);
+   }
+
+   // same component choice as load_jpeg_image
+   p.n = req_comp;
+   p.is_rgb = z->s->img_n == 3 && (z->rgb == 3 || (z->app14_color_transform == 0 && !z->jfif));
+   if (z->s->img_n == 3 && p.n < 3 && !p.is_rgb)
+      p.decode_n = 1;
+   else
+      p.decode_n = z->s->img_n;
+   if (p.decode_n <= 0) { stbi__cleanup_jpeg(z); return 0; }
+
+   p.out = out;
+   p.out_stride = out_stride;
+   p.flip = stbi__vertically_flip_on_load;
+   p.ok = 1;
+   parallel_for(user, stbi__jpeg_convert_task, &p, (z->s->img_y + STBI__JPEG_BAND_ROWS - 1) / STBI__JPEG_BAND_ROWS);
+   stbi__cleanup_jpeg(z);
+   return p.ok ? 1 : stbi__err("outofmem", "Out of memory");
+}
+
+STBIDEF int stbi_jpeg_decode_parallel_from_memory(stbi_uc const *buffer, int len, stbi_uc *out, int out_stride, int req_comp,
+                                                  stbi_parallel_for *parallel_for, void *user)
+{
+   stbi__context s;
+   stbi__jpeg *z;
+   int ok;
+   if (req_comp < 1 || req_comp > 4) return stbi__err("bad req_comp", "Internal error");
+   z = (stbi__jpeg *) stbi__malloc(sizeof(stbi__jpeg));
+   if (!z) return stbi__err("outofmem", "Out of memory");
+   memset(z, 0, sizeof(stbi__jpeg));
+   stbi__start_mem(&s, buffer, len);
+   z->s = &s;
+   stbi__setup_jpeg(z);
+   ok = stbi__jpeg_decode_parallel(z, out, out_stride, req_comp, parallel_for, user);
+   STBI_FREE(z);
+   return ok;
+}
+
 static void *stbi__jpeg_load(stbi__context *s, int *x, int *y, int *comp, int req_comp, stbi__result_info *ri)
 {
    unsigned char* result;
@@ -4088,7 +4503,7 @@ static int stbi__jpeg_info(stbi__context *s, int *x, int *y, int *comp)
 #ifndef STBI_NO_ZLIB
 
 // fast-way is faster to check than jpeg huffman, but slow way is slower
-#define STBI__ZFAST_BITS  9 // accelerate all cases in default tables
+#define STBI__ZFAST_BITS  11 // accelerate all cases in default tables, and most literals in dynamic ones
 #define STBI__ZFAST_MASK  ((1 << STBI__ZFAST_BITS) - 1)
 #define STBI__ZNSYMS 288 // number of symbols in literal/length alphabet
 
@@ -4270,6 +4685,29 @@ stbi_inline static int stbi__zhuffman_decode(stbi__zbuf *a, stbi__zhuffman *z)
    return stbi__zhuffman_decode_slowpath(a, z);
 }
 
+// local modification: with at least 4 bytes of input left, the bit buffer can be
+// refilled without any end of stream checks.
+stbi_inline static int stbi__zhuffman_decode_fast(stbi__zbuf *a, stbi__zhuffman *z)
+{
+   int b,s;
+   if (a->num_bits < 16) {
+      if (a->zbuffer_end - a->zbuffer < 4)
+         return stbi__zhuffman_decode(a, z);
+      do {
+         a->code_buffer |= (unsigned int) *a->zbuffer++ << a->num_bits;
+         a->num_bits += 8;
+      } while (a->num_bits <= 24);
+   }
+   b = z->fast[a->code_buffer & STBI__ZFAST_MASK];
+   if (b) {
+      s = b >> 9;
+      a->code_buffer >>= s;
+      a->num_bits -= s;
+      return b & 511;
+   }
+   return stbi__zhuffman_decode_slowpath(a, z);
+}
+
 static int stbi__zexpand(stbi__zbuf *z, char *zout, int n)  // need to make room for n bytes
 {
    char *q;
@@ -4309,8 +4747,9 @@ static const int stbi__zdist_extra[32] =
 static int stbi__parse_huffman_block(stbi__zbuf *a)
 {
    char *zout = a->zout;
+   int accelerated = stbi__png_accelerated;
    for(;;) {
-      int z = stbi__zhuffman_decode(a, &a->z_length);
+      int z = accelerated ? stbi__zhuffman_decode_fast(a, &a->z_length) : stbi__zhuffman_decode(a, &a->z_length);
       if (z < 256) {
          if (z < 0) return stbi__err("bad huffman code","Corrupt PNG"); // error in huffman codes
          if (zout >= a->zout_end) {
@@ -4336,7 +4775,7 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
          z -= 257;
          len = stbi__zlength_base[z];
          if (stbi__zlength_extra[z]) len += stbi__zreceive(a, stbi__zlength_extra[z]);
-         z = stbi__zhuffman_decode(a, &a->z_distance);
+         z = accelerated ? stbi__zhuffman_decode_fast(a, &a->z_distance) : stbi__zhuffman_decode(a, &a->z_distance);
          if (z < 0 || z >= 30) return stbi__err("bad huffman code","Corrupt PNG"); // per DEFLATE, distance codes 30 and 31 must not appear in compressed data
          dist = stbi__zdist_base[z];
          if (stbi__zdist_extra[z]) dist += stbi__zreceive(a, stbi__zdist_extra[z]);
@@ -4346,7 +4785,20 @@ static int stbi__parse_huffman_block(stbi__zbuf *a)
             zout = a->zout;
          }
          p = (stbi_uc *) (zout - dist);
-         if (dist == 1) { // run of one byte; common in images.
+         if (accelerated && dist == 1) {
+            memset(zout, *p, len);
+            zout += len;
+         } else if (accelerated && dist >= 8 && a->zout_end - zout >= len + 8) {
+            // copy 8 bytes at a time; with dist >= 8 no chunk reads bytes it writes itself,
+            // and the last chunk may write up to 7 bytes past the match (there's room for that).
+            char *end = zout + len;
+            do {
+               memcpy(zout, p, 8);
+               zout += 8;
+               p += 8;
+            } while (zout < end);
+            zout = end;
+         } else if (dist == 1) { // run of one byte; common in images.
             stbi_uc v = *p;
             if (len) { do *zout++ = v; while (--len); }
          } else {
@@ -4667,6 +5119,97 @@ static int stbi__paeth(int a, int b, int c)
    return t1;
 }
 
+#if defined(STBI_SSE2)
+// local modification: SSE2 unfilter kernels. Sub, Avg and Paeth depend on the pixel to
+// the left, so they work one whole pixel (all channels at once) at a time. Up has no such
+// dependency and works on 16 bytes at a time.
+stbi_inline static __m128i stbi__png_load_pixel(const stbi_uc *p, int bpp)
+{
+   int v = 0;
+   memcpy(&v, p, bpp);
+   return _mm_cvtsi32_si128(v);
+}
+
+stbi_inline static void stbi__png_store_pixel(stbi_uc *p, __m128i v, int bpp)
+{
+   int x = _mm_cvtsi128_si32(v);
+   memcpy(p, &x, bpp);
+}
+
+stbi_inline static __m128i stbi__png_select(__m128i mask, __m128i a, __m128i b)
+{
+   return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+stbi_inline static __m128i stbi__png_abs16(__m128i v)
+{
+   return _mm_max_epi16(v, _mm_sub_epi16(_mm_setzero_si128(), v));
+}
+
+// bpp is always a constant after inlining, so the pixel loads and stores become single moves
+stbi_inline static int stbi__png_unfilter_pixels_sse2(int filter, stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   __m128i zero = _mm_setzero_si128();
+   __m128i a = zero, b, c = zero, x;
+   int k = 0;
+
+   switch (filter) {
+   case STBI__F_sub:
+      for (; k < nk; k += bpp) {
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), a);
+         stbi__png_store_pixel(cur + k, a, bpp);
+      }
+      return 1;
+   case STBI__F_avg:
+      for (; k < nk; k += bpp) {
+         // _mm_avg_epu8 rounds up, PNG rounds down
+         b = stbi__png_load_pixel(prior + k, bpp);
+         x = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), _mm_set1_epi8(1)));
+         a = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), x);
+         stbi__png_store_pixel(cur + k, a, bpp);
+      }
+      return 1;
+   case STBI__F_paeth:
+      // in 16-bit lanes: a is the left pixel, b the one above, c the one above left
+      for (; k < nk; k += bpp) {
+         __m128i pa, pb, pc, smallest, nearest;
+         b = _mm_unpacklo_epi8(stbi__png_load_pixel(prior + k, bpp), zero);
+         pa = _mm_sub_epi16(b, c);
+         pb = _mm_sub_epi16(a, c);
+         pc = stbi__png_abs16(_mm_add_epi16(pa, pb));
+         pa = stbi__png_abs16(pa);
+         pb = stbi__png_abs16(pb);
+         // ties go to a, then b, then c
+         smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+         nearest = stbi__png_select(_mm_cmpeq_epi16(smallest, pa), a,
+                   stbi__png_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+         x = _mm_add_epi8(stbi__png_load_pixel(raw + k, bpp), _mm_packus_epi16(nearest, zero));
+         stbi__png_store_pixel(cur + k, x, bpp);
+         a = _mm_unpacklo_epi8(x, zero);
+         c = b;
+      }
+      return 1;
+   }
+   return 0;
+}
+
+// returns 0 if the filter isn't handled here and the scalar code should run instead
+static int stbi__png_unfilter_sse2(int filter, stbi_uc *cur, const stbi_uc *raw, const stbi_uc *prior, int nk, int bpp)
+{
+   int k = 0;
+   if (filter == STBI__F_up) {
+      for (; k + 16 <= nk; k += 16)
+         _mm_storeu_si128((__m128i *) (cur + k), _mm_add_epi8(_mm_loadu_si128((const __m128i *) (raw + k)), _mm_loadu_si128((const __m128i *) (prior + k))));
+      for (; k < nk; ++k)
+         cur[k] = STBI__BYTECAST(raw[k] + prior[k]);
+      return 1;
+   }
+   if (bpp == 4) return stbi__png_unfilter_pixels_sse2(filter, cur, raw, prior, nk, 4);
+   if (bpp == 3) return stbi__png_unfilter_pixels_sse2(filter, cur, raw, prior, nk, 3);
+   return 0;
+}
+#endif
+
 static const stbi_uc stbi__depth_scale_table[9] = { 0, 0xff, 0x55, 0, 0x11, 0,0,0, 0x01 };
 
 // adds an extra all-255 alpha channel
@@ -4703,6 +5246,7 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
    int all_ok = 1;
    int k;
    int img_n = s->img_n; // copy it into a local for later
+   int handled;
 
    int output_bytes = out_n*bytes;
    int filter_bytes = img_n*bytes;
@@ -4752,7 +5296,12 @@ static int stbi__create_png_image_raw(stbi__png *a, stbi_uc *raw, stbi__uint32 r
       if (j == 0) filter = first_row_filter[filter];
 
       // perform actual filtering
-      switch (filter) {
+      handled = 0;
+#if defined(STBI_SSE2)
+      if (stbi__png_accelerated && j > 0 && stbi__sse2_available())
+         handled = stbi__png_unfilter_sse2(filter, cur, raw, prior, nk, filter_bytes);
+#endif
+      if (!handled) switch (filter) {
       case STBI__F_none:
          memcpy(cur, raw, nk);
          break;
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+
+// The tests build without a framework: CHECK() prints what failed and where, and main() returns the failure count.
+namespace check
+{
+    inline int failures = 0;
+}
+
+#define CHECK(condition) \
+    do \
+    { \
+        if (!(condition)) \
+        { \
+            std::printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #condition); \
+            check::failures++; \
+        } \
+    } while (false)
+
+#define RUN_TEST(test) \
+    do \
+    { \
+        std::printf("%s\n", #test); \
+        test(); \
+    } while (false)
@@ -0,0 +1,72 @@
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <string>
+
+#include "Check.h"
+#include "CameraPath.h"
+
+namespace
+{
+    const std::string testPath = (std::filesystem::temp_directory_path() / "camera_path_test.campath").string();
+
+    // A file in CameraPath's format with whatever header values, followed by frameBytes bytes of frames.
+    void writePath(uint32_t frameCount, float frameDelta, size_t frameBytes)
+    {
+        std::ofstream file(testPath, std::ios::binary);
+        const uint32_t version = 1;
+        file.write("CAMP", 4);
+        file.write((const char*)&version, sizeof(version));
+        file.write((const char*)&frameCount, sizeof(frameCount));
+        file.write((const char*)&frameDelta, sizeof(frameDelta));
+        for (size_t i = 0; i < frameBytes; i++) file.put(0);
+    }
+
+    void testRoundTrip()
+    {
+        CameraPath path;
+        for (int i = 0; i < 10; i++) path.Add({ glm::vec3((float)i, 1.0f, 2.0f), -90.0f + i, 5.0f, 45.0f });
+        path.SetFrameDelta(0.02f);
+        CHECK(path.Save(testPath));
+
+        CameraPath loaded;
+        CHECK(loaded.Load(testPath));
+        CHECK(loaded.GetFrameDelta() == 0.02f);
+        CHECK(loaded.GetFrameCount() == 10 && loaded.GetFrame(9).position.x == 9.0f && loaded.GetFrame(9).yaw == -81.0f);
+    }
+
+    void testRejectsBadFiles()
+    {
+        CameraPath path;
+        CHECK(!path.Load(testPath + ".missing"));
+
+        // Frame counts the file can't hold, up to one that would try to allocate about 100 GB.
+        writePath(10, 0.02f, 9 * sizeof(CameraPath::Frame));
+        CHECK(!path.Load(testPath));
+        writePath(std::numeric_limits<uint32_t>::max(), 0.02f, sizeof(CameraPath::Frame));
+        CHECK(!path.Load(testPath));
+
+        // Deltas that would stop time, run it backwards or poison it.
+        for (float frameDelta : { 0.0f, -0.02f, std::numeric_limits<float>::quiet_NaN(), std::numeric_limits<float>::infinity() })
+        {
+            writePath(1, frameDelta, sizeof(CameraPath::Frame));
+            CHECK(!path.Load(testPath));
+        }
+        CHECK(path.GetFrameCount() == 0);
+
+        // An empty path is fine.
+        writePath(0, 0.02f, 0);
+        CHECK(path.Load(testPath));
+        CHECK(path.GetFrameCount() == 0);
+    }
+}
+
+int main()
+{
+    RUN_TEST(testRoundTrip);
+    RUN_TEST(testRejectsBadFiles);
+    std::filesystem::remove(testPath);
+    return check::failures > 0 ? 1 : 0;
+}
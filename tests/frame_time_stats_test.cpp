@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "Check.h"
+#include "FramePacer.h"
+
+namespace
+{
+    std::vector<std::string> readLines(const std::string& path)
+    {
+        std::vector<std::string> lines;
+        std::ifstream file(path);
+        for (std::string line; std::getline(file, line);) lines.push_back(line);
+        return lines;
+    }
+
+    void testStats()
+    {
+        std::vector<float> frameTimes;
+        for (int i = 1; i <= 100; i++) frameTimes.push_back((float)i);
+        const FrameTimeStats stats = ComputeFrameTimeStats(frameTimes);
+        CHECK(stats.frames == 100);
+        CHECK(stats.mean == 50.5);
+        CHECK(stats.worst == 100.0);
+        CHECK(stats.p50 <= stats.p95 && stats.p95 <= stats.p99 && stats.p99 <= stats.worst);
+    }
+
+    void testCsvAppends()
+    {
+        const std::string path = (std::filesystem::temp_directory_path() / "frame_time_stats_test.csv").string();
+        std::filesystem::remove(path);
+
+        // The header is written once, every run adds a row.
+        const std::vector<float> frameTimes = { 10.0f, 20.0f, 30.0f };
+        const FrameTimeStats stats = ComputeFrameTimeStats(frameTimes);
+        for (int run = 0; run < 3; run++) CHECK(WriteFrameTimeStats(path.c_str(), stats, frameTimes));
+        const std::vector<std::string> lines = readLines(path);
+        CHECK(lines.size() == 4 && lines[0].rfind("frames,", 0) == 0 && lines[1].rfind("3,", 0) == 0 && lines[3] == lines[1]);
+        std::filesystem::remove(path);
+    }
+}
+
+int main()
+{
+    RUN_TEST(testStats);
+    RUN_TEST(testCsvAppends);
+    return check::failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+#include <atomic>
+#include <chrono>
+#include <set>
+#include <thread>
+#include <vector>
+
+#include "Check.h"
+#include "JobSystem.h"
+
+namespace
+{
+    void testDependencies()
+    {
+        JobSystem jobs(3);
+        std::atomic<int> finished(0);
+        std::atomic<bool> ranAfterBoth(false);
+        JobSystem::JobHandle a = jobs.Schedule([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); finished++; });
+        JobSystem::JobHandle b = jobs.Schedule([&]() { finished++; });
+        JobSystem::JobHandle c = jobs.Schedule([&]() { ranAfterBoth = finished == 2; }, { a, b });
+        jobs.Wait(c);
+        CHECK(ranAfterBoth);
+        CHECK(JobSystem::IsFinished(a) && JobSystem::IsFinished(b));
+
+        // Finished and null dependencies don't hold a job back.
+        std::atomic<bool> ran(false);
+        jobs.Wait(jobs.Schedule([&]() { ran = true; }, { a, nullptr }));
+        CHECK(ran);
+
+        // A chain where every job depends on the one before runs strictly in order.
+        const int chainLength = 500;
+        int next = 0;
+        bool ordered = true;
+        std::vector<JobSystem::JobHandle> chain;
+        for (int i = 0; i < chainLength; i++)
+        {
+            chain.push_back(jobs.Schedule([&next, &ordered, i]() { ordered = ordered && next++ == i; }, { chain.empty() ? nullptr : chain.back() }));
+        }
+        jobs.Wait(chain.back());
+        CHECK(ordered);
+        CHECK(next == chainLength);
+    }
+
+    void testThen()
+    {
+        JobSystem jobs(2);
+        std::atomic<int> step(0);
+        std::atomic<bool> inOrder(false);
+        JobSystem::JobHandle first = jobs.Schedule([&]() { std::this_thread::sleep_for(std::chrono::milliseconds(5)); step = 1; });
+        JobSystem::JobHandle second = jobs.Then(first, [&]() { inOrder = step == 1; step = 2; });
+        jobs.Wait(second);
+        CHECK(inOrder);
+        CHECK(step == 2);
+
+        // A continuation on a job that already finished runs anyway.
+        std::atomic<bool> ran(false);
+        jobs.Wait(jobs.Then(first, [&]() { ran = true; }));
+        CHECK(ran);
+    }
+
+    void testMainThreadQueue()
+    {
+        // The thread that creates the system is its main thread.
+        JobSystem jobs(2);
+        CHECK(jobs.IsMainThread());
+
+        std::atomic<bool> workerDone(false);
+        std::thread::id ranOn;
+        JobSystem::JobHandle work = jobs.Schedule([&]() { workerDone = true; });
+        JobSystem::JobHandle upload = jobs.Then(work, [&]() { ranOn = std::this_thread::get_id(); }, JobSystem::Affinity::MainThread);
+
+        // Workers never run it, only RunMainThreadJobs() does.
+        while (!JobSystem::IsFinished(work)) std::this_thread::yield();
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        CHECK(!JobSystem::IsFinished(upload));
+        CHECK(jobs.RunMainThreadJobs() == 1);
+        CHECK(JobSystem::IsFinished(upload));
+        CHECK(ranOn == std::this_thread::get_id());
+        CHECK(jobs.RunMainThreadJobs() == 0);
+
+        // Waiting on the main thread runs them too.
+        std::atomic<bool> ran(false);
+        jobs.Wait(jobs.Schedule([&]() { ran = true; }, {}, JobSystem::Affinity::MainThread));
+        CHECK(ran);
+    }
+
+    void testStealing()
+    {
+        // One job spawns everything into its own worker's deque. The other workers only get any of it by stealing.
+        JobSystem jobs(4);
+        const int jobCount = 64;
+        std::mutex mutex;
+        std::set<std::thread::id> threads;
+        std::atomic<int> ran(0);
+        jobs.Wait(jobs.Schedule([&]()
+        {
+            std::vector<JobSystem::JobHandle> children;
+            for (int i = 0; i < jobCount; i++)
+            {
+                children.push_back(jobs.Schedule([&]()
+                {
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                    std::lock_guard<std::mutex> lock(mutex);
+                    threads.insert(std::this_thread::get_id());
+                    ran++;
+                }));
+            }
+            jobs.Wait(children);
+        }));
+        CHECK(ran == jobCount);
+        CHECK(threads.size() > 1);
+    }
+
+    void testNestedWait()
+    {
+        // Jobs waiting on jobs they spawned, three levels deep, must not deadlock even with a single worker or none.
+        for (int workerCount : { 0, 1, 3 })
+        {
+            JobSystem jobs(workerCount);
+            std::atomic<int> leaves(0);
+            std::vector<JobSystem::JobHandle> roots;
+            for (int i = 0; i < 4; i++)
+            {
+                roots.push_back(jobs.Schedule([&]()
+                {
+                    std::vector<JobSystem::JobHandle> children;
+                    for (int j = 0; j < 4; j++)
+                    {
+                        children.push_back(jobs.Schedule([&]()
+                        {
+                            JobSystem::JobHandle leaf = jobs.Schedule([&]() { leaves++; });
+                            jobs.Wait(leaf);
+                        }));
+                    }
+                    jobs.Wait(children);
+                }));
+            }
+            jobs.Wait(roots);
+            CHECK(leaves == 16);
+        }
+    }
+
+    void testParallelFor()
+    {
+        JobSystem jobs(3);
+        for (size_t grain : { (size_t)0, (size_t)1, (size_t)7, (size_t)1000, (size_t)5000 })
+        {
+            // Not a multiple of any grain, so the last chunk is partial.
+            const size_t count = 4099;
+            std::vector<std::atomic<int>> visits(count);
+            for (std::atomic<int>& visit : visits) visit = 0;
+            std::atomic<bool> chunksFit(true);
+            jobs.ParallelFor(count, [&](size_t begin, size_t end)
+            {
+                if (begin >= end || end > count || (grain > 0 && end - begin > grain)) chunksFit = false;
+                for (size_t i = begin; i < end; i++) visits[i]++;
+            }, grain);
+
+            bool once = true;
+            for (const std::atomic<int>& visit : visits) once = once && visit == 1;
+            CHECK(once);
+            CHECK(chunksFit);
+        }
+
+        // Nothing to do calls nothing, and nested loops finish.
+        std::atomic<int> calls(0);
+        jobs.ParallelFor(0, [&](size_t, size_t) { calls++; });
+        CHECK(calls == 0);
+        std::atomic<int> items(0);
+        jobs.ParallelFor(16, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++) jobs.ParallelFor(100, [&](size_t innerBegin, size_t innerEnd) { items += (int)(innerEnd - innerBegin); }, 10);
+        }, 1);
+        CHECK(items == 1600);
+    }
+}
+
+int main()
+{
+    RUN_TEST(testDependencies);
+    RUN_TEST(testThen);
+    RUN_TEST(testMainThreadQueue);
+    RUN_TEST(testStealing);
+    RUN_TEST(testNestedWait);
+    RUN_TEST(testParallelFor);
+    return check::failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+#include <vector>
+
+#include "Check.h"
+#include "ShadowAtlasScheduler.h"
+
+namespace
+{
+    bool overlap(const ShadowTile& a, const ShadowTile& b)
+    {
+        return a.x < b.x + b.size && b.x < a.x + a.size && a.y < b.y + b.size && b.y < a.y + a.size;
+    }
+
+    bool anyOverlap(const std::vector<ShadowTile>& tiles)
+    {
+        for (size_t i = 0; i < tiles.size(); i++)
+        {
+            for (size_t j = i + 1; j < tiles.size(); j++)
+            {
+                if (overlap(tiles[i], tiles[j])) return true;
+            }
+        }
+        return false;
+    }
+
+    ShadowAtlasScheduler::Request makeRequest(int lightId, float importance, int desiredSize, uint64_t viewHash = 1)
+    {
+        ShadowAtlasScheduler::Request request;
+        request.lightId = lightId;
+        request.faceCount = 1;
+        request.importance = importance;
+        request.desiredSize = desiredSize;
+        request.viewHash = viewHash;
+        return request;
+    }
+
+    const ShadowAtlasScheduler::Assignment* findAssignment(const ShadowAtlasScheduler& scheduler, int lightId)
+    {
+        for (const ShadowAtlasScheduler::Assignment& assignment : scheduler.GetAssignments())
+        {
+            if (assignment.lightId == lightId) return &assignment;
+        }
+        return nullptr;
+    }
+
+    void testAllocateAndMerge()
+    {
+        ShadowAtlasAllocator allocator(1024, 128);
+        for (int tileSize : { 512, 128 })
+        {
+            // Fill the atlas with tiles of one size. They must not overlap and one more doesn't fit.
+            const int tileCount = (1024 / tileSize) * (1024 / tileSize);
+            std::vector<ShadowTile> tiles(tileCount);
+            for (ShadowTile& tile : tiles)
+            {
+                CHECK(allocator.Allocate(tileSize, tile));
+                CHECK(tile.size == tileSize && tile.x + tile.size <= 1024 && tile.y + tile.size <= 1024);
+            }
+            ShadowTile extra;
+            CHECK(!allocator.Allocate(tileSize, extra));
+            CHECK(!anyOverlap(tiles));
+            CHECK(allocator.GetUsedArea() == 1024LL * 1024);
+
+            // Freeing everything, in any order, merges back into the whole atlas.
+            for (int i = 0; i < tileCount; i += 2) allocator.Free(tiles[i]);
+            for (int i = 1; i < tileCount; i += 2) allocator.Free(tiles[i]);
+            CHECK(allocator.GetUsedArea() == 0);
+            ShadowTile whole;
+            CHECK(allocator.Allocate(1024, whole));
+            CHECK(whole.x == 0 && whole.y == 0 && whole.size == 1024);
+            allocator.Free(whole);
+        }
+
+        // Mixed sizes share the atlas without overlapping, and sizes outside the limits are refused.
+        std::vector<ShadowTile> tiles(3);
+        CHECK(allocator.Allocate(512, tiles[0]));
+        CHECK(allocator.Allocate(256, tiles[1]));
+        CHECK(allocator.Allocate(128, tiles[2]));
+        CHECK(!anyOverlap(tiles));
+        ShadowTile tile;
+        CHECK(!allocator.Allocate(64, tile));
+        CHECK(!allocator.Allocate(2048, tile));
+    }
+
+    void testEviction()
+    {
+        // Four 512 tiles fill the atlas.
+        ShadowAtlasScheduler scheduler(1024, 128, 512);
+        scheduler.Schedule({ makeRequest(0, 1.0f, 512), makeRequest(1, 1.0f, 512), makeRequest(2, 1.0f, 512), makeRequest(3, 1.0f, 512) }, 0);
+        CHECK(scheduler.GetAssignments().size() == 4);
+        scheduler.Schedule({ makeRequest(1, 1.0f, 512), makeRequest(2, 1.0f, 512), makeRequest(3, 1.0f, 512) }, 0);
+        scheduler.Schedule({ makeRequest(2, 1.0f, 512), makeRequest(3, 1.0f, 512) }, 0);
+        CHECK(scheduler.GetEvictionCount() == 0);
+
+        // A new light takes the tile of the one that went unused the longest, even at the lowest importance.
+        scheduler.Schedule({ makeRequest(2, 1.0f, 512), makeRequest(3, 1.0f, 512), makeRequest(4, 0.1f, 512) }, 0);
+        const ShadowAtlasScheduler::Assignment* added = findAssignment(scheduler, 4);
+        CHECK(added != nullptr && added->tiles[0].size == 512 && added->needsRender);
+        CHECK(scheduler.GetEvictionCount() == 1);
+
+        // Light 1 is still cached and doesn't need rendering, light 0 was evicted and does.
+        scheduler.Schedule({ makeRequest(1, 2.0f, 512), makeRequest(0, 1.0f, 512) }, 0);
+        const ShadowAtlasScheduler::Assignment* cached = findAssignment(scheduler, 1);
+        const ShadowAtlasScheduler::Assignment* evicted = findAssignment(scheduler, 0);
+        CHECK(cached != nullptr && !cached->needsRender);
+        CHECK(evicted != nullptr && evicted->needsRender);
+    }
+
+    void testResizeHysteresis()
+    {
+        ShadowAtlasScheduler scheduler(4096, 128, 1024);
+        struct Step
+        {
+            int desiredSize;
+            int expectedSize;
+            bool expectedRender;
+        };
+        const Step steps[] = {
+            { 1024, 1024, true },
+            // Wanting a bit less than half keeps the current tiles.
+            { 500, 1024, false },
+            // Clearly less shrinks them.
+            { 300, 512, true },
+            { 400, 512, false },
+            // Growing happens right away.
+            { 600, 1024, true },
+            { 1024, 1024, false }
+        };
+        for (const Step& step : steps)
+        {
+            scheduler.Schedule({ makeRequest(0, 1.0f, step.desiredSize) }, 0);
+            const ShadowAtlasScheduler::Assignment* assignment = findAssignment(scheduler, 0);
+            CHECK(assignment != nullptr);
+            if (!assignment) continue;
+            CHECK(assignment->tiles[0].size == step.expectedSize);
+            CHECK(assignment->needsRender == step.expectedRender);
+        }
+    }
+
+    void testNeedsRender()
+    {
+        ShadowAtlasScheduler scheduler(2048, 128, 512);
+        ShadowAtlasScheduler::Request point = makeRequest(0, 1.0f, 512, 10);
+        point.faceCount = 6;
+        ShadowAtlasScheduler::Request spot = makeRequest(1, 2.0f, 512, 20);
+
+        scheduler.Schedule({ point, spot }, 0);
+        CHECK(findAssignment(scheduler, 0)->needsRender && findAssignment(scheduler, 1)->needsRender);
+        CHECK(findAssignment(scheduler, 0)->faceCount == 6);
+
+        // Static lights keep their tiles.
+        scheduler.Schedule({ point, spot }, 0);
+        CHECK(!findAssignment(scheduler, 0)->needsRender && !findAssignment(scheduler, 1)->needsRender);
+
+        // Only the light that moved renders again.
+        spot.viewHash = 21;
+        scheduler.Schedule({ point, spot }, 0);
+        CHECK(!findAssignment(scheduler, 0)->needsRender && findAssignment(scheduler, 1)->needsRender);
+
+        // Moving geometry re-renders every light.
+        scheduler.Schedule({ point, spot }, 1);
+        CHECK(findAssignment(scheduler, 0)->needsRender && findAssignment(scheduler, 1)->needsRender);
+        scheduler.Schedule({ point, spot }, 1);
+        CHECK(!findAssignment(scheduler, 0)->needsRender && !findAssignment(scheduler, 1)->needsRender);
+    }
+}
+
+int main()
+{
+    RUN_TEST(testAllocateAndMerge);
+    RUN_TEST(testEviction);
+    RUN_TEST(testResizeHysteresis);
+    RUN_TEST(testNeedsRender);
+    return check::failures > 0 ? 1 : 0;
+}
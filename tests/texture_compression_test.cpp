@@ -0,0 +1,99 @@
+#include <algorithm>
+#include <cstdlib>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "Check.h"
+#include "TextureCompression.h"
+
+namespace
+{
+    // What sampling returns for a texel once GL_TEXTURE_SWIZZLE_RGBA is applied.
+    void applySwizzle(const int swizzle[4], const unsigned char texel[4], unsigned char sampled[4])
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            switch (swizzle[i])
+            {
+            case GL_RED: sampled[i] = texel[0]; break;
+            case GL_GREEN: sampled[i] = texel[1]; break;
+            case GL_BLUE: sampled[i] = texel[2]; break;
+            case GL_ALPHA: sampled[i] = texel[3]; break;
+            case GL_ZERO: sampled[i] = 0; break;
+            case GL_ONE: sampled[i] = 255; break;
+            }
+        }
+    }
+
+    // Compress and decompress a gray gradient with some noise, as a scalar map like specular would look.
+    std::vector<unsigned char> roundTrip(BlockFormat format, int width, int height, std::vector<unsigned char>& original)
+    {
+        original.resize((size_t)width * height * 4);
+        for (int y = 0; y < height; y++)
+        {
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char value = (unsigned char)std::min(x * 240 / (width - 1) + (y * 7 + x * 3) % 16, 255);
+                unsigned char* pixel = &original[((size_t)y * width + x) * 4];
+                pixel[0] = pixel[1] = pixel[2] = value;
+                pixel[3] = 255;
+            }
+        }
+        std::vector<unsigned char> blocks(GetCompressedSize(format, width, height));
+        CompressImage(original.data(), width, height, format, blocks.data(), 2);
+        std::vector<unsigned char> decoded(original.size());
+        DecompressImage(blocks.data(), width, height, format, decoded.data(), 2);
+        return decoded;
+    }
+
+    void testBC4SamplesAsGray()
+    {
+        const int width = 64, height = 36;
+        std::vector<unsigned char> original;
+        std::vector<unsigned char> decoded = roundTrip(BlockFormat::BC4, width, height, original);
+
+        // The texture only stores red. Without the swizzle green and blue sample as 0, which tints the map red.
+        CHECK(GetGLFormat(BlockFormat::BC4) == GL_COMPRESSED_RED_RGTC1);
+        const int* swizzle = GetGLSwizzle(BlockFormat::BC4);
+        bool gray = true, opaque = true;
+        int maxError = 0;
+        for (size_t i = 0; i < decoded.size(); i += 4)
+        {
+            unsigned char sampled[4];
+            applySwizzle(swizzle, &decoded[i], sampled);
+            gray = gray && sampled[0] == sampled[1] && sampled[1] == sampled[2];
+            opaque = opaque && sampled[3] == 255;
+            maxError = std::max(maxError, std::abs(sampled[1] - original[i + 1]));
+        }
+        CHECK(gray);
+        CHECK(opaque);
+        CHECK(maxError <= 8);
+    }
+
+    void testOtherFormatsKeepTheirChannels()
+    {
+        for (BlockFormat format : { BlockFormat::BC1, BlockFormat::BC3, BlockFormat::BC5, BlockFormat::BC7 })
+        {
+            const int* swizzle = GetGLSwizzle(format);
+            CHECK(swizzle[0] == GL_RED && swizzle[1] == GL_GREEN && swizzle[2] == GL_BLUE && swizzle[3] == GL_ALPHA);
+        }
+
+        // Gray color maps stay gray through BC1 by themselves.
+        std::vector<unsigned char> original;
+        std::vector<unsigned char> decoded = roundTrip(BlockFormat::BC1, 32, 32, original);
+        int maxError = 0;
+        for (size_t i = 0; i < decoded.size(); i++)
+        {
+            maxError = std::max(maxError, std::abs(decoded[i] - original[i]));
+        }
+        CHECK(maxError <= 16);
+    }
+}
+
+int main()
+{
+    RUN_TEST(testBC4SamplesAsGray);
+    RUN_TEST(testOtherFormatsKeepTheirChannels);
+    return check::failures > 0 ? 1 : 0;
+}